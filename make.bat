@@ -7,19 +7,23 @@ set "BUILD_DIR=build"
 set "BUILD_STANDALONE_DIR=%BUILD_DIR%\standalone"
 set "BUILD_PYTHON_DIR=%BUILD_DIR%\python"
 set "BUILD_BLENDER_DIR=%BUILD_DIR%\blender"
+set "BUILD_BENCH_DIR=%BUILD_DIR%\bench"
+set "BUILD_MICROBENCH_DIR=%BUILD_DIR%\microbench"
 
 rem Dispatch on the first argument
 if "%~1"=="" (
-  echo Usage: make.bat [standalone^|python^|blender^|clean]
+  echo Usage: make.bat [standalone^|python^|blender^|bench^|microbench^|clean]
   exit /b 1
 )
 if /I "%~1"=="standalone" goto :STANDALONE
 if /I "%~1"=="python"     goto :PYTHON
 if /I "%~1"=="blender"    goto :BLENDER
+if /I "%~1"=="bench"      goto :BENCH
+if /I "%~1"=="microbench" goto :MICROBENCH
 if /I "%~1"=="clean"      goto :CLEAN
 
 echo Unknown target "%~1"
-echo Usage: make.bat [standalone^|python^|blender^|clean]
+echo Usage: make.bat [standalone^|python^|blender^|bench^|microbench^|clean]
 exit /b 1
 
 :STANDALONE
@@ -71,6 +75,40 @@ echo ^> Install it via Blender's User Preferences → Add-ons → Install…
 echo.
 exit /b 0
 
+:BENCH
+mkdir "%BUILD_BENCH_DIR%" 2>nul
+"%CMAKE%" -S . -B "%BUILD_BENCH_DIR%" ^
+  -DBUILD_STANDALONE=OFF ^
+  -DBUILD_PYTHON=OFF ^
+  -DBUILD_BLENDER_EXTENSION=OFF ^
+  -DBUILD_BENCHMARKS=ON
+if errorlevel 1 exit /b %errorlevel%
+"%CMAKE%" --build "%BUILD_BENCH_DIR%" --target crt_bench
+if errorlevel 1 exit /b %errorlevel%
+
+echo.
+echo ^> Build finished successfully
+echo ^> Run from .\build\bench with crt_bench.exe --output results.json [--baseline baseline.json]
+echo.
+exit /b 0
+
+:MICROBENCH
+mkdir "%BUILD_MICROBENCH_DIR%" 2>nul
+"%CMAKE%" -S . -B "%BUILD_MICROBENCH_DIR%" ^
+  -DBUILD_STANDALONE=OFF ^
+  -DBUILD_PYTHON=OFF ^
+  -DBUILD_BLENDER_EXTENSION=OFF ^
+  -DBUILD_MICROBENCHMARKS=ON
+if errorlevel 1 exit /b %errorlevel%
+"%CMAKE%" --build "%BUILD_MICROBENCH_DIR%" --target crt_microbench
+if errorlevel 1 exit /b %errorlevel%
+
+echo.
+echo ^> Build finished successfully
+echo ^> Run with .\build\microbench\crt_microbench.exe [--benchmark_filter=^<regex^>]
+echo.
+exit /b 0
+
 :CLEAN
 rmdir /S /Q "%BUILD_DIR%"
 echo.
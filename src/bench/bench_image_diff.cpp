@@ -0,0 +1,39 @@
+#include "bench_image_diff.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace crt::bench {
+
+static float quantize(const float component) {
+    return std::clamp(static_cast<int>(component * 255), 0, 255) / 255.0f;
+}
+
+ImageDiff compare_images(const Image &image, const Image &reference) {
+    assert(image.width == reference.width && image.height == reference.height);
+
+    double squared_sum = 0.0;
+    double max_difference = 0.0;
+    int differing_pixel_count = 0;
+    for (size_t i = 0; i < image.buffer.size(); ++i) {
+        bool is_differing = false;
+        for (int c = 0; c < 3; ++c) {
+            const double difference = std::abs(quantize(image.buffer[i].data[c]) - reference.buffer[i].data[c]);
+            squared_sum += difference * difference;
+            max_difference = std::max(max_difference, difference);
+            // NOTE: Both components are multiples of 1/255, so this catches a difference of 1/255, but not float rounding
+            is_differing |= difference > 0.5 / 255.0;
+        }
+        differing_pixel_count += is_differing;
+    }
+
+    const size_t component_count = 3 * image.buffer.size();
+    return ImageDiff {
+        .rmse = component_count > 0 ? std::sqrt(squared_sum / component_count) : 0.0,
+        .max_difference = max_difference,
+        .differing_pixel_count = differing_pixel_count,
+    };
+}
+
+}
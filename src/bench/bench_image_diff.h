@@ -0,0 +1,30 @@
+#pragma once
+
+#include "core/crt_image.h"
+
+namespace crt::bench {
+
+struct ImageDiff {
+    /**
+     * Root mean square difference over all components, in [0, 1]
+     */
+    double rmse;
+    /**
+     * Largest difference of a single component, in [0, 1]
+     */
+    double max_difference;
+    /**
+     * Number of pixels, which differ by 1/255 or more in any component
+     */
+    int differing_pixel_count;
+};
+
+/**
+ * Compare a rendered image with a (8-bit) reference. The rendered image is quantized the same way
+ * `write_ppm()` does, so an image that was written and read back doesn't differ from itself.
+ *
+ * The images must have the same resolution.
+ */
+ImageDiff compare_images(const Image &image, const Image &reference);
+
+}
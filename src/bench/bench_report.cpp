@@ -0,0 +1,177 @@
+#include "bench_report.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <utility>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+
+namespace crt::bench {
+
+std::string_view get_image_check_name(const ImageCheck image_check) {
+    switch (image_check) {
+        case ImageCheck::Skipped:     return "skipped";
+        case ImageCheck::NoReference: return "no_reference";
+        case ImageCheck::Match:       return "match";
+        case ImageCheck::Differs:     return "differs";
+    }
+    std::unreachable();
+}
+
+static std::optional<ImageCheck> get_image_check_from_name(const std::string_view name) {
+    for (const ImageCheck image_check : { ImageCheck::Skipped, ImageCheck::NoReference, ImageCheck::Match, ImageCheck::Differs })
+        if (get_image_check_name(image_check) == name)
+            return image_check;
+    return std::nullopt;
+}
+
+void write_results_json(std::ostream &os, const std::span<const BenchResult> results) {
+    const std::streamsize precision = os.precision(std::numeric_limits<double>::max_digits10);
+
+    // NOTE: Case names are paths and generated names, which never need escaping
+    os << "{\n  \"cases\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &result = results[i];
+        os << (i > 0 ? ",\n" : "\n") << "    {\n"
+           << "      \"name\": \"" << result.name << "\",\n"
+           << "      \"width\": " << result.width << ",\n"
+           << "      \"height\": " << result.height << ",\n"
+           << "      \"triangle_count\": " << result.triangle_count << ",\n"
+           << "      \"light_count\": " << result.light_count << ",\n"
+           << "      \"repetitions\": " << result.repetitions << ",\n"
+           << "      \"ray_count\": " << result.ray_count << ",\n"
+           << "      \"load_seconds\": " << result.load_seconds << ",\n"
+           << "      \"build_seconds\": " << result.build_seconds << ",\n"
+           << "      \"render_seconds\": " << result.render_seconds << ",\n"
+           << "      \"min_render_seconds\": " << result.min_render_seconds << ",\n"
+           << "      \"mrays_per_second\": " << result.mrays_per_second << ",\n"
+           << "      \"peak_rss_mib\": " << result.peak_rss_mib << ",\n"
+           << "      \"image_check\": \"" << get_image_check_name(result.image_check) << "\",\n"
+           << "      \"image_rmse\": " << result.image_rmse << "\n"
+           << "    }";
+    }
+    os << "\n  ]\n}\n";
+
+    os.precision(precision);
+}
+
+static std::optional<BenchResult> get_result_from_value(const rapidjson::Value &v) {
+    if (!v.IsObject())
+        return std::nullopt;
+
+    const auto get_number = [&](const char *name) -> std::optional<double> {
+        auto it = v.FindMember(name);
+        if (it == v.MemberEnd() || !it->value.IsNumber())
+            return std::nullopt;
+        return it->value.GetDouble();
+    };
+
+    auto name_it = v.FindMember("name");
+    auto image_check_it = v.FindMember("image_check");
+    if (name_it == v.MemberEnd() || !name_it->value.IsString() || image_check_it == v.MemberEnd() || !image_check_it->value.IsString())
+        return std::nullopt;
+
+    std::optional<ImageCheck> image_check = get_image_check_from_name(image_check_it->value.GetString());
+    auto ray_count_it = v.FindMember("ray_count");
+    if (!image_check || ray_count_it == v.MemberEnd() || !ray_count_it->value.IsUint64())
+        return std::nullopt;
+
+    std::optional<double> width = get_number("width"), height = get_number("height");
+    std::optional<double> triangle_count = get_number("triangle_count"), light_count = get_number("light_count");
+    std::optional<double> repetitions = get_number("repetitions");
+    std::optional<double> load_seconds = get_number("load_seconds"), build_seconds = get_number("build_seconds");
+    std::optional<double> render_seconds = get_number("render_seconds"), min_render_seconds = get_number("min_render_seconds");
+    std::optional<double> mrays_per_second = get_number("mrays_per_second"), peak_rss_mib = get_number("peak_rss_mib");
+    std::optional<double> image_rmse = get_number("image_rmse");
+    if (!width || !height || !triangle_count || !light_count || !repetitions || !load_seconds || !build_seconds
+            || !render_seconds || !min_render_seconds || !mrays_per_second || !peak_rss_mib || !image_rmse)
+        return std::nullopt;
+
+    return BenchResult {
+        .name = name_it->value.GetString(),
+        .width = static_cast<int>(*width),
+        .height = static_cast<int>(*height),
+        .triangle_count = static_cast<uint32_t>(*triangle_count),
+        .light_count = static_cast<uint32_t>(*light_count),
+        .repetitions = static_cast<int>(*repetitions),
+        .ray_count = ray_count_it->value.GetUint64(),
+        .load_seconds = *load_seconds,
+        .build_seconds = *build_seconds,
+        .render_seconds = *render_seconds,
+        .min_render_seconds = *min_render_seconds,
+        .mrays_per_second = *mrays_per_second,
+        .peak_rss_mib = *peak_rss_mib,
+        .image_check = *image_check,
+        .image_rmse = *image_rmse,
+    };
+}
+
+std::optional<std::vector<BenchResult>> read_results_json(std::istream &is) {
+    rapidjson::IStreamWrapper isw{ is };
+    rapidjson::Document doc;
+    doc.ParseStream(isw);
+    if (doc.HasParseError() || !doc.IsObject())
+        return std::nullopt;
+
+    auto cases_it = doc.FindMember("cases");
+    if (cases_it == doc.MemberEnd() || !cases_it->value.IsArray())
+        return std::nullopt;
+
+    std::vector<BenchResult> results;
+    results.reserve(cases_it->value.Size());
+    for (const rapidjson::Value &v : cases_it->value.GetArray()) {
+        std::optional<BenchResult> result = get_result_from_value(v);
+        if (!result)
+            return std::nullopt;
+        results.push_back(std::move(*result));
+    }
+    return results;
+}
+
+std::vector<BaselineComparison> compare_with_baseline(const std::span<const BenchResult> results, const std::span<const BenchResult> baseline, const double threshold) {
+    std::vector<BaselineComparison> comparisons;
+    for (const BenchResult &result : results) {
+        auto it = std::ranges::find(baseline, result.name, &BenchResult::name);
+        if (it == baseline.end() || it->render_seconds <= 0.0)
+            continue;
+
+        const double change = result.render_seconds / it->render_seconds - 1.0;
+        comparisons.push_back(BaselineComparison {
+            .name = result.name,
+            .baseline_seconds = it->render_seconds,
+            .seconds = result.render_seconds,
+            .change = change,
+            .is_regression = change > threshold,
+            .is_ray_count_changed = result.ray_count != it->ray_count,
+        });
+    }
+    return comparisons;
+}
+
+void print_comparison_report(std::ostream &os, const std::span<const BaselineComparison> comparisons, const double threshold) {
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+
+    int regression_count = 0;
+    os << "Compared with baseline (threshold " << std::fixed << std::setprecision(1) << threshold * 100.0 << "%):\n";
+    for (const BaselineComparison &comparison : comparisons) {
+        os << "  " << std::left << std::setw(48) << comparison.name << std::right
+           << std::setprecision(3) << std::setw(10) << comparison.baseline_seconds << "s ->"
+           << std::setw(10) << comparison.seconds << "s "
+           << std::showpos << std::setprecision(1) << std::setw(7) << comparison.change * 100.0 << '%' << std::noshowpos;
+        if (comparison.is_regression)
+            os << "  REGRESSION";
+        if (comparison.is_ray_count_changed)
+            os << "  (ray count changed)";
+        os << '\n';
+        regression_count += comparison.is_regression;
+    }
+    os << "  " << regression_count << " of " << comparisons.size() << " cases regressed\n";
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace crt::bench {
+
+enum class ImageCheck {
+    Skipped,
+    NoReference,
+    Match,
+    Differs,
+};
+
+/**
+ * Measurements of one benchmark case (a scene file or a generated stress scene). The timings are
+ * medians over all repetitions.
+ */
+struct BenchResult {
+    std::string name;
+    int width, height;
+    uint32_t triangle_count;
+    uint32_t light_count;
+    int repetitions;
+    uint64_t ray_count;
+    /**
+     * Parsing (or generating) the scene, including building its acceleration trees
+     */
+    double load_seconds;
+    double build_seconds;
+    double render_seconds;
+    double min_render_seconds;
+    double mrays_per_second;
+    /**
+     * Peak resident set size of the whole process so far, not just of this case
+     */
+    double peak_rss_mib;
+    ImageCheck image_check;
+    double image_rmse;
+};
+
+std::string_view get_image_check_name(ImageCheck image_check);
+
+void write_results_json(std::ostream &os, std::span<const BenchResult> results);
+
+/**
+ * Read results previously written by `write_results_json()`, e.g. to use them as a baseline.
+ */
+std::optional<std::vector<BenchResult>> read_results_json(std::istream &is);
+
+struct BaselineComparison {
+    std::string name;
+    double baseline_seconds;
+    double seconds;
+    /**
+     * Relative change of the render time, positive when slower than the baseline
+     */
+    double change;
+    bool is_regression;
+    /**
+     * A changed number of rays means the renderer doesn't do the same work anymore, so the
+     * timings are not directly comparable
+     */
+    bool is_ray_count_changed;
+};
+
+/**
+ * Compare the render times of the cases, which are present in both `results` and `baseline`.
+ * A case regressed when it got slower by more than `threshold` (e.g. 0.05 for 5%).
+ */
+std::vector<BaselineComparison> compare_with_baseline(std::span<const BenchResult> results, std::span<const BenchResult> baseline, double threshold);
+
+void print_comparison_report(std::ostream &os, std::span<const BaselineComparison> comparisons, double threshold);
+
+}
@@ -0,0 +1,134 @@
+#include "bench_scenes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+#include "core/crt_acceleration_tree.h"
+#include "core/crt_camera.h"
+#include "core/crt_mesh.h"
+#include "core/crt_random.h"
+#include "core/crt_texture.h"
+
+namespace crt::bench {
+
+inline constexpr int SPHERE_RING_COUNT = 12;
+inline constexpr int SPHERE_SEGMENT_COUNT = 24;
+inline constexpr uint32_t SPHERE_TRIANGLE_COUNT = 2 * SPHERE_SEGMENT_COUNT * (SPHERE_RING_COUNT - 1);
+
+inline constexpr float TOTAL_LIGHT_INTENSITY = 300.0f;
+
+std::string get_stress_scene_name(const StressSceneSettings &settings) {
+    return "stress/triangles-" + std::to_string(settings.triangle_count) + "-lights-" + std::to_string(settings.light_count);
+}
+
+/**
+ * UV sphere, whose poles are single vertices
+ */
+static void append_sphere(Geometry &geometry, const Vector &center, const float radius, const TriangleFlags flags) {
+    std::vector<Vector> positions;
+    std::vector<int> indices;
+    positions.reserve(2 + (SPHERE_RING_COUNT - 1) * SPHERE_SEGMENT_COUNT);
+    indices.reserve(3 * SPHERE_TRIANGLE_COUNT);
+
+    positions.push_back(center + Vector{ 0.0f, radius, 0.0f });
+    for (int ring = 1; ring < SPHERE_RING_COUNT; ++ring) {
+        const float theta = std::numbers::pi_v<float> * ring / SPHERE_RING_COUNT;
+        for (int segment = 0; segment < SPHERE_SEGMENT_COUNT; ++segment) {
+            const float phi = 2.0f * std::numbers::pi_v<float> * segment / SPHERE_SEGMENT_COUNT;
+            positions.push_back(center + Vector{
+                radius * std::sin(theta) * std::cos(phi),
+                radius * std::cos(theta),
+                radius * std::sin(theta) * std::sin(phi),
+            });
+        }
+    }
+    positions.push_back(center - Vector{ 0.0f, radius, 0.0f });
+
+    const auto ring_vertex = [](int ring, int segment) {
+        return 1 + (ring - 1) * SPHERE_SEGMENT_COUNT + segment % SPHERE_SEGMENT_COUNT;
+    };
+    const int bottom = static_cast<int>(positions.size()) - 1;
+
+    for (int segment = 0; segment < SPHERE_SEGMENT_COUNT; ++segment) {
+        // Counter-clockwise, seen from the outside
+        indices.insert(indices.end(), { 0, ring_vertex(1, segment + 1), ring_vertex(1, segment) });
+        for (int ring = 1; ring < SPHERE_RING_COUNT - 1; ++ring) {
+            const int a = ring_vertex(ring, segment), b = ring_vertex(ring, segment + 1);
+            const int c = ring_vertex(ring + 1, segment), d = ring_vertex(ring + 1, segment + 1);
+            indices.insert(indices.end(), { a, b, c, c, b, d });
+        }
+        indices.insert(indices.end(), { bottom, ring_vertex(SPHERE_RING_COUNT - 1, segment), ring_vertex(SPHERE_RING_COUNT - 1, segment + 1) });
+    }
+
+    vertex_array_extend(geometry, positions, indices, 0, flags);
+}
+
+Scene make_stress_scene(const StressSceneSettings &settings) {
+    const uint32_t sphere_count = std::max<uint32_t>(1, (settings.triangle_count + SPHERE_TRIANGLE_COUNT - 1) / SPHERE_TRIANGLE_COUNT);
+
+    // NOTE: The spheres fill a box in front of the camera, whose volume grows with their number,
+    //       so their density (and the depth complexity of the image) stays about the same
+    const float extent = 2.0f * std::cbrt(static_cast<float>(sphere_count));
+    const float radius = 0.5f;
+
+    Geometry geometry;
+    geometry.reserve(sphere_count * (2 + (SPHERE_RING_COUNT - 1) * SPHERE_SEGMENT_COUNT) + 4, sphere_count * SPHERE_TRIANGLE_COUNT + 2);
+
+    const TriangleFlags smooth{ .smooth_shading = true, .back_face_culling = false };
+    PCG32 rng = make_pcg(settings.triangle_count, settings.light_count);
+    for (uint32_t i = 0; i < sphere_count; ++i) {
+        const Vector center{
+            (rng.uniform() - 0.5f) * 2.0f * extent,
+            rng.uniform() * extent,
+            -3.0f - rng.uniform() * 2.0f * extent,
+        };
+        append_sphere(geometry, center, radius, smooth);
+    }
+
+    const float ground_size = 4.0f * extent + 10.0f;
+    const Vector ground_positions[]{
+        { -ground_size, -radius, ground_size },
+        {  ground_size, -radius, ground_size },
+        { -ground_size, -radius, -ground_size },
+        {  ground_size, -radius, -ground_size },
+    };
+    const int ground_indices[]{ 0, 1, 2, 3, 2, 1 };
+    vertex_array_extend(geometry, ground_positions, ground_indices, 0, TriangleFlags{ .smooth_shading = false, .back_face_culling = false });
+
+    std::vector<Light> lights;
+    lights.reserve(settings.light_count);
+    for (uint32_t i = 0; i < settings.light_count; ++i) {
+        const float angle = 2.0f * std::numbers::pi_v<float> * i / settings.light_count;
+        lights.push_back(Light{
+            .intensity = TOTAL_LIGHT_INTENSITY * extent * extent / settings.light_count,
+            .position = { extent * std::cos(angle), 2.0f * extent, -extent - 3.0f + extent * std::sin(angle) },
+        });
+    }
+
+    Transform camera_transform;
+    camera_transform.translate_world({ 0.0f, 0.5f * extent, 0.5f * extent });
+
+    AccelerationTree acceleration_tree = acceleration_tree::build(geometry);
+
+    return Scene {
+        .background_color = { 0.1f, 0.1f, 0.15f },
+        .camera = Camera{ settings.resolution_x, settings.resolution_y, 60.0f, camera_transform },
+        .geometry = std::move(geometry),
+        .acceleration_tree = std::move(acceleration_tree),
+        .meshes = {},
+        .instances = {},
+        .instance_tree = {},
+        .lights = std::move(lights),
+        .textures = { Texture{ .type = TextureType::Albedo, .as_albedo_tex = { Color{ 0.8f, 0.6f, 0.4f } } } },
+        .bitmaps = {},
+        .materials = { Material{ .type = MaterialType::Diffuse, .albedo_map_texture_index = 0, .ior = 1.0f } },
+        .bucket_size = DEFAULT_SCENE_BUCKET_SIZE,
+        .gi_on = false,
+        .reflections_on = true,
+        .refractions_on = true,
+    };
+}
+
+}
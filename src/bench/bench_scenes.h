@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "core/crt_scene.h"
+
+namespace crt::bench {
+
+struct StressSceneSettings {
+    /**
+     * Approximate number of triangles. The scene is made of spheres, so it's rounded up to whole ones.
+     */
+    uint32_t triangle_count;
+    uint32_t light_count;
+    int resolution_x{ 640 };
+    int resolution_y{ 360 };
+};
+
+/**
+ * Name of the benchmark case of a stress scene, e.g. "stress/triangles-100000-lights-4"
+ */
+std::string get_stress_scene_name(const StressSceneSettings &settings);
+
+/**
+ * Generate a field of randomly placed (but deterministic) spheres over a ground quad, lit by
+ * `light_count` point lights on a ring above it. The total light intensity stays the same
+ * regardless of the number of lights, so all variants are exposed alike.
+ */
+Scene make_stress_scene(const StressSceneSettings &settings);
+
+}
@@ -0,0 +1,416 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "core/crt_image.h"
+#include "core/crt_image_ppm.h"
+#include "core/crt_json.h"
+#include "core/crt_renderer.h"
+#include "core/crt_scene.h"
+#include "core/crt_stats.h"
+#include "core/crt_tile.h"
+
+#include "bench_image_diff.h"
+#include "bench_report.h"
+#include "bench_scenes.h"
+
+namespace fs = std::filesystem;
+
+struct BenchOptions {
+    fs::path scenes_dir_path{ "../scenes" };
+    fs::path references_dir_path{ "../results/ppm" };
+    std::optional<fs::path> output_file_path;
+    std::optional<fs::path> baseline_file_path;
+    std::optional<fs::path> images_dir_path;
+    std::string filter;
+    bool run_scenes{ true };
+    bool run_stress{ true };
+    std::vector<uint32_t> stress_triangle_counts{ 10'000, 100'000, 1'000'000 };
+    std::vector<uint32_t> stress_light_counts{ 1, 16 };
+    int repetitions{ 3 };
+    int warmup_repetitions{ 0 };
+    double threshold{ 0.05 };
+    double image_threshold{ 0.01 };
+    crt::RendererSettings renderer_settings;
+};
+
+/**
+ * Produces the scene of a benchmark case. It's called once per repetition, so loading is measured each time.
+ */
+struct BenchCase {
+    std::string name;
+    std::function<std::optional<crt::Scene>()> load_scene;
+    std::optional<fs::path> reference_file_path;
+};
+
+static void print_usage(const char *program_name) {
+    std::cerr
+        << "Usage: " << program_name << " [options]\n"
+        << "  --scenes DIR              render every DIR/<slug>/<scene>.crtscene (default: ../scenes)\n"
+        << "  --references DIR          compare with DIR/<slug>-<scene>.ppm (default: ../results/ppm)\n"
+        << "  --no-scenes               skip the scene files\n"
+        << "  --no-stress               skip the generated stress scenes\n"
+        << "  --generic-shading         render without the shading code, specialized for the features of each scene\n"
+        << "  --wavefront               trace the rays bounce by bounce in sorted batches, rather than depth first\n"
+        << "  --stress-triangles N,...  triangle counts of the stress scenes (default: 10000,100000,1000000)\n"
+        << "  --stress-lights N,...     light counts of the stress scenes (default: 1,16)\n"
+        << "  --filter TEXT             only run the cases, whose name contains TEXT\n"
+        << "  --repetitions N           timed renders per case (default: 3)\n"
+        << "  --warmup N                untimed renders per case (default: 0)\n"
+        << "  --output results.json     write the results\n"
+        << "  --images DIR              write the rendered images to DIR/<case>.ppm\n"
+        << "  --baseline baseline.json  compare with previously written results\n"
+        << "  --threshold F             allowed slowdown, relative to the baseline (default: 0.05)\n"
+        << "  --image-threshold F       allowed RMS difference from the reference images (default: 0.01)\n";
+}
+
+template <typename T>
+static std::optional<T> parse_number(const std::string_view arg) {
+    T value;
+    auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+    if (ec != std::errc{} || ptr != arg.data() + arg.size())
+        return std::nullopt;
+    return value;
+}
+
+static std::optional<std::vector<uint32_t>> parse_number_list(std::string_view arg) {
+    std::vector<uint32_t> values;
+    while (!arg.empty()) {
+        const size_t comma = arg.find(',');
+        std::optional<uint32_t> value = parse_number<uint32_t>(arg.substr(0, comma));
+        if (!value || *value == 0)
+            return std::nullopt;
+        values.push_back(*value);
+        arg = comma == std::string_view::npos ? std::string_view{} : arg.substr(comma + 1);
+    }
+    if (values.empty())
+        return std::nullopt;
+    return values;
+}
+
+static std::optional<BenchOptions> parse_options(const int argc, char *argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+
+        if (arg == "--no-scenes") {
+            options.run_scenes = false;
+        } else if (arg == "--no-stress") {
+            options.run_stress = false;
+        } else if (arg == "--generic-shading") {
+            options.renderer_settings.specialize_shading = false;
+        } else if (arg == "--wavefront") {
+            options.renderer_settings.wavefront = true;
+        } else if (!has_value) {
+            return std::nullopt;
+        } else if (arg == "--scenes") {
+            options.scenes_dir_path = argv[++i];
+        } else if (arg == "--references") {
+            options.references_dir_path = argv[++i];
+        } else if (arg == "--filter") {
+            options.filter = argv[++i];
+        } else if (arg == "--output") {
+            options.output_file_path = argv[++i];
+        } else if (arg == "--baseline") {
+            options.baseline_file_path = argv[++i];
+        } else if (arg == "--images") {
+            options.images_dir_path = argv[++i];
+        } else if (arg == "--stress-triangles" || arg == "--stress-lights") {
+            std::optional<std::vector<uint32_t>> values = parse_number_list(argv[++i]);
+            if (!values)
+                return std::nullopt;
+            (arg == "--stress-triangles" ? options.stress_triangle_counts : options.stress_light_counts) = std::move(*values);
+        } else if (arg == "--repetitions" || arg == "--warmup") {
+            std::optional<int> value = parse_number<int>(argv[++i]);
+            if (!value || *value < (arg == "--repetitions" ? 1 : 0))
+                return std::nullopt;
+            (arg == "--repetitions" ? options.repetitions : options.warmup_repetitions) = *value;
+        } else if (arg == "--threshold" || arg == "--image-threshold") {
+            std::optional<double> value = parse_number<double>(argv[++i]);
+            if (!value || *value < 0.0)
+                return std::nullopt;
+            (arg == "--threshold" ? options.threshold : options.image_threshold) = *value;
+        } else {
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+static std::vector<BenchCase> get_bench_cases(const BenchOptions &options) {
+    std::vector<BenchCase> cases;
+
+    if (options.run_scenes) {
+        std::vector<fs::path> scene_file_paths;
+        std::error_code ec;
+        for (const fs::directory_entry &entry : fs::recursive_directory_iterator{ options.scenes_dir_path, ec })
+            if (entry.is_regular_file() && entry.path().extension() == ".crtscene")
+                scene_file_paths.push_back(entry.path());
+        if (ec)
+            std::cerr << "Warning: Could not list scenes in " << options.scenes_dir_path << ": " << ec.message() << '\n';
+        std::ranges::sort(scene_file_paths);
+
+        for (const fs::path &scene_file_path : scene_file_paths) {
+            const std::string slug = scene_file_path.parent_path().filename().string();
+            const std::string scene_name = scene_file_path.stem().string();
+            cases.push_back(BenchCase {
+                .name = slug + '/' + scene_name,
+                .load_scene = [scene_file_path]() -> std::optional<crt::Scene> {
+                    std::ifstream input_file{ scene_file_path, std::ios::in | std::ios::binary };
+                    if (!input_file.is_open())
+                        return std::nullopt;
+                    return crt::json::read_scene_from_istream(input_file, scene_file_path.parent_path());
+                },
+                // Same naming as `tools/submit_render_task.sh`
+                .reference_file_path = options.references_dir_path / (slug + '-' + scene_name + ".ppm"),
+            });
+        }
+    }
+
+    if (options.run_stress) {
+        for (const uint32_t triangle_count : options.stress_triangle_counts) {
+            for (const uint32_t light_count : options.stress_light_counts) {
+                const crt::bench::StressSceneSettings settings{ .triangle_count = triangle_count, .light_count = light_count };
+                cases.push_back(BenchCase {
+                    .name = crt::bench::get_stress_scene_name(settings),
+                    .load_scene = [settings]() -> std::optional<crt::Scene> { return crt::bench::make_stress_scene(settings); },
+                    .reference_file_path = std::nullopt,
+                });
+            }
+        }
+    }
+
+    std::erase_if(cases, [&](const BenchCase &bench_case) { return !bench_case.name.contains(options.filter); });
+    return cases;
+}
+
+static double get_peak_rss_mib() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0.0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+#else
+    // FIXME: Not measured on other platforms
+    return 0.0;
+#endif
+}
+
+static double get_median(std::vector<double> values) {
+    std::ranges::sort(values);
+    const size_t middle = values.size() / 2;
+    return values.size() % 2 == 1 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+}
+
+static uint32_t get_triangle_count(const crt::Scene &scene) {
+    uint32_t triangle_count = scene.geometry.triangle_count();
+    for (const crt::Instance &instance : scene.instances)
+        triangle_count += scene.meshes[instance.mesh_index].geometry.triangle_count();
+    return triangle_count;
+}
+
+static void check_image(const crt::Image &image, const fs::path &reference_file_path, const double image_threshold, crt::bench::BenchResult &result) {
+    std::ifstream reference_file{ reference_file_path, std::ios::in | std::ios::binary };
+    if (!reference_file.is_open()) {
+        result.image_check = crt::bench::ImageCheck::NoReference;
+        return;
+    }
+
+    std::optional<crt::Image> reference = crt::read_ppm(reference_file);
+    if (!reference) {
+        // NOTE: The references are not all checked in, some of them are empty placeholders
+        std::cerr << "Warning: Could not read reference image: " << reference_file_path << '\n';
+        result.image_check = crt::bench::ImageCheck::NoReference;
+        return;
+    }
+
+    if (reference->width != image.width || reference->height != image.height) {
+        result.image_check = crt::bench::ImageCheck::Differs;
+        result.image_rmse = 1.0;
+        return;
+    }
+
+    const crt::bench::ImageDiff diff = crt::bench::compare_images(image, *reference);
+    result.image_rmse = diff.rmse;
+    result.image_check = diff.rmse <= image_threshold ? crt::bench::ImageCheck::Match : crt::bench::ImageCheck::Differs;
+}
+
+static void write_image(const crt::Image &image, const fs::path &images_dir_path, std::string name) {
+    std::ranges::replace(name, '/', '-');
+    const fs::path image_file_path = images_dir_path / (name + ".ppm");
+
+    std::error_code ec;
+    fs::create_directories(images_dir_path, ec);
+    std::ofstream image_file{ image_file_path, std::ios::out | std::ios::binary };
+    if (!image_file.is_open()) {
+        std::cerr << "Warning: Could not write image: " << image_file_path << '\n';
+        return;
+    }
+    crt::write_ppm(image, image_file);
+}
+
+static std::optional<crt::bench::BenchResult> run_bench_case(const BenchCase &bench_case, const BenchOptions &options) {
+    using clock = std::chrono::steady_clock;
+
+    crt::bench::BenchResult result{};
+    result.name = bench_case.name;
+    result.repetitions = options.repetitions;
+    result.image_check = crt::bench::ImageCheck::Skipped;
+    std::vector<double> load_seconds, build_seconds, render_seconds;
+
+    const crt::RendererSettings &settings = options.renderer_settings;
+    for (int repetition = 0; repetition < options.warmup_repetitions + options.repetitions; ++repetition) {
+        const bool is_warmup = repetition < options.warmup_repetitions;
+        crt::RenderStats stats;
+
+        std::optional<crt::Scene> scene;
+        const clock::time_point load_start = clock::now();
+        {
+            crt::StatsScope stats_scope{ &stats };
+            scene = bench_case.load_scene();
+        }
+        const clock::time_point load_end = clock::now();
+        if (!scene)
+            return std::nullopt;
+
+        crt::Image image{ scene->camera.resolution_x(), scene->camera.resolution_y() };
+        crt::ImageTileSink sink{ image };
+        const clock::time_point render_start = clock::now();
+        crt::render_image(*scene, settings, sink, {}, &stats);
+        const clock::time_point render_end = clock::now();
+
+        if (is_warmup)
+            continue;
+
+        // NOTE: Measured here rather than taken from the stats, so that the timings are there even without CRT_ENABLE_STATS
+        load_seconds.push_back(std::chrono::duration<double>(load_end - load_start).count());
+        build_seconds.push_back(stats[crt::StatTimer::AccelerationTreeBuild]);
+        render_seconds.push_back(std::chrono::duration<double>(render_end - render_start).count());
+
+        // Every repetition renders the same image with the same rays, so only the last one is kept
+        if (repetition + 1 == options.warmup_repetitions + options.repetitions) {
+            result.width = image.width;
+            result.height = image.height;
+            result.triangle_count = get_triangle_count(*scene);
+            result.light_count = static_cast<uint32_t>(scene->lights.size());
+            result.ray_count = stats.ray_count();
+            if (bench_case.reference_file_path)
+                check_image(image, *bench_case.reference_file_path, options.image_threshold, result);
+            if (options.images_dir_path)
+                write_image(image, *options.images_dir_path, bench_case.name);
+        }
+    }
+
+    result.load_seconds = get_median(load_seconds);
+    result.build_seconds = get_median(build_seconds);
+    result.render_seconds = get_median(render_seconds);
+    result.min_render_seconds = std::ranges::min(render_seconds);
+    result.mrays_per_second = result.render_seconds > 0.0 ? result.ray_count / result.render_seconds * 1e-6 : 0.0;
+    result.peak_rss_mib = get_peak_rss_mib();
+    return result;
+}
+
+static void print_result(std::ostream &os, const crt::bench::BenchResult &result) {
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+
+    os << std::left << std::setw(44) << result.name << std::right
+       << std::setw(5) << result.width << 'x' << std::left << std::setw(5) << result.height << std::right
+       << std::setw(9) << result.triangle_count << " tris"
+       << std::setw(4) << result.light_count << " lights"
+       << std::fixed << std::setprecision(3)
+       << "  load" << std::setw(8) << result.load_seconds << 's'
+       << "  build" << std::setw(8) << result.build_seconds << 's'
+       << "  render" << std::setw(8) << result.render_seconds << 's'
+       << " (min" << std::setw(8) << result.min_render_seconds << "s)"
+       << std::setprecision(2) << std::setw(9) << result.mrays_per_second << " Mrays/s"
+       << std::setprecision(1) << "  RSS" << std::setw(8) << result.peak_rss_mib << " MiB"
+       << "  image: " << crt::bench::get_image_check_name(result.image_check);
+    if (result.image_check == crt::bench::ImageCheck::Match || result.image_check == crt::bench::ImageCheck::Differs)
+        os << " (RMSE " << std::setprecision(4) << result.image_rmse << ')';
+    os << '\n';
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+int main(int argc, char *argv[]) {
+    std::optional<BenchOptions> options = parse_options(argc, argv);
+    if (!options) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Read the baseline first, so that a wrong path doesn't go unnoticed until after a long run
+    std::optional<std::vector<crt::bench::BenchResult>> baseline;
+    if (options->baseline_file_path) {
+        std::ifstream baseline_file{ *options->baseline_file_path };
+        if (baseline_file.is_open())
+            baseline = crt::bench::read_results_json(baseline_file);
+        if (!baseline) {
+            std::cerr << "Error: Could not read baseline file: " << *options->baseline_file_path << '\n';
+            return 1;
+        }
+    }
+
+    const std::vector<BenchCase> cases = get_bench_cases(*options);
+    if (cases.empty()) {
+        std::cerr << "Error: No benchmark cases to run\n";
+        return 1;
+    }
+
+#ifndef CRT_ENABLE_STATS
+    std::cerr << "Warning: Built without CRT_ENABLE_STATS, rays and build times are not counted\n";
+#endif
+
+    bool is_failed = false;
+    std::vector<crt::bench::BenchResult> results;
+    results.reserve(cases.size());
+    for (const BenchCase &bench_case : cases) {
+        std::optional<crt::bench::BenchResult> result = run_bench_case(bench_case, *options);
+        if (!result) {
+            // NOTE: Not a failure, as some of the bundled scenes predate the supported format (e.g. have no materials)
+            std::cerr << "Warning: Could not load scene, skipping: " << bench_case.name << '\n';
+            continue;
+        }
+        print_result(std::cout, *result);
+        is_failed |= result->image_check == crt::bench::ImageCheck::Differs;
+        results.push_back(std::move(*result));
+    }
+
+    if (options->output_file_path) {
+        std::ofstream output_file{ *options->output_file_path };
+        if (!output_file.is_open()) {
+            std::cerr << "Error: Could not open output file: " << *options->output_file_path << '\n';
+            return 1;
+        }
+        crt::bench::write_results_json(output_file, results);
+    }
+
+    if (baseline) {
+        const std::vector<crt::bench::BaselineComparison> comparisons = crt::bench::compare_with_baseline(results, *baseline, options->threshold);
+        std::cout << '\n';
+        crt::bench::print_comparison_report(std::cout, comparisons, options->threshold);
+        is_failed |= std::ranges::any_of(comparisons, &crt::bench::BaselineComparison::is_regression);
+    }
+
+    return is_failed ? 1 : 0;
+}
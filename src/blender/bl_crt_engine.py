@@ -1,34 +1,79 @@
-import json
-
 import bpy
+import gpu
+from bpy.app.handlers import persistent
+
+from .bl_crt_scene import SceneSync
+from .bl_crt_viewport import ViewportRender
 
-from .bl_crt_json import build_scene_dict
+# NOTE: Blender creates a new engine for every final render, so the resident scene lives in the module.
+#       It learns about edits through the depsgraph updates of the view layer (see _on_depsgraph_update).
+_render_scene_sync = SceneSync()
 
 
 class CRTRenderEngine(bpy.types.RenderEngine):
     bl_idname = 'CRT'
     bl_label = 'CRT'
 
+    def __init__(self):
+        self._viewport_render = None
+
     def render(self, depsgraph):
         from . import _crt
 
-        # HACK: use real scene instead
-        scene_dict = build_scene_dict(depsgraph)
-        image_settings = scene_dict['settings']['image_settings']
+        crt_scene = _render_scene_sync.sync(depsgraph)
+        renderer_settings = _get_renderer_settings(depsgraph.scene)
+
+        task = _crt.RenderTask(crt_scene, renderer_settings)
+        while not task.wait(0.1):
+            if self.test_break():
+                task.cancel()
+                task.wait()
+                break
+
+            self._write_tiles(task)
+            self.update_progress(task.progress)
+
+        self._write_tiles(task)
+
+    def _write_tiles(self, task) -> None:
+        """Display the buckets, finished since the last call, while the render is running."""
+        for x, y, tile in task.pop_tiles():
+            result = self.begin_result(x, y, tile.width, tile.height)
+            layer = result.layers[0].passes['Combined']
+            layer.rect.foreach_set(tile)
+            self.end_result(result)
+
+    def view_update(self, context, depsgraph):
+        if self._viewport_render is None:
+            self._viewport_render = ViewportRender()
+        self._viewport_render.update(depsgraph, _get_renderer_settings(depsgraph.scene))
+
+    def view_draw(self, context, depsgraph):
+        if self._viewport_render is None:
+            return
 
-        renderer_settings = _crt.RendererSettings((
-            depsgraph.scene.crt.max_ray_depth,
-            depsgraph.scene.crt.diffuse_reflection_ray_count,
-            depsgraph.scene.crt.shadow_bias,
-            depsgraph.scene.crt.reflection_bias,
-            depsgraph.scene.crt.diffuse_reflection_bias,
-            depsgraph.scene.crt.refraction_bias,
-        ))
+        gpu.state.blend_set('ALPHA_PREMULT')
+        self.bind_display_space_shader(depsgraph.scene)
+        is_done = self._viewport_render.draw(context)
+        self.unbind_display_space_shader()
+        gpu.state.blend_set('NONE')
 
-        result = self.begin_result(0, 0, image_settings['width'], image_settings['height'])
-        layer = result.layers[0].passes['Combined']
-        layer.rect = _crt.render_scene_from_dict(scene_dict, '/', renderer_settings)  # Make sure assets are relative to system root
-        self.end_result(result)
+        # Keep drawing, until the last pass is finished
+        if not is_done:
+            self.tag_redraw()
+
+
+def _get_renderer_settings(scene):
+    from . import _crt
+
+    return _crt.RendererSettings((
+        scene.crt.max_ray_depth,
+        scene.crt.diffuse_reflection_ray_count,
+        scene.crt.shadow_bias,
+        scene.crt.reflection_bias,
+        scene.crt.diffuse_reflection_bias,
+        scene.crt.refraction_bias,
+    ))
 
 
 def get_compatible_panels():
@@ -54,18 +99,35 @@ def get_compatible_panels():
                 yield panel
 
 
+@persistent
+def _on_depsgraph_update(scene, depsgraph):
+    _render_scene_sync.tag_updates(depsgraph.updates)
+
+
+@persistent
+def _on_load_post(*args):
+    global _render_scene_sync
+    _render_scene_sync = SceneSync()
+
+
 classes = (CRTRenderEngine,)
 
 
 def register():
     for cls in classes:
         bpy.utils.register_class(cls)
+
+    bpy.app.handlers.depsgraph_update_post.append(_on_depsgraph_update)
+    bpy.app.handlers.load_post.append(_on_load_post)
     
     for panel in get_compatible_panels():
         panel.COMPAT_ENGINES.add(CRTRenderEngine.bl_idname)
 
 
 def unregister():
+    bpy.app.handlers.load_post.remove(_on_load_post)
+    bpy.app.handlers.depsgraph_update_post.remove(_on_depsgraph_update)
+
     for panel in get_compatible_panels():
         # FIXME: For some reason, register() succeeds, but some Blender native panels at this
         #        point still don't have CRT in COMPAT_ENGINES. Maybe they are
@@ -0,0 +1,324 @@
+import math
+from dataclasses import dataclass
+
+import bpy
+import numpy as np
+
+from .bl_crt_json import _absolute_path, _blender_to_rh_conversion, _ensure_external
+
+
+def _convert_transform(matrix_world) -> tuple[list[float], list[float]]:
+    """Return the CRT (position, row-major matrix) of a Blender world matrix."""
+    m = _blender_to_rh_conversion @ matrix_world
+    position = list(m.translation)
+    # CRT transforms row vectors (p * M), Blender transforms column vectors (M @ p)
+    matrix = [v for row in m.to_3x3().transposed() for v in row]
+    return position, matrix
+
+
+def _get_texture_signature() -> tuple:
+    """Return everything about the CRT textures, that requires the scene to be rebuilt when it changes."""
+    signature = []
+    for tex in bpy.data.textures:
+        if tex.type != 'IMAGE' or not hasattr(tex, 'crt') or tex.crt is None:
+            continue
+
+        crt_tex = tex.crt
+        signature.append((
+            tex.name, crt_tex.type,
+            tuple(crt_tex.albedo_color), tuple(crt_tex.edge_color), tuple(crt_tex.inner_color), crt_tex.edge_width,
+            tuple(crt_tex.checker_color_a), tuple(crt_tex.checker_color_b), crt_tex.square_size,
+            tex.image.filepath if tex.image else None,
+        ))
+    return tuple(signature)
+
+
+def _build_textures(crt_scene) -> dict:
+    texture_index_map = {}
+
+    for tex in bpy.data.textures:
+        if tex.type != 'IMAGE':
+            continue
+        if not hasattr(tex, 'crt') or tex.crt is None:
+            continue
+
+        crt_tex = tex.crt
+        if crt_tex.type == 'ALBEDO':
+            index = crt_scene.add_albedo_texture(tuple(crt_tex.albedo_color))
+        elif crt_tex.type == 'EDGES':
+            index = crt_scene.add_edges_texture(tuple(crt_tex.edge_color), tuple(crt_tex.inner_color), crt_tex.edge_width)
+        elif crt_tex.type == 'CHECKER':
+            index = crt_scene.add_checker_texture(tuple(crt_tex.checker_color_a), tuple(crt_tex.checker_color_b), crt_tex.square_size)
+        elif crt_tex.type == 'BITMAP':
+            if not tex.image:
+                raise ValueError(f"Bitmap texture '{tex.name}' has no external image")
+            _ensure_external(tex.image)
+            index = crt_scene.add_bitmap_texture(_absolute_path(tex.image.filepath))
+        else:
+            continue
+
+        texture_index_map[tex.name] = index
+
+    return texture_index_map
+
+
+def _get_used_materials() -> list[bpy.types.Material]:
+    if not bpy.data.materials:
+        raise ValueError('Blender file must have at least 1 material')
+
+    return [mat for mat in bpy.data.materials if mat.users != 0]
+
+
+def _get_material_args(mat: bpy.types.Material, texture_index_map: dict) -> tuple[str, dict]:
+    """Return the (type, kwargs) of `_crt.Scene.add_material()` / `set_material()` for a Blender material."""
+    kwargs = {
+        'smooth_shading': mat.crt.smooth_shading,
+        'back_face_culling': mat.use_backface_culling,
+    }
+    if mat.crt.type != 'REFRACTIVE':
+        tex = mat.crt.albedo_texture
+        if not tex:
+            kwargs['albedo'] = tuple(mat.diffuse_color[:3])
+        else:
+            kwargs['albedo_texture'] = texture_index_map[tex.name]
+    else:
+        kwargs['ior'] = mat.crt.ior
+
+    return mat.crt.type.lower(), kwargs
+
+
+def _build_materials(crt_scene, texture_index_map: dict) -> dict:
+    mat_index_map = {}
+
+    for mat in _get_used_materials():
+        material_type, kwargs = _get_material_args(mat, texture_index_map)
+        mat_index_map[mat.name] = crt_scene.add_material(material_type, **kwargs)
+
+    return mat_index_map
+
+
+def _get_mesh_buffers(mesh: bpy.types.Mesh) -> tuple:
+    """Return the object space (vertices, triangles, uvs) buffers of a mesh."""
+    if not mesh.loop_triangles:
+        mesh.calc_loop_triangles()
+
+    vertices = np.empty(len(mesh.vertices) * 3, dtype=np.float32)
+    mesh.vertices.foreach_get('co', vertices)
+
+    triangles = np.empty(len(mesh.loop_triangles) * 3, dtype=np.int32)
+    mesh.loop_triangles.foreach_get('vertices', triangles)
+
+    uvs = None
+    if mesh.uv_layers.active:
+        loop_uvs = np.empty(len(mesh.loops) * 2, dtype=np.float32)
+        mesh.uv_layers.active.data.foreach_get('uv', loop_uvs)
+        loop_vertex_indices = np.empty(len(mesh.loops), dtype=np.int32)
+        mesh.loops.foreach_get('vertex_index', loop_vertex_indices)
+
+        # NOTE: Each vertex takes the UV of its first loop. Assigning in reverse makes
+        #       the first loop the one that's written last.
+        uvs = np.zeros((len(mesh.vertices), 2), dtype=np.float32)
+        uvs[loop_vertex_indices[::-1]] = loop_uvs.reshape(-1, 2)[::-1]
+        uvs = uvs.reshape(-1)
+
+    return vertices, triangles, uvs
+
+
+def _get_material_index(obj: bpy.types.Object, mesh: bpy.types.Mesh, mat_index_map: dict) -> int:
+    # HACK: The whole object uses the material of its last triangle, like the JSON exporter
+    if obj.material_slots and mesh.loop_triangles:
+        slot = obj.material_slots[mesh.loop_triangles[-1].material_index]
+        # If the object has no material, use the first (default) one
+        return mat_index_map.get(slot.material.name if slot.material else None, 0)
+    return 0
+
+
+@dataclass
+class _SyncedObject:
+    mesh_index: int
+    instance_index: int
+    material_index: int
+    vertex_count: int
+    topology_hash: int
+    """Hash of the triangles and UVs. Only the vertex positions can change without re-adding the mesh."""
+
+
+def _get_topology_hash(triangles, uvs) -> int:
+    return hash((triangles.tobytes(), uvs.tobytes() if uvs is not None else None))
+
+
+def _build_objects(crt_scene, depsgraph: bpy.types.Depsgraph, mat_index_map: dict) -> dict[str, _SyncedObject]:
+    objects = {}
+
+    for obj in depsgraph.scene.objects:
+        if obj.type != 'MESH':
+            continue
+
+        eval_obj = obj.evaluated_get(depsgraph)
+        mesh = eval_obj.to_mesh()
+        try:
+            vertices, triangles, uvs = _get_mesh_buffers(mesh)
+            material_index = _get_material_index(obj, mesh, mat_index_map)
+            mesh_index = crt_scene.add_mesh(vertices, triangles, material_index, uvs)
+        finally:
+            eval_obj.to_mesh_clear()
+
+        position, matrix = _convert_transform(eval_obj.matrix_world)
+        instance_index = crt_scene.add_instance(mesh_index, position, matrix)
+
+        objects[obj.name] = _SyncedObject(
+            mesh_index=mesh_index,
+            instance_index=instance_index,
+            material_index=material_index,
+            vertex_count=len(vertices) // 3,
+            topology_hash=_get_topology_hash(triangles, uvs),
+        )
+
+    return objects
+
+
+def _get_resolution(scene: bpy.types.Scene) -> tuple[int, int]:
+    scale = scene.render.resolution_percentage / 100.0
+    return int(scene.render.resolution_x * scale), int(scene.render.resolution_y * scale)
+
+
+def _sync_view(crt_scene, depsgraph: bpy.types.Depsgraph, use_scene_camera: bool) -> None:
+    """Apply the settings, camera and lights, which are cheap enough to set on every sync."""
+    scene = depsgraph.scene
+
+    crt_scene.set_resolution(*_get_resolution(scene))
+    crt_scene.set_options(
+        background_color=tuple(scene.world.color),
+        bucket_size=scene.crt.bucket_size,
+        gi_on=scene.crt.gi_on,
+        reflections_on=scene.crt.reflections_on,
+        refractions_on=scene.crt.refractions_on,
+    )
+
+    if use_scene_camera:
+        cam_obj = scene.camera
+        if cam_obj is None:
+            raise RuntimeError('No active camera found')
+        position, matrix = _convert_transform(cam_obj.matrix_world)
+        crt_scene.set_camera(position, matrix, math.degrees(cam_obj.data.angle))
+
+    crt_scene.clear_lights()
+    for obj in scene.objects:
+        if obj.type == 'LIGHT' and obj.data.type == 'POINT':
+            position, _ = _convert_transform(obj.matrix_world)
+            crt_scene.add_light(position, obj.data.energy)
+
+
+class SceneSync:
+    """
+    Keeps a `_crt.Scene` (and its acceleration trees) resident between renders and brings it up to date
+    incrementally.
+
+    Settings, the camera, lights and materials are re-applied on every sync, objects are only re-read
+    when they were tagged as updated, and the whole scene is only rebuilt when objects, materials or
+    textures are added or removed (or a mesh changes its topology).
+    """
+
+    def __init__(self):
+        self.crt_scene = None
+        self._scene_name = None
+        self._objects: dict[str, _SyncedObject] = {}
+        self._texture_index_map = {}
+        self._mat_index_map = {}
+        self._texture_signature = None
+        # Object name -> (is_updated_transform, is_updated_geometry)
+        self._updated_objects: dict[str, tuple[bool, bool]] = {}
+
+    def tag_updates(self, updates) -> None:
+        """Remember which objects changed, from the `updates` of a depsgraph."""
+        for update in updates:
+            if not isinstance(update.id, bpy.types.Object):
+                continue
+
+            transform, geometry = self._updated_objects.get(update.id.name, (False, False))
+            self._updated_objects[update.id.name] = (
+                transform or update.is_updated_transform,
+                geometry or update.is_updated_geometry,
+            )
+
+    def sync(self, depsgraph: bpy.types.Depsgraph, use_scene_camera: bool = True):
+        """
+        Bring the scene up to date with the evaluated depsgraph and return it. Without `use_scene_camera`,
+        the camera is left for the caller to place (eg. for the viewport).
+        """
+        updated_objects, self._updated_objects = self._updated_objects, {}
+
+        if self._needs_rebuild(depsgraph) or not self._sync_objects(depsgraph, updated_objects):
+            self._rebuild(depsgraph, use_scene_camera)
+            return self.crt_scene
+
+        for mat in _get_used_materials():
+            material_type, kwargs = _get_material_args(mat, self._texture_index_map)
+            self.crt_scene.set_material(self._mat_index_map[mat.name], material_type, **kwargs)
+
+        _sync_view(self.crt_scene, depsgraph, use_scene_camera)
+        return self.crt_scene
+
+    def _needs_rebuild(self, depsgraph: bpy.types.Depsgraph) -> bool:
+        if self.crt_scene is None or self._scene_name != depsgraph.scene.name:
+            return True
+
+        object_names = {obj.name for obj in depsgraph.scene.objects if obj.type == 'MESH'}
+        material_names = {mat.name for mat in _get_used_materials()}
+        return (
+            object_names != self._objects.keys()
+            or material_names != self._mat_index_map.keys()
+            or _get_texture_signature() != self._texture_signature
+        )
+
+    def _sync_objects(self, depsgraph: bpy.types.Depsgraph, updated_objects: dict) -> bool:
+        """Apply the updates of the objects. Returns False if the scene has to be rebuilt instead."""
+        for name, (is_updated_transform, is_updated_geometry) in updated_objects.items():
+            synced_object = self._objects.get(name)
+            if synced_object is None:
+                continue
+
+            eval_obj = depsgraph.scene.objects[name].evaluated_get(depsgraph)
+
+            if is_updated_geometry:
+                mesh = eval_obj.to_mesh()
+                try:
+                    vertices, triangles, uvs = _get_mesh_buffers(mesh)
+                    material_index = _get_material_index(eval_obj, mesh, self._mat_index_map)
+                finally:
+                    eval_obj.to_mesh_clear()
+
+                if (
+                    material_index != synced_object.material_index
+                    or len(vertices) // 3 != synced_object.vertex_count
+                    or _get_topology_hash(triangles, uvs) != synced_object.topology_hash
+                ):
+                    return False
+
+                # NOTE: Meshes are not shared between objects, so the mesh can be refitted in place
+                self.crt_scene.set_mesh_vertices(synced_object.mesh_index, vertices)
+
+            if is_updated_transform:
+                position, matrix = _convert_transform(eval_obj.matrix_world)
+                self.crt_scene.set_instance_transform(synced_object.instance_index, position, matrix)
+
+        return True
+
+    def _rebuild(self, depsgraph: bpy.types.Depsgraph, use_scene_camera: bool) -> None:
+        from . import _crt
+
+        scene = depsgraph.scene
+
+        self.crt_scene = _crt.Scene(*_get_resolution(scene))
+        self._scene_name = scene.name
+        self._texture_signature = _get_texture_signature()
+        self._texture_index_map = _build_textures(self.crt_scene)
+        self._mat_index_map = _build_materials(self.crt_scene, self._texture_index_map)
+        self._objects = _build_objects(self.crt_scene, depsgraph, self._mat_index_map)
+
+        _sync_view(self.crt_scene, depsgraph, use_scene_camera)
+
+
+def build_scene(depsgraph: bpy.types.Depsgraph):
+    """Build a native `_crt.Scene` from the evaluated depsgraph, without going through JSON."""
+    return SceneSync().sync(depsgraph)
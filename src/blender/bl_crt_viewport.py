@@ -0,0 +1,137 @@
+import math
+
+import bpy
+import gpu
+from gpu_extras.batch import batch_for_shader
+
+from .bl_crt_scene import SceneSync, _convert_transform
+
+# Each pass renders the viewport at 1/scale of its resolution. The first one gives quick feedback,
+# the following ones refine it, until the last one renders every pixel.
+PASS_SCALES = (8, 4, 2, 1)
+
+
+def _make_texture(image) -> gpu.types.GPUTexture:
+    """Upload a `_crt.Image` (already stored bottom to top, like GPU textures)."""
+    pixels = gpu.types.Buffer('FLOAT', (image.height, image.width, 4), image)
+    return gpu.types.GPUTexture((image.width, image.height), format='RGBA16F', data=pixels)
+
+
+def _draw_texture(texture: gpu.types.GPUTexture, width: int, height: int) -> None:
+    """Draw the texture, stretched over the whole region."""
+    shader = gpu.shader.from_builtin('IMAGE')
+    batch = batch_for_shader(shader, 'TRI_FAN', {
+        'pos': ((0, 0), (width, 0), (width, height), (0, height)),
+        'texCoord': ((0, 0), (1, 0), (1, 1), (0, 1)),
+    })
+    shader.uniform_sampler('image', texture)
+    batch.draw(shader)
+
+
+def _get_view_key(context: bpy.types.Context) -> tuple:
+    """Return everything about the view, which requires restarting the render when it changes."""
+    region = context.region
+    region_data = context.region_data
+    return (
+        region.width, region.height,
+        tuple(map(tuple, region_data.view_matrix)),
+        tuple(map(tuple, region_data.window_matrix)),
+    )
+
+
+def _set_view_camera(crt_scene, context: bpy.types.Context, scale: int) -> None:
+    """Render from the point of view of the viewport (not the scene camera), at 1/scale of its resolution."""
+    region = context.region
+    region_data = context.region_data
+
+    crt_scene.set_resolution(max(1, region.width // scale), max(1, region.height // scale))
+
+    # NOTE: CRT's FOV is vertical. The projection's [1][1] element is 1 / tan(fov_y / 2).
+    #       Orthographic views and lens shift are not supported and are rendered as perspective ones.
+    fov_degrees = math.degrees(2.0 * math.atan(1.0 / region_data.window_matrix[1][1]))
+    position, matrix = _convert_transform(region_data.view_matrix.inverted())
+    crt_scene.set_camera(position, matrix, fov_degrees)
+
+
+class ViewportRender:
+    """
+    Progressive rendering of the 3D viewport. The scene stays resident between updates, while each change
+    (of the scene or the view) cancels the running render and starts over from the lowest resolution pass.
+    """
+
+    def __init__(self):
+        self._scene_sync = SceneSync()
+        self._renderer_settings = None
+        self._task = None
+        self._pass_index = 0
+        self._view_key = None
+        # The last finished pass and the (partially rendered) one in progress
+        self._texture = None
+        self._progress_texture = None
+        self._uploaded_progress = 0.0
+
+    def update(self, depsgraph: bpy.types.Depsgraph, renderer_settings) -> None:
+        """Bring the scene up to date with the depsgraph. The render restarts on the next draw."""
+        self._cancel()
+        self._scene_sync.tag_updates(depsgraph.updates)
+        self._scene_sync.sync(depsgraph, use_scene_camera=False)
+        self._renderer_settings = renderer_settings
+        self._view_key = None
+
+    def draw(self, context: bpy.types.Context) -> bool:
+        """Draw the latest result. Returns whether the render is finished (and further redraws are pointless)."""
+        if self._scene_sync.crt_scene is None:
+            return True
+
+        view_key = _get_view_key(context)
+        if view_key != self._view_key:
+            self._view_key = view_key
+            self._restart(context, 0)
+
+        self._poll(context)
+
+        if self._texture:
+            _draw_texture(self._texture, context.region.width, context.region.height)
+        if self._progress_texture:
+            # NOTE: Pixels, which are not rendered yet, have an alpha of 0
+            _draw_texture(self._progress_texture, context.region.width, context.region.height)
+
+        return self._task is None
+
+    def _poll(self, context: bpy.types.Context) -> None:
+        if self._task is None:
+            return
+
+        if self._task.is_done:
+            self._texture = _make_texture(self._task.image)
+            self._progress_texture = None
+            self._task = None
+
+            if self._pass_index + 1 < len(PASS_SCALES):
+                self._restart(context, self._pass_index + 1)
+            return
+
+        # Only upload the pass in progress, when enough of it changed
+        progress = self._task.progress
+        if progress - self._uploaded_progress > 0.05:
+            self._progress_texture = _make_texture(self._task.image)
+            self._uploaded_progress = progress
+
+    def _restart(self, context: bpy.types.Context, pass_index: int) -> None:
+        from . import _crt
+
+        self._cancel()
+
+        self._pass_index = pass_index
+        crt_scene = self._scene_sync.crt_scene
+        _set_view_camera(crt_scene, context, PASS_SCALES[pass_index])
+
+        self._task = _crt.RenderTask(crt_scene, self._renderer_settings)
+        self._progress_texture = None
+        self._uploaded_progress = 0.0
+
+    def _cancel(self) -> None:
+        if self._task is not None:
+            self._task.cancel()
+            self._task.wait()
+            self._task = None
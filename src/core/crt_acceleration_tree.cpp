@@ -1,110 +1,208 @@
 #include "crt_acceleration_tree.h"
 
+#include <algorithm>
 #include <cassert>
 #include <tuple>
 
 #include "crt_aabb.h"
-#include "crt_triangle.h"
+#include "crt_mesh.h"
+#include "crt_stats.h"
+#include "crt_trace.h"
 
 namespace crt {
 
 namespace acceleration_tree {
 
-static constexpr void union_triangle_aabb(AABB &box, const Triangle &triangle) noexcept {
-    std::apply([&](const auto &...v) {
-        ((box.min.x = std::min(box.min.x, v.position.x),
-            box.min.y = std::min(box.min.y, v.position.y),
-            box.min.z = std::min(box.min.z, v.position.z),
+static void union_triangle_aabb(AABB &box, const Geometry &geometry, uint32_t triangle_index) noexcept {
+    std::apply([&](const auto &...position) {
+        ((box.min.x = std::min(box.min.x, position.x),
+            box.min.y = std::min(box.min.y, position.y),
+            box.min.z = std::min(box.min.z, position.z),
 
-            box.max.x = std::max(box.max.x, v.position.x),
-            box.max.y = std::max(box.max.y, v.position.y),
-            box.max.z = std::max(box.max.z, v.position.z)), ...);
-    }, triangle.vertices());
+            box.max.x = std::max(box.max.x, position.x),
+            box.max.y = std::max(box.max.y, position.y),
+            box.max.z = std::max(box.max.z, position.z)), ...);
+    }, geometry.triangle_positions(triangle_index));
 }
 
-static constexpr AABB get_triangle_aabb(const Triangle &triangle) noexcept {
+static AABB get_triangle_aabb(const Geometry &geometry, uint32_t triangle_index) noexcept {
     AABB result = AABB::vacuum();
-    union_triangle_aabb(result, triangle);
+    union_triangle_aabb(result, geometry, triangle_index);
     return result;
 }
 
-static void build_branch(AccelerationTree &acceleration_tree, int parent_index, std::vector<Triangle> triangles, int depth) {
-    if (depth > MAX_ACCELERATION_TREE_DEPTH || triangles.size() <= MAX_BOX_TRIANGLE_COUNT) {
-        assert(acceleration_tree[parent_index].triangles.size() == 0);
-        acceleration_tree[parent_index].triangles = std::move(triangles);
+static size_t get_triangle_packet_count(const size_t triangle_count) noexcept {
+    return (triangle_count + TRIANGLE_PACKET_SIZE - 1) / TRIANGLE_PACKET_SIZE;
+}
+
+static void write_triangle_packets(const Geometry &geometry, std::span<const uint32_t> triangle_indices, std::span<TrianglePacket> packets) {
+    assert(packets.size() == get_triangle_packet_count(triangle_indices.size()));
+
+    for (size_t packet_index = 0; packet_index < packets.size(); ++packet_index) {
+        TrianglePacket &packet = packets[packet_index];
+        const size_t first = packet_index * TRIANGLE_PACKET_SIZE;
+        const size_t triangle_count = std::min<size_t>(TRIANGLE_PACKET_SIZE, triangle_indices.size() - first);
+
+        for (size_t lane = 0; lane < TRIANGLE_PACKET_SIZE; ++lane) {
+            const uint32_t triangle_index = triangle_indices[first + (lane < triangle_count ? lane : 0)];
+            const std::array<Vector, 3> positions = geometry.triangle_positions(triangle_index);
+            for (int vertex = 0; vertex < 3; ++vertex) {
+                for (int axis = 0; axis < 3; ++axis)
+                    packet.positions[vertex][axis][lane] = positions[vertex].data[axis];
+            }
+        }
+    }
+}
+
+std::vector<TrianglePacket> make_triangle_packets(const Geometry &geometry, std::span<const uint32_t> triangle_indices) {
+    std::vector<TrianglePacket> packets(get_triangle_packet_count(triangle_indices.size()));
+    write_triangle_packets(geometry, triangle_indices, packets);
+    return packets;
+}
+
+static int add_node(AccelerationTree &acceleration_tree, const AABB &bounds, const int parent_index) {
+    const int node_index = static_cast<int>(acceleration_tree.nodes.size());
+    acceleration_tree.nodes.emplace_back(AccelerationTreeNode {
+        .bounds = bounds,
+        .children_indices = { -1, -1 },
+        .parent_index = parent_index,
+        .first_triangle = 0,
+        .triangle_count = 0,
+        .first_packet = 0,
+    });
+    return node_index;
+}
+
+static void make_leaf(AccelerationTree &acceleration_tree, const int node_index, std::span<const uint32_t> triangle_indices) {
+    AccelerationTreeNode &node = acceleration_tree.nodes[node_index];
+    assert(!node.is_leaf());
+
+    node.first_triangle = static_cast<uint32_t>(acceleration_tree.triangle_indices.size());
+    node.triangle_count = static_cast<uint32_t>(triangle_indices.size());
+    acceleration_tree.triangle_indices.insert(acceleration_tree.triangle_indices.end(), triangle_indices.begin(), triangle_indices.end());
+}
+
+/**
+ * Done once all leaves are known, so that the packets, which are the bulk of a tree, are allocated at their
+ * final size, rather than grown leaf by leaf
+ */
+[[maybe_unused]] static void make_leaf_packets(AccelerationTree &acceleration_tree, const Geometry &geometry) {
+    size_t packet_count = 0;
+    for (AccelerationTreeNode &node : acceleration_tree.nodes) {
+        if (!node.is_leaf())
+            continue;
+        node.first_packet = static_cast<uint32_t>(packet_count);
+        packet_count += get_triangle_packet_count(node.triangle_count);
+    }
+
+    acceleration_tree.triangle_packets.resize(packet_count);
+    for (const AccelerationTreeNode &node : acceleration_tree.nodes) {
+        if (node.is_leaf())
+            write_triangle_packets(geometry, acceleration_tree.get_triangle_indices(node), std::span{ acceleration_tree.triangle_packets }.subspan(node.first_packet, get_triangle_packet_count(node.triangle_count)));
+    }
+}
+
+static void build_branch(AccelerationTree &acceleration_tree, const Geometry &geometry, int parent_index, std::vector<uint32_t> triangle_indices, int depth) {
+    if (depth > MAX_ACCELERATION_TREE_DEPTH || triangle_indices.size() <= MAX_BOX_TRIANGLE_COUNT) {
+        make_leaf(acceleration_tree, parent_index, triangle_indices);
         return;
     }
 
-    const auto [child0_bounds, child1_bounds] = acceleration_tree[parent_index].bounds.split(depth % 3); // Alternating the split axis
+    const auto [child0_bounds, child1_bounds] = acceleration_tree.nodes[parent_index].bounds.split(depth % 3); // Alternating the split axis
 
-    std::vector<Triangle> &child0_triangles = triangles, child1_triangles;
-    child1_triangles.reserve(triangles.size() / 2);
+    std::vector<uint32_t> &child0_triangles = triangle_indices, child1_triangles;
+    child1_triangles.reserve(triangle_indices.size() / 2);
 
     auto child0_new_end = child0_triangles.begin();
-    for (const auto &triangle : child0_triangles) {
-        AABB triangle_bounds = get_triangle_aabb(triangle);
+    for (const uint32_t triangle : child0_triangles) {
+        AABB triangle_bounds = get_triangle_aabb(geometry, triangle);
         bool is_in_child0 = child0_bounds.intersects(triangle_bounds);
         bool is_in_child1 = child1_bounds.intersects(triangle_bounds);
 
         if (!is_in_child0 && is_in_child1)
-            child1_triangles.push_back(std::move(triangle));
+            child1_triangles.push_back(triangle);
         else if (is_in_child0 && is_in_child1)
         {
             *child0_new_end++ = triangle;
             child1_triangles.push_back(triangle);
         }
         else if (is_in_child0 && !is_in_child1)
-            *child0_new_end++ = std::move(triangle);
+            *child0_new_end++ = triangle;
     }
 
     child0_triangles.erase(child0_new_end, child0_triangles.end());
 
     // TODO: compress these ifs
     if (child0_triangles.size() > 0) {
-        int child0_index = acceleration_tree.size();
-        acceleration_tree.emplace_back(AccelerationTreeNode {
-            .triangles = {},
-            .bounds = child0_bounds,
-            .children_indices = { -1, -1 },
-            .parent_index = parent_index
-        });
-        acceleration_tree[parent_index].children_indices[0] = child0_index;
-        build_branch(acceleration_tree, child0_index, std::move(child0_triangles), depth + 1);
+        int child0_index = add_node(acceleration_tree, child0_bounds, parent_index);
+        acceleration_tree.nodes[parent_index].children_indices[0] = child0_index;
+        build_branch(acceleration_tree, geometry, child0_index, std::move(child0_triangles), depth + 1);
     }
     if (child1_triangles.size() > 0) {
-        int child1_index = acceleration_tree.size();
-        acceleration_tree.emplace_back(AccelerationTreeNode {
-            .triangles = {},
-            .bounds = child1_bounds,
-            .children_indices = { -1, -1 },
-            .parent_index = parent_index
-        });
-        acceleration_tree[parent_index].children_indices[1] = child1_index;
-        build_branch(acceleration_tree, child1_index, std::move(child1_triangles), depth + 1);
+        int child1_index = add_node(acceleration_tree, child1_bounds, parent_index);
+        acceleration_tree.nodes[parent_index].children_indices[1] = child1_index;
+        build_branch(acceleration_tree, geometry, child1_index, std::move(child1_triangles), depth + 1);
     }
 }
 
-AccelerationTree build(std::vector<Triangle> triangles) {
+AccelerationTree build(const Geometry &geometry) {
+    ScopedStatTimer timer{ StatTimer::AccelerationTreeBuild };
+    TraceScope trace_scope{ "build_acceleration_tree", { "triangles", geometry.triangle_count() } };
+
     // Build bounding box, encapsulating the triangles
     AABB bounds = AABB::vacuum();
 
     // FIXME: we might be duplicating some vertices in the check
-    for (const auto &triangle : triangles) {
-        union_triangle_aabb(bounds, triangle);
+    std::vector<uint32_t> triangle_indices(geometry.triangle_count());
+    for (uint32_t triangle = 0; triangle < geometry.triangle_count(); ++triangle) {
+        union_triangle_aabb(bounds, geometry, triangle);
+        triangle_indices[triangle] = triangle;
     }
 
     AccelerationTree acceleration_tree;
+    // NOTE: Triangles, which straddle a split, are in several leaves, so this is a lower bound
+    acceleration_tree.triangle_indices.reserve(geometry.triangle_count());
     // Insert root node
-    acceleration_tree.emplace_back(AccelerationTreeNode {
-        .triangles = {},
-        .bounds = bounds,
-        .children_indices = { -1, -1 },
-        .parent_index = -1,
-    });
-    build_branch(acceleration_tree, 0, std::move(triangles), 0);
+    add_node(acceleration_tree, bounds, -1);
+    build_branch(acceleration_tree, geometry, 0, std::move(triangle_indices), 0);
+    acceleration_tree.nodes.shrink_to_fit();
+    acceleration_tree.triangle_indices.shrink_to_fit();
+#ifdef CRT_SIMD
+    make_leaf_packets(acceleration_tree, geometry);
+#endif
     return acceleration_tree;
 }
 
+void refit(AccelerationTree &acceleration_tree, const Geometry &geometry) {
+    // NOTE: Children are always added after their parent, so walking the nodes backwards
+    //       visits every child before its parent.
+    for (auto node = acceleration_tree.nodes.rbegin(); node != acceleration_tree.nodes.rend(); ++node) {
+        node->bounds = AABB::vacuum();
+
+        if (node->is_leaf()) {
+            const std::span<const uint32_t> triangle_indices = acceleration_tree.get_triangle_indices(*node);
+            // Triangles, split between several leaves, are no longer clipped to the split planes
+            for (const uint32_t triangle : triangle_indices)
+                union_triangle_aabb(node->bounds, geometry, triangle);
+#ifdef CRT_SIMD
+            write_triangle_packets(geometry, triangle_indices, std::span{ acceleration_tree.triangle_packets }.subspan(node->first_packet, get_triangle_packet_count(node->triangle_count)));
+#endif
+            continue;
+        }
+
+        for (const int child_index : node->children_indices) {
+            if (child_index == -1)
+                continue;
+
+            const AABB &child_bounds = acceleration_tree.nodes[child_index].bounds;
+            for (int axis = 0; axis < 3; ++axis) {
+                node->bounds.min.data[axis] = std::min(node->bounds.min.data[axis], child_bounds.min.data[axis]);
+                node->bounds.max.data[axis] = std::max(node->bounds.max.data[axis], child_bounds.max.data[axis]);
+            }
+        }
+    }
+}
+
 } // acceleration_tree
 
 } // crt
\ No newline at end of file
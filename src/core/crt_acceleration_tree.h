@@ -1,10 +1,12 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <span>
 #include <vector>
 
 #include "crt_aabb.h"
-#include "crt_triangle.h"
+#include "crt_mesh.h"
 
 namespace crt {
 
@@ -12,22 +14,94 @@ namespace crt {
 inline constexpr int MAX_ACCELERATION_TREE_DEPTH = 39;
 inline constexpr int MAX_BOX_TRIANGLE_COUNT = 16;
 
+inline constexpr int TRIANGLE_PACKET_SIZE = 8;
+
+/**
+ * The vertex positions of up to 8 triangles of a leaf, transposed, so that they can be loaded straight into
+ * SIMD registers and tested together. Lanes past the last triangle of the leaf repeat the first triangle
+ * of the packet.
+ *
+ * NOTE: The triangle flags aren't copied in, but read from the Geometry while testing, as materials can
+ *       change them without touching the tree.
+ */
+struct alignas(32) TrianglePacket {
+    /**
+     * [vertex][axis][lane]
+     */
+    float positions[3][3][TRIANGLE_PACKET_SIZE];
+};
+
+// NOTE: The triangle count of a packet follows from the triangle count of its leaf. Storing it would pad
+//       the packet to 320 bytes.
+static_assert(sizeof(TrianglePacket) == 288);
+
 struct AccelerationTreeNode {
-    std::vector<Triangle> triangles;
     AABB bounds;
     std::array<int, 2> children_indices;
     int parent_index;
+    /**
+     * The triangles of a leaf are `triangle_count` indices into the triangle streams of the Geometry the tree
+     * was built for, starting at `first_triangle` in AccelerationTree::triangle_indices
+     */
+    uint32_t first_triangle;
+    uint32_t triangle_count;
+    /**
+     * The packets of a leaf start at `first_packet` in AccelerationTree::triangle_packets
+     */
+    uint32_t first_packet;
 
     constexpr bool is_leaf() const noexcept {
-        return triangles.size() > 0;
+        return triangle_count > 0;
+    }
+};
+
+/**
+ * The triangles of all leaves are kept in shared arrays, rather than in arrays of every leaf, so that a tree
+ * takes a few allocations, no matter its size, and is freed in one go.
+ */
+struct AccelerationTree {
+    /**
+     * Children are always after their parent. The root is the first node.
+     */
+    std::vector<AccelerationTreeNode> nodes;
+    std::vector<uint32_t> triangle_indices;
+    /**
+     * The triangles of every leaf, 8 per packet in the order of `triangle_indices`. Only filled with CRT_SIMD.
+     */
+    std::vector<TrianglePacket> triangle_packets;
+
+    bool empty() const noexcept {
+        return nodes.empty();
+    }
+
+    std::span<const uint32_t> get_triangle_indices(const AccelerationTreeNode &node) const noexcept {
+        return { triangle_indices.data() + node.first_triangle, node.triangle_count };
+    }
+
+    std::span<const TrianglePacket> get_triangle_packets(const AccelerationTreeNode &node) const noexcept {
+        return { triangle_packets.data() + node.first_packet, (node.triangle_count + TRIANGLE_PACKET_SIZE - 1) / TRIANGLE_PACKET_SIZE };
     }
 };
 
-using AccelerationTree = std::vector<AccelerationTreeNode>;
+/**
+ * Enough room for the nodes, which are waiting to be visited during a traversal: one sibling for every
+ * level above the deepest leaf, and both children of its parent
+ */
+inline constexpr int ACCELERATION_TREE_TRAVERSAL_STACK_SIZE = MAX_ACCELERATION_TREE_DEPTH + 2;
 
 namespace acceleration_tree {
 
-AccelerationTree build(std::vector<Triangle> triangles);
+AccelerationTree build(const Geometry &geometry);
+
+std::vector<TrianglePacket> make_triangle_packets(const Geometry &geometry, std::span<const uint32_t> triangle_indices);
+
+/**
+ * Recompute the bounds of the nodes after the vertices of `geometry` moved, keeping the topology of the tree.
+ *
+ * Much cheaper than a rebuild, but traversal gets slower, the further the vertices are from where the
+ * tree was built for. The triangles of `geometry` must be the same, that the tree was built for.
+ */
+void refit(AccelerationTree &acceleration_tree, const Geometry &geometry);
 
 } // acceleration_tree
 
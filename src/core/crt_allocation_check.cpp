@@ -0,0 +1,99 @@
+#include "crt_allocation_check.h"
+
+#ifdef CRT_CHECK_ALLOCATIONS
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace crt {
+
+namespace allocation_check {
+
+// NOTE: Trivial thread locals, so that reaching them never allocates
+static thread_local uint64_t t_allocation_count = 0;
+static thread_local bool t_allocations_allowed = false;
+
+uint64_t thread_allocation_count() noexcept {
+    return t_allocation_count;
+}
+
+void allow_allocations(const bool allow) noexcept {
+    t_allocations_allowed = allow;
+}
+
+bool are_allocations_allowed() noexcept {
+    return t_allocations_allowed;
+}
+
+void fail(const char *scope_name, const uint64_t allocation_count, const int x, const int y) noexcept {
+    std::fprintf(stderr, "Error: %llu heap allocations in %s at (%d, %d), which must not allocate\n",
+                 static_cast<unsigned long long>(allocation_count), scope_name, x, y);
+    std::abort();
+}
+
+static void *allocate(size_t size, const size_t alignment) {
+    if (!t_allocations_allowed)
+        t_allocation_count++;
+
+    if (size == 0)
+        size = 1;
+
+    void *memory = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        memory = std::malloc(size);
+    } else {
+#ifdef _WIN32
+        memory = _aligned_malloc(size, alignment);
+#else
+        // The size must be a multiple of the alignment
+        memory = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    }
+
+    if (!memory)
+        throw std::bad_alloc{};
+    return memory;
+}
+
+static void deallocate(void *memory, [[maybe_unused]] const size_t alignment) noexcept {
+#ifdef _WIN32
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(memory);
+        return;
+    }
+#endif
+    std::free(memory);
+}
+
+} // allocation_check
+
+} // crt
+
+// NOTE: The array and nothrow forms of new and delete default to these, so replacing these is enough
+//       to count every allocation.
+
+void *operator new(std::size_t size) {
+    return crt::allocation_check::allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return crt::allocation_check::allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *memory) noexcept {
+    crt::allocation_check::deallocate(memory, alignof(std::max_align_t));
+}
+
+void operator delete(void *memory, std::align_val_t alignment) noexcept {
+    crt::allocation_check::deallocate(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *memory, [[maybe_unused]] std::size_t size) noexcept {
+    crt::allocation_check::deallocate(memory, alignof(std::max_align_t));
+}
+
+void operator delete(void *memory, [[maybe_unused]] std::size_t size, std::align_val_t alignment) noexcept {
+    crt::allocation_check::deallocate(memory, static_cast<size_t>(alignment));
+}
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+
+namespace crt {
+
+namespace allocation_check {
+
+#ifdef CRT_CHECK_ALLOCATIONS
+/**
+ * Heap allocations of the calling thread so far, outside of AllowAllocationsScopes.
+ *
+ * Counted by the global operator new, which is replaced when CRT_CHECK_ALLOCATIONS is defined.
+ */
+uint64_t thread_allocation_count() noexcept;
+
+void allow_allocations(bool allow) noexcept;
+bool are_allocations_allowed() noexcept;
+
+/**
+ * Print where the allocations happened and abort.
+ */
+[[noreturn]] void fail(const char *scope_name, uint64_t allocation_count, int x, int y) noexcept;
+#endif
+
+} // allocation_check
+
+/**
+ * Abort when the calling thread allocates from the heap until the end of the scope, so that the code,
+ * which must not allocate (e.g. the render loop), is kept that way. Only checked with CRT_CHECK_ALLOCATIONS.
+ *
+ * @warning The name must be a string literal (or otherwise outlive the scope).
+ */
+class NoAllocationsScope {
+public:
+#ifdef CRT_CHECK_ALLOCATIONS
+    explicit NoAllocationsScope(const char *name, int x = 0, int y = 0) noexcept
+        : m_name(name)
+        , m_x(x)
+        , m_y(y)
+        , m_allocation_count(allocation_check::thread_allocation_count())
+    {}
+
+    ~NoAllocationsScope() {
+        const uint64_t allocation_count = allocation_check::thread_allocation_count() - m_allocation_count;
+        if (allocation_count > 0)
+            allocation_check::fail(m_name, allocation_count, m_x, m_y);
+    }
+#else
+    explicit NoAllocationsScope([[maybe_unused]] const char *name, [[maybe_unused]] int x = 0, [[maybe_unused]] int y = 0) noexcept {}
+#endif
+
+    NoAllocationsScope(const NoAllocationsScope &) = delete;
+    NoAllocationsScope &operator=(const NoAllocationsScope &) = delete;
+
+private:
+#ifdef CRT_CHECK_ALLOCATIONS
+    const char *m_name;
+    int m_x, m_y;
+    uint64_t m_allocation_count;
+#endif
+};
+
+/**
+ * Allocations until the end of the scope are expected (e.g. loading a texture page on demand), so they
+ * don't fail an enclosing NoAllocationsScope.
+ */
+class AllowAllocationsScope {
+public:
+#ifdef CRT_CHECK_ALLOCATIONS
+    AllowAllocationsScope() noexcept
+        : m_previous(allocation_check::are_allocations_allowed())
+    {
+        allocation_check::allow_allocations(true);
+    }
+
+    ~AllowAllocationsScope() {
+        allocation_check::allow_allocations(m_previous);
+    }
+#else
+    AllowAllocationsScope() noexcept {}
+#endif
+
+    AllowAllocationsScope(const AllowAllocationsScope &) = delete;
+    AllowAllocationsScope &operator=(const AllowAllocationsScope &) = delete;
+
+private:
+#ifdef CRT_CHECK_ALLOCATIONS
+    bool m_previous;
+#endif
+};
+
+}
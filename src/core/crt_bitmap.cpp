@@ -0,0 +1,305 @@
+#include "crt_bitmap.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "crt_half.h"
+#include "crt_parallel.h"
+#include "crt_texture_pages.h"
+
+namespace crt {
+
+static constexpr int TILE_TEXEL_COUNT = BITMAP_TILE_SIZE * BITMAP_TILE_SIZE;
+static constexpr int TILE_SIZE_LOG2 = std::countr_zero(static_cast<unsigned>(BITMAP_TILE_SIZE));
+static_assert((1 << TILE_SIZE_LOG2) == BITMAP_TILE_SIZE, "BITMAP_TILE_SIZE must be a power of 2");
+
+/**
+ * Spread the low 3 bits of `value` over the even bits of the result.
+ */
+static constexpr uint32_t part_1_by_1(uint32_t value) noexcept {
+    value = (value | (value << 2)) & 0x33u;
+    value = (value | (value << 1)) & 0x55u;
+    return value;
+}
+
+static constexpr uint32_t morton_index(const int x, const int y) noexcept {
+    static_assert(BITMAP_TILE_SIZE <= 8, "part_1_by_1 only handles 3 bits per coordinate");
+    return part_1_by_1(x) | (part_1_by_1(y) << 1);
+}
+
+static constexpr int PAGE_TILE_COUNT_X = TEXTURE_PAGE_SIZE / BITMAP_TILE_SIZE;
+
+/**
+ * Index of a texel within its page, laid out like the tiles of a level
+ */
+static constexpr size_t page_texel_index(const int page_x, const int page_y) noexcept {
+    const size_t tile_index = static_cast<size_t>(page_y >> TILE_SIZE_LOG2) * PAGE_TILE_COUNT_X + (page_x >> TILE_SIZE_LOG2);
+    return tile_index * TILE_TEXEL_COUNT + morton_index(page_x & (BITMAP_TILE_SIZE - 1), page_y & (BITMAP_TILE_SIZE - 1));
+}
+
+static constexpr int wrap(const int coordinate, const int size) noexcept {
+    const int result = coordinate % size;
+    return result < 0 ? result + size : result;
+}
+
+static constexpr size_t get_texel_size(const BitmapFormat format) noexcept {
+    switch (format) {
+        case BitmapFormat::RGBA8:
+            return 4 * sizeof(uint8_t);
+        case BitmapFormat::RGBA16F:
+            return 4 * sizeof(uint16_t);
+    }
+    std::unreachable();
+}
+
+Bitmap::Bitmap(const int width, const int height, const BitmapFormat format, const bool allocate_texels)
+    : m_format(format)
+    , m_texel_size(get_texel_size(format))
+{
+    assert(width > 0 && height > 0);
+
+    size_t texel_count = 0, page_count = 0;
+    int level_width = width, level_height = height;
+    for (;;) {
+        const int tile_count_x = (level_width + BITMAP_TILE_SIZE - 1) / BITMAP_TILE_SIZE;
+        const int tile_count_y = (level_height + BITMAP_TILE_SIZE - 1) / BITMAP_TILE_SIZE;
+        const int page_count_x = (level_width + TEXTURE_PAGE_SIZE - 1) / TEXTURE_PAGE_SIZE;
+        const int page_count_y = (level_height + TEXTURE_PAGE_SIZE - 1) / TEXTURE_PAGE_SIZE;
+        m_levels.push_back(Level {
+            .width = level_width,
+            .height = level_height,
+            .tile_count_x = tile_count_x,
+            .offset = texel_count,
+            .page_count_x = page_count_x,
+            .first_page = page_count,
+        });
+        texel_count += static_cast<size_t>(tile_count_x) * tile_count_y * TILE_TEXEL_COUNT;
+        page_count += static_cast<size_t>(page_count_x) * page_count_y;
+
+        if (level_width == 1 && level_height == 1)
+            break;
+        level_width = std::max(1, level_width / 2);
+        level_height = std::max(1, level_height / 2);
+    }
+
+    if (allocate_texels)
+        m_texels.resize(texel_count * m_texel_size);
+}
+
+Bitmap Bitmap::from_rgba8(const int width, const int height, std::span<const uint8_t> rgba) {
+    assert(rgba.size() == static_cast<size_t>(width) * height * 4);
+
+    Bitmap result{ width, height, BitmapFormat::RGBA8 };
+    const Level &level = result.m_levels[0];
+
+    parallel_for_chunks(0, height, 64, [&](int begin_y, int end_y) {
+        for (int y = begin_y; y < end_y; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const size_t index = result.texel_index(level, x, y);
+                std::memcpy(&result.m_texels[index * result.m_texel_size], &rgba[(static_cast<size_t>(y) * width + x) * 4], 4);
+            }
+        }
+    });
+
+    result.generate_mip_chain();
+    return result;
+}
+
+Bitmap Bitmap::from_rgba_float(const int width, const int height, std::span<const float> rgba) {
+    assert(rgba.size() == static_cast<size_t>(width) * height * 4);
+
+    Bitmap result{ width, height, BitmapFormat::RGBA16F };
+    const Level &level = result.m_levels[0];
+
+    parallel_for_chunks(0, height, 64, [&](int begin_y, int end_y) {
+        for (int y = begin_y; y < end_y; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const float *channels = &rgba[(static_cast<size_t>(y) * width + x) * 4];
+                result.store(result.texel_index(level, x, y), { channels[0], channels[1], channels[2], channels[3] });
+            }
+        }
+    });
+
+    result.generate_mip_chain();
+    return result;
+}
+
+size_t Bitmap::texel_index(const Level &level, const int x, const int y) const noexcept {
+    const size_t tile_index = static_cast<size_t>(y >> TILE_SIZE_LOG2) * level.tile_count_x + (x >> TILE_SIZE_LOG2);
+    return level.offset + tile_index * TILE_TEXEL_COUNT + morton_index(x & (BITMAP_TILE_SIZE - 1), y & (BITMAP_TILE_SIZE - 1));
+}
+
+Bitmap::Texel Bitmap::decode(const std::byte *texel) const noexcept {
+    switch (m_format) {
+        case BitmapFormat::RGBA8: {
+            uint8_t channels[4];
+            std::memcpy(channels, texel, sizeof(channels));
+            return { channels[0] / 255.0f, channels[1] / 255.0f, channels[2] / 255.0f, channels[3] / 255.0f };
+        }
+
+        case BitmapFormat::RGBA16F: {
+            uint16_t channels[4];
+            std::memcpy(channels, texel, sizeof(channels));
+            return { half_to_float(channels[0]), half_to_float(channels[1]), half_to_float(channels[2]), half_to_float(channels[3]) };
+        }
+    }
+
+    std::unreachable();
+}
+
+Bitmap::Texel Bitmap::load(const size_t index) const noexcept {
+    return decode(&m_texels[index * m_texel_size]);
+}
+
+/**
+ * The pages, which the thread has used last, so that a run of lookups in the same page only goes to
+ * the shared TexturePageCache once
+ */
+struct RecentPage {
+    uint64_t file_id{ 0 };
+    size_t page_index{ 0 };
+    std::shared_ptr<const TexturePage> page;
+};
+
+static constexpr size_t RECENT_PAGE_COUNT = 8;
+
+static thread_local std::array<RecentPage, RECENT_PAGE_COUNT> recent_pages;
+
+Bitmap::Texel Bitmap::load_paged(const Level &level, const int x, const int y) const {
+    const size_t page_index = level.first_page + static_cast<size_t>(y / TEXTURE_PAGE_SIZE) * level.page_count_x + x / TEXTURE_PAGE_SIZE;
+    const uint64_t file_id = m_page_file->id();
+
+    // NOTE: File IDs are never reused, so a recent page can't be stale
+    RecentPage &recent_page = recent_pages[(page_index ^ file_id) % RECENT_PAGE_COUNT];
+    if (recent_page.file_id != file_id || recent_page.page_index != page_index || !recent_page.page) {
+        recent_page = RecentPage {
+            .file_id = file_id,
+            .page_index = page_index,
+            .page = m_page_file->page_cache().get(*m_page_file, page_index),
+        };
+    }
+
+    const size_t index = page_texel_index(x % TEXTURE_PAGE_SIZE, y % TEXTURE_PAGE_SIZE);
+    return decode(&(*recent_page.page)[index * m_texel_size]);
+}
+
+void Bitmap::store(const size_t index, const Texel &value) noexcept {
+    std::byte *texel = &m_texels[index * m_texel_size];
+
+    switch (m_format) {
+        case BitmapFormat::RGBA8: {
+            uint8_t channels[4];
+            for (int i = 0; i < 4; ++i)
+                channels[i] = static_cast<uint8_t>(std::lround(std::clamp(value[i], 0.0f, 1.0f) * 255.0f));
+            std::memcpy(texel, channels, sizeof(channels));
+            return;
+        }
+
+        case BitmapFormat::RGBA16F: {
+            uint16_t channels[4];
+            for (int i = 0; i < 4; ++i)
+                channels[i] = float_to_half(value[i]);
+            std::memcpy(texel, channels, sizeof(channels));
+            return;
+        }
+    }
+
+    std::unreachable();
+}
+
+void Bitmap::generate_mip_chain() {
+    for (size_t level_index = 1; level_index < m_levels.size(); ++level_index) {
+        const Level &source = m_levels[level_index - 1];
+        const Level &level = m_levels[level_index];
+
+        // 2x2 box filter. For odd source sizes the last row / column is dropped.
+        parallel_for_chunks(0, level.height, 64, [&](int begin_y, int end_y) {
+            for (int y = begin_y; y < end_y; ++y) {
+                const int y0 = std::min(2 * y, source.height - 1), y1 = std::min(2 * y + 1, source.height - 1);
+
+                for (int x = 0; x < level.width; ++x) {
+                    const int x0 = std::min(2 * x, source.width - 1), x1 = std::min(2 * x + 1, source.width - 1);
+
+                    const Texel t00 = load(texel_index(source, x0, y0)), t01 = load(texel_index(source, x1, y0));
+                    const Texel t10 = load(texel_index(source, x0, y1)), t11 = load(texel_index(source, x1, y1));
+
+                    Texel average;
+                    for (int i = 0; i < 4; ++i)
+                        average[i] = (t00[i] + t01[i] + t10[i] + t11[i]) * 0.25f;
+                    store(texel_index(level, x, y), average);
+                }
+            }
+        });
+    }
+}
+
+std::optional<Bitmap> Bitmap::open_paged(const std::filesystem::path &file_path, TexturePageCache &page_cache) {
+    std::shared_ptr<const TexturePageFile> page_file = TexturePageFile::open(file_path, page_cache);
+    if (!page_file)
+        return std::nullopt;
+
+    const TexturePageFileInfo &info = page_file->info();
+    Bitmap result{ info.width, info.height, info.format, false };
+    assert(get_texture_page_count(info.width, info.height) == result.m_levels.back().first_page + 1);
+    result.m_page_file = std::move(page_file);
+    return result;
+}
+
+bool Bitmap::write_pages(std::ostream &os) const {
+    assert(!is_paged());
+
+    if (!write_texture_page_file_header(os, TexturePageFileInfo { .format = m_format, .width = width(), .height = height() }))
+        return false;
+
+    TexturePage page(static_cast<size_t>(TEXTURE_PAGE_SIZE) * TEXTURE_PAGE_SIZE * m_texel_size);
+    for (const Level &level : m_levels) {
+        const int page_count_y = (level.height + TEXTURE_PAGE_SIZE - 1) / TEXTURE_PAGE_SIZE;
+        for (int page_y = 0; page_y < page_count_y; ++page_y) {
+            for (int page_x = 0; page_x < level.page_count_x; ++page_x) {
+                // NOTE: Texels past the edges of the level are padding
+                std::fill(page.begin(), page.end(), std::byte{ 0 });
+
+                const int x0 = page_x * TEXTURE_PAGE_SIZE, y0 = page_y * TEXTURE_PAGE_SIZE;
+                for (int y = y0; y < std::min(y0 + TEXTURE_PAGE_SIZE, level.height); ++y) {
+                    for (int x = x0; x < std::min(x0 + TEXTURE_PAGE_SIZE, level.width); ++x) {
+                        std::memcpy(&page[page_texel_index(x - x0, y - y0) * m_texel_size],
+                                    &m_texels[texel_index(level, x, y) * m_texel_size], m_texel_size);
+                    }
+                }
+                if (!os.write(reinterpret_cast<const char *>(page.data()), static_cast<std::streamsize>(page.size())))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+Color Bitmap::fetch(const int level_index, const int x, const int y) const {
+    const Level &level = m_levels[level_index];
+    assert(x >= 0 && x < level.width && y >= 0 && y < level.height);
+
+    const Texel texel = m_page_file ? load_paged(level, x, y) : load(texel_index(level, x, y));
+    return { texel[0], texel[1], texel[2] };
+}
+
+Color Bitmap::sample(const Vector &uv, const float footprint) const {
+    // Pick the level, where the footprint covers between one and two texels.
+    // NOTE: NaN footprints (degenerate UVs) fall back to the base level.
+    int level_index = 0;
+    const float texel_footprint = footprint * std::max(width(), height());
+    if (texel_footprint > 1.0f)
+        level_index = std::min(std::ilogb(texel_footprint), level_count() - 1);
+
+    const Level &level = m_levels[level_index];
+    const int x = wrap(static_cast<int>(std::floor(uv.x * level.width)), level.width);
+    const int y = wrap(static_cast<int>(std::floor((1.0f - uv.y) * level.height)), level.height);
+
+    return fetch(level_index, x, y);
+}
+
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <vector>
+
+#include "crt_image.h"
+#include "crt_vector.h"
+
+namespace crt {
+
+enum class BitmapFormat {
+    /**
+     * 8-bit unsigned normalized channels, for LDR images
+     */
+    RGBA8,
+    /**
+     * binary16 float channels, for HDR images
+     */
+    RGBA16F,
+};
+
+/**
+ * Texels are stored in square tiles of this size
+ */
+inline constexpr int BITMAP_TILE_SIZE = 8;
+
+class TexturePageCache;
+class TexturePageFile;
+
+/**
+ * Mipmapped texture image, stored in a compact texel format.
+ *
+ * Every level is split into BITMAP_TILE_SIZE x BITMAP_TILE_SIZE tiles and the texels of
+ * a tile are stored in Morton (Z) order, so that texels that are close in the image are
+ * also close in memory, no matter the direction the image is traversed in.
+ *
+ * A paged bitmap keeps its texels on disk instead (see TexturePageFile) and reads the pages,
+ * which are sampled, through a TexturePageCache.
+ */
+class Bitmap {
+public:
+    /**
+     * @param rgba `width * height * 4` channels, row-major, top to bottom
+     */
+    static Bitmap from_rgba8(int width, int height, std::span<const uint8_t> rgba);
+
+    /**
+     * @param rgba `width * height * 4` channels, row-major, top to bottom
+     */
+    static Bitmap from_rgba_float(int width, int height, std::span<const float> rgba);
+
+    /**
+     * Open a page file, written by write_pages(). Its pages are read on demand through `page_cache`,
+     * which must outlive the bitmap.
+     */
+    static std::optional<Bitmap> open_paged(const std::filesystem::path &file_path, TexturePageCache &page_cache);
+
+    /**
+     * Write all levels as a page file. Only for bitmaps, which are in memory.
+     */
+    bool write_pages(std::ostream &os) const;
+
+    int width() const noexcept {
+        return m_levels[0].width;
+    }
+
+    int height() const noexcept {
+        return m_levels[0].height;
+    }
+
+    int level_count() const noexcept {
+        return static_cast<int>(m_levels.size());
+    }
+
+    BitmapFormat format() const noexcept {
+        return m_format;
+    }
+
+    bool is_paged() const noexcept {
+        return m_page_file != nullptr;
+    }
+
+    /**
+     * Size of all texels of all levels, which are kept in memory, in bytes. None for paged bitmaps.
+     */
+    size_t memory_size() const noexcept {
+        return m_texels.size();
+    }
+
+    /**
+     * Nearest texel lookup, wrapping around the edges.
+     *
+     * @param footprint Width of the area, covered by the lookup, in UV space. It selects the mip level.
+     */
+    Color sample(const Vector &uv, float footprint) const;
+
+    Color fetch(int level, int x, int y) const;
+
+private:
+    using Texel = std::array<float, 4>;
+
+    struct Level {
+        int width, height;
+        int tile_count_x;
+        /**
+         * Index of the first texel of the level
+         */
+        size_t offset;
+        int page_count_x;
+        /**
+         * Index of the first page of the level in the page file
+         */
+        size_t first_page;
+    };
+
+    Bitmap(int width, int height, BitmapFormat format, bool allocate_texels = true);
+
+    size_t texel_index(const Level &level, int x, int y) const noexcept;
+    Texel decode(const std::byte *texel) const noexcept;
+    Texel load(size_t index) const noexcept;
+    Texel load_paged(const Level &level, int x, int y) const;
+    void store(size_t index, const Texel &texel) noexcept;
+
+    void generate_mip_chain();
+
+    BitmapFormat m_format;
+    size_t m_texel_size;
+    std::vector<Level> m_levels;
+    std::vector<std::byte> m_texels;
+    std::shared_ptr<const TexturePageFile> m_page_file;
+};
+
+}
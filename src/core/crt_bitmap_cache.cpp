@@ -0,0 +1,247 @@
+#include "crt_bitmap_cache.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "crt_image_stbi.h"
+#include "crt_texture_pages.h"
+#include "crt_trace.h"
+
+namespace crt {
+
+static std::optional<std::string> get_file_key(const std::filesystem::path &file_path) {
+    std::error_code error;
+    const std::filesystem::path canonical_path = std::filesystem::canonical(file_path, error);
+    if (error)
+        return std::nullopt;
+    const uintmax_t size = std::filesystem::file_size(canonical_path, error);
+    if (error)
+        return std::nullopt;
+    const std::filesystem::file_time_type write_time = std::filesystem::last_write_time(canonical_path, error);
+    if (error)
+        return std::nullopt;
+
+    return canonical_path.string() + '\n' + std::to_string(size) + '\n' + std::to_string(write_time.time_since_epoch().count());
+}
+
+static std::optional<std::vector<std::byte>> read_file(const std::filesystem::path &file_path) {
+    std::ifstream file{ file_path, std::ios::in | std::ios::binary | std::ios::ate };
+    if (!file.is_open())
+        return std::nullopt;
+
+    std::vector<std::byte> contents(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(contents.data()), static_cast<std::streamsize>(contents.size())))
+        return std::nullopt;
+    return contents;
+}
+
+/**
+ * 64-bit FNV-1a
+ */
+static uint64_t hash_bytes(std::span<const std::byte> bytes) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const std::byte byte : bytes) {
+        hash ^= static_cast<uint64_t>(byte);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static std::shared_ptr<const Bitmap> decode_bitmap(std::span<const std::byte> contents) {
+    TraceScope trace_scope{ "decode_bitmap" };
+    std::optional<Bitmap> decoded = read_stb_bitmap_from_memory(contents);
+    if (!decoded)
+        return nullptr;
+    return std::make_shared<const Bitmap>(std::move(*decoded));
+}
+
+static bool write_page_file(const Bitmap &bitmap, const std::filesystem::path &page_file_path) {
+    TraceScope trace_scope{ "write_texture_pages" };
+
+    std::error_code error;
+    std::filesystem::create_directories(page_file_path.parent_path(), error);
+
+    // NOTE: Written under a unique name and renamed, so that other threads and processes never open a partial file
+    std::filesystem::path temporary_path = page_file_path;
+    char temporary_suffix[32];
+    std::snprintf(temporary_suffix, sizeof(temporary_suffix), ".%08x.tmp", std::random_device{}());
+    temporary_path += temporary_suffix;
+    {
+        std::ofstream file{ temporary_path, std::ios::out | std::ios::binary };
+        if (!file.is_open())
+            return false;
+        if (!bitmap.write_pages(file) || !file.flush()) {
+            file.close();
+            std::filesystem::remove(temporary_path, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporary_path, page_file_path, error);
+    if (error) {
+        // NOTE: Another process could have won the race (renaming over an existing file fails on Windows)
+        std::filesystem::remove(temporary_path, error);
+        return std::filesystem::exists(page_file_path, error);
+    }
+    return true;
+}
+
+BitmapCache::BitmapCache(size_t memory_budget, std::filesystem::path page_directory)
+    : m_memory_budget(memory_budget)
+    , m_page_directory(std::move(page_directory))
+{
+}
+
+std::shared_ptr<const Bitmap> BitmapCache::load(const std::filesystem::path &file_path) {
+    std::optional<std::string> file_key = get_file_key(file_path);
+    if (!file_key)
+        return nullptr;
+
+    std::optional<BitmapFuture> cached;
+    {
+        std::scoped_lock lock{ m_mutex };
+        if (auto it = m_content_keys_by_file.find(*file_key); it != m_content_keys_by_file.end()) {
+            Entry &entry = m_entries.at(it->second);
+            m_stats.file_hits++;
+            touch(entry);
+            cached = entry.bitmap;
+        }
+    }
+    // NOTE: Waits, when another thread is still loading the file
+    if (cached)
+        return cached->get();
+
+    std::optional<std::vector<std::byte>> contents = read_file(file_path);
+    if (!contents)
+        return nullptr;
+
+    // NOTE: The size is part of the key, so that a collision would also need a file of the same size
+    const uint64_t content_hash = hash_bytes(*contents);
+    const std::string content_key = std::to_string(content_hash) + '\n' + std::to_string(contents->size());
+    char page_file_name[64];
+    std::snprintf(page_file_name, sizeof(page_file_name), "%016llx-%zu.crttex", static_cast<unsigned long long>(content_hash), contents->size());
+
+    std::promise<std::shared_ptr<const Bitmap>> promise;
+    {
+        std::scoped_lock lock{ m_mutex };
+        if (auto it = m_entries.find(content_key); it != m_entries.end()) {
+            Entry &entry = it->second;
+            // NOTE: Another thread could have started loading the same file in the meantime
+            if (m_content_keys_by_file.emplace(*file_key, content_key).second) {
+                m_stats.content_hits++;
+                entry.file_keys.push_back(*file_key);
+            } else {
+                m_stats.file_hits++;
+            }
+            touch(entry);
+            cached = entry.bitmap;
+        } else {
+            m_stats.misses++;
+            m_content_keys_by_file.insert_or_assign(*file_key, content_key);
+            m_lru.push_back(content_key);
+            m_entries.emplace(content_key, Entry {
+                .bitmap = promise.get_future().share(),
+                .memory_size = 0,
+                .loaded = false,
+                .file_keys = { *file_key },
+                .lru_position = std::prev(m_lru.end()),
+            });
+        }
+    }
+    if (cached)
+        return cached->get();
+
+    std::shared_ptr<const Bitmap> bitmap = m_page_directory.empty() ? decode_bitmap(*contents) : load_paged(*contents, page_file_name);
+    promise.set_value(bitmap);
+
+    std::scoped_lock lock{ m_mutex };
+    auto it = m_entries.find(content_key);
+    if (!bitmap) {
+        // NOTE: Not kept, so that the file is tried again by the next load
+        for (const std::string &key : it->second.file_keys) {
+            if (auto file_it = m_content_keys_by_file.find(key); file_it != m_content_keys_by_file.end() && file_it->second == content_key)
+                m_content_keys_by_file.erase(file_it);
+        }
+        m_lru.erase(it->second.lru_position);
+        m_entries.erase(it);
+        return nullptr;
+    }
+
+    it->second.loaded = true;
+    it->second.memory_size = bitmap->memory_size();
+    m_stats.bitmap_count++;
+    m_stats.memory_size += it->second.memory_size;
+    evict_over_budget();
+    return bitmap;
+}
+
+std::shared_ptr<const Bitmap> BitmapCache::load_paged(std::span<const std::byte> contents, const std::string &page_file_name) {
+    const std::filesystem::path page_file_path = m_page_directory / page_file_name;
+    if (std::optional<Bitmap> paged = Bitmap::open_paged(page_file_path, TexturePageCache::global()))
+        return std::make_shared<const Bitmap>(std::move(*paged));
+
+    // The image is converted once. Later loads, also by other processes, open the page file.
+    std::shared_ptr<const Bitmap> bitmap = decode_bitmap(contents);
+    if (!bitmap)
+        return nullptr;
+    if (write_page_file(*bitmap, page_file_path)) {
+        if (std::optional<Bitmap> paged = Bitmap::open_paged(page_file_path, TexturePageCache::global()))
+            return std::make_shared<const Bitmap>(std::move(*paged));
+    }
+    // NOTE: Kept in memory, when the page file can't be written
+    return bitmap;
+}
+
+size_t BitmapCache::memory_budget() const {
+    std::scoped_lock lock{ m_mutex };
+    return m_memory_budget;
+}
+
+void BitmapCache::set_memory_budget(size_t memory_budget) {
+    std::scoped_lock lock{ m_mutex };
+    m_memory_budget = memory_budget;
+    evict_over_budget();
+}
+
+BitmapCacheStats BitmapCache::stats() const {
+    std::scoped_lock lock{ m_mutex };
+    return m_stats;
+}
+
+void BitmapCache::touch(Entry &entry) {
+    m_lru.splice(m_lru.end(), m_lru, entry.lru_position);
+}
+
+void BitmapCache::evict_over_budget() {
+    for (auto lru_it = m_lru.begin(); lru_it != m_lru.end() && m_stats.memory_size > m_memory_budget;) {
+        auto it = m_entries.find(*lru_it);
+        Entry &entry = it->second;
+        // NOTE: The other references are held by scenes. A load, which is handing out an evicted bitmap at the
+        //       same time, keeps it alive through its copy of the future.
+        if (!entry.loaded || entry.bitmap.get().use_count() > 1) {
+            ++lru_it;
+            continue;
+        }
+
+        for (const std::string &key : entry.file_keys) {
+            if (auto file_it = m_content_keys_by_file.find(key); file_it != m_content_keys_by_file.end() && file_it->second == *lru_it)
+                m_content_keys_by_file.erase(file_it);
+        }
+        m_stats.evictions++;
+        m_stats.bitmap_count--;
+        m_stats.memory_size -= entry.memory_size;
+        lru_it = m_lru.erase(lru_it);
+        m_entries.erase(it);
+    }
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "crt_bitmap.h"
+
+namespace crt {
+
+struct BitmapCacheStats {
+    /**
+     * Loads of a file, which was already loaded
+     */
+    uint64_t file_hits{ 0 };
+    /**
+     * Loads of a file, which wasn't loaded, but has the same contents as one that was
+     */
+    uint64_t content_hits{ 0 };
+    /**
+     * Loads, which had to decode the file
+     */
+    uint64_t misses{ 0 };
+    /**
+     * Bitmaps dropped from the cache to stay within its memory budget
+     */
+    uint64_t evictions{ 0 };
+    /**
+     * Bitmaps in the cache
+     */
+    size_t bitmap_count{ 0 };
+    /**
+     * Size of the texels of the bitmaps in the cache, in bytes
+     */
+    size_t memory_size{ 0 };
+};
+
+/**
+ * Shares the bitmaps of image files between scenes, so that a texture, which is used by several of
+ * them, is decoded (and its mip chain built) only once.
+ *
+ * Files are recognized by their path, size and modification time, so a file, which was changed in the
+ * meantime, is loaded again. Files with the same contents are also recognized (by a hash of the contents),
+ * no matter their path.
+ *
+ * The bitmaps are reference counted: a scene keeps the bitmaps of its textures alive, even after they
+ * were evicted. When the bitmaps in the cache take more than the memory budget, the least recently loaded
+ * ones, which no scene uses anymore, are evicted. Bitmaps in use are never evicted, so the cache can go
+ * over its budget while they are.
+ *
+ * Thread-safe. Concurrent loads of the same file decode it once.
+ */
+class BitmapCache {
+public:
+    static constexpr size_t UNLIMITED_MEMORY_BUDGET = std::numeric_limits<size_t>::max();
+
+    /**
+     * @param page_directory When given, the bitmaps are paged (see Bitmap::open_paged()): every image is
+     *                       converted once into a page file in this directory, named by the hash of its
+     *                       contents, and its texels are read on demand through TexturePageCache::global().
+     */
+    explicit BitmapCache(size_t memory_budget = UNLIMITED_MEMORY_BUDGET, std::filesystem::path page_directory = {});
+
+    /**
+     * The bitmap of the image file, or nullptr when it can't be loaded.
+     */
+    std::shared_ptr<const Bitmap> load(const std::filesystem::path &file_path);
+
+    size_t memory_budget() const;
+    /**
+     * Evicts bitmaps right away, if the cache takes more than the new budget
+     */
+    void set_memory_budget(size_t memory_budget);
+
+    BitmapCacheStats stats() const;
+
+private:
+    using BitmapFuture = std::shared_future<std::shared_ptr<const Bitmap>>;
+
+    struct Entry {
+        BitmapFuture bitmap;
+        /**
+         * Zero until the bitmap is decoded
+         */
+        size_t memory_size{ 0 };
+        bool loaded{ false };
+        /**
+         * The keys in m_content_keys_by_file, which refer to this entry
+         */
+        std::vector<std::string> file_keys;
+        std::list<std::string>::iterator lru_position;
+    };
+
+    std::shared_ptr<const Bitmap> load_paged(std::span<const std::byte> contents, const std::string &page_file_name);
+
+    /**
+     * Moves the entry to the most recently used end. Requires m_mutex.
+     */
+    void touch(Entry &entry);
+    /**
+     * Requires m_mutex.
+     */
+    void evict_over_budget();
+
+    mutable std::mutex m_mutex;
+    size_t m_memory_budget;
+    const std::filesystem::path m_page_directory;
+    /**
+     * Keyed by the hash and size of the contents of the file
+     */
+    std::unordered_map<std::string, Entry> m_entries;
+    /**
+     * The content key of the entry, keyed by the path, size and modification time of the file
+     */
+    std::unordered_map<std::string, std::string> m_content_keys_by_file;
+    /**
+     * Content keys from the least to the most recently used
+     */
+    std::list<std::string> m_lru;
+    BitmapCacheStats m_stats;
+};
+
+}
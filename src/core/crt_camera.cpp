@@ -22,8 +22,12 @@ Ray Camera::generate_ray(int raster_x, int raster_y) const {
     ray.direction.x *= float(m_resolution_x) / m_resolution_y;
 
     // Apply FOV
-    ray.direction.x *= std::tan(m_fov_radians * 0.5f);
-    ray.direction.y *= std::tan(m_fov_radians * 0.5f);
+    const float tan_half_fov = std::tan(m_fov_radians * 0.5f);
+    ray.direction.x *= tan_half_fov;
+    ray.direction.y *= tan_half_fov;
+
+    // Angle, subtended by a single pixel (the cone starts as a point at the camera)
+    ray.cone_spread = 2.0f * tan_half_fov / m_resolution_y;
 
     ray.origin = m_transform.location;
 
@@ -63,6 +63,14 @@ public:
         return m_resolution_y;
     }
 
+    constexpr float fov_degrees() const {
+        return m_fov_radians * 180.0f / std::numbers::pi_v<float>;
+    }
+
+    constexpr const Transform &transform() const {
+        return m_transform;
+    }
+
 private:
     int m_resolution_x, m_resolution_y;
     float m_fov_radians;
@@ -0,0 +1,126 @@
+#include "crt_camera_path.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace crt {
+
+namespace {
+
+struct Quaternion {
+    float w, x, y, z;
+
+    constexpr float dot(const Quaternion &rhs) const {
+        return w * rhs.w + x * rhs.x + y * rhs.y + z * rhs.z;
+    }
+};
+
+}
+
+static Quaternion get_quaternion_from_matrix(const Matrix &matrix) {
+    const auto &m = matrix.data;
+    const float trace = m[0][0] + m[1][1] + m[2][2];
+
+    // NOTE: Divides by the largest of the 4 components, so that it stays accurate for any rotation
+    if (trace > 0.0f) {
+        const float s = 2.0f * std::sqrt(trace + 1.0f);
+        return { 0.25f * s, (m[2][1] - m[1][2]) / s, (m[0][2] - m[2][0]) / s, (m[1][0] - m[0][1]) / s };
+    }
+    if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+        const float s = 2.0f * std::sqrt(1.0f + m[0][0] - m[1][1] - m[2][2]);
+        return { (m[2][1] - m[1][2]) / s, 0.25f * s, (m[0][1] + m[1][0]) / s, (m[0][2] + m[2][0]) / s };
+    }
+    if (m[1][1] > m[2][2]) {
+        const float s = 2.0f * std::sqrt(1.0f + m[1][1] - m[0][0] - m[2][2]);
+        return { (m[0][2] - m[2][0]) / s, (m[0][1] + m[1][0]) / s, 0.25f * s, (m[1][2] + m[2][1]) / s };
+    }
+    const float s = 2.0f * std::sqrt(1.0f + m[2][2] - m[0][0] - m[1][1]);
+    return { (m[1][0] - m[0][1]) / s, (m[0][2] + m[2][0]) / s, (m[1][2] + m[2][1]) / s, 0.25f * s };
+}
+
+static Matrix get_matrix_from_quaternion(const Quaternion &q) {
+    const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    return {{
+        { 1.0f - 2.0f * (yy + zz),        2.0f * (xy - wz),        2.0f * (xz + wy) },
+        {        2.0f * (xy + wz), 1.0f - 2.0f * (xx + zz),        2.0f * (yz - wx) },
+        {        2.0f * (xz - wy),        2.0f * (yz + wx), 1.0f - 2.0f * (xx + yy) },
+    }};
+}
+
+static Quaternion slerp(const Quaternion &from, Quaternion to, const float t) {
+    float cos_angle = from.dot(to);
+    // q and -q are the same rotation, so take the one on the shorter arc
+    if (cos_angle < 0.0f) {
+        to = { -to.w, -to.x, -to.y, -to.z };
+        cos_angle = -cos_angle;
+    }
+
+    float from_weight = 1.0f - t;
+    float to_weight = t;
+    // NOTE: For (almost) equal rotations, the sine below is (almost) 0, and the linear interpolation is just as good
+    if (cos_angle < 0.9995f) {
+        const float angle = std::acos(cos_angle);
+        const float sin_angle = std::sin(angle);
+        from_weight = std::sin((1.0f - t) * angle) / sin_angle;
+        to_weight = std::sin(t * angle) / sin_angle;
+    }
+
+    Quaternion result{
+        from_weight * from.w + to_weight * to.w,
+        from_weight * from.x + to_weight * to.x,
+        from_weight * from.y + to_weight * to.y,
+        from_weight * from.z + to_weight * to.z,
+    };
+    const float inv_length = 1.0f / std::sqrt(result.dot(result));
+    return { result.w * inv_length, result.x * inv_length, result.y * inv_length, result.z * inv_length };
+}
+
+Camera CameraPath::get_camera(const int frame, const Camera &scene_camera) const {
+    assert(!keyframes.empty());
+
+    const auto get_fov_degrees = [&](const CameraKeyframe &keyframe) {
+        return keyframe.fov_degrees.value_or(scene_camera.fov_degrees());
+    };
+
+    // The first keyframe after the frame
+    const auto next_it = std::ranges::upper_bound(keyframes, frame, {}, &CameraKeyframe::frame);
+    if (next_it == keyframes.begin() || next_it == keyframes.end() || (next_it - 1)->frame == frame) {
+        // NOTE: Exactly on (or outside of) the keyframes, their transforms are used as is, without the rounding of the interpolation
+        const CameraKeyframe &keyframe = next_it == keyframes.begin() ? keyframes.front() : *(next_it - 1);
+        return Camera { scene_camera.resolution_x(), scene_camera.resolution_y(), get_fov_degrees(keyframe), keyframe.transform };
+    }
+
+    const CameraKeyframe &from = *(next_it - 1);
+    const CameraKeyframe &to = *next_it;
+    const float t = static_cast<float>(frame - from.frame) / (to.frame - from.frame);
+
+    const Quaternion rotation = slerp(get_quaternion_from_matrix(from.transform.rotation), get_quaternion_from_matrix(to.transform.rotation), t);
+    const Transform transform{
+        .location = from.transform.location * (1.0f - t) + to.transform.location * t,
+        .rotation = get_matrix_from_quaternion(rotation),
+    };
+    const float fov_degrees = get_fov_degrees(from) * (1.0f - t) + get_fov_degrees(to) * t;
+
+    return Camera { scene_camera.resolution_x(), scene_camera.resolution_y(), fov_degrees, transform };
+}
+
+Matrix get_look_at_rotation(const Vector &position, const Vector &target) {
+    const Vector forward = (target - position).normalized();
+
+    // NOTE: Looking straight up or down, the up axis is the view direction, so the right axis is taken from -Z instead
+    Vector right = forward.cross({ 0.0f, 1.0f, 0.0f });
+    if (right.length_squared() < 1e-12f)
+        right = forward.cross({ 0.0f, 0.0f, -1.0f });
+    right.normalize();
+
+    const Vector up = right.cross(forward);
+
+    // The camera looks down its -Z axis
+    return Matrix::from_axes(right, up, -forward);
+}
+
+}
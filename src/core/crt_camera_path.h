@@ -0,0 +1,49 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include "crt_camera.h"
+#include "crt_matrix.h"
+#include "crt_transform.h"
+#include "crt_vector.h"
+
+namespace crt {
+
+struct CameraKeyframe {
+    int frame;
+    /**
+     * The rotation must be orthonormal, as it's interpolated as a quaternion
+     */
+    Transform transform;
+    /**
+     * The FOV of the scene's camera is used, when it's not given
+     */
+    std::optional<float> fov_degrees;
+};
+
+/**
+ * A camera, which moves between keyframes.
+ *
+ * The positions and FOVs are interpolated linearly and the rotations spherically. Before the first
+ * keyframe and after the last one, the camera stays where they are.
+ */
+struct CameraPath {
+    /**
+     * Sorted by frame, at most one per frame and never empty
+     */
+    std::vector<CameraKeyframe> keyframes;
+    int frame_count;
+
+    /**
+     * The camera of `scene_camera` (its resolution and FOV) moved to where it's at `frame`.
+     */
+    Camera get_camera(int frame, const Camera &scene_camera) const;
+};
+
+/**
+ * The rotation of a camera at `position`, which looks at `target` with the +Y axis up.
+ */
+Matrix get_look_at_rotation(const Vector &position, const Vector &target);
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+namespace crt {
+
+/**
+ * Convert a float to an IEEE 754 binary16 bit pattern (round to nearest even).
+ */
+constexpr uint16_t float_to_half(const float value) noexcept {
+    const uint32_t bits = std::bit_cast<uint32_t>(value);
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t exponent = (bits >> 23) & 0xffu;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    // NaN and infinity
+    if (exponent == 0xffu)
+        return sign | 0x7c00u | (mantissa ? 0x200u : 0u);
+
+    const int half_exponent = static_cast<int>(exponent) - 127 + 15;
+
+    // Overflow to infinity
+    if (half_exponent >= 0x1f)
+        return sign | 0x7c00u;
+
+    // Subnormal or zero
+    if (half_exponent <= 0) {
+        if (half_exponent < -10)
+            return sign;
+
+        mantissa |= 0x800000u;
+        const uint32_t shift = 14 - half_exponent;
+        uint32_t half_mantissa = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half_mantissa & 1u)))
+            ++half_mantissa;
+        return sign | half_mantissa;
+    }
+
+    uint32_t half = sign | (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+    const uint32_t remainder = mantissa & 0x1fffu;
+    // A carry out of the mantissa correctly bumps the exponent
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+        ++half;
+    return static_cast<uint16_t>(half);
+}
+
+/**
+ * Convert an IEEE 754 binary16 bit pattern to a float.
+ */
+constexpr float half_to_float(const uint16_t half) noexcept {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+
+    if (exponent == 0x1fu)
+        return std::bit_cast<float>(sign | 0x7f800000u | (mantissa << 13));
+
+    if (exponent == 0) {
+        if (mantissa == 0)
+            return std::bit_cast<float>(sign);
+
+        // Normalize the subnormal
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400u)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        mantissa &= 0x3ffu;
+        return std::bit_cast<float>(sign | (exponent << 23) | (mantissa << 13));
+    }
+
+    return std::bit_cast<float>(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+}
@@ -0,0 +1,27 @@
+#include "crt_image_encoder.h"
+
+#include <algorithm>
+
+#include "crt_parallel.h"
+
+namespace crt {
+
+static constexpr int ENCODER_MIN_ROWS_PER_THREAD = 32;
+
+void write_image(const Image &image, const RowEncoder &encoder, std::ostream &os) {
+    std::string buffer(encoder.header.size() + encoder.row_size * image.height, '\0');
+    std::copy(encoder.header.begin(), encoder.header.end(), buffer.begin());
+    uint8_t *data = reinterpret_cast<uint8_t *>(buffer.data() + encoder.header.size());
+
+    parallel_for_chunks(0, image.height, ENCODER_MIN_ROWS_PER_THREAD, [&](int row_begin, int row_end) {
+        for (int raster_y = row_begin; raster_y < row_end; ++raster_y) {
+            const int row_index = encoder.bottom_to_top ? image.height - raster_y - 1 : raster_y;
+            std::span<const Color> row{ image.buffer.data() + raster_y * image.width, static_cast<size_t>(image.width) };
+            encoder.encode_row(row, raster_y, data + row_index * encoder.row_size);
+        }
+    });
+
+    os.write(buffer.data(), buffer.size());
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <string>
+
+#include "crt_image.h"
+
+namespace crt {
+
+/**
+ * Describes a file format as a fixed header, followed by fixed-size, independently encoded scanlines.
+ */
+struct RowEncoder {
+    std::string header;
+    size_t row_size;
+    /**
+     * Whether scanlines are stored from the bottom of the image to the top
+     */
+    bool bottom_to_top{ false };
+    /**
+     * Encode `row` (the scanline at `raster_y`) into `row_size` bytes at `out`. Must be thread safe.
+     */
+    std::function<void(std::span<const Color> row, int raster_y, uint8_t *out)> encode_row;
+};
+
+/**
+ * Encode all rows of `image` in parallel into a single buffer and write it with one call.
+ */
+void write_image(const Image &image, const RowEncoder &encoder, std::ostream &os);
+
+}
@@ -0,0 +1,151 @@
+#include "crt_image_exr.h"
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "crt_half.h"
+#include "crt_image.h"
+#include "crt_image_encoder.h"
+
+namespace crt {
+
+// See "The OpenEXR File Layout" (https://openexr.com/en/latest/OpenEXRFileLayout.html)
+static constexpr uint32_t EXR_MAGIC_NUMBER = 20000630;
+static constexpr uint32_t EXR_VERSION = 2;
+static constexpr uint32_t EXR_PIXEL_TYPE_HALF = 1;
+
+// Channels must be sorted by name. Indices are into Color::data.
+static constexpr struct { std::string_view name; int component; } EXR_CHANNELS[] = {
+    { "B", 2 },
+    { "G", 1 },
+    { "R", 0 },
+};
+
+namespace {
+
+class ExrHeaderWriter {
+public:
+    explicit ExrHeaderWriter(std::string &buffer) : m_buffer(buffer) {}
+
+    void u8(uint8_t value) {
+        m_buffer.push_back(static_cast<char>(value));
+    }
+
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i)
+            u8(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    void i32(int32_t value) {
+        u32(static_cast<uint32_t>(value));
+    }
+
+    void f32(float value) {
+        u32(std::bit_cast<uint32_t>(value));
+    }
+
+    void string(std::string_view value) {
+        m_buffer.append(value);
+        u8(0);
+    }
+
+    void attribute(std::string_view name, std::string_view type, uint32_t size) {
+        string(name);
+        string(type);
+        u32(size);
+    }
+
+private:
+    std::string &m_buffer;
+};
+
+}
+
+RowEncoder make_exr_encoder(int width, int height) {
+    std::string buffer;
+    ExrHeaderWriter header{ buffer };
+
+    header.u32(EXR_MAGIC_NUMBER);
+    header.u32(EXR_VERSION);
+
+    uint32_t channel_list_size = 1;
+    for (const auto &channel : EXR_CHANNELS)
+        channel_list_size += channel.name.size() + 1 + 16;
+
+    header.attribute("channels", "chlist", channel_list_size);
+    for (const auto &channel : EXR_CHANNELS) {
+        header.string(channel.name);
+        header.u32(EXR_PIXEL_TYPE_HALF);
+        header.u32(0); // pLinear + reserved
+        header.i32(1); // xSampling
+        header.i32(1); // ySampling
+    }
+    header.u8(0);
+
+    header.attribute("compression", "compression", 1);
+    header.u8(0); // NO_COMPRESSION
+
+    for (std::string_view window : { "dataWindow", "displayWindow" }) {
+        header.attribute(window, "box2i", 16);
+        header.i32(0);
+        header.i32(0);
+        header.i32(width - 1);
+        header.i32(height - 1);
+    }
+
+    header.attribute("lineOrder", "lineOrder", 1);
+    header.u8(0); // INCREASING_Y
+
+    header.attribute("pixelAspectRatio", "float", 4);
+    header.f32(1.0f);
+
+    header.attribute("screenWindowCenter", "v2f", 8);
+    header.f32(0.0f);
+    header.f32(0.0f);
+
+    header.attribute("screenWindowWidth", "float", 4);
+    header.f32(1.0f);
+
+    header.u8(0); // End of header
+
+    // Every uncompressed scanline block has the same size, so the offset table can be written upfront
+    const size_t pixel_data_size = width * std::size(EXR_CHANNELS) * sizeof(uint16_t);
+    const size_t block_size = 2 * sizeof(uint32_t) + pixel_data_size;
+    const size_t first_block_offset = buffer.size() + height * sizeof(uint64_t);
+
+    for (int raster_y = 0; raster_y < height; ++raster_y) {
+        const uint64_t offset = first_block_offset + raster_y * block_size;
+        header.u32(static_cast<uint32_t>(offset));
+        header.u32(static_cast<uint32_t>(offset >> 32));
+    }
+
+    return RowEncoder {
+        .header = std::move(buffer),
+        .row_size = block_size,
+        .encode_row = [=](std::span<const Color> row, int raster_y, uint8_t *out) {
+            auto put_u32 = [&](uint32_t value) {
+                for (int i = 0; i < 4; ++i)
+                    *out++ = static_cast<uint8_t>(value >> (8 * i));
+            };
+            put_u32(static_cast<uint32_t>(raster_y));
+            put_u32(static_cast<uint32_t>(pixel_data_size));
+
+            // Within a scanline, pixels are grouped by channel
+            for (const auto &channel : EXR_CHANNELS) {
+                for (const Color &pixel : row) {
+                    const uint16_t half = float_to_half(pixel.data[channel.component]);
+                    *out++ = static_cast<uint8_t>(half);
+                    *out++ = static_cast<uint8_t>(half >> 8);
+                }
+            }
+        },
+    };
+}
+
+void write_exr(const Image &image, std::ostream &os) {
+    write_image(image, make_exr_encoder(image.width, image.height), os);
+}
+
+}
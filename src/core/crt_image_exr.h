@@ -0,0 +1,17 @@
+#pragma once
+
+#include <ostream>
+
+#include "crt_image.h"
+#include "crt_image_encoder.h"
+
+namespace crt {
+
+/**
+ * Single-part, scanline OpenEXR file with uncompressed half float R, G and B channels.
+ */
+RowEncoder make_exr_encoder(int width, int height);
+
+void write_exr(const Image &image, std::ostream &os);
+
+}
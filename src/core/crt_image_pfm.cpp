@@ -0,0 +1,36 @@
+#include "crt_image_pfm.h"
+
+#include <bit>
+#include <cstdint>
+#include <string>
+
+#include "crt_image.h"
+#include "crt_image_encoder.h"
+
+namespace crt {
+
+RowEncoder make_pfm_encoder(int width, int height) {
+    return RowEncoder {
+        // A negative scale marks the data as little endian
+        .header = "PF\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n-1.0\n",
+        .row_size = width * 3 * sizeof(float),
+        .bottom_to_top = true,
+        .encode_row = [](std::span<const Color> row, int, uint8_t *out) {
+            for (const Color &pixel : row) {
+                for (const float component : pixel.data) {
+                    const uint32_t bits = std::bit_cast<uint32_t>(component);
+                    *out++ = static_cast<uint8_t>(bits);
+                    *out++ = static_cast<uint8_t>(bits >> 8);
+                    *out++ = static_cast<uint8_t>(bits >> 16);
+                    *out++ = static_cast<uint8_t>(bits >> 24);
+                }
+            }
+        },
+    };
+}
+
+void write_pfm(const Image &image, std::ostream &os) {
+    write_image(image, make_pfm_encoder(image.width, image.height), os);
+}
+
+}
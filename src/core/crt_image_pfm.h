@@ -0,0 +1,17 @@
+#pragma once
+
+#include <ostream>
+
+#include "crt_image.h"
+#include "crt_image_encoder.h"
+
+namespace crt {
+
+/**
+ * Little endian, 3-channel Portable Float Map. Values are written unclamped.
+ */
+RowEncoder make_pfm_encoder(int width, int height);
+
+void write_pfm(const Image &image, std::ostream &os);
+
+}
@@ -1,25 +1,98 @@
 #include "crt_image_ppm.h"
 
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <optional>
+#include <string>
 
 #include "crt_image.h"
+#include "crt_image_encoder.h"
 
 namespace crt {
 
+RowEncoder make_ppm_encoder(int width, int height, int max_color_component) {
+    assert(max_color_component > 0 && max_color_component <= 65535);
+
+    const size_t bytes_per_component = max_color_component > 255 ? 2 : 1;
+
+    return RowEncoder {
+        .header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + '\n'
+            + std::to_string(max_color_component) + '\n',
+        .row_size = width * 3 * bytes_per_component,
+        .encode_row = [=](std::span<const Color> row, int, uint8_t *out) {
+            for (const Color &pixel : row) {
+                const Color color = pixel * max_color_component;
+                for (const float component : color.data) {
+                    const int value = std::clamp(static_cast<int>(component), 0, max_color_component);
+                    if (bytes_per_component == 2)
+                        *out++ = static_cast<uint8_t>(value >> 8);
+                    *out++ = static_cast<uint8_t>(value);
+                }
+            }
+        },
+    };
+}
+
 void write_ppm(const Image &image, std::ostream &os, int max_color_component) {
-    os << "P3\n"
-       << image.width << ' ' << image.height << '\n'
-       << max_color_component << '\n';
-
-    for (int raster_y = 0; raster_y < image.height; ++raster_y) {
-        for (int raster_x = 0; raster_x < image.width; ++raster_x) {
-            Color color = image.buffer[raster_y * image.width + raster_x] * max_color_component;
-            os << std::clamp(static_cast<int>(color.x), 0, max_color_component) << ' '
-               << std::clamp(static_cast<int>(color.y), 0, max_color_component) << ' '
-               << std::clamp(static_cast<int>(color.z), 0, max_color_component) << '\t';
+    write_image(image, make_ppm_encoder(image.width, image.height, max_color_component), os);
+}
+
+/**
+ * Read the next number of the header, skipping whitespace and comments
+ */
+static std::optional<int> read_header_value(std::istream &is) {
+    while (is >> std::ws && is.peek() == '#')
+        is.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+    int value;
+    if (!(is >> value) || value < 0)
+        return std::nullopt;
+    return value;
+}
+
+std::optional<Image> read_ppm(std::istream &is) {
+    char magic[2];
+    if (!is.read(magic, 2) || magic[0] != 'P' || (magic[1] != '3' && magic[1] != '6'))
+        return std::nullopt;
+    const bool is_binary = magic[1] == '6';
+
+    const std::optional<int> width = read_header_value(is);
+    const std::optional<int> height = read_header_value(is);
+    const std::optional<int> max_color_component = read_header_value(is);
+    if (!width || !height || !max_color_component || *max_color_component == 0 || *max_color_component > 65535)
+        return std::nullopt;
+
+    const size_t bytes_per_component = *max_color_component > 255 ? 2 : 1;
+    const float scale = 1.0f / *max_color_component;
+
+    Image image{ *width, *height };
+    if (is_binary) {
+        // NOTE: Exactly one whitespace character separates the header from the pixels
+        is.get();
+        for (Color &pixel : image.buffer) {
+            for (float &component : pixel.data) {
+                uint8_t bytes[2];
+                if (!is.read(reinterpret_cast<char *>(bytes), bytes_per_component))
+                    return std::nullopt;
+                const int value = bytes_per_component == 2 ? (bytes[0] << 8) | bytes[1] : bytes[0];
+                component = value * scale;
+            }
+        }
+    } else {
+        for (Color &pixel : image.buffer) {
+            for (float &component : pixel.data) {
+                int value;
+                if (!(is >> value))
+                    return std::nullopt;
+                component = value * scale;
+            }
         }
-        os << '\n';
     }
+
+    return image;
 }
 
-}
\ No newline at end of file
+}
@@ -1,11 +1,25 @@
 #pragma once
 
+#include <istream>
+#include <optional>
 #include <ostream>
 
 #include "crt_image.h"
+#include "crt_image_encoder.h"
 
 namespace crt {
 
+/**
+ * Binary (P6) PPM. Components are clamped to [0, max_color_component],
+ * which must be at most 65535. Values above 255 are written as 16-bit big endian.
+ */
+RowEncoder make_ppm_encoder(int width, int height, int max_color_component = 255);
+
 void write_ppm(const Image &image, std::ostream &os, int max_color_component = 255);
 
-}
\ No newline at end of file
+/**
+ * Read a plain (P3) or binary (P6) PPM. Components are normalized to [0, 1].
+ */
+std::optional<Image> read_ppm(std::istream &is);
+
+}
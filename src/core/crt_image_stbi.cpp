@@ -1,42 +1,61 @@
 #include "crt_image_stbi.h"
 
+#include <cstddef>
 #include <experimental/scope>
 #include <optional>
-#include <vector>
+#include <span>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#include "crt_image.h"
+#include "crt_bitmap.h"
 
 using std::experimental::scope_exit;
 
 namespace crt {
 
-std::optional<Image> read_stb(const std::filesystem::path &filename) {
+std::optional<Bitmap> read_stb_bitmap(const std::filesystem::path &filename) {
     int width, height, num_components;
-    uint8_t *buffer = stbi_load(filename.c_str(), &width, &height, &num_components, STBI_rgb);
+
+    // NOTE: stb converts any number of source channels to the requested RGBA
+    if (stbi_is_hdr(filename.c_str())) {
+        float *buffer = stbi_loadf(filename.c_str(), &width, &height, &num_components, STBI_rgb_alpha);
+        if (!buffer)
+            return std::nullopt;
+
+        scope_exit guard{ [&](){ stbi_image_free(buffer); } };
+        return Bitmap::from_rgba_float(width, height, std::span{ buffer, static_cast<size_t>(width) * height * 4 });
+    }
+
+    uint8_t *buffer = stbi_load(filename.c_str(), &width, &height, &num_components, STBI_rgb_alpha);
     if (!buffer)
         return std::nullopt;
 
     scope_exit guard{ [&](){ stbi_image_free(buffer); } };
+    return Bitmap::from_rgba8(width, height, std::span{ buffer, static_cast<size_t>(width) * height * 4 });
+}
 
-    if (num_components != 3)
-        return std::nullopt;
+std::optional<Bitmap> read_stb_bitmap_from_memory(std::span<const std::byte> file_contents) {
+    int width, height, num_components;
 
-    std::vector<Color> pixels;
-    pixels.reserve(width * height);
-    for (size_t i = 0; i < width * height * 3; i += 3) {
-        pixels.emplace_back(
-            Color {
-                buffer[i] / 255.0f,
-                buffer[i + 1] / 255.0f,
-                buffer[i + 2] / 255.0f
-            }
-        );
+    const auto *data = reinterpret_cast<const stbi_uc *>(file_contents.data());
+    const int size = static_cast<int>(file_contents.size());
+
+    if (stbi_is_hdr_from_memory(data, size)) {
+        float *buffer = stbi_loadf_from_memory(data, size, &width, &height, &num_components, STBI_rgb_alpha);
+        if (!buffer)
+            return std::nullopt;
+
+        scope_exit guard{ [&](){ stbi_image_free(buffer); } };
+        return Bitmap::from_rgba_float(width, height, std::span{ buffer, static_cast<size_t>(width) * height * 4 });
     }
 
-    return Image { width, height, std::move(pixels) };
+    uint8_t *buffer = stbi_load_from_memory(data, size, &width, &height, &num_components, STBI_rgb_alpha);
+    if (!buffer)
+        return std::nullopt;
+
+    scope_exit guard{ [&](){ stbi_image_free(buffer); } };
+    return Bitmap::from_rgba8(width, height, std::span{ buffer, static_cast<size_t>(width) * height * 4 });
 }
 
-}
\ No newline at end of file
+}
@@ -1,12 +1,23 @@
 #pragma once
 
+#include <cstddef>
 #include <filesystem>
 #include <optional>
+#include <span>
 
-#include "crt_image.h"
+#include "crt_bitmap.h"
 
 namespace crt {
 
-std::optional<Image> read_stb(const std::filesystem::path &filename);
+/**
+ * Load an image file as a mipmapped texture. HDR images (e.g. Radiance .hdr) are stored
+ * as half floats, all other images as 8-bit RGBA.
+ */
+std::optional<Bitmap> read_stb_bitmap(const std::filesystem::path &filename);
 
-}
\ No newline at end of file
+/**
+ * Like read_stb_bitmap(), but from the contents of an image file, which are already in memory.
+ */
+std::optional<Bitmap> read_stb_bitmap_from_memory(std::span<const std::byte> file_contents);
+
+}
@@ -0,0 +1,106 @@
+#include "crt_image_stream.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace crt {
+
+StreamingImageWriter::StreamingImageWriter(std::ostream &os, int width, int height, RowEncoder encoder)
+    : m_os(os)
+    , m_width(width)
+    , m_height(height)
+    , m_encoder(std::move(encoder))
+{
+    assert(!m_encoder.bottom_to_top);
+    m_os.write(m_encoder.header.data(), m_encoder.header.size());
+}
+
+void StreamingImageWriter::write_tile(const Tile &tile) {
+    {
+        std::scoped_lock lock{ m_mutex };
+
+        auto [it, inserted] = m_strips.try_emplace(tile.y);
+        Strip &strip = it->second;
+        if (inserted) {
+            strip.height = tile.height;
+            strip.remaining_pixel_count = m_width * tile.height;
+            strip.pixels.resize(m_width * tile.height);
+        }
+        assert(strip.height == tile.height);
+
+        for (int row = 0; row < tile.height; ++row) {
+            const auto row_pixels = tile.pixels.subspan(row * tile.width, tile.width);
+            std::copy(row_pixels.begin(), row_pixels.end(), strip.pixels.begin() + row * m_width + tile.x);
+        }
+        strip.remaining_pixel_count -= tile.width * tile.height;
+
+        take_completed_strips();
+        // NOTE: The thread, which is already writing, picks the strips up before it stops
+        if (m_completed_strips.empty() || m_is_writing)
+            return;
+        m_is_writing = true;
+    }
+
+    write_completed_strips();
+}
+
+bool StreamingImageWriter::is_complete() const {
+    std::scoped_lock lock{ m_mutex };
+    return m_written_row_count >= m_height;
+}
+
+bool StreamingImageWriter::has_failed() const {
+    std::scoped_lock lock{ m_mutex };
+    return m_has_failed;
+}
+
+void StreamingImageWriter::take_completed_strips() {
+    for (auto it = m_strips.begin(); it != m_strips.end() && it->first == m_next_row && it->second.remaining_pixel_count == 0; it = m_strips.erase(it)) {
+        m_next_row += it->second.height;
+        m_completed_strips.push_back(std::move(it->second));
+    }
+}
+
+void StreamingImageWriter::write_completed_strips() {
+    for (;;) {
+        bool has_failed;
+        int row_index;
+        {
+            std::scoped_lock lock{ m_mutex };
+            if (m_completed_strips.empty()) {
+                m_is_writing = false;
+                return;
+            }
+            std::swap(m_writing_strips, m_completed_strips);
+            has_failed = m_has_failed;
+            row_index = m_written_row_count;
+        }
+
+        int written_row_count = 0;
+        if (!has_failed) {
+            for (const Strip &strip : m_writing_strips) {
+                m_encoded_strip.resize(m_encoder.row_size * strip.height);
+                for (int row = 0; row < strip.height; ++row) {
+                    std::span<const Color> row_pixels{ strip.pixels.data() + row * m_width, static_cast<size_t>(m_width) };
+                    m_encoder.encode_row(row_pixels, row_index + row, m_encoded_strip.data() + row * m_encoder.row_size);
+                }
+
+                m_os.write(reinterpret_cast<const char *>(m_encoded_strip.data()), m_encoded_strip.size());
+                if (!m_os) {
+                    has_failed = true;
+                    break;
+                }
+                row_index += strip.height;
+                written_row_count += strip.height;
+            }
+        }
+        m_writing_strips.clear();
+
+        std::scoped_lock lock{ m_mutex };
+        m_written_row_count += written_row_count;
+        m_has_failed = has_failed;
+    }
+}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "crt_image.h"
+#include "crt_image_encoder.h"
+#include "crt_tile.h"
+
+namespace crt {
+
+/**
+ * Streams tiles to a file as soon as whole strips of rows are complete.
+ *
+ * Tiles are gathered into strips (all tiles sharing the same `y`). Completed strips are
+ * encoded and written in top-to-bottom order, so only the strips that are still being
+ * rendered (or are waiting for a strip above them) are held in memory.
+ *
+ * Strips are encoded and written without holding the lock of the strips, by one thread at a
+ * time: a thread, which completes strips, while another one is writing, leaves them to it,
+ * so render threads don't wait for the disk.
+ */
+class StreamingImageWriter : public TileSink {
+public:
+    /**
+     * @warning The encoder must store scanlines from top to bottom.
+     */
+    StreamingImageWriter(std::ostream &os, int width, int height, RowEncoder encoder);
+
+    void write_tile(const Tile &tile) override;
+
+    /**
+     * Whether all rows of the image have been written.
+     */
+    bool is_complete() const;
+
+    /**
+     * Whether writing to the stream failed (e.g. the disk is full). Rows after the failure are dropped.
+     */
+    bool has_failed() const;
+
+private:
+    struct Strip {
+        int height;
+        int remaining_pixel_count;
+        std::vector<Color> pixels;
+    };
+
+    /**
+     * Move the completed strips, which are next in the file, to `m_completed_strips`. Requires m_mutex.
+     */
+    void take_completed_strips();
+    /**
+     * Write the completed strips, until there are no more. Only called by the thread, which set `m_is_writing`.
+     */
+    void write_completed_strips();
+
+    std::ostream &m_os;
+    int m_width, m_height;
+    RowEncoder m_encoder;
+
+    mutable std::mutex m_mutex;
+    std::map<int, Strip> m_strips;
+    /**
+     * Completed strips, in the order they are written
+     */
+    std::vector<Strip> m_completed_strips;
+    /**
+     * The first row, which isn't completed yet
+     */
+    int m_next_row{ 0 };
+    int m_written_row_count{ 0 };
+    bool m_is_writing{ false };
+    bool m_has_failed{ false };
+
+    /**
+     * Only used by the writing thread
+     */
+    std::vector<Strip> m_writing_strips;
+    std::vector<uint8_t> m_encoded_strip;
+};
+
+}
@@ -0,0 +1,143 @@
+#include "crt_instance.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+#include "crt_aabb.h"
+#include "crt_matrix.h"
+#include "crt_stats.h"
+#include "crt_trace.h"
+#include "crt_vector.h"
+
+namespace crt {
+
+static AABB get_transformed_aabb(const AABB &box, const Transform &transform) noexcept {
+    AABB result = AABB::vacuum();
+
+    // An empty mesh stays empty, no matter where it's placed
+    if (box.min.x > box.max.x)
+        return result;
+
+    for (int corner = 0; corner < 8; ++corner) {
+        const Vector local_point{
+            (corner & 1) ? box.max.x : box.min.x,
+            (corner & 2) ? box.max.y : box.min.y,
+            (corner & 4) ? box.max.z : box.min.z,
+        };
+        const Vector world_point = local_point * transform.rotation + transform.location;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            result.min.data[axis] = std::min(result.min.data[axis], world_point.data[axis]);
+            result.max.data[axis] = std::max(result.max.data[axis], world_point.data[axis]);
+        }
+    }
+
+    return result;
+}
+
+Instance make_instance(int mesh_index, const Mesh &mesh, const Transform &transform) {
+    assert(!mesh.acceleration_tree.empty());
+
+    const Matrix inverse_rotation = transform.rotation.inverse();
+
+    return Instance {
+        .mesh_index = mesh_index,
+        .transform = transform,
+        .inverse_rotation = inverse_rotation,
+        .normal_matrix = inverse_rotation.transposed(),
+        .scale = std::cbrt(std::abs(transform.rotation.determinant())),
+        .bounds = get_transformed_aabb(mesh.acceleration_tree.nodes[0].bounds, transform),
+    };
+}
+
+namespace instance_tree {
+
+static void union_aabb(AABB &box, const AABB &other) noexcept {
+    for (int axis = 0; axis < 3; ++axis) {
+        box.min.data[axis] = std::min(box.min.data[axis], other.min.data[axis]);
+        box.max.data[axis] = std::max(box.max.data[axis], other.max.data[axis]);
+    }
+}
+
+static int add_node(InstanceTree &instance_tree, const AABB &bounds, const int parent_index) {
+    const int node_index = static_cast<int>(instance_tree.nodes.size());
+    instance_tree.nodes.emplace_back(InstanceTreeNode {
+        .bounds = bounds,
+        .children_indices = { -1, -1 },
+        .parent_index = parent_index,
+        .first_instance = 0,
+        .instance_count = 0,
+    });
+    return node_index;
+}
+
+static void make_leaf(InstanceTree &instance_tree, const int node_index, std::span<const int> instance_indices) {
+    InstanceTreeNode &node = instance_tree.nodes[node_index];
+    assert(!node.is_leaf());
+
+    node.first_instance = static_cast<uint32_t>(instance_tree.instance_indices.size());
+    node.instance_count = static_cast<uint32_t>(instance_indices.size());
+    instance_tree.instance_indices.insert(instance_tree.instance_indices.end(), instance_indices.begin(), instance_indices.end());
+}
+
+static void build_branch(InstanceTree &instance_tree, std::span<const Instance> instances, int parent_index, std::vector<int> instance_indices, int depth) {
+    if (depth > MAX_INSTANCE_TREE_DEPTH || instance_indices.size() <= MAX_BOX_INSTANCE_COUNT) {
+        make_leaf(instance_tree, parent_index, instance_indices);
+        return;
+    }
+
+    const auto [child0_bounds, child1_bounds] = instance_tree.nodes[parent_index].bounds.split(depth % 3); // Alternating the split axis
+
+    std::vector<int> child0_instance_indices, child1_instance_indices;
+    child0_instance_indices.reserve(instance_indices.size() / 2);
+    child1_instance_indices.reserve(instance_indices.size() / 2);
+
+    for (int instance_index : instance_indices) {
+        const AABB &instance_bounds = instances[instance_index].bounds;
+        if (child0_bounds.intersects(instance_bounds))
+            child0_instance_indices.push_back(instance_index);
+        if (child1_bounds.intersects(instance_bounds))
+            child1_instance_indices.push_back(instance_index);
+    }
+
+    // Large instances straddling the split plane can't be separated any further
+    if (child0_instance_indices.size() == instance_indices.size() && child1_instance_indices.size() == instance_indices.size()) {
+        make_leaf(instance_tree, parent_index, instance_indices);
+        return;
+    }
+
+    for (int child = 0; child < 2; ++child) {
+        std::vector<int> &child_instance_indices = child == 0 ? child0_instance_indices : child1_instance_indices;
+        if (child_instance_indices.empty())
+            continue;
+
+        int child_index = add_node(instance_tree, child == 0 ? child0_bounds : child1_bounds, parent_index);
+        instance_tree.nodes[parent_index].children_indices[child] = child_index;
+        build_branch(instance_tree, instances, child_index, std::move(child_instance_indices), depth + 1);
+    }
+}
+
+InstanceTree build(std::span<const Instance> instances) {
+    ScopedStatTimer timer{ StatTimer::AccelerationTreeBuild };
+    TraceScope trace_scope{ "build_instance_tree", { "instances", static_cast<int64_t>(instances.size()) } };
+
+    AABB bounds = AABB::vacuum();
+    for (const auto &instance : instances) {
+        union_aabb(bounds, instance.bounds);
+    }
+
+    std::vector<int> instance_indices(instances.size());
+    std::iota(instance_indices.begin(), instance_indices.end(), 0);
+
+    InstanceTree instance_tree;
+    // Insert root node
+    add_node(instance_tree, bounds, -1);
+    build_branch(instance_tree, instances, 0, std::move(instance_indices), 0);
+    return instance_tree;
+}
+
+} // instance_tree
+
+} // crt
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <vector>
+
+#include "crt_aabb.h"
+#include "crt_acceleration_tree.h"
+#include "crt_matrix.h"
+#include "crt_mesh.h"
+#include "crt_transform.h"
+
+namespace crt {
+
+inline constexpr int MAX_INSTANCE_TREE_DEPTH = 24;
+inline constexpr int MAX_BOX_INSTANCE_COUNT = 4;
+
+/**
+ * Geometry that is shared between instances. Vertices are in object space and the
+ * acceleration tree (BLAS) is built once, no matter how many times the mesh is placed.
+ */
+struct Mesh {
+    Geometry geometry;
+    AccelerationTree acceleration_tree;
+};
+
+/**
+ * A placement of a Mesh in the world.
+ *
+ * Object space points map to world space as `p * transform.rotation + transform.location`.
+ */
+struct Instance {
+    int mesh_index;
+    Transform transform;
+    /**
+     * Brings world space directions into object space
+     */
+    Matrix inverse_rotation;
+    /**
+     * Brings object space normals into world space (the inverse-transpose of the rotation)
+     */
+    Matrix normal_matrix;
+    /**
+     * Uniform approximation of the scale of the transform (cube root of its determinant), used
+     * to bring surface measurements, such as texture footprints, into world space
+     */
+    float scale;
+    /**
+     * World space bounds of the transformed mesh
+     */
+    AABB bounds;
+};
+
+Instance make_instance(int mesh_index, const Mesh &mesh, const Transform &transform);
+
+struct InstanceTreeNode {
+    AABB bounds;
+    std::array<int, 2> children_indices;
+    int parent_index;
+    /**
+     * The instances of a leaf are `instance_count` indices, starting at `first_instance` in
+     * InstanceTree::instance_indices
+     */
+    uint32_t first_instance;
+    uint32_t instance_count;
+
+    constexpr bool is_leaf() const noexcept {
+        return instance_count > 0;
+    }
+};
+
+/**
+ * Top-level acceleration structure (TLAS) over the instances in a scene.
+ *
+ * Like AccelerationTree, the instances of all leaves are kept in a shared array.
+ */
+struct InstanceTree {
+    std::vector<InstanceTreeNode> nodes;
+    std::vector<int> instance_indices;
+
+    bool empty() const noexcept {
+        return nodes.empty();
+    }
+
+    std::span<const int> get_instance_indices(const InstanceTreeNode &node) const noexcept {
+        return { instance_indices.data() + node.first_instance, node.instance_count };
+    }
+};
+
+inline constexpr int INSTANCE_TREE_TRAVERSAL_STACK_SIZE = MAX_INSTANCE_TREE_DEPTH + 2;
+
+namespace instance_tree {
+
+InstanceTree build(std::span<const Instance> instances);
+
+} // instance_tree
+
+} // crt
@@ -1,11 +1,18 @@
 #include "crt_intersection.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
 #include <cstdlib>
-#include <stack>
+#include <limits>
 
 #include "crt_acceleration_tree.h"
+#include "crt_instance.h"
 #include "crt_ray.h"
+#include "crt_mesh.h"
+#include "crt_simd.h"
+#include "crt_stats.h"
 #include "crt_triangle.h"
 #include "crt_vector.h"
 
@@ -44,59 +51,93 @@ bool ray_intersect_aabb_p(const Ray &ray, const AABB &aabb) {
     return false;
 }
 
-std::optional<Intersection> ray_intersect_triangle(const Ray &ray, const Triangle &triangle) {
-    const auto &[v0, v1, v2] = triangle.vertices();
-    const auto [e0, e1, e2] = triangle.edges();
+/**
+ * The Intersection with a triangle, which the ray is known to hit at `intersection_distance`
+ */
+static Intersection make_triangle_intersection(const Ray &ray, const Geometry &geometry, const uint32_t triangle_index, const float intersection_distance) {
+    const auto [i0, i1, i2] = geometry.triangle_vertex_indices(triangle_index);
+    const Vector &p0 = geometry.positions[i0], &p1 = geometry.positions[i1], &p2 = geometry.positions[i2];
+    const Vector v0v1 = p1 - p0, v0v2 = -(p0 - p2);
+    const Vector face_cross = v0v1.cross(v0v2);
+    const float face_cross_length = face_cross.length();
 
-    float ray_normal_dist = triangle.face_normal.dot(ray.direction);
+    const Vector intersection_point = ray.at(intersection_distance);
+    const Vector v0p = intersection_point - p0;
+    float bary_u = v0p.cross(v0v2).length() / face_cross_length;
+    float bary_v = v0v1.cross(v0p).length() / face_cross_length;
+    float bary_w = 1.0f - bary_u - bary_v;
+
+    Vector normal;
+    if (geometry.triangle_flags[triangle_index].smooth_shading) {
+        // NOTE: Interpolated unit vectors are shorter than 1
+        normal = (geometry.normals[i1].decode() * bary_u + geometry.normals[i2].decode() * bary_v + geometry.normals[i0].decode() * bary_w).normalize();
+    } else {
+        normal = face_cross / face_cross_length;
+    }
+
+    const Vector uv0 = geometry.uvs[i0].decode(), uv1 = geometry.uvs[i1].decode(), uv2 = geometry.uvs[i2].decode();
+    const Vector uv = uv1 * bary_u + uv2 * bary_v + uv0 * bary_w;
+
+    // NOTE: Both areas are doubled, which cancels out
+    const Vector uv_e0 = uv1 - uv0, uv_e1 = uv2 - uv0;
+    const float uv_area = std::abs(uv_e0.x * uv_e1.y - uv_e0.y * uv_e1.x);
+    const float uv_scale = std::sqrt(uv_area / face_cross_length);
+
+    return Intersection {
+        .distance = intersection_distance,
+        .point = intersection_point,
+        .normal = normal,
+        .uv = uv,
+        .bary_u = bary_u, .bary_v = bary_v,
+        .uv_scale = uv_scale,
+        .material_index = geometry.triangle_material_indices[triangle_index]
+    };
+}
+
+std::optional<Intersection> ray_intersect_triangle(const Ray &ray, const Geometry &geometry, const uint32_t triangle_index) {
+    const auto [i0, i1, i2] = geometry.triangle_vertex_indices(triangle_index);
+    const Vector &p0 = geometry.positions[i0], &p1 = geometry.positions[i1], &p2 = geometry.positions[i2];
+    const Vector e0 = p1 - p0, e1 = p2 - p1, e2 = p0 - p2;
+
+    // NOTE: The unit face normal isn't stored, but computed from the positions in the same steps as when
+    //       triangles cached it, so that the hits don't depend on how the vertex attributes are stored
+    const Vector face_cross = e0.cross(-e2);
+    const Vector face_normal = face_cross / face_cross.length();
+
+    float ray_normal_dist = face_normal.dot(ray.direction);
     bool is_parallel_to_plane = std::abs(ray_normal_dist) < 1e-6f;
     if (is_parallel_to_plane) {
         return std::nullopt;
     }
 
-    float origin_plane_dist = triangle.face_normal.dot(v0.position - ray.origin);
+    const TriangleFlags flags = geometry.triangle_flags[triangle_index];
+
+    float origin_plane_dist = face_normal.dot(p0 - ray.origin);
     bool is_front_face = origin_plane_dist < 0.0f;
-    if (is_front_face || !triangle.flags.back_face_culling) {
+    if (is_front_face || !flags.back_face_culling) {
         float intersection_distance = origin_plane_dist / ray_normal_dist;
         if (intersection_distance < 0.0f) {
             return std::nullopt;
         }
 
         Vector intersection_point = ray.at(intersection_distance);
-        Vector v0p = intersection_point - v0.position, v1p = intersection_point - v1.position, v2p = intersection_point - v2.position;
-        if (triangle.face_normal.dot(e0.cross(v0p)) >= 0.0f
-                && triangle.face_normal.dot(e1.cross(v1p)) >= 0.0f
-                && triangle.face_normal.dot(e2.cross(v2p)) >= 0.0f)
+        Vector v0p = intersection_point - p0, v1p = intersection_point - p1, v2p = intersection_point - p2;
+        if (face_normal.dot(e0.cross(v0p)) >= 0.0f
+                && face_normal.dot(e1.cross(v1p)) >= 0.0f
+                && face_normal.dot(e2.cross(v2p)) >= 0.0f)
         {
-            const Vector &v0v1 = e0;
-            Vector v0v2 = -e2;
-            float bary_u = v0p.cross(v0v2).length() / v0v1.cross(v0v2).length();
-            float bary_v = v0v1.cross(v0p).length() / v0v1.cross(v0v2).length();
-
-            const Vector smooth_normal = v1.normal * bary_u + v2.normal * bary_v + v0.normal * (1 - bary_u - bary_v);
-            const Vector normal = triangle.flags.smooth_shading ? smooth_normal : triangle.face_normal;
-
-            const Vector uv = v1.uv * bary_u + v2.uv * bary_v + v0.uv * (1.0f - bary_u - bary_v);
-
-            return Intersection {
-                .distance = intersection_distance,
-                .point = intersection_point,
-                .normal = normal,
-                .uv = uv,
-                .bary_u = bary_u, .bary_v = bary_v,
-                .material_index = triangle.material_index
-            };
+            return make_triangle_intersection(ray, geometry, triangle_index, intersection_distance);
         }
     }
 
     return std::nullopt;
 }
 
-std::optional<Intersection> ray_intersect_triangle_span(const Ray &ray, std::span<const Triangle> triangles) {
+std::optional<Intersection> ray_intersect_triangle_span(const Ray &ray, const Geometry &geometry, std::span<const uint32_t> triangle_indices) {
     std::optional<Intersection> closest_intersection = std::nullopt;
 
-    for (const auto &triangle : triangles) {
-        if (auto intersection = ray_intersect_triangle(ray, triangle)) {
+    for (const uint32_t triangle_index : triangle_indices) {
+        if (auto intersection = ray_intersect_triangle(ray, geometry, triangle_index)) {
             if (!closest_intersection || intersection->distance < closest_intersection->distance) {
                 closest_intersection = intersection;
             }
@@ -106,32 +147,186 @@ std::optional<Intersection> ray_intersect_triangle_span(const Ray &ray, std::spa
     return closest_intersection;
 }
 
-std::optional<Intersection> ray_intersect_acceleration_tree(const Ray &ray, const AccelerationTree &acceleration_tree) {
+#ifdef CRT_SIMD
+/**
+ * Distances to the 8 triangles of the packet at once, following the same steps as ray_intersect_triangle(),
+ * so that a triangle is hit at the same distance as there. Lanes of misses (and unused lanes) are +inf.
+ */
+static Float8 ray_intersect_triangle_packet_distances(const Ray &ray, const TrianglePacket &packet, const Float8 &back_face_culling) {
+    const auto load_vertex = [&](const int vertex) {
+        return Vector8{ Float8::load(packet.positions[vertex][0]), Float8::load(packet.positions[vertex][1]), Float8::load(packet.positions[vertex][2]) };
+    };
+
+    const Float8 zero = Float8::broadcast(0.0f);
+    const Vector8 p0 = load_vertex(0), p1 = load_vertex(1), p2 = load_vertex(2);
+    const Vector8 e0 = p1 - p0, e1 = p2 - p1, e2 = p0 - p2;
+
+    const Vector8 face_cross = e0.cross(-e2);
+    const Vector8 face_normal = face_cross / face_cross.length();
+
+    const Vector8 direction = Vector8::broadcast(ray.direction);
+    const Float8 ray_normal_dist = face_normal.dot(direction);
+    const Float8 is_parallel_to_plane = abs(ray_normal_dist) < Float8::broadcast(1e-6f);
+
+    const Vector8 origin = Vector8::broadcast(ray.origin);
+    const Float8 origin_plane_dist = face_normal.dot(p0 - origin);
+    const Float8 is_front_face = origin_plane_dist < zero;
+    const Float8 is_culled = and_not(back_face_culling > zero, is_front_face);
+
+    const Float8 intersection_distance = origin_plane_dist / ray_normal_dist;
+    const Vector8 intersection_point = origin + direction * intersection_distance;
+    const Vector8 v0p = intersection_point - p0, v1p = intersection_point - p1, v2p = intersection_point - p2;
+
+    Float8 is_hit = and_not(intersection_distance >= zero, is_parallel_to_plane | is_culled);
+    is_hit = is_hit & (face_normal.dot(e0.cross(v0p)) >= zero);
+    is_hit = is_hit & (face_normal.dot(e1.cross(v1p)) >= zero);
+    is_hit = is_hit & (face_normal.dot(e2.cross(v2p)) >= zero);
+
+    return select(is_hit, intersection_distance, Float8::broadcast(std::numeric_limits<float>::infinity()));
+}
+
+std::optional<Intersection> ray_intersect_triangle_packets(const Ray &ray, const Geometry &geometry, std::span<const TrianglePacket> packets, std::span<const uint32_t> triangle_indices) {
+    // NOTE: Only the distances are tested a packet at a time. The full intersection is computed once, for
+    //       the closest triangle, from its lane's distance rather than by testing it again, as the scalar
+    //       test may round differently (e.g. contracted into FMAs) and miss. Ties go to the first triangle,
+    //       like in ray_intersect_triangle_span().
+    float closest_distance = std::numeric_limits<float>::infinity();
+    std::optional<uint32_t> closest_triangle_index;
+
+    for (size_t packet_index = 0; packet_index < packets.size(); ++packet_index) {
+        const size_t first = packet_index * TRIANGLE_PACKET_SIZE;
+        const size_t triangle_count = std::min<size_t>(TRIANGLE_PACKET_SIZE, triangle_indices.size() - first);
+
+        alignas(32) float back_face_culling[TRIANGLE_PACKET_SIZE];
+        for (size_t lane = 0; lane < TRIANGLE_PACKET_SIZE; ++lane) {
+            const uint32_t triangle_index = triangle_indices[first + (lane < triangle_count ? lane : 0)];
+            back_face_culling[lane] = geometry.triangle_flags[triangle_index].back_face_culling ? 1.0f : 0.0f;
+        }
+
+        const Float8 distances = ray_intersect_triangle_packet_distances(ray, packets[packet_index], Float8::load(back_face_culling));
+        if (!bits(distances < Float8::broadcast(closest_distance)))
+            continue;
+
+        alignas(32) float lane_distances[TRIANGLE_PACKET_SIZE];
+        distances.store(lane_distances);
+        for (size_t lane = 0; lane < triangle_count; ++lane) {
+            if (lane_distances[lane] < closest_distance) {
+                closest_distance = lane_distances[lane];
+                closest_triangle_index = triangle_indices[first + lane];
+            }
+        }
+    }
+
+    if (!closest_triangle_index)
+        return std::nullopt;
+    return make_triangle_intersection(ray, geometry, *closest_triangle_index, closest_distance);
+}
+#endif
+
+std::optional<Intersection> ray_intersect_acceleration_tree(const Ray &ray, const Geometry &geometry, const AccelerationTree &acceleration_tree) {
     std::optional<Intersection> closest_intersection = std::nullopt;
 
     assert(!acceleration_tree.empty());
 
-    std::stack<int> node_indices_to_check{{ 0 }};
+    // NOTE: Counted locally and only added to the stats once per traversal
+    uint64_t nodes_visited = 0, triangle_tests = 0;
 
-    while (!node_indices_to_check.empty()) {
-        const int node_index = node_indices_to_check.top();
-        node_indices_to_check.pop();
-        const AccelerationTreeNode &node = acceleration_tree[node_index];
+    // NOTE: A fixed size stack, so that traversals don't allocate
+    std::array<int, ACCELERATION_TREE_TRAVERSAL_STACK_SIZE> node_indices_to_check;
+    int stack_size = 0;
+    node_indices_to_check[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const int node_index = node_indices_to_check[--stack_size];
+        const AccelerationTreeNode &node = acceleration_tree.nodes[node_index];
+        nodes_visited++;
 
         if (ray_intersect_aabb_p(ray, node.bounds)) {
             if (node.is_leaf()) {
-                auto intersection = ray_intersect_triangle_span(ray, node.triangles);
+                triangle_tests += node.triangle_count;
+#ifdef CRT_SIMD
+                auto intersection = ray_intersect_triangle_packets(ray, geometry, acceleration_tree.get_triangle_packets(node), acceleration_tree.get_triangle_indices(node));
+#else
+                auto intersection = ray_intersect_triangle_span(ray, geometry, acceleration_tree.get_triangle_indices(node));
+#endif
                 if (intersection && (!closest_intersection || intersection->distance < closest_intersection->distance)) 
                     closest_intersection = intersection;
             } else {
+                assert(stack_size + 2 <= ACCELERATION_TREE_TRAVERSAL_STACK_SIZE);
                 if (node.children_indices[0] != -1)
-                    node_indices_to_check.push(node.children_indices[0]);
+                    node_indices_to_check[stack_size++] = node.children_indices[0];
                 if (node.children_indices[1] != -1)
-                    node_indices_to_check.push(node.children_indices[1]);
+                    node_indices_to_check[stack_size++] = node.children_indices[1];
             }
         }
     }
 
+    stats::add(StatCounter::NodesVisited, nodes_visited);
+    stats::add(StatCounter::TriangleTests, triangle_tests);
+
+    return closest_intersection;
+}
+
+std::optional<Intersection> ray_intersect_instance(const Ray &ray, const Instance &instance, const Mesh &mesh) {
+    // NOTE: The object space direction is intentionally left unnormalized, so that
+    //       distances along it are the same as distances along the world space ray.
+    const Ray object_ray{
+        (ray.origin - instance.transform.location) * instance.inverse_rotation,
+        ray.direction * instance.inverse_rotation,
+        ray.depth
+    };
+
+    std::optional<Intersection> intersection = ray_intersect_acceleration_tree(object_ray, mesh.geometry, mesh.acceleration_tree);
+    if (intersection) {
+        intersection->point = ray.at(intersection->distance);
+        intersection->normal = (intersection->normal * instance.normal_matrix).normalize();
+        intersection->uv_scale /= instance.scale;
+    }
+
+    return intersection;
+}
+
+std::optional<Intersection> ray_intersect_instance_tree(const Ray &ray, const InstanceTree &instance_tree, std::span<const Instance> instances, std::span<const Mesh> meshes) {
+    std::optional<Intersection> closest_intersection = std::nullopt;
+
+    assert(!instance_tree.empty());
+
+    uint64_t nodes_visited = 0, instance_tests = 0;
+
+    std::array<int, INSTANCE_TREE_TRAVERSAL_STACK_SIZE> node_indices_to_check;
+    int stack_size = 0;
+    node_indices_to_check[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const int node_index = node_indices_to_check[--stack_size];
+        const InstanceTreeNode &node = instance_tree.nodes[node_index];
+        nodes_visited++;
+
+        if (ray_intersect_aabb_p(ray, node.bounds)) {
+            if (node.is_leaf()) {
+                for (int instance_index : instance_tree.get_instance_indices(node)) {
+                    const Instance &instance = instances[instance_index];
+                    instance_tests++;
+                    if (!ray_intersect_aabb_p(ray, instance.bounds))
+                        continue;
+
+                    auto intersection = ray_intersect_instance(ray, instance, meshes[instance.mesh_index]);
+                    if (intersection && (!closest_intersection || intersection->distance < closest_intersection->distance))
+                        closest_intersection = intersection;
+                }
+            } else {
+                assert(stack_size + 2 <= INSTANCE_TREE_TRAVERSAL_STACK_SIZE);
+                if (node.children_indices[0] != -1)
+                    node_indices_to_check[stack_size++] = node.children_indices[0];
+                if (node.children_indices[1] != -1)
+                    node_indices_to_check[stack_size++] = node.children_indices[1];
+            }
+        }
+    }
+
+    stats::add(StatCounter::NodesVisited, nodes_visited);
+    stats::add(StatCounter::InstanceTests, instance_tests);
+
     return closest_intersection;
 }
 
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <cstdint>
+#include <optional>
 #include <span>
 
 #include "crt_aabb.h"
 #include "crt_acceleration_tree.h"
+#include "crt_instance.h"
+#include "crt_mesh.h"
 #include "crt_ray.h"
-#include "crt_triangle.h"
 #include "crt_vector.h"
 
 namespace crt {
@@ -16,15 +19,29 @@ struct Intersection {
     Vector normal;
     Vector uv;
     float bary_u, bary_v;
+    /**
+     * Length in UV space of a unit length on the surface (the square root of the
+     * ratio of the UV area to the world space area of the hit triangle)
+     */
+    float uv_scale;
     int material_index;
 };
 
 namespace intersection {
 
 bool ray_intersect_aabb_p(const Ray &ray, const AABB &aabb);
-std::optional<Intersection> ray_intersect_triangle(const Ray &ray, const Triangle &triangle);
-std::optional<Intersection> ray_intersect_triangle_span(const Ray &ray, std::span<const Triangle> triangles);
-std::optional<Intersection> ray_intersect_acceleration_tree(const Ray &ray, const AccelerationTree &acceleration_tree);
+std::optional<Intersection> ray_intersect_triangle(const Ray &ray, const Geometry &geometry, uint32_t triangle_index);
+std::optional<Intersection> ray_intersect_triangle_span(const Ray &ray, const Geometry &geometry, std::span<const uint32_t> triangle_indices);
+#ifdef CRT_SIMD
+/**
+ * Same as ray_intersect_triangle_span(), with the triangles tested 8 at a time. `packets` must be made from
+ * `triangle_indices` (see acceleration_tree::make_triangle_packets()).
+ */
+std::optional<Intersection> ray_intersect_triangle_packets(const Ray &ray, const Geometry &geometry, std::span<const TrianglePacket> packets, std::span<const uint32_t> triangle_indices);
+#endif
+std::optional<Intersection> ray_intersect_acceleration_tree(const Ray &ray, const Geometry &geometry, const AccelerationTree &acceleration_tree);
+std::optional<Intersection> ray_intersect_instance(const Ray &ray, const Instance &instance, const Mesh &mesh);
+std::optional<Intersection> ray_intersect_instance_tree(const Ray &ray, const InstanceTree &instance_tree, std::span<const Instance> instances, std::span<const Mesh> meshes);
 
 } // namespace intersection
 
@@ -1,7 +1,9 @@
 #include "crt_json.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <memory>
 #include <new>
 #include <optional>
 #include <string>
@@ -15,15 +17,19 @@
 #include <rapidjson/rapidjson.h>
 
 #include "crt_acceleration_tree.h"
+#include "crt_bitmap.h"
+#include "crt_bitmap_cache.h"
 #include "crt_camera.h"
+#include "crt_camera_path.h"
 #include "crt_image.h"
-#include "crt_image_stbi.h"
+#include "crt_instance.h"
 #include "crt_light.h"
 #include "crt_material.h"
 #include "crt_matrix.h"
 #include "crt_mesh.h"
 #include "crt_scene.h"
 #include "crt_texture.h"
+#include "crt_trace.h"
 #include "crt_transform.h"
 #include "crt_triangle.h"
 #include "crt_vector.h"
@@ -142,12 +148,72 @@ static std::optional<Camera> get_camera_from_value(const rapidjson::Value &camer
     return Camera { width_it->value.GetInt(), height_it->value.GetInt(), std::move(*transform) };
 }
 
-struct ParsedMeshes {
-    std::vector<Vertex> vertices;
-    std::vector<Triangle> triangles;
-};
 
-static std::optional<ParsedMeshes> get_meshes_from_value(const rapidjson::Value &value, const std::vector<TriangleFlags> &material_triangle_flags) {
+static bool get_mesh_counts_from_value(const rapidjson::Value &v, size_t &vertex_count, size_t &triangle_count) {
+    if (!v.IsObject())
+        return false;
+
+    auto positions_it = v.FindMember("vertices");
+    if (positions_it == v.MemberEnd() || !positions_it->value.IsArray())
+        return false;
+
+    auto indices_it = v.FindMember("triangles");
+    if (indices_it == v.MemberEnd() || !indices_it->value.IsArray())
+        return false;
+
+    if (indices_it->value.Size() % 3 != 0) 
+        return false;
+
+    vertex_count += positions_it->value.Size() / 3;
+    triangle_count += indices_it->value.Size() / 3;
+    return true;
+}
+
+/**
+ * Append a single mesh object to `result`.
+ */
+static bool append_mesh_from_value(const rapidjson::Value &v, const std::vector<TriangleFlags> &material_triangle_flags, Geometry &result) {
+    assert(v.IsObject());
+
+    auto positions_it = v.FindMember("vertices");
+    assert(positions_it != v.MemberEnd());
+
+    auto indices_it = v.FindMember("triangles");
+    assert(indices_it != v.MemberEnd());
+
+    auto material_index_it = v.FindMember("material_index");
+    if (material_index_it == v.MemberEnd() || !material_index_it->value.IsInt())
+        return false;
+
+    int material_index = material_index_it->value.GetInt();
+
+    std::optional<std::vector<Vector>> positions = get_vector_array_from_value(positions_it->value);
+    if (!positions)
+        return false;
+
+    std::optional<std::vector<int>> indices = get_int_array_from_value(indices_it->value);
+    if (!indices)
+        return false;
+
+    if (auto it = v.FindMember("uvs"); it != v.MemberEnd()) {
+        std::optional<std::vector<Vector>> uvs = get_vector_array_from_value(it->value);
+        if (!uvs)
+            return false;
+
+        if (uvs->size() != positions->size())
+            return false;
+
+        vertex_array_extend(result, *positions, *uvs, *indices, material_index, material_triangle_flags[material_index]);
+    } else {
+        vertex_array_extend(result, *positions, *indices, material_index, material_triangle_flags[material_index]);
+    }
+
+    return true;
+}
+
+static std::optional<Geometry> get_meshes_from_value(const rapidjson::Value &value, const std::vector<TriangleFlags> &material_triangle_flags) {
+    TraceScope trace_scope{ "read_meshes" };
+
     if (!value.IsArray())
         return std::nullopt;
 
@@ -155,66 +221,106 @@ static std::optional<ParsedMeshes> get_meshes_from_value(const rapidjson::Value
     size_t triangle_count = 0;
 
     for (const auto &v : value.GetArray()) {
-        if (!v.IsObject())
+        if (!get_mesh_counts_from_value(v, vertex_count, triangle_count))
             return std::nullopt;
+    }
+
+    Geometry result;
+    result.reserve(vertex_count, triangle_count);
 
-        auto positions_it = v.FindMember("vertices");
-        if (positions_it == v.MemberEnd() || !positions_it->value.IsArray())
+    for (const auto &v : value.GetArray()) {
+        if (!append_mesh_from_value(v, material_triangle_flags, result))
             return std::nullopt;
+    }
+
+    return result;
+}
 
-        auto indices_it = v.FindMember("triangles");
-        if (indices_it == v.MemberEnd() || !indices_it->value.IsArray())
+struct ParsedInstancedMeshes {
+    std::vector<Mesh> meshes;
+    std::unordered_map<std::string_view, int> mesh_index_map;
+};
+
+/**
+ * Named meshes, which are not placed in the scene by themselves, but are referenced by instances.
+ */
+static std::optional<ParsedInstancedMeshes> get_instanced_meshes_from_value(const rapidjson::Value &value, const std::vector<TriangleFlags> &material_triangle_flags) {
+    TraceScope trace_scope{ "read_instanced_meshes" };
+
+    if (!value.IsArray())
+        return std::nullopt;
+
+    ParsedInstancedMeshes result;
+    result.meshes.reserve(value.Size());
+
+    for (const auto &v : value.GetArray()) {
+        size_t vertex_count = 0;
+        size_t triangle_count = 0;
+        if (!get_mesh_counts_from_value(v, vertex_count, triangle_count))
+            return std::nullopt;
+
+        auto name_it = v.FindMember("name");
+        if (name_it == v.MemberEnd() || !name_it->value.IsString())
+            return std::nullopt;
+
+        std::string_view name{ name_it->value.GetString(), name_it->value.GetStringLength() };
+        if (result.mesh_index_map.contains(name))
             return std::nullopt;
 
-        if (indices_it->value.Size() % 3 != 0) 
+        Geometry geometry;
+        geometry.reserve(vertex_count, triangle_count);
+        if (!append_mesh_from_value(v, material_triangle_flags, geometry))
             return std::nullopt;
 
-        vertex_count += positions_it->value.Size() / 3;
-        triangle_count += indices_it->value.Size() / 3;
+        AccelerationTree acceleration_tree = acceleration_tree::build(geometry);
+
+        result.mesh_index_map[name] = result.meshes.size();
+        result.meshes.emplace_back(Mesh {
+            .geometry = std::move(geometry),
+            .acceleration_tree = std::move(acceleration_tree),
+        });
     }
 
-    ParsedMeshes result;
-    result.vertices.reserve(vertex_count);
-    result.triangles.reserve(triangle_count);
+    return result;
+}
 
-    for (const auto &v : value.GetArray()) {
-        assert(v.IsObject());
+static std::optional<std::vector<Instance>> get_instances_from_value(const rapidjson::Value &value, const ParsedInstancedMeshes &parsed_meshes) {
+    TraceScope trace_scope{ "read_instances" };
 
-        auto positions_it = v.FindMember("vertices");
-        assert(positions_it != v.MemberEnd());
+    if (!value.IsArray())
+        return std::nullopt;
 
-        auto indices_it = v.FindMember("triangles");
-        assert(indices_it != v.MemberEnd());
+    std::vector<Instance> instances;
 
-        auto material_index_it = v.FindMember("material_index");
-        if (material_index_it == v.MemberEnd() || !material_index_it->value.IsInt())
+    for (const auto &v : value.GetArray()) {
+        if (!v.IsObject())
             return std::nullopt;
 
-        int material_index = material_index_it->value.GetInt();
-
-        std::optional<std::vector<Vector>> positions = get_vector_array_from_value(positions_it->value);
-        if (!positions)
+        auto mesh_it = v.FindMember("mesh");
+        if (mesh_it == v.MemberEnd() || !mesh_it->value.IsString())
             return std::nullopt;
 
-        std::optional<std::vector<int>> indices = get_int_array_from_value(indices_it->value);
-        if (!indices)
+        std::string_view mesh_name{ mesh_it->value.GetString(), mesh_it->value.GetStringLength() };
+        auto mesh_index_it = parsed_meshes.mesh_index_map.find(mesh_name);
+        if (mesh_index_it == parsed_meshes.mesh_index_map.end())
             return std::nullopt;
 
-        if (auto it = v.FindMember("uvs"); it != v.MemberEnd()) {
-            std::optional<std::vector<Vector>> uvs = get_vector_array_from_value(it->value);
-            if (!uvs)
-                return std::nullopt;
+        const int mesh_index = mesh_index_it->second;
 
-            if (uvs->size() != positions->size())
+        auto transforms_it = v.FindMember("transforms");
+        if (transforms_it == v.MemberEnd() || !transforms_it->value.IsArray())
+            return std::nullopt;
+
+        for (const auto &transform_value : transforms_it->value.GetArray()) {
+            std::optional<Transform> transform = get_transform_from_value(transform_value);
+            if (!transform)
                 return std::nullopt;
 
-            vertex_array_extend(result.vertices, result.triangles, *positions, *uvs, *indices, material_index, material_triangle_flags[material_index]);
-        } else {
-            vertex_array_extend(result.vertices, result.triangles, *positions, *indices, material_index, material_triangle_flags[material_index]);
+            instances.emplace_back(make_instance(mesh_index, parsed_meshes.meshes[mesh_index], *transform));
         }
     }
 
-    return result;
+    return instances;
 }
 
 static std::optional<std::vector<Light>> get_lights_from_value(const rapidjson::Value &value) {
@@ -346,7 +452,7 @@ static std::optional<CheckerTexture> get_checker_texture_from_value(const rapidj
     };
 }
 
-static std::optional<BitmapTexture> get_bitmap_texture_from_value(const rapidjson::Value &value, const std::filesystem::path &asset_root) {
+static std::optional<BitmapTexture> get_bitmap_texture_from_value(const rapidjson::Value &value, const std::filesystem::path &asset_root, BitmapCache &bitmap_cache, std::vector<std::shared_ptr<const Bitmap>> &bitmaps) {
     assert(value.IsObject());
 
     namespace fs = std::filesystem;
@@ -357,22 +463,26 @@ static std::optional<BitmapTexture> get_bitmap_texture_from_value(const rapidjso
 
     fs::path file_path{ std::u8string {  file_path_it->value.GetString(), file_path_it->value.GetString() + file_path_it->value.GetStringLength()  } };
 
-    std::optional<Image> image = read_stb(asset_root / file_path.relative_path());
-    if (!image)
+    TraceScope trace_scope{ "read_bitmap" };
+    std::shared_ptr<const Bitmap> bitmap = bitmap_cache.load(asset_root / file_path.relative_path());
+    if (!bitmap)
         return std::nullopt;
 
+    bitmaps.push_back(bitmap);
     return BitmapTexture {
-        // FIXME: Do not do this...
-        .image = new Image { std::move(*image) },
+        .bitmap = bitmap.get(),
     };
 }
 
 struct ParsedTextures {
     std::vector<Texture> textures;
+    std::vector<std::shared_ptr<const Bitmap>> bitmaps;
     std::unordered_map<std::string_view, std::size_t> texture_index_map;
 };
 
-static std::optional<ParsedTextures> get_textures_from_value(const rapidjson::Value &value, const std::filesystem::path &asset_root) {
+static std::optional<ParsedTextures> get_textures_from_value(const rapidjson::Value &value, const std::filesystem::path &asset_root, BitmapCache &bitmap_cache) {
+    TraceScope trace_scope{ "read_textures" };
+
     if (!value.IsArray())
         return std::nullopt;
 
@@ -436,7 +546,7 @@ static std::optional<ParsedTextures> get_textures_from_value(const rapidjson::Va
             }
 
             case TextureType::Bitmap: {
-                std::optional<BitmapTexture> bitmap_texture = get_bitmap_texture_from_value(v, asset_root);
+                std::optional<BitmapTexture> bitmap_texture = get_bitmap_texture_from_value(v, asset_root, bitmap_cache, result.bitmaps);
                 if (!bitmap_texture)
                     return std::nullopt;
 
@@ -458,6 +568,8 @@ struct ParsedMaterials {
 };
 
 static std::optional<ParsedMaterials> get_materials_from_value(const rapidjson::Value &value, ParsedTextures &parsed_textures) {
+    TraceScope trace_scope{ "read_materials" };
+
     if (!value.IsArray() || value.Empty())
         return std::nullopt;
 
@@ -538,15 +650,23 @@ static std::optional<ParsedMaterials> get_materials_from_value(const rapidjson::
     return result;
 }
 
-std::optional<Scene> read_scene_from_istream(std::istream &is, const std::filesystem::path &asset_root) {
+std::optional<Scene> read_scene_from_istream(std::istream &is, const std::filesystem::path &asset_root, BitmapCache *bitmap_cache) {
+    TraceScope trace_scope{ "read_scene" };
+
     rapidjson::IStreamWrapper isw{is};
     rapidjson::Document doc;
-    if (doc.ParseStream(isw).HasParseError())
-        return std::nullopt;
+    {
+        TraceScope parse_trace_scope{ "parse_json" };
+        if (doc.ParseStream(isw).HasParseError())
+            return std::nullopt;
+    }
 
     if (!doc.IsObject())
         return std::nullopt;
 
+    // NOTE: Without a shared cache, the textures of the scene, which use the same image file, still share its bitmap
+    BitmapCache scene_bitmap_cache;
+
     auto settings_it = doc.FindMember("settings");
     if (settings_it == doc.MemberEnd() || !settings_it->value.IsObject())
         return std::nullopt;
@@ -581,7 +701,7 @@ std::optional<Scene> read_scene_from_istream(std::istream &is, const std::filesy
 
     auto parsed_textures = [&]() -> ParsedTextures {
         if (auto it = doc.FindMember("textures"); it != doc.MemberEnd()) {
-            if (auto res = get_textures_from_value(it->value, asset_root))
+            if (auto res = get_textures_from_value(it->value, asset_root, bitmap_cache ? *bitmap_cache : scene_bitmap_cache))
                 return std::move(*res);
         }
         return {};
@@ -595,15 +715,36 @@ std::optional<Scene> read_scene_from_istream(std::istream &is, const std::filesy
     if (!parsed_materials)
         return std::nullopt;
 
+    ParsedInstancedMeshes instanced_meshes;
+    std::vector<Instance> instances;
+
+    if (auto it = doc.FindMember("meshes"); it != doc.MemberEnd()) {
+        std::optional<ParsedInstancedMeshes> res = get_instanced_meshes_from_value(it->value, parsed_materials->triangle_flags);
+        if (!res)
+            return std::nullopt;
+        instanced_meshes = std::move(*res);
+    }
+
+    if (auto it = doc.FindMember("instances"); it != doc.MemberEnd()) {
+        std::optional<std::vector<Instance>> res = get_instances_from_value(it->value, instanced_meshes);
+        if (!res)
+            return std::nullopt;
+        instances = std::move(*res);
+    }
+
+    // NOTE: Scenes made up of instances only don't need any flattened objects
     auto meshes_it = doc.FindMember("objects");
-    if (meshes_it == doc.MemberEnd())
+    if (meshes_it == doc.MemberEnd() && instances.empty())
         return std::nullopt;
 
-    std::optional<ParsedMeshes> meshes = get_meshes_from_value(meshes_it->value, parsed_materials->triangle_flags);
-    if (!meshes)
+    std::optional<Geometry> geometry = meshes_it != doc.MemberEnd()
+        ? get_meshes_from_value(meshes_it->value, parsed_materials->triangle_flags)
+        : Geometry{};
+    if (!geometry)
         return std::nullopt;
 
-    AccelerationTree acceleration_tree = acceleration_tree::build(std::move(meshes->triangles));
+    AccelerationTree acceleration_tree = acceleration_tree::build(*geometry);
+    InstanceTree instance_tree = instance_tree::build(instances);
 
     auto lights_it = doc.FindMember("lights");
     if (lights_it == doc.MemberEnd())
@@ -634,10 +775,14 @@ std::optional<Scene> read_scene_from_istream(std::istream &is, const std::filesy
     return Scene {
         .background_color = std::move(*bg_color),
         .camera = std::move(*camera),
-        .vertices = std::move(meshes->vertices),
+        .geometry = std::move(*geometry),
         .acceleration_tree = std::move(acceleration_tree),
+        .meshes = std::move(instanced_meshes.meshes),
+        .instances = std::move(instances),
+        .instance_tree = std::move(instance_tree),
         .lights = std::move(*lights),
         .textures = std::move(parsed_textures.textures),
+        .bitmaps = std::move(parsed_textures.bitmaps),
         .materials = std::move(parsed_materials->materials),
         .bucket_size = bucket_size,
         .gi_on = gi_on,
@@ -646,4 +791,87 @@ std::optional<Scene> read_scene_from_istream(std::istream &is, const std::filesy
     };
 }
 
+
+static std::optional<CameraKeyframe> get_camera_keyframe_from_value(const rapidjson::Value &value) {
+    if (!value.IsObject())
+        return std::nullopt;
+
+    auto frame_it = value.FindMember("frame");
+    if (frame_it == value.MemberEnd() || !frame_it->value.IsInt() || frame_it->value.GetInt() < 0)
+        return std::nullopt;
+
+    auto position_it = value.FindMember("position");
+    if (position_it == value.MemberEnd())
+        return std::nullopt;
+
+    std::optional<Vector> position = get_vector_from_value(position_it->value);
+    if (!position)
+        return std::nullopt;
+
+    // The rotation is given either as a matrix, or as the point the camera looks at
+    std::optional<Matrix> rotation;
+    if (auto it = value.FindMember("matrix"); it != value.MemberEnd()) {
+        rotation = get_matrix_from_value(it->value);
+    } else if (auto it = value.FindMember("look_at"); it != value.MemberEnd()) {
+        std::optional<Vector> target = get_vector_from_value(it->value);
+        if (target && (*target - *position).length_squared() > 0.0f)
+            rotation = get_look_at_rotation(*position, *target);
+    }
+    if (!rotation)
+        return std::nullopt;
+
+    std::optional<float> fov_degrees;
+    if (auto it = value.FindMember("fov_degrees"); it != value.MemberEnd()) {
+        if (!it->value.IsNumber())
+            return std::nullopt;
+        fov_degrees = it->value.GetFloat();
+    }
+
+    return CameraKeyframe {
+        .frame = frame_it->value.GetInt(),
+        .transform = Transform { std::move(*position), std::move(*rotation) },
+        .fov_degrees = fov_degrees
+    };
+}
+
+std::optional<CameraPath> read_camera_path_from_istream(std::istream &is) {
+    rapidjson::IStreamWrapper isw{is};
+    rapidjson::Document doc;
+    if (doc.ParseStream(isw).HasParseError())
+        return std::nullopt;
+
+    if (!doc.IsObject())
+        return std::nullopt;
+
+    auto keyframes_it = doc.FindMember("keyframes");
+    if (keyframes_it == doc.MemberEnd() || !keyframes_it->value.IsArray() || keyframes_it->value.Empty())
+        return std::nullopt;
+
+    std::vector<CameraKeyframe> keyframes;
+    keyframes.reserve(keyframes_it->value.Size());
+    for (const auto &keyframe_value : keyframes_it->value.GetArray()) {
+        std::optional<CameraKeyframe> keyframe = get_camera_keyframe_from_value(keyframe_value);
+        if (!keyframe)
+            return std::nullopt;
+        keyframes.push_back(std::move(*keyframe));
+    }
+
+    std::ranges::sort(keyframes, {}, &CameraKeyframe::frame);
+    if (std::ranges::adjacent_find(keyframes, {}, &CameraKeyframe::frame) != keyframes.end())
+        return std::nullopt;
+
+    // Up to and including the last keyframe, unless the path is held for longer
+    int frame_count = keyframes.back().frame + 1;
+    if (auto it = doc.FindMember("frame_count"); it != doc.MemberEnd()) {
+        if (!it->value.IsInt() || it->value.GetInt() < 1)
+            return std::nullopt;
+        frame_count = it->value.GetInt();
+    }
+
+    return CameraPath {
+        .keyframes = std::move(keyframes),
+        .frame_count = frame_count
+    };
+}
+
 }
\ No newline at end of file
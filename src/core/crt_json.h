@@ -4,10 +4,26 @@
 #include <istream>
 #include <optional>
 
+#include "crt_bitmap_cache.h"
+#include "crt_camera_path.h"
 #include "crt_scene.h"
 
 namespace crt::json {
 
-std::optional<Scene> read_scene_from_istream(std::istream &is, const std::filesystem::path &asset_root);
+/**
+ * When `bitmap_cache` is given, the bitmaps of the textures are loaded through it, so that they are shared
+ * with the other scenes loaded through it. Otherwise, they are only shared between the textures of the scene.
+ */
+std::optional<Scene> read_scene_from_istream(std::istream &is, const std::filesystem::path &asset_root, BitmapCache *bitmap_cache = nullptr);
+
+/**
+ * Read the keyframes of a camera animation:
+ *
+ *     { "keyframes": [ { "frame": 0, "position": [...], "matrix": [...] | "look_at": [...], "fov_degrees": ... }, ... ],
+ *       "frame_count": ... }
+ *
+ * `fov_degrees` and `frame_count` are optional.
+ */
+std::optional<CameraPath> read_camera_path_from_istream(std::istream &is);
 
 }
\ No newline at end of file
@@ -1,9 +1,47 @@
 #include "crt_matrix.h"
 
+#include <cassert>
 #include <cmath>
 
 namespace crt {
 
+float Matrix::determinant() const {
+    const auto &m = data;
+    return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+         + m[0][1] * (m[1][2] * m[2][0] - m[1][0] * m[2][2])
+         + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+Matrix Matrix::inverse() const {
+    // Adjugate divided by the determinant
+    const auto &m = data;
+    const float cofactor00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    const float cofactor01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    const float cofactor02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+
+    const float determinant = m[0][0] * cofactor00 + m[0][1] * cofactor01 + m[0][2] * cofactor02;
+    assert(std::abs(determinant) > 0.0f);
+    const float inv_determinant = 1.0f / determinant;
+
+    return {{
+        {
+            cofactor00 * inv_determinant,
+            (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_determinant,
+            (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_determinant
+        },
+        {
+            cofactor01 * inv_determinant,
+            (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_determinant,
+            (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_determinant
+        },
+        {
+            cofactor02 * inv_determinant,
+            (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_determinant,
+            (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_determinant
+        }
+    }};
+}
+
 Matrix Matrix::rotation_x(const float angle_radians) {
     return {{
         {1.0f, 0.0f, 0.0f},
@@ -22,6 +22,19 @@ struct Matrix {
     static Matrix rotation_y(const float angle_radians);
     static Matrix rotation_z(const float angle_radians);
 
+    float determinant() const;
+    Matrix inverse() const;
+
+    constexpr Matrix transposed() const {
+        Matrix result{};
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                result.data[i][j] = data[j][i];
+            }
+        }
+        return result;
+    }
+
     static constexpr Matrix from_axes(const Vector &right, const Vector &up, const Vector &forward) {
         return {{
             {  right.x,   right.y,   right.z},
@@ -31,8 +44,14 @@ struct Matrix {
     }
 
     constexpr Matrix operator*(const Matrix &rhs) const {
-        Matrix result{ *this };
-        result *= rhs;
+        Matrix result{};
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                for (int k = 0; k < 3; k++) {
+                    result.data[i][j] += data[i][k] * rhs.data[k][j];
+                }
+            }
+        }
         return result;
     }
 
@@ -43,18 +62,12 @@ struct Matrix {
     }
 
     constexpr Matrix& operator*=(const Matrix &rhs) {
-        for (int i = 0; i < 3; i++) {
-            for (int j = 0; j < 3; j++) {
-                for (int k = 0; k < 3; k++) {
-                    data[i][j] += data[i][k] * rhs.data[k][j];
-                }
-            }
-        }
+        // NOTE: Every element of the product depends on a whole row, so it can't be accumulated in place
+        *this = *this * rhs;
         return *this;
     }
 
     constexpr Matrix& operator*=(const float scalar) {
-        *this = *this * scalar;
         for (int i = 0; i < 3; i++) {
             for (int j = 0; j < 3; j++) {
                 data[i][j] = data[i][j] * scalar;
@@ -64,6 +77,20 @@ struct Matrix {
     }
 
     constexpr friend Vector operator*(const Vector &lhs_vec, const Matrix &rhs_mat) {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            // NOTE: The sum of the rows, scaled by the components of the vector. The last row is loaded
+            //       in two parts, so that it isn't read past the end of the matrix.
+            const __m128 row0 = _mm_loadu_ps(rhs_mat.data[0]);
+            const __m128 row1 = _mm_loadu_ps(rhs_mat.data[1]);
+            const __m128 row2 = _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(rhs_mat.data[2]))), _mm_load_ss(&rhs_mat.data[2][2]));
+
+            __m128 result = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_set1_ps(lhs_vec.x), row0));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(lhs_vec.y), row1));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(lhs_vec.z), row2));
+            return Vector::from_simd(result);
+        }
+#endif
         Vector result{};
         for (int i = 0; i < 3; i++) {
             for (int j = 0; j < 3; j++) {
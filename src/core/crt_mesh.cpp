@@ -1,75 +1,135 @@
 #include "crt_mesh.h"
 #include "crt_triangle.h"
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstdint>
 #include <span>
 #include <vector>
 
 namespace crt {
 
+void Geometry::reserve(size_t vertex_count, size_t triangle_count) {
+    positions.reserve(vertex_count);
+    normals.reserve(vertex_count);
+    uvs.reserve(vertex_count);
+    indices.reserve(3 * triangle_count);
+    triangle_material_indices.reserve(triangle_count);
+    triangle_flags.reserve(triangle_count);
+}
+
+static Vector get_face_normal(const Geometry &geometry, uint32_t i0, uint32_t i1, uint32_t i2) {
+    const Vector &p0 = geometry.positions[i0], &p1 = geometry.positions[i1], &p2 = geometry.positions[i2];
+    return (p1 - p0).cross(p2 - p0).normalized();
+}
+
 static void fill_triangles(
-    std::vector<Vertex> &vertices, std::vector<Triangle> &triangles,
+    Geometry &geometry,
     std::span<const int> indices,
-    int base_index, int material_index,
+    uint32_t base_index, int material_index,
     TriangleFlags flags
-) noexcept {
+) {
     assert(indices.size() % 3 == 0);
 
-    // Compute smooth normals of vertices
+    const size_t vertex_count = geometry.positions.size() - base_index;
+
+    // Compute smooth normals of vertices. They are accumulated at full precision and
+    // only encoded at the end.
+    std::vector<Vector> smooth_normals(vertex_count);
+
     for (size_t i = 0; i < indices.size(); i += 3) {
-        Vertex &v0 = vertices[base_index + indices[i]], &v1 = vertices[base_index + indices[i + 1]], &v2 = vertices[base_index + indices[i + 2]];
-        triangles.emplace_back(&v0, &v1, &v2, material_index, flags);
-        v0.normal += triangles.back().face_normal;
-        v1.normal += triangles.back().face_normal;
-        v2.normal += triangles.back().face_normal;
+        const uint32_t i0 = base_index + indices[i], i1 = base_index + indices[i + 1], i2 = base_index + indices[i + 2];
+        geometry.indices.insert(geometry.indices.end(), { i0, i1, i2 });
+        geometry.triangle_material_indices.push_back(material_index);
+        geometry.triangle_flags.push_back(flags);
+
+        const Vector face_normal = get_face_normal(geometry, i0, i1, i2);
+        smooth_normals[indices[i]] += face_normal;
+        smooth_normals[indices[i + 1]] += face_normal;
+        smooth_normals[indices[i + 2]] += face_normal;
     }
 
-    for (Vertex &v : vertices) {
-        v.normal.normalize();
+#ifndef CRT_COMPACT_VERTEX_ATTRIBUTES
+    // NOTE: When the vertices were stored together with the triangles, adding a mesh normalized the normals
+    //       of all vertices, including the ones of the meshes before it. Normalizing a unit vector again can
+    //       move it by a rounding step, so that is still done, to keep the images the same. Only the normals,
+    //       which aren't settled yet, have to be visited for that.
+    // NOTE: Compared bit by bit, so that NaNs (of degenerate triangles) are settled too
+    const auto is_settled = [](const Vector &normal) {
+        const Vector normalized = normal.normalized();
+        return std::bit_cast<uint32_t>(normalized.x) == std::bit_cast<uint32_t>(normal.x)
+            && std::bit_cast<uint32_t>(normalized.y) == std::bit_cast<uint32_t>(normal.y)
+            && std::bit_cast<uint32_t>(normalized.z) == std::bit_cast<uint32_t>(normal.z);
+    };
+
+    std::erase_if(geometry.unsettled_normal_indices, [&](const uint32_t index) {
+        Vector &normal = geometry.normals[index].value;
+        normal.normalize();
+        return is_settled(normal);
+    });
+#endif
+
+    for (Vector &normal : smooth_normals) {
+        geometry.normals.push_back(VertexNormal::encode(normal.normalize()));
+#ifndef CRT_COMPACT_VERTEX_ATTRIBUTES
+        if (!is_settled(normal))
+            geometry.unsettled_normal_indices.push_back(static_cast<uint32_t>(geometry.normals.size() - 1));
+#endif
     }
 }
 
 void vertex_array_extend(
-    std::vector<Vertex> &vertices, std::vector<Triangle> &triangles,
+    Geometry &geometry,
     std::span<const Vector> positions, std::span<const Vector> uvs, std::span<const int> indices,
     int material_index,
     TriangleFlags triangle_flags
 )
 {
     assert(positions.size() == uvs.size());
-    // NOTE: The caller has to have reserved enough memory for all vertices.
-    //       This is because the `Triangle` struct is storing raw pointers to the vertices inside the std::vector.
-    //       Resizing the vector could potentially cause a move, invalidating all existing pointers.
-    assert(vertices.capacity() >= vertices.size() + positions.size());
-    
-    size_t base_index = vertices.size();
-
-    for (size_t i = 0; i < positions.size(); ++i) {
-        vertices.emplace_back(positions[i], Vector {}, uvs[i]);
+
+    const uint32_t base_index = geometry.positions.size();
+
+    geometry.positions.insert(geometry.positions.end(), positions.begin(), positions.end());
+    for (const Vector &uv : uvs) {
+        geometry.uvs.push_back(VertexUV::encode(uv));
     }
 
-    fill_triangles(vertices, triangles, indices, base_index, material_index, triangle_flags);
+    fill_triangles(geometry, indices, base_index, material_index, triangle_flags);
 }
 
 void vertex_array_extend(
-    std::vector<Vertex> &vertices, std::vector<Triangle> &triangles,
+    Geometry &geometry,
     std::span<const Vector> positions, std::span<const int> indices,
     int material_index,
     TriangleFlags triangle_flags
 )
 {
-    // NOTE: The caller has to have reserved enough memory for all vertices.
-    //       This is because the `Triangle` struct is storing raw pointers to the vertices inside the std::vector.
-    //       Resizing the vector could potentially cause a move, invalidating all existing pointers.
-    assert(vertices.capacity() >= vertices.size() + positions.size());
-    
-    size_t base_index = vertices.size();
-
-    for (size_t i = 0; i < positions.size(); ++i) {
-        vertices.emplace_back(positions[i], Vector {}, Vector {});
+    const uint32_t base_index = geometry.positions.size();
+
+    geometry.positions.insert(geometry.positions.end(), positions.begin(), positions.end());
+    geometry.uvs.resize(geometry.positions.size(), VertexUV::encode(Vector {}));
+
+    fill_triangles(geometry, indices, base_index, material_index, triangle_flags);
+}
+
+void vertex_array_update_positions(Geometry &geometry, std::span<const Vector> positions) {
+    assert(positions.size() == geometry.positions.size());
+
+    std::copy(positions.begin(), positions.end(), geometry.positions.begin());
+
+    std::vector<Vector> smooth_normals(positions.size());
+    for (uint32_t triangle = 0; triangle < geometry.triangle_count(); ++triangle) {
+        const auto [i0, i1, i2] = geometry.triangle_vertex_indices(triangle);
+        const Vector face_normal = get_face_normal(geometry, i0, i1, i2);
+        smooth_normals[i0] += face_normal;
+        smooth_normals[i1] += face_normal;
+        smooth_normals[i2] += face_normal;
     }
 
-    fill_triangles(vertices, triangles, indices, base_index, material_index, triangle_flags);
+    for (size_t i = 0; i < smooth_normals.size(); ++i) {
+        geometry.normals[i] = VertexNormal::encode(smooth_normals[i].normalize());
+    }
 }
 
-}
\ No newline at end of file
+}
@@ -1,8 +1,9 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <span>
 #include <vector>
-#include <cassert>
 
 #include "crt_triangle.h"
 #include "crt_vector.h"
@@ -10,18 +11,67 @@
 
 namespace crt {
 
+/**
+ * Indexed triangle geometry, stored as separate attribute streams.
+ *
+ * Triangles are defined by three vertex indices in counter-clockwise order
+ * and are referred to by their index into the triangle streams.
+ */
+struct Geometry {
+    std::vector<Vector> positions;
+    std::vector<VertexNormal> normals;
+    std::vector<VertexUV> uvs;
+
+    /**
+     * Shared index buffer, 3 vertex indices per triangle.
+     */
+    std::vector<uint32_t> indices;
+    std::vector<int> triangle_material_indices;
+    std::vector<TriangleFlags> triangle_flags;
+
+#ifndef CRT_COMPACT_VERTEX_ATTRIBUTES
+    /**
+     * Vertices, whose normal still changes, when it's normalized again, which happens to all normals,
+     * whenever a mesh is added (see fill_triangles())
+     */
+    std::vector<uint32_t> unsettled_normal_indices;
+#endif
+
+    uint32_t triangle_count() const noexcept {
+        return static_cast<uint32_t>(triangle_material_indices.size());
+    }
+
+    std::array<uint32_t, 3> triangle_vertex_indices(const uint32_t triangle_index) const noexcept {
+        const uint32_t *first = &indices[3 * triangle_index];
+        return { first[0], first[1], first[2] };
+    }
+
+    std::array<Vector, 3> triangle_positions(const uint32_t triangle_index) const noexcept {
+        const auto [i0, i1, i2] = triangle_vertex_indices(triangle_index);
+        return { positions[i0], positions[i1], positions[i2] };
+    }
+
+    void reserve(size_t vertex_count, size_t triangle_count);
+};
+
 void vertex_array_extend(
-    std::vector<Vertex> &vertices, std::vector<Triangle> &triangles,
+    Geometry &geometry,
     std::span<const Vector> positions, std::span<const Vector> uvs, std::span<const int> indices,
     int material_index,
     TriangleFlags triangle_flags
 );
 
 void vertex_array_extend(
-    std::vector<Vertex> &vertices, std::vector<Triangle> &triangles,
+    Geometry &geometry,
     std::span<const Vector> positions, std::span<const int> indices,
     int material_index,
     TriangleFlags triangle_flags
 );
 
-}
\ No newline at end of file
+/**
+ * Move all vertices of `geometry` (eg. for a deforming mesh) and recompute the smooth normals.
+ * The triangles stay the same, so `positions` must have one position per existing vertex.
+ */
+void vertex_array_update_positions(Geometry &geometry, std::span<const Vector> positions);
+
+}
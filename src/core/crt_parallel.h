@@ -0,0 +1,40 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace crt {
+
+/**
+ * Split [begin, end) into contiguous chunks of at least `min_chunk_size` items and
+ * call `fn(chunk_begin, chunk_end)` for each of them on its own thread.
+ *
+ * Small ranges are processed on the calling thread.
+ */
+template <typename F>
+void parallel_for_chunks(int begin, int end, int min_chunk_size, F &&fn) {
+    const int count = end - begin;
+    if (count <= 0)
+        return;
+
+    const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const int num_chunks = std::clamp(count / std::max(1, min_chunk_size), 1, max_threads);
+    if (num_chunks == 1) {
+        fn(begin, end);
+        return;
+    }
+
+    std::vector<std::jthread> threads;
+    threads.reserve(num_chunks);
+
+    for (int chunk = 0; chunk < num_chunks; ++chunk) {
+        const int chunk_begin = begin + static_cast<int>(static_cast<long long>(count) * chunk / num_chunks);
+        const int chunk_end = begin + static_cast<int>(static_cast<long long>(count) * (chunk + 1) / num_chunks);
+        threads.emplace_back([&fn, chunk_begin, chunk_end]() {
+            fn(chunk_begin, chunk_end);
+        });
+    }
+}
+
+}
@@ -0,0 +1,73 @@
+#include "crt_pixel_cost.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <utility>
+
+namespace crt {
+
+std::string_view get_pixel_cost_metric_name(const PixelCostMetric metric) {
+    switch (metric) {
+        case PixelCostMetric::Time:          return "time";
+        case PixelCostMetric::Rays:          return "rays";
+        case PixelCostMetric::NodesVisited:  return "nodes";
+        case PixelCostMetric::TriangleTests: return "triangles";
+    }
+    std::unreachable();
+}
+
+std::optional<PixelCostMetric> get_pixel_cost_metric_from_name(const std::string_view name) {
+    for (const PixelCostMetric metric : { PixelCostMetric::Time, PixelCostMetric::Rays, PixelCostMetric::NodesVisited, PixelCostMetric::TriangleTests })
+        if (get_pixel_cost_metric_name(metric) == name)
+            return metric;
+    return std::nullopt;
+}
+
+static float get_percentile(std::vector<float> costs, const float percentile) {
+    assert(!costs.empty());
+    const size_t index = std::min(costs.size() - 1, static_cast<size_t>(percentile * costs.size()));
+    std::nth_element(costs.begin(), costs.begin() + index, costs.end());
+    return costs[index];
+}
+
+PixelCostSummary get_pixel_cost_summary(const PixelCostBuffer &buffer) {
+    if (buffer.costs.empty())
+        return {};
+
+    const auto [min, max] = std::ranges::minmax_element(buffer.costs);
+    const double sum = std::accumulate(buffer.costs.begin(), buffer.costs.end(), 0.0);
+    return PixelCostSummary {
+        .min = *min,
+        .mean = static_cast<float>(sum / buffer.costs.size()),
+        .max = *max,
+        .percentile_99 = get_percentile(buffer.costs, 0.99f),
+    };
+}
+
+/**
+ * Polynomial approximation of the Turbo colormap
+ * (https://ai.googleblog.com/2019/08/turbo-improved-rainbow-colormap-for.html)
+ */
+static Color get_turbo_color(const float t) {
+    const float t2 = t * t, t3 = t2 * t, t4 = t3 * t, t5 = t4 * t;
+    return Color {
+        std::clamp(0.13572138f + 4.61539260f * t - 42.66032258f * t2 + 132.13108234f * t3 - 152.94239396f * t4 + 59.28637943f * t5, 0.0f, 1.0f),
+        std::clamp(0.09140261f + 2.19418839f * t + 4.84296658f * t2 - 14.18503333f * t3 + 4.27729857f * t4 + 2.82956604f * t5, 0.0f, 1.0f),
+        std::clamp(0.10667330f + 12.64194608f * t - 60.58204836f * t2 + 110.36276771f * t3 - 89.90310912f * t4 + 27.34824973f * t5, 0.0f, 1.0f),
+    };
+}
+
+Image make_pixel_cost_heatmap(const PixelCostBuffer &buffer, std::optional<float> max_cost) {
+    if (!max_cost)
+        max_cost = buffer.costs.empty() ? 0.0f : get_percentile(buffer.costs, 0.99f);
+    const float scale = *max_cost > 0.0f ? 1.0f / *max_cost : 0.0f;
+
+    Image result{ buffer.width, buffer.height };
+    std::ranges::transform(buffer.costs, result.buffer.begin(), [scale](float cost) {
+        return get_turbo_color(std::clamp(cost * scale, 0.0f, 1.0f));
+    });
+    return result;
+}
+
+}
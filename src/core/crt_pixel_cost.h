@@ -0,0 +1,64 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "crt_image.h"
+
+namespace crt {
+
+enum class PixelCostMetric {
+    /**
+     * Nanoseconds spent on the pixel
+     */
+    Time,
+    /**
+     * Rays of all kinds, including the camera ray
+     */
+    Rays,
+    NodesVisited,
+    TriangleTests,
+};
+
+std::string_view get_pixel_cost_metric_name(PixelCostMetric metric);
+std::optional<PixelCostMetric> get_pixel_cost_metric_from_name(std::string_view name);
+
+/**
+ * Does the metric rely on the counters of CRT_ENABLE_STATS (and is all zeroes without them)
+ */
+constexpr bool is_pixel_cost_metric_counted(const PixelCostMetric metric) noexcept {
+    return metric != PixelCostMetric::Time;
+}
+
+/**
+ * Auxiliary output of the renderer with the cost of rendering every pixel, row-major, top to bottom.
+ */
+struct PixelCostBuffer {
+    PixelCostMetric metric;
+    int width, height;
+    std::vector<float> costs;
+
+    PixelCostBuffer(const PixelCostMetric metric, const int width, const int height)
+        : metric(metric)
+        , width(width)
+        , height(height)
+        , costs(static_cast<size_t>(width) * height)
+    {}
+};
+
+struct PixelCostSummary {
+    float min, mean, max;
+    float percentile_99;
+};
+
+PixelCostSummary get_pixel_cost_summary(const PixelCostBuffer &buffer);
+
+/**
+ * False-color visualization of the costs (Turbo colormap). Costs are mapped linearly from 0 to
+ * `max_cost`, anything above is clamped. When `max_cost` isn't given, the 99th percentile is used,
+ * so that a few outliers don't wash out the rest of the image.
+ */
+Image make_pixel_cost_heatmap(const PixelCostBuffer &buffer, std::optional<float> max_cost = std::nullopt);
+
+}
@@ -42,4 +42,16 @@ inline constexpr PCG32 make_pcg(const uint32_t raster_x, const uint32_t raster_y
     return rng;
 }
 
+/**
+ * A generator, seeded from `rng`, for a path, which is traced apart from the one of `rng` (e.g. in another
+ * bounce of the wavefront renderer), so that they don't draw the same numbers
+ */
+inline constexpr PCG32 split_pcg(PCG32 &rng) noexcept {
+    PCG32 result;
+    result.state = (uint64_t(rng()) << 32) | rng();
+    result.inc = rng.inc;
+    (void)result();
+    return result;
+}
+
 }
\ No newline at end of file
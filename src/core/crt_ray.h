@@ -10,17 +10,30 @@ struct Ray {
     Vector origin, direction;
     int depth{0};
 
+    /**
+     * Ray cone, used to estimate the footprint of a pixel on the surfaces it hits
+     * (see "Texture Level of Detail Strategies for Real-Time Ray Tracing", Akenine-Möller et al. 2019).
+     *
+     * The width of the cone at distance `t` is `cone_width + cone_spread * t`.
+     */
+    float cone_width{0.0f}, cone_spread{0.0f};
+
     Vector at(const float t) const {
         return origin + direction * t;
     }
 
+    float cone_width_at(const float t) const {
+        return cone_width + cone_spread * t;
+    }
+
     /**
      * Generate a reflection ray, originating from a point on the current ray.
      *
      * @warning point MUST be a point on the original ray. Only call it with values, returned by at().
      */
     Ray reflected_at(const Vector &point, const Vector &normal, const float reflection_bias = 1e-2f) const {
-        return { point + normal * reflection_bias, direction.reflected(normal), depth + 1 };
+        const float t = (point - origin).length();
+        return { point + normal * reflection_bias, direction.reflected(normal), depth + 1, cone_width_at(t), cone_spread };
     }
 
     /**
@@ -43,6 +56,7 @@ struct Ray {
     bool refract_at(const Vector &point, Vector normal, float outside_ior, float inside_ior, const float refraction_bias = 1e-2f) {
         if (!direction.refract(normal, outside_ior, inside_ior))
             return false;
+        cone_width = cone_width_at((point - origin).length());
         origin = point + -normal * refraction_bias;
         depth++;
 
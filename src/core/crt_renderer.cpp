@@ -1,37 +1,61 @@
 
 #include "crt_renderer.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <mutex>
 #include <numbers>
 #include <optional>
-#include <queue>
+#include <string>
+#include <span>
+#include <stop_token>
 #include <thread>
-#include <tuple>
 #include <utility>
+#include <vector>
 
+#include "crt_aabb.h"
+#include "crt_allocation_check.h"
 #include "crt_image.h"
 #include "crt_intersection.h"
 #include "crt_matrix.h"
+#include "crt_pixel_cost.h"
 #include "crt_random.h"
 #include "crt_ray.h"
+#include "crt_stats.h"
+#include "crt_tile.h"
+#include "crt_trace.h"
 #include "crt_vector.h"
 
 namespace crt {
 
 using namespace intersection;
 
+template<ShadingFeatures Features>
 static std::optional<Intersection> trace_ray(const Ray &ray, const Scene &scene) {
-    return ray_intersect_acceleration_tree(ray, scene.acceleration_tree);
+    std::optional<Intersection> closest_intersection = ray_intersect_acceleration_tree(ray, scene.geometry, scene.acceleration_tree);
+
+    if (Features.instances && !scene.instances.empty()) {
+        auto intersection = ray_intersect_instance_tree(ray, scene.instance_tree, scene.instances, scene.meshes);
+        if (intersection && (!closest_intersection || intersection->distance < closest_intersection->distance))
+            closest_intersection = intersection;
+    }
+
+    if (closest_intersection)
+        stats::add(StatCounter::RayHits);
+
+    return closest_intersection;
 }
 
+template<ShadingFeatures Features>
 static std::optional<Intersection> trace_ray_with_refractions(const Ray &ray, const Scene &scene, const RendererSettings &settings) {
     Ray r = ray;
     std::optional<Intersection> closest_intersection = std::nullopt;
     bool has_refracted = false;
-    while (has_refracted && r.depth <= settings.max_ray_depth) {
-        closest_intersection = ray_intersect_acceleration_tree(ray, scene.acceleration_tree);
+    while (has_refracted && static_cast<uint32_t>(r.depth) <= settings.max_ray_depth) {
+        closest_intersection = trace_ray<Features>(ray, scene);
         if (closest_intersection) {
             const Material &material = scene.materials[closest_intersection->material_index];
             has_refracted = material.type == MaterialType::Refractive;
@@ -43,22 +67,47 @@ static std::optional<Intersection> trace_ray_with_refractions(const Ray &ray, co
     return closest_intersection;
 }
 
+/**
+ * Width of the ray cone at the intersection, projected on the surface and measured in UV space.
+ */
+static float get_texture_footprint(const Ray &ray, const Intersection &intersection) {
+    // NOTE: Clamped, so that grazing angles don't blow the footprint up to the coarsest mip level
+    const float cos_theta = std::max(std::abs(ray.direction.dot(intersection.normal)), 0.1f);
+    return ray.cone_width_at(intersection.distance) * intersection.uv_scale / cos_theta;
+}
+
+template<ShadingFeatures Features>
+static Color sample_texture(const Texture &texture, const Intersection &intersection, const float footprint) {
+    if constexpr (Features.albedo_textures_only) {
+        assert(texture.type == TextureType::Albedo);
+        return texture.as_albedo_tex.albedo;
+    } else {
+        return texture.sample(intersection.uv, intersection.bary_u, intersection.bary_v, footprint);
+    }
+}
+
+/**
+ * @tparam Features The parts of the shading, which are compiled in. The checks of the scene's flags
+ *                  are kept, so that the generic instantiation can render any scene.
+ */
+template<ShadingFeatures Features>
 static Color shade_ray(const Ray &ray, const Scene &scene, const RendererSettings &settings, PCG32 &rng) {
-    if (ray.depth > settings.max_ray_depth)
+    if (static_cast<uint32_t>(ray.depth) > settings.max_ray_depth)
         return Color { 0.0f, 0.0f, 0.0f };
 
-    if (auto intersection = trace_ray(ray, scene)) {
+    if (auto intersection = trace_ray<Features>(ray, scene)) {
         const Material &material = scene.materials[intersection->material_index];
         const Texture &albedo_map = scene.textures[material.albedo_map_texture_index];
         Vector normal = intersection->normal;
+        const float texture_footprint = Features.albedo_textures_only ? 0.0f : get_texture_footprint(ray, *intersection);
 
         switch (material.type) {
             case MaterialType::Diffuse: {
                 Color final_color{};
 
                 // Compute diffuse reflections (GI)
-                if (scene.gi_on) {
-                    for (int i = 0; i < settings.diffuse_reflection_ray_count; ++i) {
+                if (Features.gi && scene.gi_on) {
+                    for (uint32_t i = 0; i < settings.diffuse_reflection_ray_count; ++i) {
                         const Vector right = ray.direction.cross(normal).normalize();
                         const Vector &up = normal;
                         const Vector forward = right.cross(up);
@@ -73,8 +122,12 @@ static Color shade_ray(const Ray &ray, const Scene &scene, const RendererSetting
                         direction *= rotation;
                         direction *= local_hit_matrix;
 
-                        Ray diffuse_reflection_ray{ intersection->point + normal * settings.diffuse_reflection_bias, direction, ray.depth + 1 };
-                        final_color += shade_ray(diffuse_reflection_ray, scene, settings, rng);
+                        Ray diffuse_reflection_ray{
+                            intersection->point + normal * settings.diffuse_reflection_bias, direction, ray.depth + 1,
+                            ray.cone_width_at(intersection->distance), ray.cone_spread
+                        };
+                        stats::add(StatCounter::DiffuseRays);
+                        final_color += shade_ray<Features>(diffuse_reflection_ray, scene, settings, rng);
                     }
                 }
 
@@ -88,10 +141,11 @@ static Color shade_ray(const Ray &ray, const Scene &scene, const RendererSetting
                     float sphere_area = 4 * std::numbers::pi_v<float> * sphere_radius_squared;
 
                     Ray shadow_ray{ intersection->point + normal * settings.shadow_bias, light_dir };
-                    auto shadow_intersection = trace_ray_with_refractions(shadow_ray, scene, settings);
+                    stats::add(StatCounter::ShadowRays);
+                    auto shadow_intersection = trace_ray_with_refractions<Features>(shadow_ray, scene, settings);
                     bool is_illuminated = !shadow_intersection.has_value() || shadow_intersection->distance * shadow_intersection->distance > sphere_radius_squared;
                     if (is_illuminated) {
-                        final_color += albedo_map.sample(intersection->uv, intersection->bary_u, intersection->bary_v) * light.intensity / sphere_area * cos_law;
+                        final_color += sample_texture<Features>(albedo_map, *intersection, texture_footprint) * light.intensity / sphere_area * cos_law;
                     }
                 }
 
@@ -102,12 +156,16 @@ static Color shade_ray(const Ray &ray, const Scene &scene, const RendererSetting
 
             case MaterialType::Reflective: {
                 Ray reflection_ray = ray.reflected_at(intersection->point, normal, settings.reflection_bias);
-                Color albedo = albedo_map.sample(intersection->uv, intersection->bary_u, intersection->bary_v);
-                return scene.reflections_on ? albedo * shade_ray(reflection_ray, scene, settings, rng) : albedo;
+                Color albedo = sample_texture<Features>(albedo_map, *intersection, texture_footprint);
+                if (!Features.reflections || !scene.reflections_on)
+                    return albedo;
+
+                stats::add(StatCounter::ReflectionRays);
+                return albedo * shade_ray<Features>(reflection_ray, scene, settings, rng);
             }
 
             case MaterialType::Refractive: {
-                if (!scene.refractions_on)
+                if (!Features.refractions || !scene.refractions_on)
                     return Color { 0.0f, 0.0f, 0.0f };
 
                 // HACK: Assuming the external environment is always air and when rays
@@ -123,10 +181,12 @@ static Color shade_ray(const Ray &ray, const Scene &scene, const RendererSetting
                 std::optional<Ray> refraction_ray = ray.refracted_at(intersection->point, normal, outside_ior, inside_ior, settings.refraction_bias);
                 Ray reflection_ray = ray.reflected_at(intersection->point, normal, settings.reflection_bias);
 
-                Color reflection_color = shade_ray(reflection_ray, scene, settings, rng);
+                stats::add(StatCounter::ReflectionRays);
+                Color reflection_color = shade_ray<Features>(reflection_ray, scene, settings, rng);
 
                 if (refraction_ray) {
-                    Color refraction_color = shade_ray(*refraction_ray, scene, settings, rng);
+                    stats::add(StatCounter::RefractionRays);
+                    Color refraction_color = shade_ray<Features>(*refraction_ray, scene, settings, rng);
                     float fresnel = 0.5f * std::pow((1.0f + ray.direction.dot(normal)), 5.0f);
                     return reflection_color * fresnel + refraction_color * (1.0f - fresnel);
                 } else {
@@ -135,7 +195,7 @@ static Color shade_ray(const Ray &ray, const Scene &scene, const RendererSetting
             }
 
             case MaterialType::Constant: {
-                return albedo_map.sample(intersection->uv, intersection->bary_u, intersection->bary_v);
+                return sample_texture<Features>(albedo_map, *intersection, texture_footprint);
             }
         }
         std::unreachable();
@@ -144,58 +204,560 @@ static Color shade_ray(const Ray &ray, const Scene &scene, const RendererSetting
     }
 }
 
-static void render_region(const Scene &scene, const RendererSettings &settings, int x, int y, int width, int height, Image &result) {
+/**
+ * Running total of the counter, which a pixel cost metric is measured in
+ */
+static uint64_t get_pixel_cost_count(const PixelCostMetric metric) {
+    const RenderStats *stats = stats::current();
+    if (!stats)
+        return 0;
+
+    switch (metric) {
+        case PixelCostMetric::Time:          return 0;
+        case PixelCostMetric::Rays:          return stats->ray_count();
+        case PixelCostMetric::NodesVisited:  return (*stats)[StatCounter::NodesVisited];
+        case PixelCostMetric::TriangleTests: return (*stats)[StatCounter::TriangleTests];
+    }
+    std::unreachable();
+}
+
+template<ShadingFeatures Features>
+static void render_region(const Scene &scene, const RendererSettings &settings, int x, int y, int width, int height, std::span<Color> pixels, PixelCostBuffer *pixel_costs) {
+    assert(pixels.size() == static_cast<size_t>(width * height));
+
+    // Everything a ray needs is allocated before the render, so that the threads don't contend on the heap
+    NoAllocationsScope no_allocations_scope{ "render_region", x, y };
+
+    stats::add(StatCounter::CameraRays, static_cast<uint64_t>(width) * height);
+
     for (int raster_y = y; raster_y < y + height; ++raster_y) {
         for (int raster_x = x; raster_x < x + width; ++raster_x) {
             PCG32 rng = make_pcg(raster_x, raster_y);
-            Ray camera_ray = scene.camera.generate_ray(raster_x, raster_y);
-            result.buffer[raster_y * result.width + raster_x] = shade_ray(camera_ray, scene, settings, rng);
+            Color &pixel = pixels[(raster_y - y) * width + (raster_x - x)];
+
+            if (!pixel_costs) {
+                Ray camera_ray = scene.camera.generate_ray(raster_x, raster_y);
+                pixel = shade_ray<Features>(camera_ray, scene, settings, rng);
+                continue;
+            }
+
+            float &cost = pixel_costs->costs[static_cast<size_t>(raster_y) * pixel_costs->width + raster_x];
+            if (pixel_costs->metric == PixelCostMetric::Time) {
+                const auto start = std::chrono::steady_clock::now();
+                Ray camera_ray = scene.camera.generate_ray(raster_x, raster_y);
+                pixel = shade_ray<Features>(camera_ray, scene, settings, rng);
+                cost = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - start).count();
+            } else {
+                const uint64_t count_before = get_pixel_cost_count(pixel_costs->metric);
+                Ray camera_ray = scene.camera.generate_ray(raster_x, raster_y);
+                pixel = shade_ray<Features>(camera_ray, scene, settings, rng);
+                // NOTE: The camera rays of the whole region are counted up front
+                const uint64_t camera_ray_count = pixel_costs->metric == PixelCostMetric::Rays ? 1 : 0;
+                cost = static_cast<float>(get_pixel_cost_count(pixel_costs->metric) - count_before + camera_ray_count);
+            }
         }
     }
 }
 
+/**
+ * Rays, which the wavefront renderer keeps in a queue. A bucket is split into batches of pixels, so that
+ * their paths never take more.
+ */
+inline constexpr size_t WAVEFRONT_QUEUE_CAPACITY = size_t{ 1 } << 15;
+
+/**
+ * The paths of a batch of pixels, which are traced in the same bounce, one array per field. The throughput
+ * is the weight of the color the path brings back in its pixel.
+ */
+struct PathQueue {
+    std::vector<Ray> rays;
+    std::vector<Color> throughputs;
+    std::vector<uint32_t> pixel_indices;
+    std::vector<PCG32> rngs;
+
+    size_t size() const noexcept {
+        return rays.size();
+    }
+
+    void reserve(const size_t capacity) {
+        rays.reserve(capacity);
+        throughputs.reserve(capacity);
+        pixel_indices.reserve(capacity);
+        rngs.reserve(capacity);
+    }
+
+    void clear() noexcept {
+        rays.clear();
+        throughputs.clear();
+        pixel_indices.clear();
+        rngs.clear();
+    }
+
+    void push(const Ray &ray, const Color &throughput, const uint32_t pixel_index, const PCG32 &rng) noexcept {
+        // NOTE: Reserved up front, so that rendering doesn't allocate
+        assert(size() < rays.capacity());
+        rays.push_back(ray);
+        throughputs.push_back(throughput);
+        pixel_indices.push_back(pixel_index);
+        rngs.push_back(rng);
+    }
+};
+
+/**
+ * Scratch memory of a render thread for render_region_wavefront(), allocated before the render
+ */
+struct WavefrontQueues {
+    PathQueue current, next;
+    std::vector<std::optional<Intersection>> intersections;
+    /**
+     * Sort key and index of the paths of `current`
+     */
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    /**
+     * Bounds the origins of the rays are sorted in
+     */
+    AABB scene_bounds;
+    size_t pixels_per_batch{ 0 };
+
+    void reserve(const size_t capacity) {
+        current.reserve(capacity);
+        next.reserve(capacity);
+        intersections.resize(capacity);
+        order.resize(capacity);
+    }
+};
+
+/**
+ * Rays, which start from the same region of the scene and go the same way, get close keys: the octant of the
+ * direction, followed by the Morton code of the origin in a 1024^3 grid over the bounds of the scene.
+ */
+static uint64_t get_ray_sort_key(const Ray &ray, const AABB &scene_bounds) noexcept {
+    const auto spread_bits = [](uint64_t bits) {
+        bits &= 0x3ff;
+        bits = (bits | (bits << 16)) & 0x30000ff;
+        bits = (bits | (bits << 8)) & 0x300f00f;
+        bits = (bits | (bits << 4)) & 0x30c30c3;
+        bits = (bits | (bits << 2)) & 0x9249249;
+        return bits;
+    };
+
+    uint64_t morton_code = 0;
+    uint64_t octant = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        const float extent = scene_bounds.max.data[axis] - scene_bounds.min.data[axis];
+        const float position = extent > 0.0f ? (ray.origin.data[axis] - scene_bounds.min.data[axis]) / extent : 0.0f;
+        // NOTE: The negated comparison also catches NaNs
+        const uint64_t cell = !(position > 0.0f) ? 0 : static_cast<uint64_t>(std::min(position, 1.0f) * 1023.0f);
+        morton_code |= spread_bits(cell) << axis;
+        octant |= static_cast<uint64_t>(ray.direction.data[axis] < 0.0f) << axis;
+    }
+    return (octant << 30) | morton_code;
+}
+
+static AABB get_scene_bounds(const Scene &scene) {
+    AABB bounds = AABB::vacuum();
+    const auto add_bounds = [&](const AABB &other) {
+        for (int axis = 0; axis < 3; ++axis) {
+            bounds.min.data[axis] = std::min(bounds.min.data[axis], other.min.data[axis]);
+            bounds.max.data[axis] = std::max(bounds.max.data[axis], other.max.data[axis]);
+        }
+    };
+
+    if (!scene.acceleration_tree.empty())
+        add_bounds(scene.acceleration_tree.nodes[0].bounds);
+    if (!scene.instance_tree.empty())
+        add_bounds(scene.instance_tree.nodes[0].bounds);
+    return bounds;
+}
+
+/**
+ * Pixels, whose paths fit into the wavefront queues, or zero, when a single pixel may spawn more rays in a
+ * bounce than they hold
+ */
+static size_t get_wavefront_pixels_per_batch(const Scene &scene, const RendererSettings &settings) {
+    const ShadingFeatures features = get_shading_features(scene);
+    // Rays, which a ray spawns at most
+    const size_t branching = std::max<size_t>({
+        1,
+        features.gi ? size_t{ settings.diffuse_reflection_ray_count } : size_t{ 0 },
+        features.refractions ? size_t{ 2 } : size_t{ 0 },
+    });
+
+    size_t paths_per_pixel = 1;
+    for (uint32_t depth = 0; depth < settings.max_ray_depth; ++depth) {
+        paths_per_pixel *= branching;
+        if (paths_per_pixel > WAVEFRONT_QUEUE_CAPACITY)
+            return 0;
+    }
+    return WAVEFRONT_QUEUE_CAPACITY / paths_per_pixel;
+}
+
+static void push_path(PathQueue &queue, const RendererSettings &settings, const Ray &ray, const Color &throughput, const uint32_t pixel_index, const PCG32 &rng) {
+    // NOTE: Deeper rays bring back black, so they aren't traced
+    if (static_cast<uint32_t>(ray.depth) <= settings.max_ray_depth)
+        queue.push(ray, throughput, pixel_index, rng);
+}
+
+/**
+ * The same shading as shade_ray(), except that the rays a hit spawns are added to `next`, weighted by the
+ * throughput of the path, rather than traced right away. Shadow rays are still traced right away.
+ */
+template<ShadingFeatures Features>
+static void shade_path(const Scene &scene, const RendererSettings &settings, const Ray &ray, const Color &throughput, const uint32_t pixel_index, PCG32 &rng, const std::optional<Intersection> &intersection, std::span<Color> pixels, PathQueue &next) {
+    Color &pixel = pixels[pixel_index];
+    if (!intersection) {
+        pixel += throughput * scene.background_color;
+        return;
+    }
+
+    const Material &material = scene.materials[intersection->material_index];
+    const Texture &albedo_map = scene.textures[material.albedo_map_texture_index];
+    Vector normal = intersection->normal;
+    const float texture_footprint = Features.albedo_textures_only ? 0.0f : get_texture_footprint(ray, *intersection);
+
+    switch (material.type) {
+        case MaterialType::Diffuse: {
+            const Color diffuse_throughput = throughput / (settings.diffuse_reflection_ray_count + 1);
+
+            if (Features.gi && scene.gi_on) {
+                for (uint32_t i = 0; i < settings.diffuse_reflection_ray_count; ++i) {
+                    const Vector right = ray.direction.cross(normal).normalize();
+                    const Vector &up = normal;
+                    const Vector forward = right.cross(up);
+
+                    const Matrix local_hit_matrix = Matrix::from_axes(right, up, forward);
+
+                    const float rand_angle_xy = std::numbers::pi_v<float> * rng.uniform();
+                    Vector direction{ std::cos(rand_angle_xy), std::sin(rand_angle_xy), 0.0f };
+
+                    const float rand_angle_xz = 2.0f * std::numbers::pi_v<float> * rng.uniform();
+                    const Matrix rotation = Matrix::rotation_y(rand_angle_xz);
+                    direction *= rotation;
+                    direction *= local_hit_matrix;
+
+                    Ray diffuse_reflection_ray{
+                        intersection->point + normal * settings.diffuse_reflection_bias, direction, ray.depth + 1,
+                        ray.cone_width_at(intersection->distance), ray.cone_spread
+                    };
+                    stats::add(StatCounter::DiffuseRays);
+                    push_path(next, settings, diffuse_reflection_ray, diffuse_throughput, pixel_index, split_pcg(rng));
+                }
+            }
+
+            Color direct_color{};
+            for (const auto &light : scene.lights) {
+                Vector light_dir = light.position - intersection->point;
+                float sphere_radius_squared = light_dir.length_squared();
+                light_dir.normalize();
+
+                float cos_law = std::max(0.0f, light_dir.dot(normal));
+
+                float sphere_area = 4 * std::numbers::pi_v<float> * sphere_radius_squared;
+
+                Ray shadow_ray{ intersection->point + normal * settings.shadow_bias, light_dir };
+                stats::add(StatCounter::ShadowRays);
+                auto shadow_intersection = trace_ray_with_refractions<Features>(shadow_ray, scene, settings);
+                bool is_illuminated = !shadow_intersection.has_value() || shadow_intersection->distance * shadow_intersection->distance > sphere_radius_squared;
+                if (is_illuminated) {
+                    direct_color += sample_texture<Features>(albedo_map, *intersection, texture_footprint) * light.intensity / sphere_area * cos_law;
+                }
+            }
+            pixel += diffuse_throughput * direct_color;
+            return;
+        }
+
+        case MaterialType::Reflective: {
+            Ray reflection_ray = ray.reflected_at(intersection->point, normal, settings.reflection_bias);
+            Color albedo = sample_texture<Features>(albedo_map, *intersection, texture_footprint);
+            if (!Features.reflections || !scene.reflections_on) {
+                pixel += throughput * albedo;
+                return;
+            }
+
+            stats::add(StatCounter::ReflectionRays);
+            push_path(next, settings, reflection_ray, throughput * albedo, pixel_index, rng);
+            return;
+        }
+
+        case MaterialType::Refractive: {
+            if (!Features.refractions || !scene.refractions_on)
+                return;
+
+            // HACK: Assuming the external environment is always air and when rays
+            //       leave transparent objects, they always enter air.
+            float outside_ior = 1.0f;
+            float inside_ior = material.ior;
+            if (ray.direction.dot(normal) > 0.0f) {
+                // Ray is leaving the refractive volume
+                normal = -normal;
+                std::swap(inside_ior, outside_ior);
+            }
+
+            std::optional<Ray> refraction_ray = ray.refracted_at(intersection->point, normal, outside_ior, inside_ior, settings.refraction_bias);
+            Ray reflection_ray = ray.reflected_at(intersection->point, normal, settings.reflection_bias);
+
+            stats::add(StatCounter::ReflectionRays);
+            if (refraction_ray) {
+                stats::add(StatCounter::RefractionRays);
+                float fresnel = 0.5f * std::pow((1.0f + ray.direction.dot(normal)), 5.0f);
+                push_path(next, settings, reflection_ray, throughput * fresnel, pixel_index, split_pcg(rng));
+                push_path(next, settings, *refraction_ray, throughput * (1.0f - fresnel), pixel_index, rng);
+            } else {
+                push_path(next, settings, reflection_ray, throughput, pixel_index, rng);
+            }
+            return;
+        }
+
+        case MaterialType::Constant: {
+            pixel += throughput * sample_texture<Features>(albedo_map, *intersection, texture_footprint);
+            return;
+        }
+    }
+    std::unreachable();
+}
+
+/**
+ * Render the region like render_region(), but bounce by bounce: the rays of a batch of pixels are traced
+ * together, sorted so that neighbouring traversals visit the same parts of the trees, and then their hits
+ * are shaded, grouped by material. The rays these spawn make up the next bounce.
+ *
+ * Gives the same images, except for the noise of GI, as the random numbers are drawn in another order.
+ */
+template<ShadingFeatures Features>
+static void render_region_wavefront(const Scene &scene, const RendererSettings &settings, int x, int y, int width, int height, std::span<Color> pixels, WavefrontQueues &queues) {
+    assert(pixels.size() == static_cast<size_t>(width * height));
+    assert(queues.pixels_per_batch > 0);
+
+    NoAllocationsScope no_allocations_scope{ "render_region_wavefront", x, y };
+
+    stats::add(StatCounter::CameraRays, static_cast<uint64_t>(width) * height);
+
+    const uint32_t pixel_count = static_cast<uint32_t>(width * height);
+    for (uint32_t first_pixel = 0; first_pixel < pixel_count; first_pixel += static_cast<uint32_t>(queues.pixels_per_batch)) {
+        const uint32_t last_pixel = static_cast<uint32_t>(std::min<size_t>(first_pixel + queues.pixels_per_batch, pixel_count));
+
+        queues.current.clear();
+        for (uint32_t pixel_index = first_pixel; pixel_index < last_pixel; ++pixel_index) {
+            const int raster_x = x + static_cast<int>(pixel_index) % width;
+            const int raster_y = y + static_cast<int>(pixel_index) / width;
+            pixels[pixel_index] = Color { 0.0f, 0.0f, 0.0f };
+            queues.current.push(scene.camera.generate_ray(raster_x, raster_y), Color { 1.0f, 1.0f, 1.0f }, pixel_index, make_pcg(raster_x, raster_y));
+        }
+
+        while (queues.current.size() > 0) {
+            PathQueue &current = queues.current;
+            const std::span order{ queues.order.data(), current.size() };
+
+            for (uint32_t i = 0; i < current.size(); ++i)
+                order[i] = { get_ray_sort_key(current.rays[i], queues.scene_bounds), i };
+            std::sort(order.begin(), order.end());
+            for (const auto &[key, i] : order)
+                queues.intersections[i] = trace_ray<Features>(current.rays[i], scene);
+
+            // NOTE: Misses come first
+            for (uint32_t i = 0; i < current.size(); ++i)
+                order[i] = { queues.intersections[i] ? static_cast<uint64_t>(queues.intersections[i]->material_index) + 1 : 0, i };
+            std::sort(order.begin(), order.end());
+            for (const auto &[key, i] : order) {
+                shade_path<Features>(scene, settings, current.rays[i], current.throughputs[i], current.pixel_indices[i],
+                                     current.rngs[i], queues.intersections[i], pixels, queues.next);
+            }
+
+            std::swap(queues.current, queues.next);
+            queues.next.clear();
+        }
+    }
+}
+
+using RenderRegionFunction = void (*)(const Scene &, const RendererSettings &, int, int, int, int, std::span<Color>, PixelCostBuffer *);
+using WavefrontRenderRegionFunction = void (*)(const Scene &, const RendererSettings &, int, int, int, int, std::span<Color>, WavefrontQueues &);
+
+inline constexpr size_t SHADING_FEATURE_COUNT = 5;
+
+static constexpr ShadingFeatures get_shading_features_from_bits(const size_t bits) {
+    return ShadingFeatures {
+        .gi                   = (bits & 1) != 0,
+        .reflections          = (bits & 2) != 0,
+        .refractions          = (bits & 4) != 0,
+        .albedo_textures_only = (bits & 8) != 0,
+        .instances            = (bits & 16) != 0,
+    };
+}
+
+static constexpr size_t get_shading_features_bits(const ShadingFeatures &features) {
+    return (features.gi ? 1 : 0)
+        | (features.reflections ? 2 : 0)
+        | (features.refractions ? 4 : 0)
+        | (features.albedo_textures_only ? 8 : 0)
+        | (features.instances ? 16 : 0);
+}
+
+static_assert(get_shading_features_from_bits(get_shading_features_bits(GENERIC_SHADING_FEATURES)) == GENERIC_SHADING_FEATURES);
+
+template<size_t... Bits>
+static constexpr std::array<RenderRegionFunction, sizeof...(Bits)> make_render_region_functions(std::index_sequence<Bits...>) {
+    return { &render_region<get_shading_features_from_bits(Bits)>... };
+}
+
+template<size_t... Bits>
+static constexpr std::array<WavefrontRenderRegionFunction, sizeof...(Bits)> make_wavefront_render_region_functions(std::index_sequence<Bits...>) {
+    return { &render_region_wavefront<get_shading_features_from_bits(Bits)>... };
+}
+
+/**
+ * render_region(), specialized for every combination of ShadingFeatures, indexed by their bits
+ */
+static constexpr std::array RENDER_REGION_FUNCTIONS = make_render_region_functions(std::make_index_sequence<1 << SHADING_FEATURE_COUNT>{});
+static constexpr std::array WAVEFRONT_RENDER_REGION_FUNCTIONS = make_wavefront_render_region_functions(std::make_index_sequence<1 << SHADING_FEATURE_COUNT>{});
+
+ShadingFeatures get_shading_features(const Scene &scene) {
+    const auto has_material = [&](const MaterialType type) {
+        return std::ranges::any_of(scene.materials, [&](const Material &material) { return material.type == type; });
+    };
+
+    return ShadingFeatures {
+        .gi                   = scene.gi_on != 0,
+        .reflections          = scene.reflections_on && has_material(MaterialType::Reflective),
+        .refractions          = scene.refractions_on && has_material(MaterialType::Refractive),
+        .albedo_textures_only = std::ranges::all_of(scene.textures, [](const Texture &texture) { return texture.type == TextureType::Albedo; }),
+        .instances            = !scene.instances.empty(),
+    };
+}
+
 Image render_image(const Scene &scene, const RendererSettings &settings) {
     Image result{ scene.camera.resolution_x(), scene.camera.resolution_y() };
+    ImageTileSink sink{ result };
+    render_image(scene, settings, sink);
+    return result;
+}
 
-    const int bucket_count_x = static_cast<int>(float(result.width) / scene.bucket_size + 0.5);
-    const int bucket_count_y = static_cast<int>(float(result.height) / scene.bucket_size + 0.5);
+std::vector<Bucket> get_buckets(const int image_width, const int image_height, const int bucket_size) {
+    // NOTE: Rounded up, so that images smaller than a bucket (eg. the first passes of the viewport) still get one
+    const int bucket_count_x = (image_width + bucket_size - 1) / bucket_size;
+    const int bucket_count_y = (image_height + bucket_size - 1) / bucket_size;
 
-    std::queue<std::tuple<int, int, int, int>> buckets;
+    std::vector<Bucket> buckets;
+    buckets.reserve(bucket_count_x * bucket_count_y);
     for (int bucket_y = 0; bucket_y < bucket_count_y; ++bucket_y) {
-        int y = bucket_y * scene.bucket_size;
-        int height = bucket_y == bucket_count_y - 1 ? result.height - y : scene.bucket_size;
+        int y = bucket_y * bucket_size;
+        int height = bucket_y == bucket_count_y - 1 ? image_height - y : bucket_size;
 
         for (int bucket_x = 0; bucket_x < bucket_count_x; ++bucket_x) {
-            int x = bucket_x * scene.bucket_size;
-            int width = bucket_x == bucket_count_x - 1 ? result.width - x : scene.bucket_size;
+            int x = bucket_x * bucket_size;
+            int width = bucket_x == bucket_count_x - 1 ? image_width - x : bucket_size;
 
-            buckets.emplace(std::make_tuple(x, y, width, height));
+            buckets.push_back(Bucket { x, y, width, height });
         }
     }
+    return buckets;
+}
+
+/**
+ * Hands out a fixed list of buckets in order
+ */
+class ListBucketSource : public BucketSource {
+public:
+    explicit ListBucketSource(std::vector<Bucket> buckets)
+        : m_buckets(std::move(buckets))
+    {}
+
+    std::optional<Bucket> next_bucket() override {
+        std::scoped_lock lock{ m_mutex };
+        if (m_next_index == m_buckets.size())
+            return std::nullopt;
+        return m_buckets[m_next_index++];
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<Bucket> m_buckets;
+    size_t m_next_index{ 0 };
+};
+
+void render_image(const Scene &scene, const RendererSettings &settings, TileSink &sink, std::stop_token stop_token, RenderStats *stats, PixelCostBuffer *pixel_costs, ThreadPool *thread_pool) {
+    ListBucketSource buckets{ get_buckets(scene.camera.resolution_x(), scene.camera.resolution_y(), scene.bucket_size) };
+    render_buckets(scene, settings, buckets, sink, stop_token, stats, pixel_costs, thread_pool);
+}
 
-    std::mutex buckets_mutex;
+void render_buckets(const Scene &scene, const RendererSettings &settings, BucketSource &buckets, TileSink &sink, std::stop_token stop_token, RenderStats *stats, PixelCostBuffer *pixel_costs, ThreadPool *thread_pool) {
+    assert(!pixel_costs || (pixel_costs->width == scene.camera.resolution_x() && pixel_costs->height == scene.camera.resolution_y()));
 
-    const auto num_threads = std::thread::hardware_concurrency();
-    std::vector<std::jthread> threads;
-    threads.reserve(num_threads);
+    // NOTE: Picked once per render, rather than checking the features for every ray
+    const ShadingFeatures features = settings.specialize_shading ? get_shading_features(scene) : GENERIC_SHADING_FEATURES;
+    const size_t features_bits = get_shading_features_bits(features);
+    const RenderRegionFunction render_region = RENDER_REGION_FUNCTIONS[features_bits];
+    const WavefrontRenderRegionFunction render_region_wavefront = WAVEFRONT_RENDER_REGION_FUNCTIONS[features_bits];
 
-    for (int i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&]() {
-            for (;;) {
-                std::unique_lock lock{ buckets_mutex };
-                if (buckets.empty())
-                    return;
+    // NOTE: The pixel costs are measured per path, so they need the recursive renderer
+    const size_t wavefront_pixels_per_batch = settings.wavefront && !pixel_costs ? get_wavefront_pixels_per_batch(scene, settings) : 0;
+    const AABB scene_bounds = wavefront_pixels_per_batch > 0 ? get_scene_bounds(scene) : AABB::vacuum();
 
-                const auto [x, y, width, height] = buckets.front();
-                buckets.pop();
-                lock.unlock();
+    StatsScope stats_scope{ stats };
+    ScopedStatTimer render_timer{ StatTimer::Render };
+    TraceScope trace_scope{ "render_image", { "shading_features", static_cast<int64_t>(features_bits) } };
 
-                render_region(scene, settings, x, y, width, height, result);
+    std::mutex stats_mutex;
+
+    const auto render_worker = [&](const unsigned i) {
+        if (trace::is_enabled())
+            trace::set_thread_name("render worker " + std::to_string(i));
+
+        std::vector<Color> tile_pixels;
+
+        WavefrontQueues wavefront_queues;
+        if (wavefront_pixels_per_batch > 0) {
+            wavefront_queues.reserve(WAVEFRONT_QUEUE_CAPACITY);
+            wavefront_queues.scene_bounds = scene_bounds;
+            wavefront_queues.pixels_per_batch = wavefront_pixels_per_batch;
+        }
+
+        // Counted without contention and only merged once the thread runs out of buckets.
+        // The pixel costs are measured with the same counters, so they are needed for them as well.
+        RenderStats thread_stats;
+        StatsScope thread_stats_scope{ stats || pixel_costs ? &thread_stats : nullptr };
+
+        for (;;) {
+            if (stop_token.stop_requested())
+                break;
+
+            const std::optional<Bucket> bucket = buckets.next_bucket();
+            if (!bucket)
+                break;
+            const auto [x, y, width, height] = *bucket;
+
+            const auto bucket_start = std::chrono::steady_clock::now();
+            {
+                TraceScope bucket_trace_scope{ "render_bucket", { "x", x }, { "y", y } };
+                tile_pixels.resize(width * height);
+                if (wavefront_pixels_per_batch > 0)
+                    render_region_wavefront(scene, settings, x, y, width, height, tile_pixels, wavefront_queues);
+                else
+                    render_region(scene, settings, x, y, width, height, tile_pixels, pixel_costs);
             }
-        });
-    }
+            thread_stats.add_bucket(std::chrono::duration<double>(std::chrono::steady_clock::now() - bucket_start).count());
 
-    return result;
+            TraceScope write_trace_scope{ "write_tile" };
+            sink.write_tile(Tile { x, y, width, height, tile_pixels });
+        }
+
+        if (stats) {
+            std::scoped_lock stats_lock{ stats_mutex };
+            stats->merge(thread_stats);
+        }
+    };
+
+    if (thread_pool) {
+        thread_pool->run(render_worker);
+    } else {
+        const unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::jthread> threads;
+        threads.reserve(num_threads);
+        for (unsigned i = 0; i < num_threads; ++i)
+            threads.emplace_back(render_worker, i);
+
+        // Join the threads, so that their stats are merged before the render time is recorded
+        threads.clear();
+    }
 }
 
 }
\ No newline at end of file
@@ -1,9 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <stop_token>
+#include <vector>
 
 #include "crt_image.h"
+#include "crt_pixel_cost.h"
 #include "crt_scene.h"
+#include "crt_stats.h"
+#include "crt_thread_pool.h"
+#include "crt_tile.h"
 
 namespace crt {
 
@@ -22,8 +28,83 @@ struct RendererSettings {
     float reflection_bias{ DEFAULT_REFLECTION_BIAS };
     float diffuse_reflection_bias{ DEFAULT_DIFFUSE_REFLECTION_BIAS };
     float refraction_bias{ DEFAULT_REFRACTION_BIAS };
+    /**
+     * Render with the shading code, specialized for the features of the scene (see ShadingFeatures).
+     * When off, the generic code, which supports every feature, is used. Both give the same images.
+     */
+    bool specialize_shading{ true };
+    /**
+     * Trace the rays of a bucket bounce by bounce in large batches, sorted by their origin and direction, rather
+     * than every path depth first, so that consecutive traversals visit the same parts of the trees. Gives the
+     * same images, except for the noise of GI. Scenes, whose paths branch into too many rays to batch, and
+     * renders, which measure pixel costs, are rendered depth first anyway. Shadow rays aren't batched, they're
+     * traced while a hit is shaded.
+     */
+    bool wavefront{ false };
 };
 
+/**
+ * The parts of the shading code, which a scene needs.
+ *
+ * The renderer is compiled for every combination, and picks the one for the scene once per render,
+ * so that the code for the rest (and the checks whether it's needed) is left out of the inner loop.
+ */
+struct ShadingFeatures {
+    /**
+     * Diffuse reflection rays (`Scene::gi_on`)
+     */
+    bool gi{ true };
+    /**
+     * Reflection rays off reflective materials (`Scene::reflections_on` and a reflective material)
+     */
+    bool reflections{ true };
+    /**
+     * Refraction rays through refractive materials (`Scene::refractions_on` and a refractive material)
+     */
+    bool refractions{ true };
+    /**
+     * Every texture is an albedo, so sampling needs neither a texture footprint nor a dispatch on the type
+     */
+    bool albedo_textures_only{ false };
+    bool instances{ true };
+
+    constexpr bool operator==(const ShadingFeatures &) const = default;
+};
+
+/**
+ * Supports every scene
+ */
+inline constexpr ShadingFeatures GENERIC_SHADING_FEATURES{};
+
+ShadingFeatures get_shading_features(const Scene &scene);
+
 Image render_image(const Scene &scene, const RendererSettings &settings);
 
+/**
+ * Render the scene bucket by bucket, handing each finished bucket to `sink` as soon as it's done.
+ *
+ * When a stop is requested through `stop_token`, no new buckets are started. The buckets that are
+ * already being rendered are still finished and handed to `sink` before returning.
+ *
+ * When `stats` is given (and CRT_ENABLE_STATS is defined), the counters and timings of the render are
+ * added to it.
+ *
+ * When `pixel_costs` is given, the cost of every pixel is recorded into it. It must have the resolution
+ * of the camera. Metrics other than time need CRT_ENABLE_STATS.
+ *
+ * When `thread_pool` is given, the buckets are rendered on its workers. Otherwise a thread per core
+ * is started for the render.
+ */
+void render_image(const Scene &scene, const RendererSettings &settings, TileSink &sink, std::stop_token stop_token = {}, RenderStats *stats = nullptr, PixelCostBuffer *pixel_costs = nullptr, ThreadPool *thread_pool = nullptr);
+
+/**
+ * Split an image into buckets of (at most) `bucket_size` pixels, row by row from the top left.
+ */
+std::vector<Bucket> get_buckets(int image_width, int image_height, int bucket_size);
+
+/**
+ * Like render_image(), but render only the buckets, which `buckets` hands out, until it runs out of them.
+ */
+void render_buckets(const Scene &scene, const RendererSettings &settings, BucketSource &buckets, TileSink &sink, std::stop_token stop_token = {}, RenderStats *stats = nullptr, PixelCostBuffer *pixel_costs = nullptr, ThreadPool *thread_pool = nullptr);
+
 }
\ No newline at end of file
@@ -1,15 +1,18 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "crt_acceleration_tree.h"
+#include "crt_bitmap.h"
 #include "crt_camera.h"
 #include "crt_image.h"
+#include "crt_instance.h"
 #include "crt_light.h"
 #include "crt_material.h"
+#include "crt_mesh.h"
 #include "crt_texture.h"
-#include "crt_vertex.h"
 
 namespace crt {
 
@@ -18,10 +21,17 @@ inline constexpr int DEFAULT_SCENE_BUCKET_SIZE = 24;
 struct Scene {
     Color background_color;
     Camera camera;
-    std::vector<Vertex> vertices;
+    Geometry geometry;
     AccelerationTree acceleration_tree;
+    std::vector<Mesh> meshes;
+    std::vector<Instance> instances;
+    InstanceTree instance_tree;
     std::vector<Light> lights;
     std::vector<Texture> textures;
+    /**
+     * The bitmaps of the bitmap textures, which may be shared with other scenes (see BitmapCache)
+     */
+    std::vector<std::shared_ptr<const Bitmap>> bitmaps;
     std::vector<Material> materials;
     int bucket_size;
     uint8_t gi_on          : 1;
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#include "crt_vector.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace crt {
+
+namespace simd_detail {
+
+// NOTE: Masks are stored in the same registers as the floats, with all bits of a lane set when it's true
+
+#if defined(__AVX__)
+using Register = __m256;
+inline constexpr int REGISTER_WIDTH = 8;
+
+inline Register broadcast(const float value) { return _mm256_set1_ps(value); }
+inline Register set(const float *lanes) { return _mm256_setr_ps(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5], lanes[6], lanes[7]); }
+inline Register load(const float *values) { return _mm256_loadu_ps(values); }
+inline void store(const Register a, float *values) { _mm256_storeu_ps(values, a); }
+
+inline Register add(const Register a, const Register b) { return _mm256_add_ps(a, b); }
+inline Register sub(const Register a, const Register b) { return _mm256_sub_ps(a, b); }
+inline Register mul(const Register a, const Register b) { return _mm256_mul_ps(a, b); }
+inline Register div(const Register a, const Register b) { return _mm256_div_ps(a, b); }
+inline Register sqrt(const Register a) { return _mm256_sqrt_ps(a); }
+inline Register min(const Register a, const Register b) { return _mm256_min_ps(a, b); }
+inline Register max(const Register a, const Register b) { return _mm256_max_ps(a, b); }
+
+inline Register less(const Register a, const Register b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline Register less_equal(const Register a, const Register b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline Register bit_and(const Register a, const Register b) { return _mm256_and_ps(a, b); }
+inline Register bit_or(const Register a, const Register b) { return _mm256_or_ps(a, b); }
+inline Register bit_xor(const Register a, const Register b) { return _mm256_xor_ps(a, b); }
+inline Register bit_and_not(const Register a, const Register b) { return _mm256_andnot_ps(b, a); }
+inline Register select(const Register mask, const Register a, const Register b) { return _mm256_blendv_ps(b, a, mask); }
+inline uint32_t move_mask(const Register a) { return static_cast<uint32_t>(_mm256_movemask_ps(a)); }
+#elif defined(__SSE2__) || defined(_M_X64)
+using Register = __m128;
+inline constexpr int REGISTER_WIDTH = 4;
+
+inline Register broadcast(const float value) { return _mm_set1_ps(value); }
+inline Register set(const float *lanes) { return _mm_setr_ps(lanes[0], lanes[1], lanes[2], lanes[3]); }
+inline Register load(const float *values) { return _mm_loadu_ps(values); }
+inline void store(const Register a, float *values) { _mm_storeu_ps(values, a); }
+
+inline Register add(const Register a, const Register b) { return _mm_add_ps(a, b); }
+inline Register sub(const Register a, const Register b) { return _mm_sub_ps(a, b); }
+inline Register mul(const Register a, const Register b) { return _mm_mul_ps(a, b); }
+inline Register div(const Register a, const Register b) { return _mm_div_ps(a, b); }
+inline Register sqrt(const Register a) { return _mm_sqrt_ps(a); }
+inline Register min(const Register a, const Register b) { return _mm_min_ps(a, b); }
+inline Register max(const Register a, const Register b) { return _mm_max_ps(a, b); }
+
+inline Register less(const Register a, const Register b) { return _mm_cmplt_ps(a, b); }
+inline Register less_equal(const Register a, const Register b) { return _mm_cmple_ps(a, b); }
+inline Register bit_and(const Register a, const Register b) { return _mm_and_ps(a, b); }
+inline Register bit_or(const Register a, const Register b) { return _mm_or_ps(a, b); }
+inline Register bit_xor(const Register a, const Register b) { return _mm_xor_ps(a, b); }
+inline Register bit_and_not(const Register a, const Register b) { return _mm_andnot_ps(b, a); }
+// NOTE: SSE2 has no blend instruction
+inline Register select(const Register mask, const Register a, const Register b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline uint32_t move_mask(const Register a) { return static_cast<uint32_t>(_mm_movemask_ps(a)); }
+#else
+using Register = float;
+inline constexpr int REGISTER_WIDTH = 1;
+
+inline constexpr float TRUE_LANE = std::bit_cast<float>(~uint32_t{ 0 });
+
+inline Register broadcast(const float value) { return value; }
+inline Register set(const float *lanes) { return *lanes; }
+inline Register load(const float *values) { return *values; }
+inline void store(const Register a, float *values) { *values = a; }
+
+inline Register add(const Register a, const Register b) { return a + b; }
+inline Register sub(const Register a, const Register b) { return a - b; }
+inline Register mul(const Register a, const Register b) { return a * b; }
+inline Register div(const Register a, const Register b) { return a / b; }
+inline Register sqrt(const Register a) { return std::sqrt(a); }
+inline Register min(const Register a, const Register b) { return b < a ? b : a; }
+inline Register max(const Register a, const Register b) { return a < b ? b : a; }
+
+inline Register less(const Register a, const Register b) { return a < b ? TRUE_LANE : 0.0f; }
+inline Register less_equal(const Register a, const Register b) { return a <= b ? TRUE_LANE : 0.0f; }
+inline Register bit_and(const Register a, const Register b) { return std::bit_cast<float>(std::bit_cast<uint32_t>(a) & std::bit_cast<uint32_t>(b)); }
+inline Register bit_or(const Register a, const Register b) { return std::bit_cast<float>(std::bit_cast<uint32_t>(a) | std::bit_cast<uint32_t>(b)); }
+inline Register bit_xor(const Register a, const Register b) { return std::bit_cast<float>(std::bit_cast<uint32_t>(a) ^ std::bit_cast<uint32_t>(b)); }
+inline Register bit_and_not(const Register a, const Register b) { return std::bit_cast<float>(std::bit_cast<uint32_t>(a) & ~std::bit_cast<uint32_t>(b)); }
+inline Register select(const Register mask, const Register a, const Register b) { return std::bit_cast<uint32_t>(mask) ? a : b; }
+inline uint32_t move_mask(const Register a) { return std::bit_cast<uint32_t>(a) >> 31; }
+#endif
+
+inline constexpr int REGISTER_COUNT = 8 / REGISTER_WIDTH;
+
+} // namespace simd_detail
+
+/**
+ * 8 floats, which are processed together.
+ *
+ * Backed by one AVX register, two SSE registers or (on other targets) plain floats, depending on
+ * what the compiler targets. Every operation is done lane by lane in the same order as the scalar
+ * code would, so results match it exactly, as long as the compiler doesn't contract into FMAs.
+ */
+struct Float8 {
+    simd_detail::Register registers[simd_detail::REGISTER_COUNT];
+
+    static Float8 broadcast(const float value) {
+        Float8 result;
+        for (auto &r : result.registers)
+            r = simd_detail::broadcast(value);
+        return result;
+    }
+
+    /**
+     * Like load(), but for values, which were just written one by one. They are put together in registers,
+     * instead of being read back from memory (which would stall, waiting for the separate writes).
+     */
+    static Float8 set(const float (&values)[8]) {
+        Float8 result;
+        for (int i = 0; i < simd_detail::REGISTER_COUNT; ++i)
+            result.registers[i] = simd_detail::set(values + i * simd_detail::REGISTER_WIDTH);
+        return result;
+    }
+
+    static Float8 load(const float *values) {
+        Float8 result;
+        for (int i = 0; i < simd_detail::REGISTER_COUNT; ++i)
+            result.registers[i] = simd_detail::load(values + i * simd_detail::REGISTER_WIDTH);
+        return result;
+    }
+
+    void store(float *values) const {
+        for (int i = 0; i < simd_detail::REGISTER_COUNT; ++i)
+            simd_detail::store(registers[i], values + i * simd_detail::REGISTER_WIDTH);
+    }
+
+    template<typename Operation>
+    static Float8 map(const Float8 &a, const Float8 &b, Operation operation) {
+        Float8 result;
+        for (int i = 0; i < simd_detail::REGISTER_COUNT; ++i)
+            result.registers[i] = operation(a.registers[i], b.registers[i]);
+        return result;
+    }
+
+    friend Float8 operator+(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::add(x, y); }); }
+    friend Float8 operator-(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::sub(x, y); }); }
+    friend Float8 operator*(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::mul(x, y); }); }
+    friend Float8 operator/(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::div(x, y); }); }
+
+    /**
+     * Correctly rounded, like std::sqrt()
+     */
+    friend Float8 sqrt(const Float8 &a) {
+        Float8 result;
+        for (int i = 0; i < simd_detail::REGISTER_COUNT; ++i)
+            result.registers[i] = simd_detail::sqrt(a.registers[i]);
+        return result;
+    }
+
+    friend Float8 min(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::min(x, y); }); }
+    friend Float8 max(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::max(x, y); }); }
+
+    /**
+     * Comparisons give masks, with all bits of the lanes, for which they are true, set. Like the scalar
+     * comparisons, they are false for NaNs.
+     */
+    friend Float8 operator<(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::less(x, y); }); }
+    friend Float8 operator<=(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::less_equal(x, y); }); }
+    friend Float8 operator>(const Float8 &a, const Float8 &b) { return b < a; }
+    friend Float8 operator>=(const Float8 &a, const Float8 &b) { return b <= a; }
+
+    friend Float8 operator&(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::bit_and(x, y); }); }
+    friend Float8 operator|(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::bit_or(x, y); }); }
+    friend Float8 operator^(const Float8 &a, const Float8 &b) { return map(a, b, [](auto x, auto y) { return simd_detail::bit_xor(x, y); }); }
+
+    /**
+     * Flips the sign bits, like the scalar negation (unlike 0 - a, which gives 0 for 0)
+     */
+    Float8 operator-() const { return *this ^ broadcast(-0.0f); }
+
+    /**
+     * Clears the sign bits, like std::abs()
+     */
+    friend Float8 abs(const Float8 &a) { return and_not(a, broadcast(-0.0f)); }
+
+    /**
+     * The lanes of `mask` and not of `other`
+     */
+    friend Float8 and_not(const Float8 &mask, const Float8 &other) { return map(mask, other, [](auto x, auto y) { return simd_detail::bit_and_not(x, y); }); }
+
+    /**
+     * `a` in the lanes of `mask`, `b` in the rest
+     */
+    friend Float8 select(const Float8 &mask, const Float8 &a, const Float8 &b) {
+        Float8 result;
+        for (int i = 0; i < simd_detail::REGISTER_COUNT; ++i)
+            result.registers[i] = simd_detail::select(mask.registers[i], a.registers[i], b.registers[i]);
+        return result;
+    }
+
+    /**
+     * Bit i is set, when lane i of the mask is
+     */
+    friend uint32_t bits(const Float8 &mask) {
+        uint32_t result = 0;
+        for (int i = 0; i < simd_detail::REGISTER_COUNT; ++i)
+            result |= simd_detail::move_mask(mask.registers[i]) << (i * simd_detail::REGISTER_WIDTH);
+        return result;
+    }
+};
+
+/**
+ * 8 vectors, stored as a structure of arrays, for code that processes packets of 8 (triangles, rays).
+ * Mirrors the operations of Vector and evaluates them in the same order.
+ */
+struct Vector8 {
+    Float8 x, y, z;
+
+    static Vector8 broadcast(const Vector &v) {
+        return { Float8::broadcast(v.x), Float8::broadcast(v.y), Float8::broadcast(v.z) };
+    }
+
+    /**
+     * Lane i is vectors[indices[i]]
+     */
+    static Vector8 gather(const Vector *vectors, const uint32_t (&indices)[8]) {
+        float xs[8], ys[8], zs[8];
+        for (int i = 0; i < 8; ++i) {
+            xs[i] = vectors[indices[i]].x;
+            ys[i] = vectors[indices[i]].y;
+            zs[i] = vectors[indices[i]].z;
+        }
+        return { Float8::set(xs), Float8::set(ys), Float8::set(zs) };
+    }
+
+    Vector8 operator+(const Vector8 &rhs) const {
+        return { x + rhs.x, y + rhs.y, z + rhs.z };
+    }
+
+    Vector8 operator-(const Vector8 &rhs) const {
+        return { x - rhs.x, y - rhs.y, z - rhs.z };
+    }
+
+    Vector8 operator-() const {
+        return { -x, -y, -z };
+    }
+
+    Vector8 operator*(const Float8 &rhs) const {
+        return { x * rhs, y * rhs, z * rhs };
+    }
+
+    Vector8 operator/(const Float8 &rhs) const {
+        return { x / rhs, y / rhs, z / rhs };
+    }
+
+    Vector8 cross(const Vector8 &rhs) const {
+        return {
+            y * rhs.z - z * rhs.y,
+            z * rhs.x - x * rhs.z,
+            x * rhs.y - y * rhs.x
+        };
+    }
+
+    Float8 dot(const Vector8 &rhs) const {
+        return x * rhs.x + y * rhs.y + z * rhs.z;
+    }
+
+    Float8 length_squared() const {
+        return x * x + y * y + z * z;
+    }
+
+    Float8 length() const {
+        return sqrt(length_squared());
+    }
+};
+
+}
@@ -0,0 +1,135 @@
+#include "crt_stats.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <utility>
+
+namespace crt {
+
+uint64_t RenderStats::ray_count() const noexcept {
+    return (*this)[StatCounter::CameraRays]
+        + (*this)[StatCounter::ShadowRays]
+        + (*this)[StatCounter::DiffuseRays]
+        + (*this)[StatCounter::ReflectionRays]
+        + (*this)[StatCounter::RefractionRays];
+}
+
+void RenderStats::add_bucket(const double bucket_seconds) noexcept {
+    seconds[static_cast<size_t>(StatTimer::Buckets)] += bucket_seconds;
+    bucket_count++;
+    min_bucket_seconds = std::min(min_bucket_seconds, bucket_seconds);
+    max_bucket_seconds = std::max(max_bucket_seconds, bucket_seconds);
+}
+
+void RenderStats::merge(const RenderStats &other) noexcept {
+    for (size_t i = 0; i < STAT_COUNTER_COUNT; ++i)
+        counters[i] += other.counters[i];
+    for (size_t i = 0; i < STAT_TIMER_COUNT; ++i)
+        seconds[i] += other.seconds[i];
+
+    bucket_count += other.bucket_count;
+    min_bucket_seconds = std::min(min_bucket_seconds, other.min_bucket_seconds);
+    max_bucket_seconds = std::max(max_bucket_seconds, other.max_bucket_seconds);
+}
+
+std::string_view get_stat_name(const StatCounter counter) {
+    switch (counter) {
+        case StatCounter::CameraRays:     return "camera_rays";
+        case StatCounter::ShadowRays:     return "shadow_rays";
+        case StatCounter::DiffuseRays:    return "diffuse_rays";
+        case StatCounter::ReflectionRays: return "reflection_rays";
+        case StatCounter::RefractionRays: return "refraction_rays";
+        case StatCounter::RayHits:        return "ray_hits";
+        case StatCounter::NodesVisited:   return "nodes_visited";
+        case StatCounter::TriangleTests:  return "triangle_tests";
+        case StatCounter::InstanceTests:  return "instance_tests";
+        case StatCounter::Count:          break;
+    }
+    std::unreachable();
+}
+
+std::string_view get_stat_name(const StatTimer timer) {
+    switch (timer) {
+        case StatTimer::SceneLoad:             return "scene_load_seconds";
+        case StatTimer::AccelerationTreeBuild: return "acceleration_tree_build_seconds";
+        case StatTimer::Render:                return "render_seconds";
+        case StatTimer::Buckets:               return "bucket_seconds";
+        case StatTimer::Count:                 break;
+    }
+    std::unreachable();
+}
+
+static double get_min_bucket_seconds(const RenderStats &stats) {
+    return stats.bucket_count > 0 ? stats.min_bucket_seconds : 0.0;
+}
+
+static void print_line(std::ostream &os, int indent, std::string_view name, double value, int precision, std::string_view suffix = {}) {
+    os << std::string(indent, ' ') << std::left << std::setw(34 - indent) << name
+       << std::right << std::setw(14) << std::fixed << std::setprecision(precision) << value;
+    if (!suffix.empty())
+        os << ' ' << suffix;
+    os << '\n';
+}
+
+static void print_per_ray_line(std::ostream &os, std::string_view name, uint64_t value, double per_ray) {
+    os << "  " << std::left << std::setw(32) << name << std::right << std::setw(14) << value
+       << " (" << std::fixed << std::setprecision(1) << value * per_ray << " per ray)\n";
+}
+
+void print_stats_report(std::ostream &os, const RenderStats &stats) {
+    const uint64_t ray_count = stats.ray_count();
+    const double render_seconds = stats[StatTimer::Render];
+    // NOTE: Per ray averages are over all kinds of rays, as every ray goes through the same traversal
+    const double per_ray = ray_count > 0 ? 1.0 / ray_count : 0.0;
+
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+
+    os << "Render stats:\n";
+    print_line(os, 2, "scene load", stats[StatTimer::SceneLoad], 3, "s");
+    print_line(os, 2, "acceleration tree build", stats[StatTimer::AccelerationTreeBuild], 3, "s");
+    print_line(os, 2, "render", render_seconds, 3, "s");
+
+    print_line(os, 2, "rays", ray_count, 0);
+    for (const StatCounter counter : { StatCounter::CameraRays, StatCounter::ShadowRays, StatCounter::DiffuseRays, StatCounter::ReflectionRays, StatCounter::RefractionRays })
+        print_line(os, 4, get_stat_name(counter), stats[counter], 0);
+    if (render_seconds > 0.0)
+        print_line(os, 2, "Mrays/s", ray_count / render_seconds * 1e-6, 3);
+
+    os << "  " << std::left << std::setw(32) << "ray hits" << std::right << std::setw(14) << stats[StatCounter::RayHits]
+       << " (" << std::setprecision(1) << 100.0 * stats[StatCounter::RayHits] * per_ray << "%)\n";
+    print_per_ray_line(os, "nodes visited", stats[StatCounter::NodesVisited], per_ray);
+    print_per_ray_line(os, "triangle tests", stats[StatCounter::TriangleTests], per_ray);
+    print_per_ray_line(os, "instance tests", stats[StatCounter::InstanceTests], per_ray);
+
+    print_line(os, 2, "buckets", stats.bucket_count, 0);
+    if (stats.bucket_count > 0) {
+        print_line(os, 4, "min", get_min_bucket_seconds(stats) * 1e3, 3, "ms");
+        print_line(os, 4, "average", stats[StatTimer::Buckets] / stats.bucket_count * 1e3, 3, "ms");
+        print_line(os, 4, "max", stats.max_bucket_seconds * 1e3, 3, "ms");
+    }
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void write_stats_json(std::ostream &os, const RenderStats &stats) {
+    const std::streamsize precision = os.precision(std::numeric_limits<double>::max_digits10);
+
+    os << "{\n";
+    for (size_t i = 0; i < STAT_COUNTER_COUNT; ++i)
+        os << "  \"" << get_stat_name(static_cast<StatCounter>(i)) << "\": " << stats.counters[i] << ",\n";
+    for (size_t i = 0; i < STAT_TIMER_COUNT; ++i)
+        os << "  \"" << get_stat_name(static_cast<StatTimer>(i)) << "\": " << stats.seconds[i] << ",\n";
+    os << "  \"ray_count\": " << stats.ray_count() << ",\n";
+    os << "  \"bucket_count\": " << stats.bucket_count << ",\n";
+    os << "  \"min_bucket_seconds\": " << get_min_bucket_seconds(stats) << ",\n";
+    os << "  \"max_bucket_seconds\": " << stats.max_bucket_seconds << "\n";
+    os << "}\n";
+
+    os.precision(precision);
+}
+
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string_view>
+
+namespace crt {
+
+enum class StatCounter : uint8_t {
+    CameraRays,
+    ShadowRays,
+    DiffuseRays,
+    ReflectionRays,
+    RefractionRays,
+    RayHits,
+    NodesVisited,
+    TriangleTests,
+    InstanceTests,
+
+    Count
+};
+
+enum class StatTimer : uint8_t {
+    SceneLoad,
+    AccelerationTreeBuild,
+    Render,
+    /**
+     * Summed over all buckets (and threads), so it's larger than the render time
+     */
+    Buckets,
+
+    Count
+};
+
+inline constexpr size_t STAT_COUNTER_COUNT = static_cast<size_t>(StatCounter::Count);
+inline constexpr size_t STAT_TIMER_COUNT = static_cast<size_t>(StatTimer::Count);
+
+/**
+ * Counters and timings of the hot paths of the renderer.
+ *
+ * Every thread records into its own instance (see StatsScope), so counting is free of contention.
+ * The instances are merged at the end of `render_image()`.
+ */
+struct RenderStats {
+    std::array<uint64_t, STAT_COUNTER_COUNT> counters{};
+    std::array<double, STAT_TIMER_COUNT> seconds{};
+    uint64_t bucket_count{ 0 };
+    double min_bucket_seconds{ std::numeric_limits<double>::infinity() };
+    double max_bucket_seconds{ 0.0 };
+
+    constexpr uint64_t operator[](const StatCounter counter) const noexcept {
+        return counters[static_cast<size_t>(counter)];
+    }
+
+    constexpr double operator[](const StatTimer timer) const noexcept {
+        return seconds[static_cast<size_t>(timer)];
+    }
+
+    /**
+     * Number of rays of all kinds
+     */
+    uint64_t ray_count() const noexcept;
+
+    void add_bucket(double bucket_seconds) noexcept;
+    void merge(const RenderStats &other) noexcept;
+};
+
+std::string_view get_stat_name(StatCounter counter);
+std::string_view get_stat_name(StatTimer timer);
+
+/**
+ * Print a human-readable summary of the stats.
+ */
+void print_stats_report(std::ostream &os, const RenderStats &stats);
+
+/**
+ * Write the stats as a JSON object, keyed by the names of the counters and timers.
+ */
+void write_stats_json(std::ostream &os, const RenderStats &stats);
+
+namespace stats {
+
+#ifdef CRT_ENABLE_STATS
+/**
+ * Where the calling thread records its stats, or nullptr when they are not collected
+ */
+inline thread_local RenderStats *t_current = nullptr;
+
+inline void add(const StatCounter counter, const uint64_t value = 1) noexcept {
+    if (t_current)
+        t_current->counters[static_cast<size_t>(counter)] += value;
+}
+
+inline void add_time(const StatTimer timer, const double seconds) noexcept {
+    if (t_current)
+        t_current->seconds[static_cast<size_t>(timer)] += seconds;
+}
+
+inline RenderStats *current() noexcept {
+    return t_current;
+}
+#else
+inline void add([[maybe_unused]] const StatCounter counter, [[maybe_unused]] const uint64_t value = 1) noexcept {}
+inline void add_time([[maybe_unused]] const StatTimer timer, [[maybe_unused]] const double seconds) noexcept {}
+inline RenderStats *current() noexcept { return nullptr; }
+#endif
+
+} // stats
+
+/**
+ * Record the stats of the calling thread into `stats` (or stop recording them, if it's nullptr)
+ * until the end of the scope.
+ */
+class StatsScope {
+public:
+#ifdef CRT_ENABLE_STATS
+    explicit StatsScope(RenderStats *stats) noexcept
+        : m_previous(stats::t_current)
+    {
+        stats::t_current = stats;
+    }
+
+    ~StatsScope() {
+        stats::t_current = m_previous;
+    }
+#else
+    explicit StatsScope([[maybe_unused]] RenderStats *stats) noexcept {}
+#endif
+
+    StatsScope(const StatsScope &) = delete;
+    StatsScope &operator=(const StatsScope &) = delete;
+
+private:
+#ifdef CRT_ENABLE_STATS
+    RenderStats *m_previous;
+#endif
+};
+
+/**
+ * Add the time until the end of the scope to a timer of the calling thread's stats.
+ */
+class ScopedStatTimer {
+public:
+    explicit ScopedStatTimer(StatTimer timer) noexcept
+        : m_timer(timer)
+        , m_start(std::chrono::steady_clock::now())
+    {}
+
+    ~ScopedStatTimer() {
+        stats::add_time(m_timer, elapsed_seconds());
+    }
+
+    double elapsed_seconds() const noexcept {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    ScopedStatTimer(const ScopedStatTimer &) = delete;
+    ScopedStatTimer &operator=(const ScopedStatTimer &) = delete;
+
+private:
+    StatTimer m_timer;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+}
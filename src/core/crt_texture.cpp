@@ -6,7 +6,7 @@
 
 namespace crt {
 
-const Color &Texture::sample(const Vector &uv, float bary_u, float bary_v) const {
+Color Texture::sample(const Vector &uv, float bary_u, float bary_v, float footprint) const {
     switch (type) {
         case TextureType::Albedo:
             return as_albedo_tex.albedo;
@@ -35,14 +35,8 @@ const Color &Texture::sample(const Vector &uv, float bary_u, float bary_v) const
                 return ct.color_a;
         }
 
-        case TextureType::Bitmap: {
-            const Image &bti = *as_bitmap_tex.image;
-
-            int raster_x = static_cast<int>(uv.x * bti.width) % bti.width;
-            int raster_y = static_cast<int>((1.0f - uv.y) * bti.height) % bti.height;
-
-            return bti.buffer[raster_y * bti.width + raster_x];
-        }
+        case TextureType::Bitmap:
+            return as_bitmap_tex.bitmap->sample(uv, footprint);
     }
 
     std::unreachable();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "crt_bitmap.h"
 #include "crt_image.h"
 #include "crt_vector.h"
 
@@ -27,9 +28,10 @@ struct CheckerTexture {
 };
 
 struct BitmapTexture {
-    // FIXME: Level of inderection added because Image is not trivially distructable and cannot be part of the enum added because Image is not trivially distructable and cannot be part of the enum
-    //        I think I should use std::variant for this...
-    Image *image;
+    /**
+     * Owned by `Scene::bitmaps`, as the union of Texture can only hold trivially destructible types
+     */
+    const Bitmap *bitmap;
 };
 
 struct Texture {
@@ -42,11 +44,15 @@ struct Texture {
         BitmapTexture as_bitmap_tex;
     };
 
-    const Color &sample(const Vector &uv, float bary_u, float bary_v) const;
+    /**
+     * @param footprint Width of the area on the surface, covered by the lookup, in UV space.
+     *                  Used for picking a mip level of bitmap textures.
+     */
+    Color sample(const Vector &uv, float bary_u, float bary_v, float footprint = 0.0f) const;
 
     // ~Texture() {
     //     if (type == TextureType::Bitmap)
-    //         delete as_bitmap_tex.image;
+    //         delete as_bitmap_tex.bitmap;
     // }
 };
     
@@ -0,0 +1,231 @@
+#include "crt_texture_pages.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include "crt_allocation_check.h"
+#include "crt_trace.h"
+
+namespace crt {
+
+inline constexpr uint32_t PAGE_FILE_MAGIC = 0x54545243; // "CRTT"
+inline constexpr uint32_t PAGE_FILE_VERSION = 1;
+/**
+ * Magic, version, format, width, height and page size, 4 bytes each
+ */
+inline constexpr size_t PAGE_FILE_HEADER_SIZE = 6 * 4;
+
+/**
+ * Larger bitmaps are treated as a broken file
+ */
+inline constexpr int MAX_PAGE_FILE_BITMAP_SIZE = 1 << 20;
+
+static size_t get_texel_size(const BitmapFormat format) noexcept {
+    return format == BitmapFormat::RGBA8 ? 4 * sizeof(uint8_t) : 4 * sizeof(uint16_t);
+}
+
+size_t get_texture_page_count(int width, int height) {
+    size_t page_count = 0;
+    for (;;) {
+        const size_t page_count_x = (width + TEXTURE_PAGE_SIZE - 1) / TEXTURE_PAGE_SIZE;
+        const size_t page_count_y = (height + TEXTURE_PAGE_SIZE - 1) / TEXTURE_PAGE_SIZE;
+        page_count += page_count_x * page_count_y;
+
+        if (width == 1 && height == 1)
+            return page_count;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+}
+
+bool write_texture_page_file_header(std::ostream &os, const TexturePageFileInfo &info) {
+    const uint32_t values[]{
+        PAGE_FILE_MAGIC,
+        PAGE_FILE_VERSION,
+        static_cast<uint32_t>(info.format),
+        static_cast<uint32_t>(info.width),
+        static_cast<uint32_t>(info.height),
+        static_cast<uint32_t>(TEXTURE_PAGE_SIZE),
+    };
+    for (const uint32_t value : values) {
+        char bytes[4];
+        for (int i = 0; i < 4; ++i)
+            bytes[i] = static_cast<char>(value >> (8 * i));
+        os.write(bytes, sizeof(bytes));
+    }
+    return static_cast<bool>(os);
+}
+
+static std::atomic<uint64_t> next_page_file_id{ 1 };
+
+TexturePageFile::TexturePageFile(std::ifstream file, const TexturePageFileInfo &info, TexturePageCache &page_cache)
+    : m_file(std::move(file))
+    , m_info(info)
+    , m_page_memory_size(static_cast<size_t>(TEXTURE_PAGE_SIZE) * TEXTURE_PAGE_SIZE * get_texel_size(info.format))
+    , m_id(next_page_file_id++)
+    , m_page_cache(page_cache)
+{
+}
+
+TexturePageFile::~TexturePageFile() {
+    m_page_cache.discard(m_id);
+}
+
+std::shared_ptr<TexturePageFile> TexturePageFile::open(const std::filesystem::path &file_path, TexturePageCache &page_cache) {
+    std::ifstream file{ file_path, std::ios::in | std::ios::binary };
+    if (!file.is_open())
+        return nullptr;
+
+    uint32_t values[PAGE_FILE_HEADER_SIZE / 4];
+    for (uint32_t &value : values) {
+        unsigned char bytes[4];
+        if (!file.read(reinterpret_cast<char *>(bytes), sizeof(bytes)))
+            return nullptr;
+        value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    }
+
+    const auto [magic, version, format, width, height, page_size] = values;
+    if (magic != PAGE_FILE_MAGIC || version != PAGE_FILE_VERSION || page_size != TEXTURE_PAGE_SIZE)
+        return nullptr;
+    if (format != static_cast<uint32_t>(BitmapFormat::RGBA8) && format != static_cast<uint32_t>(BitmapFormat::RGBA16F))
+        return nullptr;
+    if (width == 0 || height == 0 || width > MAX_PAGE_FILE_BITMAP_SIZE || height > MAX_PAGE_FILE_BITMAP_SIZE)
+        return nullptr;
+
+    const TexturePageFileInfo info{
+        .format = static_cast<BitmapFormat>(format),
+        .width = static_cast<int>(width),
+        .height = static_cast<int>(height),
+    };
+
+    // NOTE: A truncated file is rejected here, rather than while rendering
+    std::error_code error;
+    const uintmax_t file_size = std::filesystem::file_size(file_path, error);
+    const size_t page_size_in_bytes = static_cast<size_t>(TEXTURE_PAGE_SIZE) * TEXTURE_PAGE_SIZE * get_texel_size(info.format);
+    if (error || file_size < PAGE_FILE_HEADER_SIZE + get_texture_page_count(info.width, info.height) * page_size_in_bytes)
+        return nullptr;
+
+    return std::shared_ptr<TexturePageFile>{ new TexturePageFile{ std::move(file), info, page_cache } };
+}
+
+TexturePage TexturePageFile::read_page(const size_t page_index) const {
+    TraceScope trace_scope{ "read_texture_page" };
+
+    TexturePage page(m_page_memory_size);
+    std::scoped_lock lock{ m_mutex };
+    m_file.clear();
+    m_file.seekg(static_cast<std::streamoff>(PAGE_FILE_HEADER_SIZE + page_index * m_page_memory_size));
+    if (!m_file.read(reinterpret_cast<char *>(page.data()), static_cast<std::streamsize>(page.size()))) {
+        // NOTE: The file was checked when it was opened, so this is an I/O error. The texels are rendered black.
+        std::fill(page.begin(), page.end(), std::byte{ 0 });
+    }
+    return page;
+}
+
+TexturePageCache &TexturePageCache::global() {
+    // NOTE: Never destroyed, as paged bitmaps in other static objects (eg. a cache of bitmaps) can outlive it
+    static TexturePageCache *page_cache = new TexturePageCache;
+    return *page_cache;
+}
+
+TexturePageCache::TexturePageCache(const size_t memory_budget)
+    : m_shard_memory_budget(memory_budget / SHARD_COUNT)
+{
+}
+
+size_t TexturePageCache::PageKeyHash::operator()(const PageKey &key) const noexcept {
+    // NOTE: The page index varies the most between lookups, so it's in the low bits
+    return std::hash<uint64_t>{}((key.file_id << 40) ^ key.page_index);
+}
+
+TexturePageCache::Shard &TexturePageCache::get_shard(const PageKey &key) {
+    // NOTE: Neighbouring pages are spread over the shards, since neighbouring rays fetch them together
+    return m_shards[(key.page_index + key.file_id) % SHARD_COUNT];
+}
+
+std::shared_ptr<const TexturePage> TexturePageCache::get(const TexturePageFile &file, const size_t page_index) {
+    const PageKey key{ .file_id = file.id(), .page_index = page_index };
+    Shard &shard = get_shard(key);
+    {
+        std::scoped_lock lock{ shard.mutex };
+        if (auto it = shard.entries.find(key); it != shard.entries.end()) {
+            shard.stats.hits++;
+            shard.lru.splice(shard.lru.end(), shard.lru, it->second.lru_position);
+            return it->second.page;
+        }
+    }
+
+    // Pages are loaded, while rendering, by design
+    AllowAllocationsScope allow_allocations_scope;
+
+    // NOTE: Read without the lock. Another thread, which misses the same page meanwhile, reads it as well
+    //       and the first one in the cache is kept.
+    std::shared_ptr<const TexturePage> page = std::make_shared<const TexturePage>(file.read_page(page_index));
+
+    std::scoped_lock lock{ shard.mutex };
+    shard.stats.misses++;
+    auto [it, inserted] = shard.entries.try_emplace(key);
+    if (!inserted)
+        return it->second.page;
+
+    shard.lru.push_back(key);
+    it->second = Entry{ .page = page, .lru_position = std::prev(shard.lru.end()) };
+    shard.memory_size += page->size();
+    shard.stats.page_count++;
+    evict_over_budget(shard);
+    return page;
+}
+
+void TexturePageCache::evict_over_budget(Shard &shard) {
+    const size_t memory_budget = m_shard_memory_budget.load(std::memory_order_relaxed);
+    // NOTE: The page, which was just read, is kept, even when it alone is over the budget of the shard
+    while (shard.memory_size > memory_budget && shard.lru.size() > 1) {
+        auto it = shard.entries.find(shard.lru.front());
+        shard.memory_size -= it->second.page->size();
+        shard.stats.evictions++;
+        shard.stats.page_count--;
+        shard.entries.erase(it);
+        shard.lru.pop_front();
+    }
+}
+
+void TexturePageCache::discard(const uint64_t file_id) {
+    for (Shard &shard : m_shards) {
+        std::scoped_lock lock{ shard.mutex };
+        for (auto lru_it = shard.lru.begin(); lru_it != shard.lru.end();) {
+            if (lru_it->file_id != file_id) {
+                ++lru_it;
+                continue;
+            }
+            auto it = shard.entries.find(*lru_it);
+            shard.memory_size -= it->second.page->size();
+            shard.stats.page_count--;
+            shard.entries.erase(it);
+            lru_it = shard.lru.erase(lru_it);
+        }
+    }
+}
+
+void TexturePageCache::set_memory_budget(const size_t memory_budget) {
+    m_shard_memory_budget = memory_budget / SHARD_COUNT;
+    for (Shard &shard : m_shards) {
+        std::scoped_lock lock{ shard.mutex };
+        evict_over_budget(shard);
+    }
+}
+
+TexturePageCacheStats TexturePageCache::stats() const {
+    TexturePageCacheStats result;
+    for (const Shard &shard : m_shards) {
+        std::scoped_lock lock{ shard.mutex };
+        result.hits += shard.stats.hits;
+        result.misses += shard.stats.misses;
+        result.evictions += shard.stats.evictions;
+        result.page_count += shard.stats.page_count;
+        result.memory_size += shard.memory_size;
+    }
+    return result;
+}
+
+}
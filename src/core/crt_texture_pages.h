@@ -0,0 +1,195 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "crt_bitmap.h"
+
+namespace crt {
+
+/**
+ * Pages are squares of this many texels, made of BITMAP_TILE_SIZE x BITMAP_TILE_SIZE tiles
+ */
+inline constexpr int TEXTURE_PAGE_SIZE = 64;
+static_assert(TEXTURE_PAGE_SIZE % BITMAP_TILE_SIZE == 0, "Pages must consist of whole tiles");
+
+inline constexpr size_t DEFAULT_TEXTURE_PAGE_CACHE_BUDGET = size_t{ 512 } * 1024 * 1024;
+
+/**
+ * The texels of a page, laid out like the tiles of a Bitmap level, TEXTURE_PAGE_SIZE / BITMAP_TILE_SIZE
+ * tiles wide
+ */
+using TexturePage = std::vector<std::byte>;
+
+struct TexturePageFileInfo {
+    BitmapFormat format;
+    int width, height;
+};
+
+class TexturePageCache;
+
+/**
+ * A mipmapped bitmap on disk, split into pages, which are read one at a time.
+ *
+ * The file is a small header (see write_texture_page_file_header()), followed by the pages of every
+ * level from the largest to the 1x1 one, row by row. Pages at the right and bottom edges of a level are
+ * padded to the full size, so that the offset of every page can be computed.
+ *
+ * Thread-safe.
+ */
+class TexturePageFile {
+public:
+    static std::shared_ptr<TexturePageFile> open(const std::filesystem::path &file_path, TexturePageCache &page_cache);
+
+    ~TexturePageFile();
+
+    TexturePageFile(const TexturePageFile &) = delete;
+    TexturePageFile &operator=(const TexturePageFile &) = delete;
+
+    const TexturePageFileInfo &info() const noexcept {
+        return m_info;
+    }
+
+    /**
+     * Unique in the process, also after the file was closed, so that pages are never mistaken for the
+     * ones of another file
+     */
+    uint64_t id() const noexcept {
+        return m_id;
+    }
+
+    TexturePageCache &page_cache() const noexcept {
+        return m_page_cache;
+    }
+
+    size_t page_memory_size() const noexcept {
+        return m_page_memory_size;
+    }
+
+    /**
+     * Read a page from the file, bypassing the cache. An unreadable page is all zeros.
+     */
+    TexturePage read_page(size_t page_index) const;
+
+private:
+    TexturePageFile(std::ifstream file, const TexturePageFileInfo &info, TexturePageCache &page_cache);
+
+    mutable std::mutex m_mutex;
+    mutable std::ifstream m_file;
+    TexturePageFileInfo m_info;
+    size_t m_page_memory_size;
+    uint64_t m_id;
+    TexturePageCache &m_page_cache;
+};
+
+bool write_texture_page_file_header(std::ostream &os, const TexturePageFileInfo &info);
+
+/**
+ * Number of pages in all levels of a bitmap of the given size
+ */
+size_t get_texture_page_count(int width, int height);
+
+struct TexturePageCacheStats {
+    /**
+     * Lookups of a page, which was in the cache. Lookups, which are served by the small cache every
+     * render thread keeps of the pages it used last, don't get here.
+     */
+    uint64_t hits{ 0 };
+    /**
+     * Lookups, which had to read the page from its file
+     */
+    uint64_t misses{ 0 };
+    /**
+     * Pages dropped from the cache to stay within its memory budget
+     */
+    uint64_t evictions{ 0 };
+    size_t page_count{ 0 };
+    /**
+     * Size of the texels of the pages in the cache, in bytes
+     */
+    size_t memory_size{ 0 };
+};
+
+/**
+ * Keeps the recently used pages of all page files within a memory budget, evicting the least recently
+ * used ones.
+ *
+ * Pages are handed out as shared pointers, so an evicted page stays valid, while a thread still samples it.
+ * The pages are spread over shards with separate locks, so that render threads rarely wait on each other.
+ *
+ * Thread-safe.
+ */
+class TexturePageCache {
+public:
+    /**
+     * The cache of the bitmaps, which are loaded from page files by scenes
+     */
+    static TexturePageCache &global();
+
+    explicit TexturePageCache(size_t memory_budget = DEFAULT_TEXTURE_PAGE_CACHE_BUDGET);
+
+    TexturePageCache(const TexturePageCache &) = delete;
+    TexturePageCache &operator=(const TexturePageCache &) = delete;
+
+    std::shared_ptr<const TexturePage> get(const TexturePageFile &file, size_t page_index);
+
+    /**
+     * Drop the pages of a file, which is closed
+     */
+    void discard(uint64_t file_id);
+
+    void set_memory_budget(size_t memory_budget);
+
+    TexturePageCacheStats stats() const;
+
+private:
+    struct PageKey {
+        uint64_t file_id;
+        size_t page_index;
+
+        constexpr bool operator==(const PageKey &) const = default;
+    };
+
+    struct PageKeyHash {
+        size_t operator()(const PageKey &key) const noexcept;
+    };
+
+    struct Entry {
+        std::shared_ptr<const TexturePage> page;
+        std::list<PageKey>::iterator lru_position;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<PageKey, Entry, PageKeyHash> entries;
+        /**
+         * From the least to the most recently used
+         */
+        std::list<PageKey> lru;
+        size_t memory_size{ 0 };
+        TexturePageCacheStats stats;
+    };
+
+    static constexpr size_t SHARD_COUNT = 16;
+
+    Shard &get_shard(const PageKey &key);
+    /**
+     * Requires the mutex of the shard.
+     */
+    void evict_over_budget(Shard &shard);
+
+    std::atomic<size_t> m_shard_memory_budget;
+    std::array<Shard, SHARD_COUNT> m_shards;
+};
+
+}
@@ -0,0 +1,51 @@
+#include "crt_thread_pool.h"
+
+#include <cassert>
+
+namespace crt {
+
+ThreadPool::ThreadPool(unsigned thread_count) {
+    assert(thread_count > 0);
+
+    m_threads.reserve(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i) {
+        m_threads.emplace_back([this, i](std::stop_token stop_token) {
+            work(stop_token, i);
+        });
+    }
+}
+
+void ThreadPool::run(const std::function<void(unsigned worker_index)> &task) {
+    std::scoped_lock run_lock{ m_run_mutex };
+
+    std::unique_lock lock{ m_mutex };
+    m_task = &task;
+    m_generation++;
+    m_running_count = thread_count();
+    m_task_ready.notify_all();
+
+    m_task_done.wait(lock, [this]() { return m_running_count == 0; });
+    m_task = nullptr;
+}
+
+void ThreadPool::work(std::stop_token stop_token, unsigned worker_index) {
+    uint64_t finished_generation = 0;
+
+    for (;;) {
+        std::unique_lock lock{ m_mutex };
+        if (!m_task_ready.wait(lock, stop_token, [&]() { return m_generation != finished_generation; }))
+            return;
+
+        const std::function<void(unsigned)> &task = *m_task;
+        finished_generation = m_generation;
+        lock.unlock();
+
+        task(worker_index);
+
+        lock.lock();
+        if (--m_running_count == 0)
+            m_task_done.notify_one();
+    }
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace crt {
+
+/**
+ * A fixed set of worker threads, which are kept alive between renders.
+ *
+ * Meant for rendering many images in a row (eg. the frames of an animation), where starting
+ * the threads anew for every image would add up.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned thread_count = std::max(1u, std::thread::hardware_concurrency()));
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned thread_count() const noexcept {
+        return static_cast<unsigned>(m_threads.size());
+    }
+
+    /**
+     * Call `task(worker_index)` once on every worker and wait until all of them have returned.
+     *
+     * @note Calls from several threads are serialized.
+     */
+    void run(const std::function<void(unsigned worker_index)> &task);
+
+private:
+    void work(std::stop_token stop_token, unsigned worker_index);
+
+    std::mutex m_run_mutex;
+
+    std::mutex m_mutex;
+    std::condition_variable_any m_task_ready;
+    std::condition_variable m_task_done;
+    const std::function<void(unsigned)> *m_task{ nullptr };
+    /**
+     * Incremented for every task, so that the workers can tell a new one from the one they've just finished
+     */
+    uint64_t m_generation{ 0 };
+    unsigned m_running_count{ 0 };
+
+    // NOTE: Last, so that the threads are stopped and joined before the rest is destroyed
+    std::vector<std::jthread> m_threads;
+};
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <span>
+
+#include "crt_image.h"
+
+namespace crt {
+
+/**
+ * A rectangular region of the final image, which is rendered as a whole by a single thread.
+ */
+struct Bucket {
+    int x, y, width, height;
+
+    constexpr bool operator==(const Bucket &) const = default;
+};
+
+/**
+ * Hands out the buckets to render.
+ *
+ * @warning next_bucket() is called concurrently from all render threads.
+ */
+class BucketSource {
+public:
+    virtual ~BucketSource() = default;
+
+    /**
+     * The next bucket to render, or nullopt once there are no more. May block until one is available.
+     */
+    virtual std::optional<Bucket> next_bucket() = 0;
+};
+
+/**
+ * A rendered rectangular region (bucket) of the final image.
+ */
+struct Tile {
+    int x, y, width, height;
+    /**
+     * Row-major, `width * height` pixels
+     */
+    std::span<const Color> pixels;
+};
+
+/**
+ * Receives tiles as soon as they are finished rendering.
+ *
+ * @warning write_tile() is called concurrently from all render threads.
+ */
+class TileSink {
+public:
+    virtual ~TileSink() = default;
+
+    virtual void write_tile(const Tile &tile) = 0;
+};
+
+/**
+ * Assembles the tiles into an in-memory Image.
+ */
+class ImageTileSink : public TileSink {
+public:
+    explicit ImageTileSink(Image &image)
+        : m_image(image)
+    {}
+
+    void write_tile(const Tile &tile) override {
+        // Tiles never overlap, so no locking is required
+        for (int row = 0; row < tile.height; ++row) {
+            const auto row_pixels = tile.pixels.subspan(row * tile.width, tile.width);
+            std::copy(row_pixels.begin(), row_pixels.end(), m_image.buffer.begin() + (tile.y + row) * m_image.width + tile.x);
+        }
+    }
+
+private:
+    Image &m_image;
+};
+
+}
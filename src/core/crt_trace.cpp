@@ -0,0 +1,155 @@
+#include "crt_trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace crt {
+
+namespace trace {
+
+#ifdef CRT_ENABLE_TRACE
+/**
+ * Ring buffer of the events of one thread in one session. It's only written by its thread, so recording
+ * takes no locks. It's kept alive by the registry after the thread exits, so that its events can be written.
+ */
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+    uint64_t recorded_count{ 0 };
+    std::string thread_name;
+    int thread_id;
+};
+
+static std::mutex g_buffers_mutex;
+static std::vector<std::shared_ptr<TraceBuffer>> g_buffers;
+
+static std::atomic<bool> g_is_enabled{ false };
+/**
+ * Incremented by every start(), so that threads know their buffer belongs to a previous session
+ */
+static std::atomic<uint64_t> g_session{ 0 };
+static std::atomic<int> g_next_thread_id{ 1 };
+static std::chrono::steady_clock::time_point g_epoch;
+
+static thread_local std::shared_ptr<TraceBuffer> t_buffer;
+static thread_local uint64_t t_buffer_session{ 0 };
+static thread_local std::string t_thread_name;
+static thread_local int t_thread_id{ 0 };
+
+static TraceBuffer &get_thread_buffer() {
+    const uint64_t session = g_session.load(std::memory_order_relaxed);
+    if (t_buffer && t_buffer_session == session)
+        return *t_buffer;
+
+    if (t_thread_id == 0)
+        t_thread_id = g_next_thread_id.fetch_add(1, std::memory_order_relaxed);
+
+    t_buffer = std::make_shared<TraceBuffer>();
+    t_buffer->thread_name = t_thread_name;
+    t_buffer->thread_id = t_thread_id;
+    t_buffer_session = session;
+
+    std::scoped_lock lock{ g_buffers_mutex };
+    g_buffers.push_back(t_buffer);
+    return *t_buffer;
+}
+
+void start() {
+    {
+        std::scoped_lock lock{ g_buffers_mutex };
+        g_buffers.clear();
+    }
+    g_epoch = std::chrono::steady_clock::now();
+    g_session.fetch_add(1, std::memory_order_relaxed);
+    g_is_enabled.store(true, std::memory_order_release);
+}
+
+void stop() {
+    g_is_enabled.store(false, std::memory_order_release);
+}
+
+bool is_enabled() noexcept {
+    return g_is_enabled.load(std::memory_order_relaxed);
+}
+
+void set_thread_name(std::string name) {
+    t_thread_name = std::move(name);
+    if (t_buffer && t_buffer_session == g_session.load(std::memory_order_relaxed))
+        t_buffer->thread_name = t_thread_name;
+}
+
+void record(const TraceEvent &event) {
+    TraceBuffer &buffer = get_thread_buffer();
+    if (buffer.events.size() < TRACE_BUFFER_CAPACITY)
+        buffer.events.push_back(event);
+    else
+        buffer.events[buffer.recorded_count % TRACE_BUFFER_CAPACITY] = event;
+    buffer.recorded_count++;
+}
+
+int64_t now_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+static void write_event(std::ostream &os, const TraceEvent &event, const int thread_id) {
+    os << "{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread_id
+       << ",\"ts\":" << event.start_ns / 1000.0 << ",\"dur\":" << event.duration_ns / 1000.0;
+    if (event.args[0].name) {
+        os << ",\"args\":{";
+        for (size_t i = 0; i < event.args.size() && event.args[i].name; ++i)
+            os << (i > 0 ? "," : "") << '"' << event.args[i].name << "\":" << event.args[i].value;
+        os << '}';
+    }
+    os << '}';
+}
+
+void write_chrome_trace(std::ostream &os) {
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+
+    std::scoped_lock lock{ g_buffers_mutex };
+
+    // NOTE: Names are string literals and thread names are set by the renderer, so they are not escaped
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool is_first = true;
+    const auto separate = [&]() {
+        if (!is_first)
+            os << ",\n";
+        is_first = false;
+    };
+
+    for (const std::shared_ptr<TraceBuffer> &buffer : g_buffers) {
+        if (!buffer->thread_name.empty()) {
+            separate();
+            os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id
+               << ",\"args\":{\"name\":\"" << buffer->thread_name << "\"}}";
+        }
+
+        // Oldest first. Once the ring buffer wrapped around, that's the one after the last written event.
+        const size_t event_count = buffer->events.size();
+        const size_t first = buffer->recorded_count > event_count ? buffer->recorded_count % event_count : 0;
+        for (size_t i = 0; i < event_count; ++i) {
+            separate();
+            write_event(os, buffer->events[(first + i) % event_count], buffer->thread_id);
+        }
+    }
+    os << "\n]}\n";
+
+    os.flags(flags);
+    os.precision(precision);
+}
+#else
+void write_chrome_trace(std::ostream &os) {
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[]}\n";
+}
+#endif
+
+} // trace
+
+}
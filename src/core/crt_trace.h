@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace crt {
+
+/**
+ * Integer argument of a trace event, shown when the event is selected in the trace viewer.
+ */
+struct TraceArg {
+    const char *name{ nullptr };
+    int64_t value{ 0 };
+};
+
+/**
+ * A completed span of time on one thread.
+ *
+ * @warning The name and category are not copied, they must be string literals (or otherwise outlive the trace).
+ */
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    int64_t start_ns;
+    int64_t duration_ns;
+    std::array<TraceArg, 2> args;
+};
+
+/**
+ * Events, which are kept per thread. When a thread records more of them, the oldest ones are overwritten.
+ */
+inline constexpr size_t TRACE_BUFFER_CAPACITY = 1 << 14;
+
+namespace trace {
+
+#ifdef CRT_ENABLE_TRACE
+/**
+ * Start recording events on all threads. Events recorded by a previous session are discarded.
+ *
+ * @warning Not synchronized with the recording threads, so it must not be called while traced work is running.
+ */
+void start();
+
+/**
+ * Stop recording events. The recorded ones are kept until the next start().
+ */
+void stop();
+
+bool is_enabled() noexcept;
+
+/**
+ * Name the calling thread in the trace (e.g. "render worker 3").
+ */
+void set_thread_name(std::string name);
+
+void record(const TraceEvent &event);
+
+int64_t now_ns() noexcept;
+#else
+inline void start() {}
+inline void stop() {}
+inline bool is_enabled() noexcept { return false; }
+inline void set_thread_name([[maybe_unused]] std::string name) {}
+#endif
+
+/**
+ * Write the events of the last session in the Chrome trace event format, which can be opened with Perfetto
+ * (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * @warning Must not be called while traced work is running.
+ */
+void write_chrome_trace(std::ostream &os);
+
+} // trace
+
+/**
+ * Record the time until the end of the scope as an event of the calling thread, if tracing is enabled.
+ */
+class TraceScope {
+public:
+#ifdef CRT_ENABLE_TRACE
+    explicit TraceScope(const char *name, TraceArg arg0 = {}, TraceArg arg1 = {}) noexcept
+        : m_name(trace::is_enabled() ? name : nullptr)
+        , m_start_ns(m_name ? trace::now_ns() : 0)
+        , m_args{ arg0, arg1 }
+    {}
+
+    ~TraceScope() {
+        if (m_name)
+            trace::record(TraceEvent{ m_name, "crt", m_start_ns, trace::now_ns() - m_start_ns, m_args });
+    }
+#else
+    explicit TraceScope([[maybe_unused]] const char *name, [[maybe_unused]] TraceArg arg0 = {}, [[maybe_unused]] TraceArg arg1 = {}) noexcept {}
+#endif
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+#ifdef CRT_ENABLE_TRACE
+    const char *m_name;
+    int64_t m_start_ns;
+    std::array<TraceArg, 2> m_args;
+#endif
+};
+
+}
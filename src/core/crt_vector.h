@@ -1,29 +1,93 @@
 #pragma once
 
+#include <cstddef>
 #include <optional>
 
+#ifdef CRT_SIMD_VECTOR
+#include <emmintrin.h>
+#endif
+
 namespace crt {
 
-struct Vector {
+#ifdef CRT_SIMD_VECTOR
+/**
+ * Vectors are padded to 4 floats, so that they fill a whole SSE register
+ */
+inline constexpr size_t VECTOR_ALIGNMENT = 16;
+#else
+inline constexpr size_t VECTOR_ALIGNMENT = alignof(float);
+#endif
+
+/**
+ * With CRT_SIMD_VECTOR, the operators are done with SSE at runtime and with the scalar code at compile
+ * time. Both evaluate in the same order, so they give the same results.
+ */
+struct alignas(VECTOR_ALIGNMENT) Vector {
     union {
         struct { float x, y, z; };
         float data[3];
     };
+#ifdef CRT_SIMD_VECTOR
+    /**
+     * Unused 4th lane. Operators don't keep it at 0, so it must never be read.
+     */
+    float padding{ 0.0f };
+
+    __m128 simd() const {
+        return _mm_load_ps(&x);
+    }
+
+    static Vector from_simd(const __m128 v) {
+        Vector result;
+        _mm_store_ps(&result.x, v);
+        return result;
+    }
+
+    /**
+     * Sum of the first 3 lanes, added in the same order as the scalar code
+     */
+    static float sum3(const __m128 v) {
+        const __m128 y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+        const __m128 z = _mm_movehl_ps(v, v);
+        return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(v, y), z));
+    }
+#endif
 
     constexpr float length_squared() const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            const __m128 v = simd();
+            return sum3(_mm_mul_ps(v, v));
+        }
+#endif
         return x * x + y * y + z * z;
     }
 
     float length() const;
 
     constexpr Vector operator+(const Vector &rhs) const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return from_simd(_mm_add_ps(simd(), rhs.simd()));
+        }
+#endif
         return { x + rhs.x, y + rhs.y, z + rhs.z };
     }
 
     constexpr Vector operator+(const float rhs) const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return from_simd(_mm_add_ps(simd(), _mm_set1_ps(rhs)));
+        }
+#endif
         return { x + rhs, y + rhs, z + rhs };
     }
     constexpr Vector& operator+=(const Vector &rhs) {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return *this = *this + rhs;
+        }
+#endif
         x += rhs.x;
         y += rhs.y;
         z += rhs.z;
@@ -31,24 +95,49 @@ struct Vector {
     }
 
     constexpr Vector& operator+=(const float rhs) {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return *this = *this + rhs;
+        }
+#endif
         x += rhs;
         y += rhs;
         z += rhs;
         return *this;
     }
     constexpr Vector operator-(const Vector &rhs) const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return from_simd(_mm_sub_ps(simd(), rhs.simd()));
+        }
+#endif
         return { x - rhs.x, y - rhs.y, z - rhs.z };
     }
 
     constexpr Vector operator-(const float rhs) const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return from_simd(_mm_sub_ps(simd(), _mm_set1_ps(rhs)));
+        }
+#endif
         return { x - rhs, y - rhs, z - rhs };
     }
 
     constexpr Vector operator-() const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return from_simd(_mm_xor_ps(simd(), _mm_set1_ps(-0.0f)));
+        }
+#endif
         return { -x, -y, -z };
     }
 
     constexpr Vector& operator-=(const Vector &rhs) {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return *this = *this - rhs;
+        }
+#endif
         x -= rhs.x;
         y -= rhs.y;
         z -= rhs.z;
@@ -56,6 +145,11 @@ struct Vector {
     }
 
     constexpr Vector& operator-=(const float rhs) {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return *this = *this - rhs;
+        }
+#endif
         x -= rhs;
         y -= rhs;
         z -= rhs;
@@ -63,10 +157,20 @@ struct Vector {
     }
 
     constexpr Vector operator*(const float rhs) const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return from_simd(_mm_mul_ps(simd(), _mm_set1_ps(rhs)));
+        }
+#endif
         return { x * rhs, y * rhs, z * rhs };
     }
 
     constexpr Vector& operator*=(const float rhs) {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return *this = *this * rhs;
+        }
+#endif
         x *= rhs;
         y *= rhs;
         z *= rhs;
@@ -74,10 +178,20 @@ struct Vector {
     }
 
     constexpr Vector operator*(const Vector &rhs) const {
-        return { x * rhs.x, y * rhs.y * y, z * rhs.z };
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return from_simd(_mm_mul_ps(simd(), rhs.simd()));
+        }
+#endif
+        return { x * rhs.x, y * rhs.y, z * rhs.z };
     }
 
     constexpr Vector &operator*=(const Vector &rhs) {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return *this = *this * rhs;
+        }
+#endif
         x *= rhs.x;
         y *= rhs.y;
         z *= rhs.z;
@@ -85,10 +199,20 @@ struct Vector {
     }
 
     constexpr Vector operator/(const float rhs) const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return from_simd(_mm_div_ps(simd(), _mm_set1_ps(rhs)));
+        }
+#endif
         return { x / rhs, y / rhs, z / rhs };
     }
 
     constexpr Vector &operator/=(const float rhs) {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return *this = *this / rhs;
+        }
+#endif
         x /= rhs;
         y /= rhs;
         z /= rhs;
@@ -105,6 +229,14 @@ struct Vector {
     }
     
     constexpr Vector cross(const Vector &rhs) const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            const __m128 a = simd(), b = rhs.simd();
+            const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+            const __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+            return from_simd(_mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+        }
+#endif
         return {
             y * rhs.z - z * rhs.y,
             z * rhs.x - x * rhs.z,
@@ -113,6 +245,11 @@ struct Vector {
     }
 
     constexpr float dot(const Vector &rhs) const {
+#ifdef CRT_SIMD_VECTOR
+        if !consteval {
+            return sum3(_mm_mul_ps(simd(), rhs.simd()));
+        }
+#endif
         return x * rhs.x + y * rhs.y + z * rhs.z;
     }
 
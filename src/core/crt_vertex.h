@@ -1,13 +1,96 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
 #include "crt_vector.h"
 
 namespace crt {
 
-struct Vertex {
-    Vector position{};
-    Vector normal{};
-    Vector uv{};
+/**
+ * Unit vector, stored as two 16-bit snorm components of its octahedral projection.
+ *
+ * See "A Survey of Efficient Representations for Independent Unit Vectors" (Cigolle et al. 2014).
+ */
+struct OctahedralNormal {
+    int16_t u, v;
+
+    static OctahedralNormal encode(const Vector &normal) {
+        const float l1_norm = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        // Degenerate (zero or NaN) normals are mapped to +Z
+        if (!(l1_norm > 0.0f))
+            return { 0, 0 };
+
+        const float inv_l1_norm = 1.0f / l1_norm;
+        float u = normal.x * inv_l1_norm;
+        float v = normal.y * inv_l1_norm;
+
+        // Fold the lower hemisphere over the diagonals
+        if (normal.z < 0.0f) {
+            const float folded_u = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            const float folded_v = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = folded_u;
+            v = folded_v;
+        }
+
+        return {
+            static_cast<int16_t>(std::round(std::clamp(u, -1.0f, 1.0f) * 32767.0f)),
+            static_cast<int16_t>(std::round(std::clamp(v, -1.0f, 1.0f) * 32767.0f)),
+        };
+    }
+
+    Vector decode() const {
+        Vector result{ u / 32767.0f, v / 32767.0f, 0.0f };
+        result.z = 1.0f - std::abs(result.x) - std::abs(result.y);
+
+        const float t = std::max(-result.z, 0.0f);
+        result.x += result.x >= 0.0f ? -t : t;
+        result.y += result.y >= 0.0f ? -t : t;
+
+        return result.normalize();
+    }
 };
 
-}
\ No newline at end of file
+/**
+ * Texture coordinates without the W component, which is always 0.
+ *
+ * NOTE: The U and V stay full floats. Half floats step by 2^-11 in [0.5, 1), which is coarser than a texel
+ *       of a 4K bitmap, and UVs can't be normalized (e.g. to unorm16), as bitmaps repeat outside of [0, 1].
+ */
+struct PlanarUV {
+    float u, v;
+
+    static constexpr PlanarUV encode(const Vector &uv) {
+        return { uv.x, uv.y };
+    }
+
+    constexpr Vector decode() const {
+        return { u, v, 0.0f };
+    }
+};
+
+/**
+ * Uncompressed vertex attribute, for when the quantization error is not acceptable.
+ */
+struct FullVectorAttribute {
+    Vector value;
+
+    static constexpr FullVectorAttribute encode(const Vector &value) {
+        return { value };
+    }
+
+    constexpr Vector decode() const {
+        return value;
+    }
+};
+
+#ifdef CRT_COMPACT_VERTEX_ATTRIBUTES
+using VertexNormal = OctahedralNormal;
+using VertexUV = PlanarUV;
+#else
+using VertexNormal = FullVectorAttribute;
+using VertexUV = FullVectorAttribute;
+#endif
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "core/crt_random.h"
+#include "core/crt_vector.h"
+
+namespace crt::microbench {
+
+/**
+ * Number of precomputed inputs each benchmark cycles through. Large enough to defeat branch prediction
+ * on the input data, small enough to stay in L1, so only the kernel itself is measured.
+ */
+inline constexpr size_t INPUT_COUNT = 1024;
+
+inline PCG32 make_input_rng() {
+    return make_pcg(0x5eed, 0xbe4c);
+}
+
+inline Vector random_unit_vector(PCG32 &rng) {
+    // Rejection sampling in the unit ball, so the directions are uniform
+    while (true) {
+        const Vector v{ 2.0f * rng.uniform() - 1.0f, 2.0f * rng.uniform() - 1.0f, 2.0f * rng.uniform() - 1.0f };
+        const float length_squared = v.length_squared();
+        if (length_squared > 1e-4f && length_squared <= 1.0f)
+            return v.normalized();
+    }
+}
+
+/**
+ * Cycle through the inputs, one per iteration
+ */
+template <typename T>
+class InputCycle {
+public:
+    explicit InputCycle(const std::vector<T> &inputs)
+        : m_inputs(inputs)
+    {}
+
+    const T &next() noexcept {
+        const T &input = m_inputs[m_index];
+        m_index = (m_index + 1) % m_inputs.size();
+        return input;
+    }
+
+private:
+    const std::vector<T> &m_inputs;
+    size_t m_index{ 0 };
+};
+
+}
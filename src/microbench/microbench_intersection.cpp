@@ -0,0 +1,136 @@
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "bench/bench_scenes.h"
+#include "core/crt_aabb.h"
+#include "core/crt_acceleration_tree.h"
+#include "core/crt_intersection.h"
+#include "core/crt_mesh.h"
+#include "core/crt_ray.h"
+
+#include "microbench_inputs.h"
+
+using namespace crt;
+using namespace crt::microbench;
+
+/**
+ * Rays from random points around the unit box towards random points near it, so about half of them hit
+ */
+static std::vector<Ray> make_box_rays() {
+    PCG32 rng = make_input_rng();
+    std::vector<Ray> rays;
+    rays.reserve(INPUT_COUNT);
+    for (size_t i = 0; i < INPUT_COUNT; ++i) {
+        const Vector origin = random_unit_vector(rng) * 5.0f;
+        const Vector target{ 3.0f * rng.uniform() - 1.5f, 3.0f * rng.uniform() - 1.5f, 3.0f * rng.uniform() - 1.5f };
+        rays.push_back(Ray{ .origin = origin, .direction = (target - origin).normalized() });
+    }
+    return rays;
+}
+
+static void BM_RayIntersectAABB(benchmark::State &state) {
+    const AABB aabb{ { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f } };
+    const std::vector<Ray> rays = make_box_rays();
+    InputCycle cycle{ rays };
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(intersection::ray_intersect_aabb_p(cycle.next(), aabb));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RayIntersectAABB);
+
+static void BM_RayIntersectTriangle(benchmark::State &state) {
+    Geometry geometry;
+    const Vector positions[]{ { -1.0f, -1.0f, 0.0f }, { 1.0f, -1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } };
+    const int indices[]{ 0, 1, 2 };
+    vertex_array_extend(geometry, positions, indices, 0, TriangleFlags{ .smooth_shading = state.range(0) != 0, .back_face_culling = false });
+
+    const std::vector<Ray> rays = make_box_rays();
+    InputCycle cycle{ rays };
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(intersection::ray_intersect_triangle(cycle.next(), geometry, 0));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RayIntersectTriangle)->ArgName("smooth")->Arg(0)->Arg(1);
+
+/**
+ * A leaf of the acceleration tree: a fan of triangles around the z axis, in planes spread through the unit box
+ */
+static Geometry make_triangle_fan(const int triangle_count) {
+    Geometry geometry;
+    std::vector<Vector> positions;
+    std::vector<int> indices;
+    for (int i = 0; i < triangle_count; ++i) {
+        const float angle = 6.2831853f * i / triangle_count, next_angle = 6.2831853f * (i + 1) / triangle_count;
+        const float z = 2.0f * i / triangle_count - 1.0f;
+        positions.push_back({ 0.0f, 0.0f, z });
+        positions.push_back({ std::cos(angle), std::sin(angle), z });
+        positions.push_back({ std::cos(next_angle), std::sin(next_angle), z });
+        for (int vertex = 0; vertex < 3; ++vertex)
+            indices.push_back(3 * i + vertex);
+    }
+    vertex_array_extend(geometry, positions, indices, 0, TriangleFlags{ .smooth_shading = false, .back_face_culling = false });
+    return geometry;
+}
+
+static std::vector<uint32_t> make_triangle_indices(const int triangle_count) {
+    std::vector<uint32_t> triangle_indices(triangle_count);
+    for (int i = 0; i < triangle_count; ++i)
+        triangle_indices[i] = i;
+    return triangle_indices;
+}
+
+static void BM_RayIntersectTriangleSpan(benchmark::State &state) {
+    const int triangle_count = static_cast<int>(state.range(0));
+    const Geometry geometry = make_triangle_fan(triangle_count);
+    const std::vector<uint32_t> triangle_indices = make_triangle_indices(triangle_count);
+
+    const std::vector<Ray> rays = make_box_rays();
+    InputCycle cycle{ rays };
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(intersection::ray_intersect_triangle_span(cycle.next(), geometry, triangle_indices));
+    state.SetItemsProcessed(state.iterations() * triangle_count);
+}
+BENCHMARK(BM_RayIntersectTriangleSpan)->ArgName("triangles")->Arg(1)->Arg(4)->Arg(8)->Arg(16);
+
+#ifdef CRT_SIMD
+static void BM_RayIntersectTrianglePackets(benchmark::State &state) {
+    const int triangle_count = static_cast<int>(state.range(0));
+    const Geometry geometry = make_triangle_fan(triangle_count);
+    const std::vector<uint32_t> triangle_indices = make_triangle_indices(triangle_count);
+    const std::vector<TrianglePacket> packets = acceleration_tree::make_triangle_packets(geometry, triangle_indices);
+
+    const std::vector<Ray> rays = make_box_rays();
+    InputCycle cycle{ rays };
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(intersection::ray_intersect_triangle_packets(cycle.next(), geometry, packets, triangle_indices));
+    state.SetItemsProcessed(state.iterations() * triangle_count);
+}
+BENCHMARK(BM_RayIntersectTrianglePackets)->ArgName("triangles")->Arg(1)->Arg(4)->Arg(8)->Arg(16);
+#endif
+
+static void BM_RayIntersectAccelerationTree(benchmark::State &state) {
+    const Scene scene = bench::make_stress_scene({ .triangle_count = static_cast<uint32_t>(state.range(0)), .light_count = 1 });
+
+    // Camera rays through random pixels, so they see the same mix of hits and misses as a render
+    PCG32 rng = make_input_rng();
+    std::vector<Ray> rays;
+    rays.reserve(INPUT_COUNT);
+    for (size_t i = 0; i < INPUT_COUNT; ++i) {
+        const int x = static_cast<int>(rng.uniform() * scene.camera.resolution_x());
+        const int y = static_cast<int>(rng.uniform() * scene.camera.resolution_y());
+        rays.push_back(scene.camera.generate_ray(x, y));
+    }
+    InputCycle cycle{ rays };
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(intersection::ray_intersect_acceleration_tree(cycle.next(), scene.geometry, scene.acceleration_tree));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RayIntersectAccelerationTree)->ArgName("triangles")->RangeMultiplier(10)->Range(1'000, 1'000'000);
@@ -0,0 +1,101 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "core/crt_camera.h"
+#include "core/crt_matrix.h"
+#include "core/crt_random.h"
+#include "core/crt_vector.h"
+
+#include "microbench_inputs.h"
+
+using namespace crt;
+using namespace crt::microbench;
+
+static void BM_PCG32Uniform(benchmark::State &state) {
+    PCG32 rng = make_input_rng();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(rng.uniform());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PCG32Uniform);
+
+static void BM_CameraGenerateRay(benchmark::State &state) {
+    Transform transform;
+    transform.rotate_y(0.3f);
+    transform.rotate_x(-0.2f);
+    const Camera camera{ 1920, 1080, 60.0f, transform };
+
+    int x = 0, y = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(camera.generate_ray(x, y));
+        if (++x == camera.resolution_x()) {
+            x = 0;
+            y = (y + 1) % camera.resolution_y();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CameraGenerateRay);
+
+static void BM_VectorRefract(benchmark::State &state) {
+    // Directions towards the surface, so that both refraction and total internal reflection occur
+    PCG32 rng = make_input_rng();
+    std::vector<Vector> directions;
+    directions.reserve(INPUT_COUNT);
+    for (size_t i = 0; i < INPUT_COUNT; ++i) {
+        Vector direction = random_unit_vector(rng);
+        if (direction.y > 0.0f)
+            direction.y = -direction.y;
+        directions.push_back(direction);
+    }
+    InputCycle cycle{ directions };
+
+    const Vector normal{ 0.0f, 1.0f, 0.0f };
+    const float inside_ior = state.range(0) != 0 ? 1.0f : 1.5f;
+    const float outside_ior = state.range(0) != 0 ? 1.5f : 1.0f;
+    for (auto _ : state) {
+        Vector direction = cycle.next();
+        benchmark::DoNotOptimize(direction.refract(normal, outside_ior, inside_ior));
+        benchmark::DoNotOptimize(direction);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VectorRefract)->ArgName("exiting")->Arg(0)->Arg(1);
+
+static std::vector<Matrix> make_rotations() {
+    PCG32 rng = make_input_rng();
+    std::vector<Matrix> rotations;
+    rotations.reserve(INPUT_COUNT);
+    for (size_t i = 0; i < INPUT_COUNT; ++i)
+        rotations.push_back(Matrix::rotation_x(6.0f * rng.uniform()));
+    return rotations;
+}
+
+static void BM_MatrixMultiply(benchmark::State &state) {
+    const std::vector<Matrix> rotations = make_rotations();
+    InputCycle lhs_cycle{ rotations }, rhs_cycle{ rotations };
+    rhs_cycle.next();
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(lhs_cycle.next() * rhs_cycle.next());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MatrixMultiply);
+
+static void BM_VectorMatrixMultiply(benchmark::State &state) {
+    const std::vector<Matrix> rotations = make_rotations();
+    InputCycle rotation_cycle{ rotations };
+
+    PCG32 rng = make_input_rng();
+    std::vector<Vector> vectors;
+    vectors.reserve(INPUT_COUNT);
+    for (size_t i = 0; i < INPUT_COUNT; ++i)
+        vectors.push_back(random_unit_vector(rng));
+    InputCycle vector_cycle{ vectors };
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(vector_cycle.next() * rotation_cycle.next());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VectorMatrixMultiply);
@@ -0,0 +1,131 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "core/crt_bitmap.h"
+#include "core/crt_texture.h"
+#include "core/crt_texture_pages.h"
+
+#include "microbench_inputs.h"
+
+using namespace crt;
+using namespace crt::microbench;
+
+struct TextureSample {
+    Vector uv;
+    float bary_u, bary_v;
+};
+
+static std::vector<TextureSample> make_samples() {
+    PCG32 rng = make_input_rng();
+    std::vector<TextureSample> samples;
+    samples.reserve(INPUT_COUNT);
+    for (size_t i = 0; i < INPUT_COUNT; ++i) {
+        const float bary_u = rng.uniform();
+        const float bary_v = rng.uniform() * (1.0f - bary_u);
+        samples.push_back({ .uv = { 4.0f * rng.uniform(), 4.0f * rng.uniform(), 0.0f }, .bary_u = bary_u, .bary_v = bary_v });
+    }
+    return samples;
+}
+
+static void run_texture_sample(benchmark::State &state, const Texture &texture, const float footprint) {
+    const std::vector<TextureSample> samples = make_samples();
+    InputCycle cycle{ samples };
+
+    for (auto _ : state) {
+        const TextureSample &sample = cycle.next();
+        benchmark::DoNotOptimize(texture.sample(sample.uv, sample.bary_u, sample.bary_v, footprint));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_TextureSampleAlbedo(benchmark::State &state) {
+    const Texture texture{ .type = TextureType::Albedo, .as_albedo_tex = { Color{ 0.8f, 0.2f, 0.2f } } };
+    run_texture_sample(state, texture, 0.0f);
+}
+BENCHMARK(BM_TextureSampleAlbedo);
+
+static void BM_TextureSampleEdges(benchmark::State &state) {
+    const Texture texture{
+        .type = TextureType::Edges,
+        .as_edges_tex = { .edge_color = { 0.0f, 0.0f, 0.0f }, .inner_color = { 1.0f, 1.0f, 1.0f }, .edge_width = 0.05f },
+    };
+    run_texture_sample(state, texture, 0.0f);
+}
+BENCHMARK(BM_TextureSampleEdges);
+
+static void BM_TextureSampleChecker(benchmark::State &state) {
+    const Texture texture{
+        .type = TextureType::Checker,
+        .as_checker_tex = { .color_a = { 0.0f, 0.0f, 0.0f }, .color_b = { 1.0f, 1.0f, 1.0f }, .square_size = 0.125f },
+    };
+    run_texture_sample(state, texture, 0.0f);
+}
+BENCHMARK(BM_TextureSampleChecker);
+
+/**
+ * @param state range(0) is the resolution of the (square) bitmap, range(1) the footprint in 1/1024ths of UV space
+ */
+static void BM_TextureSampleBitmap(benchmark::State &state) {
+    const int size = static_cast<int>(state.range(0));
+
+    PCG32 rng = make_input_rng();
+    std::vector<uint8_t> rgba(static_cast<size_t>(size) * size * 4);
+    for (uint8_t &channel : rgba)
+        channel = static_cast<uint8_t>(rng() >> 24);
+    Bitmap bitmap = Bitmap::from_rgba8(size, size, rgba);
+
+    const Texture texture{ .type = TextureType::Bitmap, .as_bitmap_tex = { .bitmap = &bitmap } };
+    run_texture_sample(state, texture, state.range(1) / 1024.0f);
+}
+BENCHMARK(BM_TextureSampleBitmap)
+    ->ArgNames({ "size", "footprint" })
+    ->ArgsProduct({ { 256, 4096 }, { 0, 16 } });
+
+/**
+ * Like BM_TextureSampleBitmap, but the texels are read from a page file through a page cache.
+ *
+ * @param state range(0) is the resolution of the (square) bitmap, range(1) the footprint in 1/1024ths of UV space,
+ *              range(2) the budget of the page cache in MiB
+ */
+static void BM_TextureSamplePagedBitmap(benchmark::State &state) {
+    const int size = static_cast<int>(state.range(0));
+
+    PCG32 rng = make_input_rng();
+    std::vector<uint8_t> rgba(static_cast<size_t>(size) * size * 4);
+    for (uint8_t &channel : rgba)
+        channel = static_cast<uint8_t>(rng() >> 24);
+
+    const std::filesystem::path page_file_path = std::filesystem::temp_directory_path() / "crt_microbench_texture.crttex";
+    {
+        std::ofstream page_file{ page_file_path, std::ios::out | std::ios::binary };
+        if (!Bitmap::from_rgba8(size, size, rgba).write_pages(page_file)) {
+            state.SkipWithError("Could not write the page file");
+            return;
+        }
+    }
+
+    TexturePageCache page_cache{ static_cast<size_t>(state.range(2)) * 1024 * 1024 };
+    std::optional<Bitmap> bitmap = Bitmap::open_paged(page_file_path, page_cache);
+    if (!bitmap) {
+        state.SkipWithError("Could not open the page file");
+        return;
+    }
+
+    const Texture texture{ .type = TextureType::Bitmap, .as_bitmap_tex = { .bitmap = &*bitmap } };
+    run_texture_sample(state, texture, state.range(1) / 1024.0f);
+
+    const TexturePageCacheStats page_stats = page_cache.stats();
+    state.counters["page_misses"] = static_cast<double>(page_stats.misses);
+
+    bitmap.reset();
+    std::error_code error;
+    std::filesystem::remove(page_file_path, error);
+}
+BENCHMARK(BM_TextureSamplePagedBitmap)
+    ->ArgNames({ "size", "footprint", "cache_mib" })
+    ->ArgsProduct({ { 4096 }, { 0, 16 }, { 8, 256 } });
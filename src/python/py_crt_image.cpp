@@ -0,0 +1,87 @@
+#include "py_crt_image.h"
+
+#include <new>
+
+PyTypeObject ImageType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+ImageObject *image_new(int width, int height) {
+    ImageObject *self = PyObject_New(ImageObject, &ImageType);
+    if (!self)
+        return nullptr;
+
+    self->width = width;
+    self->height = height;
+    new (&self->pixels) std::vector<float>(static_cast<size_t>(width) * height * 4);
+    self->shape[0] = height;
+    self->shape[1] = width;
+    self->shape[2] = 4;
+    self->strides[0] = static_cast<Py_ssize_t>(width) * 4 * sizeof(float);
+    self->strides[1] = 4 * sizeof(float);
+    self->strides[2] = sizeof(float);
+
+    return self;
+}
+
+static void image_dealloc(ImageObject *self) {
+    self->pixels.~vector();
+    PyObject_Free(self);
+}
+
+static int image_getbuffer(ImageObject *self, Py_buffer *view, int flags) {
+    if ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS) {
+        PyErr_SetString(PyExc_BufferError, "_crt.Image is not Fortran contiguous");
+        view->obj = nullptr;
+        return -1;
+    }
+
+    view->obj = Py_NewRef(self);
+    view->buf = self->pixels.data();
+    view->len = static_cast<Py_ssize_t>(self->pixels.size() * sizeof(float));
+    view->readonly = 0;
+    view->itemsize = sizeof(float);
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char *>("f") : nullptr;
+    view->ndim = 3;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+
+    // NOTE: Without shape, consumers see a flat array of len / itemsize floats
+    if (!view->shape)
+        view->ndim = 1;
+
+    return 0;
+}
+
+static PyBufferProcs image_as_buffer = {
+    .bf_getbuffer = (getbufferproc)image_getbuffer,
+    .bf_releasebuffer = nullptr,
+};
+
+static PyObject *image_get_width(ImageObject *self, [[maybe_unused]] void *closure) {
+    return PyLong_FromLong(self->width);
+}
+
+static PyObject *image_get_height(ImageObject *self, [[maybe_unused]] void *closure) {
+    return PyLong_FromLong(self->height);
+}
+
+static PyGetSetDef image_getset[]{
+    { "width",  (getter)image_get_width,  nullptr, "Width in pixels" },
+    { "height", (getter)image_get_height, nullptr, "Height in pixels" },
+    { nullptr }
+};
+
+bool init_image_type() {
+    ImageType.tp_name = "_crt.Image";
+    ImageType.tp_doc = "Float RGBA framebuffer, rows stored bottom to top. Supports the buffer protocol.";
+    ImageType.tp_basicsize = sizeof(ImageObject);
+    ImageType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ImageType.tp_dealloc = (destructor)image_dealloc;
+    ImageType.tp_as_buffer = &image_as_buffer;
+    ImageType.tp_getset = image_getset;
+
+    return PyType_Ready(&ImageType) == 0;
+}
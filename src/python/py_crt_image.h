@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Python.h>
+
+#include <vector>
+
+#include "core/crt_tile.h"
+
+/**
+ * `_crt.Image`: a float RGBA framebuffer, stored bottom to top (the way Blender expects it).
+ *
+ * The pixels are exposed through the buffer protocol as a C-contiguous `(height, width, 4)`
+ * array of floats, so they can be handed to `numpy.asarray()`, `memoryview()` or Blender's
+ * `foreach_set()` without being copied or boxed.
+ */
+struct ImageObject {
+    PyObject_HEAD
+    int width, height;
+    std::vector<float> pixels;
+    Py_ssize_t shape[3];
+    Py_ssize_t strides[3];
+};
+
+extern PyTypeObject ImageType;
+
+ImageObject *image_new(int width, int height);
+
+bool init_image_type();
+
+/**
+ * Writes tiles straight into an ImageObject, flipping them vertically and adding an alpha channel.
+ */
+class ImageObjectTileSink : public crt::TileSink {
+public:
+    explicit ImageObjectTileSink(ImageObject &image)
+        : m_image(image)
+    {}
+
+    void write_tile(const crt::Tile &tile) override {
+        // Tiles never overlap, so no locking is required
+        for (int row = 0; row < tile.height; ++row) {
+            const int flipped_y = m_image.height - 1 - (tile.y + row);
+            float *dst = &m_image.pixels[(static_cast<size_t>(flipped_y) * m_image.width + tile.x) * 4];
+
+            for (const crt::Color &color : tile.pixels.subspan(row * tile.width, tile.width)) {
+                *dst++ = color.x;
+                *dst++ = color.y;
+                *dst++ = color.z;
+                *dst++ = 1.0f;
+            }
+        }
+    }
+
+private:
+    ImageObject &m_image;
+};
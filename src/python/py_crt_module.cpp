@@ -4,15 +4,28 @@
 #include <modsupport.h>
 #include <moduleobject.h>
 #include <object.h>
+#include <string>
+#include <string_view>
 #include <structseq.h>
 
 #include "core/crt_image.h"
 #include "core/crt_json.h"
 #include "core/crt_renderer.h"
 #include "core/crt_scene.h"
+#include "core/crt_stats.h"
+
+#include "py_crt_image.h"
+#include "py_crt_module.h"
+#include "py_crt_render_task.h"
+#include "py_crt_scene.h"
 
 using std::experimental::scope_exit;
 
+/**
+ * Bitmaps, which no scene uses anymore, are kept up to this size (in bytes), for the next sync of the scene
+ */
+static constexpr size_t DEFAULT_BITMAP_CACHE_BUDGET = size_t{ 1 } << 30;
+
 static PyStructSequence_Field fields[]{
     { "max_ray_depth",                "Maximum recursion depth for rays" },
     { "diffuse_reflection_ray_count", "Number of rays for diffuse reflections" },
@@ -48,6 +61,39 @@ bool get_renderer_settings(PyObject *obj, crt::RendererSettings &result) {
     return !PyErr_Occurred();
 }
 
+PyObject *stats_to_dict(const crt::RenderStats &stats) {
+    PyObject *dict = PyDict_New();
+    if (!dict)
+        return nullptr;
+    scope_exit dict_guard{ [&](){ Py_DECREF(dict); } };
+
+    auto set_item = [&](std::string_view key, PyObject *value) {
+        if (!value)
+            return false;
+        const int result = PyDict_SetItemString(dict, std::string{ key }.c_str(), value);
+        Py_DECREF(value);
+        return result == 0;
+    };
+
+    for (size_t i = 0; i < crt::STAT_COUNTER_COUNT; ++i) {
+        if (!set_item(crt::get_stat_name(static_cast<crt::StatCounter>(i)), PyLong_FromUnsignedLongLong(stats.counters[i])))
+            return nullptr;
+    }
+    for (size_t i = 0; i < crt::STAT_TIMER_COUNT; ++i) {
+        if (!set_item(crt::get_stat_name(static_cast<crt::StatTimer>(i)), PyFloat_FromDouble(stats.seconds[i])))
+            return nullptr;
+    }
+
+    if (!set_item("ray_count", PyLong_FromUnsignedLongLong(stats.ray_count()))
+        || !set_item("bucket_count", PyLong_FromUnsignedLongLong(stats.bucket_count))
+        || !set_item("min_bucket_seconds", PyFloat_FromDouble(stats.bucket_count > 0 ? stats.min_bucket_seconds : 0.0))
+        || !set_item("max_bucket_seconds", PyFloat_FromDouble(stats.max_bucket_seconds)))
+        return nullptr;
+
+    dict_guard.release();
+    return dict;
+}
+
 static PyObject *render_scene_from_dict([[maybe_unused]] PyObject *self, PyObject *args) {
     PyObject *dict_obj, *asset_root_unicode, *renderer_settings_obj;
     if (!PyArg_ParseTuple(args, "O!UO", &PyDict_Type, &dict_obj, &asset_root_unicode, &renderer_settings_obj)) 
@@ -87,7 +133,7 @@ static PyObject *render_scene_from_dict([[maybe_unused]] PyObject *self, PyObjec
     const char *asset_root_utf8_bytes = PyUnicode_AsUTF8AndSize(asset_root_unicode, &asset_root_utf8_size);
     std::filesystem::path asset_root{ std::u8string {  asset_root_utf8_bytes, asset_root_utf8_bytes + asset_root_utf8_size  } };
 
-    std::optional<crt::Scene> scene = crt::json::read_scene_from_istream(json_ss, asset_root);
+    std::optional<crt::Scene> scene = crt::json::read_scene_from_istream(json_ss, asset_root, &get_bitmap_cache());
     if (!scene) {
         PyErr_SetString(PyExc_ValueError, "Invalid CRT Scene dict");
         return nullptr;
@@ -97,29 +143,68 @@ static PyObject *render_scene_from_dict([[maybe_unused]] PyObject *self, PyObjec
     if (!get_renderer_settings(renderer_settings_obj, renderer_settings))
         return nullptr;
 
-    crt::Image image = crt::render_image(*scene, renderer_settings);
+    ImageObject *image = image_new(scene->camera.resolution_x(), scene->camera.resolution_y());
+    if (!image)
+        return nullptr;
 
-    PyObject *output_buffer = PyList_New(image.width * image.height);
-    if (!output_buffer)
+    ImageObjectTileSink sink{ *image };
+
+    Py_BEGIN_ALLOW_THREADS
+    crt::render_image(*scene, renderer_settings, sink);
+    Py_END_ALLOW_THREADS
+
+    return (PyObject *)image;
+}
+
+static PyObject *render_scene([[maybe_unused]] PyObject *self, PyObject *args) {
+    SceneObject *scene_obj;
+    PyObject *renderer_settings_obj;
+    if (!PyArg_ParseTuple(args, "O!O", &SceneType, &scene_obj, &renderer_settings_obj))
         return nullptr;
 
-    for (int raster_y = 0; raster_y < image.height; ++raster_y) {
-        for (int raster_x = 0; raster_x < image.width; ++raster_x) {
-            const crt::Color &color = image.buffer[raster_y * image.width + raster_x];
-            PyObject *color_tuple = Py_BuildValue("ffff", color.x, color.y, color.z, 1.0f);
-            if (!color_tuple) {
-                Py_DECREF(output_buffer);
-                return nullptr;
-            }
-            PyList_SET_ITEM(output_buffer, (image.height - raster_y - 1) * image.width + raster_x, color_tuple);
-        }
-    }
+    crt::RendererSettings renderer_settings;
+    if (!get_renderer_settings(renderer_settings_obj, renderer_settings))
+        return nullptr;
+
+    if (!scene_check_not_rendering(scene_obj))
+        return nullptr;
+    scene_prepare_for_render(scene_obj);
+    const crt::Scene &scene = scene_obj->scene;
+
+    ImageObject *image = image_new(scene.camera.resolution_x(), scene.camera.resolution_y());
+    if (!image)
+        return nullptr;
 
-    return output_buffer;
+    ImageObjectTileSink sink{ *image };
+
+    // NOTE: Other Python threads may run during the render, so they must not modify the scene
+    scene_obj->render_count++;
+    Py_BEGIN_ALLOW_THREADS
+    crt::render_image(scene, renderer_settings, sink);
+    Py_END_ALLOW_THREADS
+    scene_obj->render_count--;
+
+    return (PyObject *)image;
+}
+
+crt::BitmapCache &get_bitmap_cache() {
+    static crt::BitmapCache bitmap_cache{ DEFAULT_BITMAP_CACHE_BUDGET };
+    return bitmap_cache;
+}
+
+static PyObject *set_texture_cache_budget([[maybe_unused]] PyObject *self, PyObject *args) {
+    unsigned long long memory_budget;
+    if (!PyArg_ParseTuple(args, "K", &memory_budget))
+        return nullptr;
+
+    get_bitmap_cache().set_memory_budget(static_cast<size_t>(memory_budget));
+    Py_RETURN_NONE;
 }
 
 static PyMethodDef methods[]{
     { "render_scene_from_dict", (PyCFunction)render_scene_from_dict, METH_VARARGS },
+    { "render_scene", (PyCFunction)render_scene, METH_VARARGS },
+    { "set_texture_cache_budget", (PyCFunction)set_texture_cache_budget, METH_VARARGS },
     { nullptr, nullptr }
 };
 
@@ -142,6 +227,16 @@ PyMODINIT_FUNC PyInit__crt() {
     if (PyModule_AddIntConstant(module_obj, "DEFAULT_SCENE_BUCKET_SIZE", crt::DEFAULT_SCENE_BUCKET_SIZE) < 0)
         return nullptr;
 
+#ifdef CRT_ENABLE_STATS
+    if (PyModule_AddObject(module_obj, "STATS_ENABLED", Py_NewRef(Py_True)) < 0)
+#else
+    if (PyModule_AddObject(module_obj, "STATS_ENABLED", Py_NewRef(Py_False)) < 0)
+#endif
+        return nullptr;
+
+    if (PyModule_AddObject(module_obj, "DEFAULT_TEXTURE_CACHE_BUDGET", PyLong_FromSize_t(DEFAULT_BITMAP_CACHE_BUDGET)) < 0)
+        return nullptr;
+
     if (PyModule_AddIntConstant(module_obj, "DEFAULT_MAX_RAY_DEPTH", crt::DEFAULT_MAX_RAY_DEPTH) < 0)
         return nullptr;
 
@@ -156,6 +251,27 @@ PyMODINIT_FUNC PyInit__crt() {
     if (PyModule_AddObject(module_obj, "DEFAULT_REFRACTION_BIAS", PyFloat_FromDouble(crt::DEFAULT_REFRACTION_BIAS)) < 0)
         return nullptr;
 
+    if (!init_image_type())
+        return nullptr;
+
+    Py_INCREF(&ImageType);
+    if (PyModule_AddObject(module_obj, "Image", (PyObject *)&ImageType) < 0)
+        return nullptr;
+
+    if (!init_scene_type())
+        return nullptr;
+
+    Py_INCREF(&SceneType);
+    if (PyModule_AddObject(module_obj, "Scene", (PyObject *)&SceneType) < 0)
+        return nullptr;
+
+    if (!init_render_task_type())
+        return nullptr;
+
+    Py_INCREF(&RenderTaskType);
+    if (PyModule_AddObject(module_obj, "RenderTask", (PyObject *)&RenderTaskType) < 0)
+        return nullptr;
+
     RendererSettingsType = PyStructSequence_NewType(&renderer_settings_desc);
     if (!RendererSettingsType)
         return nullptr;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Python.h>
+
+#include "core/crt_bitmap_cache.h"
+#include "core/crt_renderer.h"
+#include "core/crt_stats.h"
+
+/**
+ * Read a `_crt.RendererSettings` instance. Raises a TypeError for any other object.
+ */
+bool get_renderer_settings(PyObject *obj, crt::RendererSettings &result);
+
+/**
+ * Convert render stats to a dict, keyed like the JSON export of crt_core.
+ */
+PyObject *stats_to_dict(const crt::RenderStats &stats);
+
+/**
+ * Shared by all scenes of the process, so that re-syncing or re-rendering a scene doesn't decode its textures again.
+ */
+crt::BitmapCache &get_bitmap_cache();
@@ -0,0 +1,300 @@
+#include "py_crt_render_task.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "core/crt_renderer.h"
+#include "core/crt_stats.h"
+#include "core/crt_tile.h"
+
+#include "py_crt_image.h"
+#include "py_crt_module.h"
+#include "py_crt_scene.h"
+
+/**
+ * State, shared between a RenderTaskObject and its render thread.
+ */
+struct RenderTaskState {
+    struct TileRect {
+        int x, y, width, height;
+    };
+
+    std::mutex mutex;
+    std::condition_variable done_condition;
+    /**
+     * Tiles, finished since the last call to `pop_tiles()`
+     */
+    std::vector<TileRect> finished_tiles;
+    size_t rendered_pixel_count{ 0 };
+    bool is_done{ false };
+    /**
+     * Written by the render thread, only valid once `is_done` is set
+     */
+    crt::RenderStats stats;
+
+    // NOTE: Declared last, so that the thread is stopped and joined before the rest of the state is destroyed
+    std::jthread thread;
+};
+
+/**
+ * Writes tiles into the task's framebuffer and records them as finished.
+ */
+class RenderTaskTileSink : public crt::TileSink {
+public:
+    RenderTaskTileSink(ImageObject &image, RenderTaskState &state)
+        : m_image_sink(image)
+        , m_state(state)
+    {}
+
+    void write_tile(const crt::Tile &tile) override {
+        m_image_sink.write_tile(tile);
+
+        std::scoped_lock lock{ m_state.mutex };
+        m_state.finished_tiles.push_back({ tile.x, tile.y, tile.width, tile.height });
+        m_state.rendered_pixel_count += tile.pixels.size();
+    }
+
+private:
+    ImageObjectTileSink m_image_sink;
+    RenderTaskState &m_state;
+};
+
+/**
+ * `_crt.RenderTask`: a render running in the background, without holding the GIL.
+ */
+struct RenderTaskObject {
+    PyObject_HEAD
+    SceneObject *scene;
+    ImageObject *image;
+    RenderTaskState *state;
+};
+
+PyTypeObject RenderTaskType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+static PyObject *render_task_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[]{ "scene", "renderer_settings", nullptr };
+
+    SceneObject *scene_obj;
+    PyObject *renderer_settings_obj;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O", const_cast<char **>(keywords), &SceneType, &scene_obj, &renderer_settings_obj))
+        return nullptr;
+
+    crt::RendererSettings renderer_settings;
+    if (!get_renderer_settings(renderer_settings_obj, renderer_settings))
+        return nullptr;
+
+    if (!scene_check_not_rendering(scene_obj))
+        return nullptr;
+    scene_prepare_for_render(scene_obj);
+
+    ImageObject *image = image_new(scene_obj->scene.camera.resolution_x(), scene_obj->scene.camera.resolution_y());
+    if (!image)
+        return nullptr;
+
+    RenderTaskObject *self = (RenderTaskObject *)type->tp_alloc(type, 0);
+    if (!self) {
+        Py_DECREF(image);
+        return nullptr;
+    }
+
+    self->scene = (SceneObject *)Py_NewRef(scene_obj);
+    self->image = image;
+    self->state = new RenderTaskState{};
+
+    scene_obj->render_count++;
+
+    // NOTE: The thread never touches Python objects (other than the pixels and the render count,
+    //       which are not owned by the interpreter), so it doesn't need the GIL.
+    RenderTaskState *state = self->state;
+    state->thread = std::jthread{ [state, scene_obj, image, renderer_settings](std::stop_token stop_token) {
+        RenderTaskTileSink sink{ *image, *state };
+        crt::render_image(scene_obj->scene, renderer_settings, sink, stop_token, &state->stats);
+
+        scene_obj->render_count--;
+        {
+            std::scoped_lock lock{ state->mutex };
+            state->is_done = true;
+        }
+        state->done_condition.notify_all();
+    } };
+
+    return (PyObject *)self;
+}
+
+static void render_task_dealloc(RenderTaskObject *self) {
+    if (self->state) {
+        // Stops and joins the render thread
+        Py_BEGIN_ALLOW_THREADS
+        delete self->state;
+        Py_END_ALLOW_THREADS
+    }
+
+    Py_XDECREF(self->image);
+    Py_XDECREF(self->scene);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *render_task_cancel(RenderTaskObject *self, [[maybe_unused]] PyObject *args) {
+    self->state->thread.request_stop();
+    Py_RETURN_NONE;
+}
+
+static PyObject *render_task_wait(RenderTaskObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[]{ "timeout", nullptr };
+
+    PyObject *timeout_obj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", const_cast<char **>(keywords), &timeout_obj))
+        return nullptr;
+
+    double timeout = -1.0;
+    if (timeout_obj != Py_None) {
+        timeout = PyFloat_AsDouble(timeout_obj);
+        if (timeout == -1.0 && PyErr_Occurred())
+            return nullptr;
+        timeout = std::max(timeout, 0.0);
+    }
+
+    RenderTaskState &state = *self->state;
+    bool is_done;
+
+    Py_BEGIN_ALLOW_THREADS
+    std::unique_lock lock{ state.mutex };
+    if (timeout < 0.0)
+        state.done_condition.wait(lock, [&]() { return state.is_done; });
+    else
+        state.done_condition.wait_for(lock, std::chrono::duration<double>(timeout), [&]() { return state.is_done; });
+    is_done = state.is_done;
+    Py_END_ALLOW_THREADS
+
+    return PyBool_FromLong(is_done);
+}
+
+static PyObject *render_task_pop_tiles(RenderTaskObject *self, [[maybe_unused]] PyObject *args) {
+    std::vector<RenderTaskState::TileRect> tiles;
+    {
+        std::scoped_lock lock{ self->state->mutex };
+        std::swap(tiles, self->state->finished_tiles);
+    }
+
+    PyObject *result = PyList_New(tiles.size());
+    if (!result)
+        return nullptr;
+
+    const ImageObject &frame = *self->image;
+
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        const auto [x, y, width, height] = tiles[i];
+
+        ImageObject *tile = image_new(width, height);
+        if (!tile) {
+            Py_DECREF(result);
+            return nullptr;
+        }
+
+        // Both the frame and the tile are stored bottom to top, so the rows of the tile
+        // are consecutive rows of the frame, starting from its bottom edge
+        const int bottom_y = frame.height - y - height;
+        for (int row = 0; row < height; ++row) {
+            const float *src = &frame.pixels[(static_cast<size_t>(bottom_y + row) * frame.width + x) * 4];
+            std::copy(src, src + width * 4, &tile->pixels[static_cast<size_t>(row) * width * 4]);
+        }
+
+        PyObject *item = Py_BuildValue("iiN", x, bottom_y, (PyObject *)tile);
+        if (!item) {
+            Py_DECREF(result);
+            return nullptr;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+    return result;
+}
+
+static PyObject *render_task_stats_report(RenderTaskObject *self, [[maybe_unused]] PyObject *args) {
+    {
+        std::scoped_lock lock{ self->state->mutex };
+        if (!self->state->is_done) {
+            PyErr_SetString(PyExc_RuntimeError, "The render is not done yet");
+            return nullptr;
+        }
+    }
+
+    std::ostringstream report;
+    crt::print_stats_report(report, self->state->stats);
+    return PyUnicode_FromString(report.str().c_str());
+}
+
+static PyObject *render_task_get_progress(RenderTaskObject *self, [[maybe_unused]] void *closure) {
+    const double pixel_count = static_cast<double>(self->image->width) * self->image->height;
+
+    std::scoped_lock lock{ self->state->mutex };
+    return PyFloat_FromDouble(self->state->rendered_pixel_count / pixel_count);
+}
+
+static PyObject *render_task_get_is_done(RenderTaskObject *self, [[maybe_unused]] void *closure) {
+    std::scoped_lock lock{ self->state->mutex };
+    return PyBool_FromLong(self->state->is_done);
+}
+
+static PyObject *render_task_get_is_cancelled(RenderTaskObject *self, [[maybe_unused]] void *closure) {
+    return PyBool_FromLong(self->state->thread.get_stop_token().stop_requested());
+}
+
+static PyObject *render_task_get_stats(RenderTaskObject *self, [[maybe_unused]] void *closure) {
+    {
+        std::scoped_lock lock{ self->state->mutex };
+        if (!self->state->is_done)
+            Py_RETURN_NONE;
+    }
+
+    return stats_to_dict(self->state->stats);
+}
+
+static PyObject *render_task_get_image(RenderTaskObject *self, [[maybe_unused]] void *closure) {
+    return Py_NewRef(self->image);
+}
+
+static PyMethodDef render_task_methods[]{
+    { "cancel", (PyCFunction)render_task_cancel, METH_NOARGS,
+        "cancel()\n--\n\nStop the render. Buckets, which are already being rendered, are still finished." },
+    { "wait", (PyCFunction)render_task_wait, METH_VARARGS | METH_KEYWORDS,
+        "wait(timeout=None)\n--\n\nWait for the render to finish, without holding the GIL. Returns whether it's done." },
+    { "pop_tiles", (PyCFunction)render_task_pop_tiles, METH_NOARGS,
+        "pop_tiles()\n--\n\nReturn the tiles, finished since the last call, as a list of (x, y, Image) tuples.\n"
+        "Coordinates are of the bottom left corner, measured from the bottom left of the frame (like Blender's)." },
+    { "stats_report", (PyCFunction)render_task_stats_report, METH_NOARGS,
+        "stats_report()\n--\n\nReturn the stats of the finished render as a human-readable report." },
+    { nullptr }
+};
+
+static PyGetSetDef render_task_getset[]{
+    { "progress",     (getter)render_task_get_progress,     nullptr, "Fraction of the pixels, which are rendered" },
+    { "is_done",      (getter)render_task_get_is_done,      nullptr, "Whether the render has finished or was cancelled" },
+    { "is_cancelled", (getter)render_task_get_is_cancelled, nullptr, "Whether cancel() was called" },
+    { "image",        (getter)render_task_get_image,        nullptr, "The whole frame. Only finished tiles are valid." },
+    { "stats",        (getter)render_task_get_stats,        nullptr, "Dict of the counters and timings of the render, None until it's done" },
+    { nullptr }
+};
+
+bool init_render_task_type() {
+    RenderTaskType.tp_name = "_crt.RenderTask";
+    RenderTaskType.tp_doc = "RenderTask(scene, renderer_settings)\n--\n\n"
+                            "Start rendering a _crt.Scene in the background. The scene cannot be modified until the render is done.";
+    RenderTaskType.tp_basicsize = sizeof(RenderTaskObject);
+    RenderTaskType.tp_flags = Py_TPFLAGS_DEFAULT;
+    RenderTaskType.tp_new = render_task_new;
+    RenderTaskType.tp_dealloc = (destructor)render_task_dealloc;
+    RenderTaskType.tp_methods = render_task_methods;
+    RenderTaskType.tp_getset = render_task_getset;
+
+    return PyType_Ready(&RenderTaskType) == 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <Python.h>
+
+extern PyTypeObject RenderTaskType;
+
+bool init_render_task_type();
@@ -0,0 +1,826 @@
+#include "py_crt_scene.h"
+
+#include <cstring>
+#include <experimental/scope>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "core/crt_acceleration_tree.h"
+#include "core/crt_bitmap.h"
+#include "core/crt_bitmap_cache.h"
+#include "core/crt_camera.h"
+#include "core/crt_instance.h"
+#include "core/crt_light.h"
+#include "core/crt_material.h"
+#include "core/crt_matrix.h"
+#include "core/crt_mesh.h"
+#include "core/crt_texture.h"
+#include "core/crt_transform.h"
+#include "core/crt_vector.h"
+
+#include "py_crt_module.h"
+
+using std::experimental::scope_exit;
+
+/**
+ * View a buffer of `count` (x, y, z) triples as Vectors. When Vectors are padded (with CRT_SIMD_VECTOR),
+ * the buffer can't be reinterpreted and is copied into `storage` instead.
+ */
+static std::span<const crt::Vector> get_vector_span(const float *floats, const size_t count, std::vector<crt::Vector> &storage) {
+    if constexpr (sizeof(crt::Vector) == 3 * sizeof(float)) {
+        return { reinterpret_cast<const crt::Vector *>(floats), count };
+    } else {
+        storage.clear();
+        storage.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            storage.push_back(crt::Vector{ floats[3 * i], floats[3 * i + 1], floats[3 * i + 2] });
+        return storage;
+    }
+}
+
+PyTypeObject SceneType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+/**
+ * Read a sequence of exactly `result.size()` numbers.
+ */
+static bool get_floats(PyObject *obj, std::span<float> result, const char *name) {
+    PyObject *sequence = PySequence_Fast(obj, name);
+    if (!sequence)
+        return false;
+    scope_exit sequence_guard{ [&](){ Py_DECREF(sequence); } };
+
+    if (PySequence_Fast_GET_SIZE(sequence) != static_cast<Py_ssize_t>(result.size())) {
+        PyErr_Format(PyExc_ValueError, "%s must have %zu items", name, result.size());
+        return false;
+    }
+
+    PyObject **items = PySequence_Fast_ITEMS(sequence);
+    for (size_t i = 0; i < result.size(); ++i) {
+        const double value = PyFloat_AsDouble(items[i]);
+        if (value == -1.0 && PyErr_Occurred())
+            return false;
+        result[i] = static_cast<float>(value);
+    }
+
+    return true;
+}
+
+static bool get_vector(PyObject *obj, crt::Vector &result, const char *name) {
+    return get_floats(obj, result.data, name);
+}
+
+/**
+ * Read a row-major 3x3 matrix, given as a flat sequence of 9 numbers (like in CRT scene files).
+ */
+static bool get_matrix(PyObject *obj, crt::Matrix &result, const char *name) {
+    return get_floats(obj, std::span{ &result.data[0][0], 9 }, name);
+}
+
+enum class BufferKind {
+    Float32,
+    Int32,
+};
+
+/**
+ * Get a C-contiguous buffer of 32-bit floats or integers (eg. a numpy array, an `array.array`
+ * or the output of Blender's `foreach_get()`). It must be released with PyBuffer_Release().
+ */
+static bool get_buffer(PyObject *obj, BufferKind kind, Py_buffer &view, const char *name) {
+    if (PyObject_GetBuffer(obj, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+        return false;
+
+    // NOTE: Native byte order is assumed for the explicit little-endian prefixes, as
+    //       the renderer only runs on little-endian hosts.
+    std::string_view format = view.format ? view.format : "B";
+    if (!format.empty() && (format[0] == '@' || format[0] == '=' || format[0] == '<'))
+        format.remove_prefix(1);
+
+    bool is_valid = view.itemsize == 4;
+    switch (kind) {
+        case BufferKind::Float32:
+            is_valid = is_valid && format == "f";
+            break;
+        case BufferKind::Int32:
+            is_valid = is_valid && (format == "i" || format == "I" || format == "l" || format == "L");
+            break;
+    }
+
+    if (!is_valid) {
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_TypeError, "%s must be a contiguous buffer of %s", name, kind == BufferKind::Float32 ? "float32" : "int32");
+        return false;
+    }
+
+    return true;
+}
+
+static std::optional<crt::MaterialType> get_material_type(std::string_view name) {
+    if (name == "diffuse")
+        return crt::MaterialType::Diffuse;
+    if (name == "reflective")
+        return crt::MaterialType::Reflective;
+    if (name == "refractive")
+        return crt::MaterialType::Refractive;
+    if (name == "constant")
+        return crt::MaterialType::Constant;
+
+    return std::nullopt;
+}
+
+/**
+ * Read an instance placement. Both parts are optional and default to the identity.
+ */
+static bool get_transform(PyObject *position_obj, PyObject *matrix_obj, crt::Transform &result) {
+    if (position_obj && !get_vector(position_obj, result.location, "position"))
+        return false;
+    if (matrix_obj && !get_matrix(matrix_obj, result.rotation, "matrix"))
+        return false;
+
+    if (result.rotation.determinant() == 0.0f) {
+        PyErr_SetString(PyExc_ValueError, "matrix must be invertible");
+        return false;
+    }
+
+    return true;
+}
+
+static bool check_index(int index, size_t size, const char *name) {
+    if (index < 0 || static_cast<size_t>(index) >= size) {
+        PyErr_Format(PyExc_IndexError, "%s is out of range", name);
+        return false;
+    }
+    return true;
+}
+
+static PyObject *scene_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[]{ "width", "height", "background_color", "bucket_size", "gi_on", "reflections_on", "refractions_on", nullptr };
+
+    int width, height;
+    PyObject *background_color_obj = nullptr;
+    int bucket_size = crt::DEFAULT_SCENE_BUCKET_SIZE;
+    int gi_on = false, reflections_on = true, refractions_on = true;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|$Oippp", const_cast<char **>(keywords),
+            &width, &height, &background_color_obj, &bucket_size, &gi_on, &reflections_on, &refractions_on))
+        return nullptr;
+
+    if (width <= 0 || height <= 0 || bucket_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "width, height and bucket_size must be positive");
+        return nullptr;
+    }
+
+    crt::Color background_color{};
+    if (background_color_obj && !get_vector(background_color_obj, background_color, "background_color"))
+        return nullptr;
+
+    SceneObject *self = (SceneObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return nullptr;
+
+    crt::Geometry geometry;
+    crt::AccelerationTree acceleration_tree = crt::acceleration_tree::build(geometry);
+
+    new (&self->scene) crt::Scene {
+        .background_color = background_color,
+        .camera = crt::Camera{ width, height },
+        .geometry = std::move(geometry),
+        .acceleration_tree = std::move(acceleration_tree),
+        .meshes = {},
+        .instances = {},
+        .instance_tree = {},
+        .lights = {},
+        .textures = {},
+        .bitmaps = {},
+        .materials = {},
+        .bucket_size = bucket_size,
+        .gi_on = static_cast<bool>(gi_on),
+        .reflections_on = static_cast<bool>(reflections_on),
+        .refractions_on = static_cast<bool>(refractions_on),
+    };
+    new (&self->material_triangle_flags) std::vector<crt::TriangleFlags>{};
+    new (&self->material_albedo_texture_indices) std::vector<int>{};
+    self->is_instance_tree_dirty = true;
+    new (&self->render_count) std::atomic<int>{ 0 };
+
+    return (PyObject *)self;
+}
+
+static void scene_dealloc(SceneObject *self) {
+    self->scene.~Scene();
+    self->material_triangle_flags.~vector();
+    self->material_albedo_texture_indices.~vector();
+    self->render_count.~atomic();
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *scene_set_camera(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "position", "matrix", "fov_degrees", nullptr };
+
+    PyObject *position_obj, *matrix_obj;
+    float fov_degrees = 90.0f;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|f", const_cast<char **>(keywords), &position_obj, &matrix_obj, &fov_degrees))
+        return nullptr;
+
+    crt::Transform transform;
+    if (!get_vector(position_obj, transform.location, "position") || !get_matrix(matrix_obj, transform.rotation, "matrix"))
+        return nullptr;
+
+    const crt::Camera &camera = self->scene.camera;
+    self->scene.camera = crt::Camera{ camera.resolution_x(), camera.resolution_y(), fov_degrees, transform };
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *scene_set_resolution(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "width", "height", nullptr };
+
+    int width, height;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii", const_cast<char **>(keywords), &width, &height))
+        return nullptr;
+
+    if (width <= 0 || height <= 0) {
+        PyErr_SetString(PyExc_ValueError, "width and height must be positive");
+        return nullptr;
+    }
+
+    const crt::Camera &camera = self->scene.camera;
+    self->scene.camera = crt::Camera{ width, height, camera.fov_degrees(), camera.transform() };
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *scene_set_options(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "background_color", "bucket_size", "gi_on", "reflections_on", "refractions_on", nullptr };
+
+    PyObject *background_color_obj = Py_None, *bucket_size_obj = Py_None;
+    PyObject *gi_on_obj = Py_None, *reflections_on_obj = Py_None, *refractions_on_obj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|$OOOOO", const_cast<char **>(keywords),
+            &background_color_obj, &bucket_size_obj, &gi_on_obj, &reflections_on_obj, &refractions_on_obj))
+        return nullptr;
+
+    // Validate everything first, so that the scene is left untouched on errors
+    crt::Color background_color = self->scene.background_color;
+    if (background_color_obj != Py_None && !get_vector(background_color_obj, background_color, "background_color"))
+        return nullptr;
+
+    int bucket_size = self->scene.bucket_size;
+    if (bucket_size_obj != Py_None) {
+        bucket_size = PyLong_AsLong(bucket_size_obj);
+        if (bucket_size == -1 && PyErr_Occurred())
+            return nullptr;
+        if (bucket_size <= 0) {
+            PyErr_SetString(PyExc_ValueError, "bucket_size must be positive");
+            return nullptr;
+        }
+    }
+
+    int flags[3]{ self->scene.gi_on, self->scene.reflections_on, self->scene.refractions_on };
+    PyObject *flag_objs[3]{ gi_on_obj, reflections_on_obj, refractions_on_obj };
+    for (int i = 0; i < 3; ++i) {
+        if (flag_objs[i] != Py_None && (flags[i] = PyObject_IsTrue(flag_objs[i])) < 0)
+            return nullptr;
+    }
+
+    self->scene.background_color = background_color;
+    self->scene.bucket_size = bucket_size;
+    self->scene.gi_on = flags[0];
+    self->scene.reflections_on = flags[1];
+    self->scene.refractions_on = flags[2];
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *scene_add_light(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "position", "intensity", nullptr };
+
+    PyObject *position_obj;
+    float intensity;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Of", const_cast<char **>(keywords), &position_obj, &intensity))
+        return nullptr;
+
+    crt::Light light{ .intensity = intensity, .position = {} };
+    if (!get_vector(position_obj, light.position, "position"))
+        return nullptr;
+
+    self->scene.lights.push_back(light);
+    return PyLong_FromSize_t(self->scene.lights.size() - 1);
+}
+
+static PyObject *scene_set_light(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "light_index", "position", "intensity", nullptr };
+
+    int light_index;
+    PyObject *position_obj;
+    float intensity;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iOf", const_cast<char **>(keywords), &light_index, &position_obj, &intensity))
+        return nullptr;
+
+    if (!check_index(light_index, self->scene.lights.size(), "light_index"))
+        return nullptr;
+
+    crt::Light light{ .intensity = intensity, .position = {} };
+    if (!get_vector(position_obj, light.position, "position"))
+        return nullptr;
+
+    self->scene.lights[light_index] = light;
+    Py_RETURN_NONE;
+}
+
+static PyObject *scene_clear_lights(SceneObject *self, [[maybe_unused]] PyObject *args) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    self->scene.lights.clear();
+    Py_RETURN_NONE;
+}
+
+static PyObject *add_texture(SceneObject *self, const crt::Texture &texture) {
+    self->scene.textures.push_back(texture);
+    return PyLong_FromSize_t(self->scene.textures.size() - 1);
+}
+
+static PyObject *scene_add_albedo_texture(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "albedo", nullptr };
+
+    PyObject *albedo_obj;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", const_cast<char **>(keywords), &albedo_obj))
+        return nullptr;
+
+    crt::AlbedoTexture albedo_texture{};
+    if (!get_vector(albedo_obj, albedo_texture.albedo, "albedo"))
+        return nullptr;
+
+    return add_texture(self, crt::Texture{ .type = crt::TextureType::Albedo, .as_albedo_tex = albedo_texture });
+}
+
+static PyObject *scene_add_edges_texture(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "edge_color", "inner_color", "edge_width", nullptr };
+
+    PyObject *edge_color_obj, *inner_color_obj;
+    crt::EdgesTexture edges_texture{};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOf", const_cast<char **>(keywords), &edge_color_obj, &inner_color_obj, &edges_texture.edge_width))
+        return nullptr;
+
+    if (!get_vector(edge_color_obj, edges_texture.edge_color, "edge_color") || !get_vector(inner_color_obj, edges_texture.inner_color, "inner_color"))
+        return nullptr;
+
+    return add_texture(self, crt::Texture{ .type = crt::TextureType::Edges, .as_edges_tex = edges_texture });
+}
+
+static PyObject *scene_add_checker_texture(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "color_a", "color_b", "square_size", nullptr };
+
+    PyObject *color_a_obj, *color_b_obj;
+    crt::CheckerTexture checker_texture{};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOf", const_cast<char **>(keywords), &color_a_obj, &color_b_obj, &checker_texture.square_size))
+        return nullptr;
+
+    if (!get_vector(color_a_obj, checker_texture.color_a, "color_a") || !get_vector(color_b_obj, checker_texture.color_b, "color_b"))
+        return nullptr;
+
+    return add_texture(self, crt::Texture{ .type = crt::TextureType::Checker, .as_checker_tex = checker_texture });
+}
+
+static PyObject *scene_add_bitmap_texture(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "file_path", nullptr };
+
+    PyObject *file_path_bytes;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&", const_cast<char **>(keywords), PyUnicode_FSConverter, &file_path_bytes))
+        return nullptr;
+    scope_exit file_path_guard{ [&](){ Py_DECREF(file_path_bytes); } };
+
+    const std::filesystem::path file_path{ PyBytes_AS_STRING(file_path_bytes) };
+    std::shared_ptr<const crt::Bitmap> bitmap;
+    Py_BEGIN_ALLOW_THREADS
+    bitmap = get_bitmap_cache().load(file_path);
+    Py_END_ALLOW_THREADS
+    if (!bitmap) {
+        PyErr_Format(PyExc_OSError, "Cannot load image %R", file_path_bytes);
+        return nullptr;
+    }
+
+    // NOTE: Another thread could have started rendering the scene, while the GIL was released
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    const auto &owned_bitmap = self->scene.bitmaps.emplace_back(std::move(bitmap));
+    return add_texture(self, crt::Texture{ .type = crt::TextureType::Bitmap, .as_bitmap_tex = { owned_bitmap.get() } });
+}
+
+struct MaterialArgs {
+    crt::MaterialType type;
+    /**
+     * Either a solid albedo color or the index of a texture of the scene (-1 for refractive materials)
+     */
+    std::optional<crt::Color> albedo;
+    int albedo_texture_index;
+    float ior;
+    crt::TriangleFlags flags;
+};
+
+/**
+ * Parse the arguments of add_material() and set_material(). The latter takes the index of
+ * the material to change as its first argument, which is returned in `material_index`.
+ */
+static bool get_material_args(SceneObject *self, PyObject *args, PyObject *kwargs, int *material_index, MaterialArgs &result) {
+    static const char *add_keywords[]{ "type", "albedo", "albedo_texture", "ior", "smooth_shading", "back_face_culling", nullptr };
+    static const char *set_keywords[]{ "material_index", "type", "albedo", "albedo_texture", "ior", "smooth_shading", "back_face_culling", nullptr };
+
+    const char *type_name;
+    PyObject *albedo_obj = nullptr;
+    int albedo_texture_index = -1;
+    float ior = 1.0f;
+    int smooth_shading = false, back_face_culling = false;
+    const bool is_parsed = material_index
+        ? PyArg_ParseTupleAndKeywords(args, kwargs, "is|$Oifpp", const_cast<char **>(set_keywords),
+              material_index, &type_name, &albedo_obj, &albedo_texture_index, &ior, &smooth_shading, &back_face_culling)
+        : PyArg_ParseTupleAndKeywords(args, kwargs, "s|$Oifpp", const_cast<char **>(add_keywords),
+              &type_name, &albedo_obj, &albedo_texture_index, &ior, &smooth_shading, &back_face_culling);
+    if (!is_parsed)
+        return false;
+
+    if (material_index && !check_index(*material_index, self->scene.materials.size(), "material_index"))
+        return false;
+
+    std::optional<crt::MaterialType> type = get_material_type(type_name);
+    if (!type) {
+        PyErr_Format(PyExc_ValueError, "Unknown material type '%s'", type_name);
+        return false;
+    }
+
+    result = MaterialArgs{
+        .type = *type,
+        .albedo = std::nullopt,
+        .albedo_texture_index = -1,
+        .ior = ior,
+        .flags = crt::TriangleFlags{
+            .smooth_shading = static_cast<bool>(smooth_shading),
+            .back_face_culling = static_cast<bool>(back_face_culling),
+        },
+    };
+
+    if (*type != crt::MaterialType::Refractive) {
+        if ((albedo_obj != nullptr) == (albedo_texture_index != -1)) {
+            PyErr_SetString(PyExc_ValueError, "Exactly one of albedo and albedo_texture must be given");
+            return false;
+        }
+
+        if (albedo_obj) {
+            crt::Color albedo;
+            if (!get_vector(albedo_obj, albedo, "albedo"))
+                return false;
+            result.albedo = albedo;
+        } else {
+            if (!check_index(albedo_texture_index, self->scene.textures.size(), "albedo_texture"))
+                return false;
+            result.albedo_texture_index = albedo_texture_index;
+        }
+    }
+
+    return true;
+}
+
+static PyObject *scene_add_material(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    MaterialArgs material_args;
+    if (!get_material_args(self, args, kwargs, nullptr, material_args))
+        return nullptr;
+
+    int albedo_texture_index = material_args.albedo_texture_index;
+    int own_albedo_texture_index = -1;
+    if (material_args.albedo) {
+        albedo_texture_index = own_albedo_texture_index = self->scene.textures.size();
+        self->scene.textures.push_back(crt::Texture{ .type = crt::TextureType::Albedo, .as_albedo_tex = { *material_args.albedo } });
+    }
+
+    self->scene.materials.push_back(crt::Material{
+        .type = material_args.type,
+        .albedo_map_texture_index = albedo_texture_index,
+        .ior = material_args.ior,
+    });
+    self->material_triangle_flags.push_back(material_args.flags);
+    self->material_albedo_texture_indices.push_back(own_albedo_texture_index);
+
+    return PyLong_FromSize_t(self->scene.materials.size() - 1);
+}
+
+static PyObject *scene_set_material(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    int material_index;
+    MaterialArgs material_args;
+    if (!get_material_args(self, args, kwargs, &material_index, material_args))
+        return nullptr;
+
+    int albedo_texture_index = material_args.albedo_texture_index;
+    if (material_args.albedo) {
+        // Reuse the material's own solid color texture, so that editing colors doesn't grow the scene
+        int &own_albedo_texture_index = self->material_albedo_texture_indices[material_index];
+        if (own_albedo_texture_index == -1) {
+            own_albedo_texture_index = self->scene.textures.size();
+            self->scene.textures.emplace_back();
+        }
+
+        albedo_texture_index = own_albedo_texture_index;
+        self->scene.textures[albedo_texture_index] = crt::Texture{ .type = crt::TextureType::Albedo, .as_albedo_tex = { *material_args.albedo } };
+    }
+
+    self->scene.materials[material_index] = crt::Material{
+        .type = material_args.type,
+        .albedo_map_texture_index = albedo_texture_index,
+        .ior = material_args.ior,
+    };
+
+    // NOTE: The flags are copied into the triangles of the meshes, using the material
+    crt::TriangleFlags &flags = self->material_triangle_flags[material_index];
+    if (flags.smooth_shading != material_args.flags.smooth_shading || flags.back_face_culling != material_args.flags.back_face_culling) {
+        flags = material_args.flags;
+
+        for (crt::Mesh &mesh : self->scene.meshes) {
+            crt::Geometry &geometry = mesh.geometry;
+            for (uint32_t triangle = 0; triangle < geometry.triangle_count(); ++triangle) {
+                if (geometry.triangle_material_indices[triangle] == material_index)
+                    geometry.triangle_flags[triangle] = flags;
+            }
+        }
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *scene_add_mesh(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "vertices", "triangles", "material_index", "uvs", nullptr };
+
+    PyObject *vertices_obj, *triangles_obj, *uvs_obj = nullptr;
+    int material_index;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOi|O", const_cast<char **>(keywords), &vertices_obj, &triangles_obj, &material_index, &uvs_obj))
+        return nullptr;
+
+    if (!check_index(material_index, self->scene.materials.size(), "material_index"))
+        return nullptr;
+
+    Py_buffer vertices_view;
+    if (!get_buffer(vertices_obj, BufferKind::Float32, vertices_view, "vertices"))
+        return nullptr;
+    scope_exit vertices_guard{ [&](){ PyBuffer_Release(&vertices_view); } };
+
+    Py_buffer triangles_view;
+    if (!get_buffer(triangles_obj, BufferKind::Int32, triangles_view, "triangles"))
+        return nullptr;
+    scope_exit triangles_guard{ [&](){ PyBuffer_Release(&triangles_view); } };
+
+    const size_t vertex_float_count = vertices_view.len / sizeof(float);
+    const size_t index_count = triangles_view.len / sizeof(int);
+    if (vertex_float_count % 3 != 0 || index_count % 3 != 0) {
+        PyErr_SetString(PyExc_ValueError, "vertices and triangles must have 3 items per element");
+        return nullptr;
+    }
+
+    std::vector<crt::Vector> position_storage;
+    const std::span<const crt::Vector> positions = get_vector_span(static_cast<const float *>(vertices_view.buf), vertex_float_count / 3, position_storage);
+    const std::span<const int> indices{ static_cast<const int *>(triangles_view.buf), index_count };
+
+    for (const int index : indices) {
+        if (index < 0 || static_cast<size_t>(index) >= positions.size()) {
+            PyErr_SetString(PyExc_IndexError, "triangles reference a vertex that is out of range");
+            return nullptr;
+        }
+    }
+
+    crt::Mesh mesh;
+    mesh.geometry.reserve(positions.size(), indices.size() / 3);
+    const crt::TriangleFlags flags = self->material_triangle_flags[material_index];
+
+    if (uvs_obj && uvs_obj != Py_None) {
+        Py_buffer uvs_view;
+        if (!get_buffer(uvs_obj, BufferKind::Float32, uvs_view, "uvs"))
+            return nullptr;
+        scope_exit uvs_guard{ [&](){ PyBuffer_Release(&uvs_view); } };
+
+        const float *uv_floats = static_cast<const float *>(uvs_view.buf);
+        const size_t uv_float_count = uvs_view.len / sizeof(float);
+
+        if (uv_float_count == 3 * positions.size()) {
+            std::vector<crt::Vector> uv_storage;
+            const std::span<const crt::Vector> uvs = get_vector_span(uv_floats, positions.size(), uv_storage);
+            crt::vertex_array_extend(mesh.geometry, positions, uvs, indices, material_index, flags);
+        } else if (uv_float_count == 2 * positions.size()) {
+            // NOTE: (u, v) pairs, as returned by Blender's `MeshUVLoop.uv`
+            std::vector<crt::Vector> uvs;
+            uvs.reserve(positions.size());
+            for (size_t i = 0; i < positions.size(); ++i)
+                uvs.push_back(crt::Vector{ uv_floats[2 * i], uv_floats[2 * i + 1], 0.0f });
+            crt::vertex_array_extend(mesh.geometry, positions, uvs, indices, material_index, flags);
+        } else {
+            PyErr_SetString(PyExc_ValueError, "uvs must have 2 or 3 items per vertex");
+            return nullptr;
+        }
+    } else {
+        crt::vertex_array_extend(mesh.geometry, positions, indices, material_index, flags);
+    }
+
+    mesh.acceleration_tree = crt::acceleration_tree::build(mesh.geometry);
+    self->scene.meshes.push_back(std::move(mesh));
+
+    return PyLong_FromSize_t(self->scene.meshes.size() - 1);
+}
+
+static PyObject *scene_set_mesh_vertices(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "mesh_index", "vertices", nullptr };
+
+    int mesh_index;
+    PyObject *vertices_obj;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iO", const_cast<char **>(keywords), &mesh_index, &vertices_obj))
+        return nullptr;
+
+    if (!check_index(mesh_index, self->scene.meshes.size(), "mesh_index"))
+        return nullptr;
+    crt::Mesh &mesh = self->scene.meshes[mesh_index];
+
+    Py_buffer vertices_view;
+    if (!get_buffer(vertices_obj, BufferKind::Float32, vertices_view, "vertices"))
+        return nullptr;
+    scope_exit vertices_guard{ [&](){ PyBuffer_Release(&vertices_view); } };
+
+    if (static_cast<size_t>(vertices_view.len) != mesh.geometry.positions.size() * 3 * sizeof(float)) {
+        PyErr_Format(PyExc_ValueError, "vertices must have the %zu vertices of the mesh", mesh.geometry.positions.size());
+        return nullptr;
+    }
+
+    std::vector<crt::Vector> position_storage;
+    const std::span<const crt::Vector> positions = get_vector_span(static_cast<const float *>(vertices_view.buf), mesh.geometry.positions.size(), position_storage);
+    crt::vertex_array_update_positions(mesh.geometry, positions);
+    crt::acceleration_tree::refit(mesh.acceleration_tree, mesh.geometry);
+
+    // The bounds of the instances of the mesh changed
+    for (crt::Instance &instance : self->scene.instances) {
+        if (instance.mesh_index == mesh_index)
+            instance = crt::make_instance(mesh_index, mesh, instance.transform);
+    }
+    self->is_instance_tree_dirty = true;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *scene_add_instance(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "mesh_index", "position", "matrix", nullptr };
+
+    int mesh_index;
+    PyObject *position_obj = nullptr, *matrix_obj = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|OO", const_cast<char **>(keywords), &mesh_index, &position_obj, &matrix_obj))
+        return nullptr;
+
+    if (!check_index(mesh_index, self->scene.meshes.size(), "mesh_index"))
+        return nullptr;
+
+    crt::Transform transform;
+    if (!get_transform(position_obj, matrix_obj, transform))
+        return nullptr;
+
+    self->scene.instances.push_back(crt::make_instance(mesh_index, self->scene.meshes[mesh_index], transform));
+    self->is_instance_tree_dirty = true;
+
+    return PyLong_FromSize_t(self->scene.instances.size() - 1);
+}
+
+static PyObject *scene_set_instance_transform(SceneObject *self, PyObject *args, PyObject *kwargs) {
+    if (!scene_check_not_rendering(self))
+        return nullptr;
+
+    static const char *keywords[]{ "instance_index", "position", "matrix", nullptr };
+
+    int instance_index;
+    PyObject *position_obj = nullptr, *matrix_obj = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|OO", const_cast<char **>(keywords), &instance_index, &position_obj, &matrix_obj))
+        return nullptr;
+
+    if (!check_index(instance_index, self->scene.instances.size(), "instance_index"))
+        return nullptr;
+
+    crt::Transform transform;
+    if (!get_transform(position_obj, matrix_obj, transform))
+        return nullptr;
+
+    // NOTE: Only the instance tree is rebuilt (on the next render), the mesh keeps its tree
+    crt::Instance &instance = self->scene.instances[instance_index];
+    instance = crt::make_instance(instance.mesh_index, self->scene.meshes[instance.mesh_index], transform);
+    self->is_instance_tree_dirty = true;
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef scene_methods[]{
+    { "set_camera", (PyCFunction)scene_set_camera, METH_VARARGS | METH_KEYWORDS,
+        "set_camera(position, matrix, fov_degrees=90.0)\n--\n\nPlace the camera. matrix is a row-major 3x3 rotation, flattened to 9 numbers." },
+    { "set_resolution", (PyCFunction)scene_set_resolution, METH_VARARGS | METH_KEYWORDS,
+        "set_resolution(width, height)\n--\n\nChange the size of the rendered image, keeping the camera where it is." },
+    { "set_options", (PyCFunction)scene_set_options, METH_VARARGS | METH_KEYWORDS,
+        "set_options(*, background_color=None, bucket_size=None, gi_on=None, reflections_on=None, refractions_on=None)\n--\n\n"
+        "Change the settings of the scene, given to the constructor. Options, which are None, are left as they are." },
+    { "add_light", (PyCFunction)scene_add_light, METH_VARARGS | METH_KEYWORDS,
+        "add_light(position, intensity)\n--\n\nAdd a point light. Returns its index." },
+    { "set_light", (PyCFunction)scene_set_light, METH_VARARGS | METH_KEYWORDS,
+        "set_light(light_index, position, intensity)\n--\n\nMove or change a point light." },
+    { "clear_lights", (PyCFunction)scene_clear_lights, METH_NOARGS,
+        "clear_lights()\n--\n\nRemove all lights." },
+    { "add_albedo_texture", (PyCFunction)scene_add_albedo_texture, METH_VARARGS | METH_KEYWORDS,
+        "add_albedo_texture(albedo)\n--\n\nAdd a solid color texture. Returns its index." },
+    { "add_edges_texture", (PyCFunction)scene_add_edges_texture, METH_VARARGS | METH_KEYWORDS,
+        "add_edges_texture(edge_color, inner_color, edge_width)\n--\n\nAdd a triangle edges texture. Returns its index." },
+    { "add_checker_texture", (PyCFunction)scene_add_checker_texture, METH_VARARGS | METH_KEYWORDS,
+        "add_checker_texture(color_a, color_b, square_size)\n--\n\nAdd a checker texture. Returns its index." },
+    { "add_bitmap_texture", (PyCFunction)scene_add_bitmap_texture, METH_VARARGS | METH_KEYWORDS,
+        "add_bitmap_texture(file_path)\n--\n\nLoad an image file as a texture. Returns its index." },
+    { "add_material", (PyCFunction)scene_add_material, METH_VARARGS | METH_KEYWORDS,
+        "add_material(type, *, albedo=None, albedo_texture=-1, ior=1.0, smooth_shading=False, back_face_culling=False)\n--\n\n"
+        "Add a material. Non-refractive materials need either an albedo color or an albedo texture index. Returns its index." },
+    { "set_material", (PyCFunction)scene_set_material, METH_VARARGS | METH_KEYWORDS,
+        "set_material(material_index, type, *, albedo=None, albedo_texture=-1, ior=1.0, smooth_shading=False, back_face_culling=False)\n--\n\n"
+        "Change a material, taking the same arguments as add_material()." },
+    { "add_mesh", (PyCFunction)scene_add_mesh, METH_VARARGS | METH_KEYWORDS,
+        "add_mesh(vertices, triangles, material_index, uvs=None)\n--\n\n"
+        "Add object space geometry from float32 vertex (3 per vertex), int32 triangle (3 per triangle) and\n"
+        "float32 UV (2 or 3 per vertex) buffers. The mesh is not visible until it is instanced. Returns its index." },
+    { "set_mesh_vertices", (PyCFunction)scene_set_mesh_vertices, METH_VARARGS | METH_KEYWORDS,
+        "set_mesh_vertices(mesh_index, vertices)\n--\n\n"
+        "Move the vertices of a mesh (eg. for deformation), keeping its triangles. The acceleration tree of\n"
+        "the mesh is refitted instead of rebuilt, so large deformations are better re-added with add_mesh()." },
+    { "add_instance", (PyCFunction)scene_add_instance, METH_VARARGS | METH_KEYWORDS,
+        "add_instance(mesh_index, position=(0, 0, 0), matrix=identity)\n--\n\nPlace a mesh in the world. Returns the instance index." },
+    { "set_instance_transform", (PyCFunction)scene_set_instance_transform, METH_VARARGS | METH_KEYWORDS,
+        "set_instance_transform(instance_index, position=(0, 0, 0), matrix=identity)\n--\n\nMove an instance. The mesh is not rebuilt." },
+    { nullptr }
+};
+
+bool init_scene_type() {
+    SceneType.tp_name = "_crt.Scene";
+    SceneType.tp_doc = "Scene(width, height, *, background_color=(0, 0, 0), bucket_size=DEFAULT_SCENE_BUCKET_SIZE, gi_on=False, reflections_on=True, refractions_on=True)\n--\n\n"
+                       "A scene, built directly from Python objects and buffers.";
+    SceneType.tp_basicsize = sizeof(SceneObject);
+    SceneType.tp_flags = Py_TPFLAGS_DEFAULT;
+    SceneType.tp_new = scene_new;
+    SceneType.tp_dealloc = (destructor)scene_dealloc;
+    SceneType.tp_methods = scene_methods;
+
+    return PyType_Ready(&SceneType) == 0;
+}
+
+void scene_prepare_for_render(SceneObject *self) {
+    if (self->is_instance_tree_dirty) {
+        self->scene.instance_tree = crt::instance_tree::build(self->scene.instances);
+        self->is_instance_tree_dirty = false;
+    }
+}
+
+bool scene_check_not_rendering(SceneObject *self) {
+    if (self->render_count.load() > 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot modify a scene while it is being rendered");
+        return false;
+    }
+    return true;
+}
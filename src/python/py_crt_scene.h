@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Python.h>
+
+#include <atomic>
+#include <vector>
+
+#include "core/crt_scene.h"
+#include "core/crt_triangle.h"
+
+/**
+ * `_crt.Scene`: a scene, built directly from Python objects and buffers, without going through JSON.
+ *
+ * Every object is added as a mesh (vertex and index buffers in object space) and placed in the
+ * world with one or more instances.
+ */
+struct SceneObject {
+    PyObject_HEAD
+    crt::Scene scene;
+    /**
+     * Flags of the triangles, using each material (indexed like `scene.materials`)
+     */
+    std::vector<crt::TriangleFlags> material_triangle_flags;
+    /**
+     * Solid color textures, created for materials, given an albedo color (-1 for materials, using
+     * a texture of the scene). They are updated in place, when the material is changed.
+     */
+    std::vector<int> material_albedo_texture_indices;
+    /**
+     * Whether instances were added or moved since the instance tree was last built
+     */
+    bool is_instance_tree_dirty;
+    /**
+     * Number of renders in progress. The scene must not be modified while there are any.
+     */
+    std::atomic<int> render_count;
+};
+
+extern PyTypeObject SceneType;
+
+bool init_scene_type();
+
+/**
+ * Bring the acceleration structures of the scene up to date before rendering.
+ */
+void scene_prepare_for_render(SceneObject *self);
+
+/**
+ * Raise a RuntimeError and return false if the scene is being rendered.
+ */
+bool scene_check_not_rendering(SceneObject *self);
@@ -1,17 +1,313 @@
+#include <charconv>
 #include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <future>
+#include <iomanip>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include "core/crt_bitmap_cache.h"
+#include "core/crt_camera_path.h"
 #include "core/crt_image.h"
-#include "core/crt_image_ppm.h"
+#include "core/crt_image_encoder.h"
+#include "core/crt_image_stream.h"
 #include "core/crt_json.h"
+#include "core/crt_pixel_cost.h"
 #include "core/crt_renderer.h"
 #include "core/crt_scene.h"
+#include "core/crt_stats.h"
+#include "core/crt_texture_pages.h"
+#include "core/crt_thread_pool.h"
+#include "core/crt_trace.h"
+
+#include "standalone_batch.h"
+#include "standalone_distributed.h"
+#include "standalone_image_file.h"
+
+static void print_usage(const char *program_name) {
+    std::cerr << "Usage: " << program_name << " [scene.crtscene] [output.ppm|.pfm|.exr] [--stats] [--stats-json stats.json] [--trace trace.json]"
+                 " [--heatmap heatmap.ppm|.pfm|.exr] [--heatmap-metric time|rays|nodes|triangles] [--animation camera_path.json] [--no-pipeline]"
+                 " [--coordinator port | --worker host:port] [--texture-pages directory] [--texture-page-cache-mib size]\n"
+                 "       " << program_name << " --batch jobs.txt [--concurrent-jobs count] [--threads count] [--metrics-log metrics.jsonl] [--texture-cache-mib size]"
+                 " [--texture-pages directory] [--texture-page-cache-mib size] [--stats] [--stats-json stats.json] [--trace trace.json]\n";
+}
+
+static std::optional<unsigned> parse_count(const std::string_view text) {
+    unsigned count = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+    if (error != std::errc{} || end != text.data() + text.size() || count == 0)
+        return std::nullopt;
+    return count;
+}
+
+static std::optional<uint16_t> parse_port(const std::string_view text) {
+    uint16_t port = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), port);
+    if (error != std::errc{} || end != text.data() + text.size() || port == 0)
+        return std::nullopt;
+    return port;
+}
+
+struct CoordinatorAddress {
+    std::string host;
+    uint16_t port;
+};
+
+static std::optional<CoordinatorAddress> parse_coordinator_address(const std::string_view text) {
+    const size_t separator = text.rfind(':');
+    if (separator == std::string_view::npos || separator == 0)
+        return std::nullopt;
+
+    std::optional<uint16_t> port = parse_port(text.substr(separator + 1));
+    if (!port)
+        return std::nullopt;
+    return CoordinatorAddress { std::string{ text.substr(0, separator) }, *port };
+}
+
+/**
+ * The file of a frame of an animation: the first run of `#` in the file name is replaced with the frame
+ * number, padded with zeros to its length. Without one, `_####` is added before the extension.
+ */
+static std::filesystem::path get_frame_file_path(const std::filesystem::path &output_file_path, int frame) {
+    std::string file_name = output_file_path.filename().string();
+    size_t placeholder_begin = file_name.find('#');
+    size_t placeholder_length = 0;
+    if (placeholder_begin == std::string::npos) {
+        placeholder_begin = output_file_path.stem().string().size();
+        file_name.insert(placeholder_begin, "_####");
+        placeholder_begin++;
+    }
+    while (placeholder_begin + placeholder_length < file_name.size() && file_name[placeholder_begin + placeholder_length] == '#')
+        placeholder_length++;
+
+    std::ostringstream frame_number;
+    frame_number << std::setw(placeholder_length) << std::setfill('0') << frame;
+    file_name.replace(placeholder_begin, placeholder_length, frame_number.str());
+    return output_file_path.parent_path() / file_name;
+}
+
+/**
+ * Render every frame of `camera_path` into a numbered image sequence (see get_frame_file_path()).
+ *
+ * The scene and its acceleration trees are shared by all frames, only the camera is moved, and the
+ * render threads are kept alive between the frames. With `pipeline`, every frame is written on another
+ * thread while the next one is rendering.
+ */
+static bool render_animation(crt::Scene &scene, const crt::CameraPath &camera_path, const std::filesystem::path &output_file_path, bool pipeline, crt::RenderStats &stats) {
+    using namespace std::chrono;
+
+    const crt::Camera scene_camera = scene.camera;
+    if (!crt::standalone::get_row_encoder(output_file_path, scene_camera.resolution_x(), scene_camera.resolution_y())) {
+        std::cerr << "Error: Unsupported output format (expected .ppm, .pfm or .exr): " << output_file_path << '\n';
+        return false;
+    }
+
+    crt::RendererSettings settings;
+    crt::ThreadPool thread_pool;
+
+    // The previous frame, while it's being written
+    std::future<bool> pending_write;
+    const auto finish_pending_write = [&pending_write]() {
+        return !pending_write.valid() || pending_write.get();
+    };
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    for (int frame = 0; frame < camera_path.frame_count; ++frame) {
+        scene.camera = camera_path.get_camera(frame, scene_camera);
+
+        crt::Image image{ scene_camera.resolution_x(), scene_camera.resolution_y() };
+        {
+            crt::TraceScope trace_scope{ "render_frame", { "frame", frame } };
+            crt::ImageTileSink sink{ image };
+            crt::render_image(scene, settings, sink, {}, &stats, nullptr, &thread_pool);
+        }
+
+        // NOTE: Waited for only after the next frame is rendered, so that at most 2 frames are kept in memory
+        if (!finish_pending_write())
+            return false;
+
+        auto write_frame = [frame, image = std::move(image), frame_file_path = get_frame_file_path(output_file_path, frame)]() {
+            if (crt::trace::is_enabled())
+                crt::trace::set_thread_name("frame writer");
+            crt::TraceScope trace_scope{ "write_frame", { "frame", frame } };
+            return crt::standalone::write_image_file(image, frame_file_path);
+        };
+        if (pipeline)
+            pending_write = std::async(std::launch::async, std::move(write_frame));
+        else if (!write_frame())
+            return false;
+    }
+    if (!finish_pending_write())
+        return false;
+    high_resolution_clock::time_point stop = high_resolution_clock::now();
+
+    const long double seconds = duration_cast<microseconds>(stop - start).count() / 1'000'000.0l;
+    std::cout << "Execution time: " << seconds << " seconds (" << camera_path.frame_count << " frames, "
+              << seconds / camera_path.frame_count << " seconds per frame).\n";
+    return true;
+}
+
+static void print_texture_page_stats(std::ostream &os) {
+    const crt::TexturePageCacheStats page_stats = crt::TexturePageCache::global().stats();
+    if (page_stats.hits + page_stats.misses == 0)
+        return;
+    os << "Texture pages: " << page_stats.misses << " read, " << page_stats.hits << " cached lookups, " << page_stats.evictions << " evicted, "
+       << page_stats.memory_size / (1024 * 1024) << " MiB cached\n";
+}
+
+/**
+ * Print and write the stats and the trace, which were asked for
+ */
+static int write_reports(bool print_stats, const std::optional<std::filesystem::path> &stats_json_file_path, const std::optional<std::filesystem::path> &trace_file_path, const crt::RenderStats &stats) {
+    if (print_stats) {
+        crt::print_stats_report(std::cout, stats);
+        print_texture_page_stats(std::cout);
+    }
+
+    if (stats_json_file_path) {
+        std::ofstream stats_json_file{ *stats_json_file_path };
+        if (!stats_json_file.is_open()) {
+            std::cerr << "Error: Could not open stats file: " << *stats_json_file_path << '\n';
+            return 1;
+        }
+        crt::write_stats_json(stats_json_file, stats);
+    }
+
+    if (trace_file_path) {
+        crt::trace::stop();
+        std::ofstream trace_file{ *trace_file_path };
+        if (!trace_file.is_open()) {
+            std::cerr << "Error: Could not open trace file: " << *trace_file_path << '\n';
+            return 1;
+        }
+        crt::trace::write_chrome_trace(trace_file);
+    }
+
+    return 0;
+}
 
 int main(int argc, char *argv[]) {
     using namespace std::chrono;
 
-    std::filesystem::path input_file_path = argc > 1 ? argv[1] : "../scenes/15-01-conclusion/scene2.crtscene";
+    std::vector<std::string_view> positional_args;
+    bool print_stats = false;
+    std::optional<std::filesystem::path> stats_json_file_path;
+    std::optional<std::filesystem::path> trace_file_path;
+    std::optional<std::filesystem::path> heatmap_file_path;
+    crt::PixelCostMetric heatmap_metric = crt::PixelCostMetric::Time;
+    std::optional<std::filesystem::path> animation_file_path;
+    bool pipeline_animation = true;
+    std::optional<uint16_t> coordinator_port;
+    std::optional<CoordinatorAddress> coordinator_address;
+    std::optional<std::filesystem::path> batch_file_path;
+    crt::standalone::BatchSettings batch_settings;
+    std::filesystem::path texture_page_directory;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--stats") {
+            print_stats = true;
+        } else if (arg == "--stats-json" && i + 1 < argc) {
+            stats_json_file_path = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_file_path = argv[++i];
+        } else if (arg == "--heatmap" && i + 1 < argc) {
+            heatmap_file_path = argv[++i];
+        } else if (arg == "--heatmap-metric" && i + 1 < argc) {
+            std::optional<crt::PixelCostMetric> metric = crt::get_pixel_cost_metric_from_name(argv[++i]);
+            if (!metric) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            heatmap_metric = *metric;
+        } else if (arg == "--animation" && i + 1 < argc) {
+            animation_file_path = argv[++i];
+        } else if (arg == "--no-pipeline") {
+            pipeline_animation = false;
+        } else if (arg == "--coordinator" && i + 1 < argc) {
+            coordinator_port = parse_port(argv[++i]);
+            if (!coordinator_port) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--worker" && i + 1 < argc) {
+            coordinator_address = parse_coordinator_address(argv[++i]);
+            if (!coordinator_address) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch_file_path = argv[++i];
+        } else if ((arg == "--concurrent-jobs" || arg == "--threads") && i + 1 < argc) {
+            std::optional<unsigned> count = parse_count(argv[++i]);
+            if (!count) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            (arg == "--threads" ? batch_settings.thread_count : batch_settings.concurrent_job_count) = *count;
+        } else if (arg == "--texture-cache-mib" && i + 1 < argc) {
+            std::optional<unsigned> mib = parse_count(argv[++i]);
+            if (!mib) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            batch_settings.bitmap_cache_budget = size_t{ *mib } * 1024 * 1024;
+        } else if (arg == "--texture-pages" && i + 1 < argc) {
+            texture_page_directory = argv[++i];
+        } else if (arg == "--texture-page-cache-mib" && i + 1 < argc) {
+            std::optional<unsigned> mib = parse_count(argv[++i]);
+            if (!mib) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            crt::TexturePageCache::global().set_memory_budget(size_t{ *mib } * 1024 * 1024);
+        } else if (arg == "--metrics-log" && i + 1 < argc) {
+            batch_settings.metrics_log_path = argv[++i];
+        } else if (arg.starts_with("--")) {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            positional_args.push_back(arg);
+        }
+    }
+
+    const bool is_distributed = coordinator_port || coordinator_address;
+    if (coordinator_port && coordinator_address) {
+        std::cerr << "Error: --coordinator and --worker can't be combined\n";
+        return 1;
+    }
+    if (heatmap_file_path && (animation_file_path || is_distributed)) {
+        std::cerr << "Error: --heatmap is not supported with --animation, --coordinator or --worker\n";
+        return 1;
+    }
+    if (animation_file_path && is_distributed) {
+        std::cerr << "Error: --animation is not supported with --coordinator or --worker\n";
+        return 1;
+    }
+
+    if (batch_file_path && (!positional_args.empty() || heatmap_file_path || animation_file_path || is_distributed)) {
+        std::cerr << "Error: --batch takes the scenes and output files from the job file, and is not supported with --heatmap, --animation, --coordinator or --worker\n";
+        return 1;
+    }
+
+    if (trace_file_path) {
+        crt::trace::set_thread_name("main");
+        crt::trace::start();
+    }
+
+    if (batch_file_path) {
+        batch_settings.texture_page_directory = texture_page_directory;
+        crt::RenderStats stats;
+        const bool succeeded = crt::standalone::run_batch(*batch_file_path, batch_settings, &stats);
+        const int result = write_reports(print_stats, stats_json_file_path, trace_file_path, stats);
+        return succeeded ? result : 1;
+    }
+
+    std::filesystem::path input_file_path = positional_args.size() > 0 ? positional_args[0] : "../scenes/15-01-conclusion/scene2.crtscene";
 
     std::ifstream input_file{ input_file_path, std::ios::in | std::ios::binary };
     if (!input_file.is_open()) {
@@ -19,30 +315,141 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    std::optional<crt::Scene> scene = crt::json::read_scene_from_istream(input_file, input_file_path.parent_path());
+    crt::RenderStats stats;
+    crt::BitmapCache bitmap_cache{ crt::BitmapCache::UNLIMITED_MEMORY_BUDGET, texture_page_directory };
+    std::optional<crt::Scene> scene;
+    {
+        crt::StatsScope stats_scope{ &stats };
+        crt::ScopedStatTimer load_timer{ crt::StatTimer::SceneLoad };
+        scene = crt::json::read_scene_from_istream(input_file, input_file_path.parent_path(), &bitmap_cache);
+    }
     if (!scene) {
         std::cerr << "Error: Could not parse JSON file: " << input_file_path << '\n';
         return 1;
     }
 
-    auto output_file_path = argc > 2 ? argv[2] : "output.ppm";
+    if (coordinator_address) {
+        // NOTE: The output is written by the coordinator
+        if (!crt::standalone::run_worker(*scene, crt::RendererSettings{}, coordinator_address->host, coordinator_address->port, &stats))
+            return 1;
+        return write_reports(print_stats, stats_json_file_path, trace_file_path, stats);
+    }
+
+    std::filesystem::path output_file_path = positional_args.size() > 1 ? positional_args[1] : "output.ppm";
+
+    if (animation_file_path) {
+        std::ifstream animation_file{ *animation_file_path, std::ios::in | std::ios::binary };
+        if (!animation_file.is_open()) {
+            std::cerr << "Error: Could not open animation file: " << *animation_file_path << '\n';
+            return 1;
+        }
+        std::optional<crt::CameraPath> camera_path = crt::json::read_camera_path_from_istream(animation_file);
+        if (!camera_path) {
+            std::cerr << "Error: Could not parse animation file: " << *animation_file_path << '\n';
+            return 1;
+        }
+        if (!render_animation(*scene, *camera_path, output_file_path, pipeline_animation, stats))
+            return 1;
+        return write_reports(print_stats, stats_json_file_path, trace_file_path, stats);
+    }
+
+    std::optional<crt::RowEncoder> encoder = crt::standalone::get_row_encoder(output_file_path, scene->camera.resolution_x(), scene->camera.resolution_y());
+    if (!encoder) {
+        std::cerr << "Error: Unsupported output format (expected .ppm, .pfm or .exr): " << output_file_path << '\n';
+        return 1;
+    }
+
     std::ofstream output_file{ output_file_path, std::ios::out | std::ios::binary };
     if (!output_file.is_open()) {
         std::cerr << "Error: Could not open output file: " << output_file_path << '\n';
         return 1;
     }
 
+    std::optional<crt::PixelCostBuffer> pixel_costs;
+    if (heatmap_file_path) {
+#ifndef CRT_ENABLE_STATS
+        if (crt::is_pixel_cost_metric_counted(heatmap_metric)) {
+            std::cerr << "Error: The " << crt::get_pixel_cost_metric_name(heatmap_metric) << " heatmap needs a build with CRT_ENABLE_STATS\n";
+            return 1;
+        }
+#endif
+        pixel_costs.emplace(heatmap_metric, scene->camera.resolution_x(), scene->camera.resolution_y());
+    }
+
     crt::RendererSettings settings;
 
+    // With --coordinator, the image is rendered by the workers instead
+    const auto render = [&](crt::TileSink &sink) {
+        if (coordinator_port)
+            return crt::standalone::run_coordinator(*coordinator_port, scene->camera.resolution_x(), scene->camera.resolution_y(), scene->bucket_size, sink);
+        crt::render_image(*scene, settings, sink, {}, &stats, pixel_costs ? &*pixel_costs : nullptr);
+        return true;
+    };
+
+    // NOTE: Rows are written while rendering, so a failed render would leave a truncated image behind
+    const auto discard_output_file = [&]() {
+        output_file.close();
+        std::error_code error;
+        if (std::filesystem::is_regular_file(output_file_path, error))
+            std::filesystem::remove(output_file_path, error);
+    };
+
     high_resolution_clock::time_point start = high_resolution_clock::now();
-    crt::Image image = crt::render_image(*scene, settings);
+    std::optional<crt::Image> image;
+    bool is_image_written = true;
+    if (encoder->bottom_to_top) {
+        // The last rendered rows come first in the file, so the whole image has to be kept around
+        image.emplace(scene->camera.resolution_x(), scene->camera.resolution_y());
+        crt::ImageTileSink sink{ *image };
+        if (!render(sink)) {
+            discard_output_file();
+            return 1;
+        }
+    } else {
+        // Finished rows are written to the output file while the rest of the image is rendering
+        crt::StreamingImageWriter writer{ output_file, scene->camera.resolution_x(), scene->camera.resolution_y(), std::move(*encoder) };
+        if (!render(writer)) {
+            discard_output_file();
+            return 1;
+        }
+        is_image_written = writer.is_complete() && !writer.has_failed();
+    }
     high_resolution_clock::time_point stop = high_resolution_clock::now();
 
     microseconds duration = duration_cast<microseconds>(stop - start);
     const long double seconds = duration.count() / 1'000'000.0l;
     std::cout << "Execution time: " << seconds << " seconds.\n";
 
-    crt::write_ppm(image, output_file);
+    if (image) {
+        crt::TraceScope trace_scope{ "write_image" };
+        crt::write_image(*image, *encoder, output_file);
+    }
 
-    return 0;
+    output_file.close();
+    if (!is_image_written || !output_file) {
+        std::cerr << "Error: Could not write output file: " << output_file_path << '\n';
+        discard_output_file();
+        return 1;
+    }
+
+    if (print_stats) {
+        crt::print_stats_report(std::cout, stats);
+        print_texture_page_stats(std::cout);
+    }
+
+    if (pixel_costs) {
+        std::optional<crt::RowEncoder> heatmap_encoder = crt::standalone::get_row_encoder(*heatmap_file_path, pixel_costs->width, pixel_costs->height);
+        std::ofstream heatmap_file{ *heatmap_file_path, std::ios::out | std::ios::binary };
+        if (!heatmap_encoder || !heatmap_file.is_open()) {
+            std::cerr << "Error: Could not write heatmap file: " << *heatmap_file_path << '\n';
+            return 1;
+        }
+        crt::write_image(crt::make_pixel_cost_heatmap(*pixel_costs), *heatmap_encoder, heatmap_file);
+
+        const crt::PixelCostSummary summary = crt::get_pixel_cost_summary(*pixel_costs);
+        std::cout << "Pixel cost (" << crt::get_pixel_cost_metric_name(pixel_costs->metric) << "): min " << summary.min
+                  << ", mean " << summary.mean << ", 99th percentile " << summary.percentile_99 << ", max " << summary.max << '\n';
+    }
+
+    return write_reports(false, stats_json_file_path, trace_file_path, stats);
 }
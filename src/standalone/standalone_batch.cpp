@@ -0,0 +1,299 @@
+#include "standalone_batch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core/crt_bitmap_cache.h"
+#include "core/crt_image.h"
+#include "core/crt_image_encoder.h"
+#include "core/crt_image_stream.h"
+#include "core/crt_json.h"
+#include "core/crt_renderer.h"
+#include "core/crt_scene.h"
+#include "core/crt_thread_pool.h"
+#include "core/crt_tile.h"
+#include "core/crt_trace.h"
+
+#include "standalone_image_file.h"
+
+namespace crt::standalone {
+
+struct BatchJob {
+    std::filesystem::path scene_file_path;
+    std::filesystem::path output_file_path;
+};
+
+struct JobMetrics {
+    bool succeeded{ false };
+    std::string error;
+    int width{ 0 }, height{ 0 };
+    double load_seconds{ 0.0 };
+    double render_seconds{ 0.0 };
+    /**
+     * Formats, which are streamed while rendering, are written within the render time
+     */
+    double write_seconds{ 0.0 };
+    double total_seconds{ 0.0 };
+    RenderStats stats;
+    BitmapCacheStats bitmap_cache_stats;
+};
+
+static std::optional<std::vector<BatchJob>> read_jobs(const std::filesystem::path &jobs_file_path) {
+    std::ifstream jobs_file{ jobs_file_path };
+    if (!jobs_file.is_open()) {
+        std::cerr << "Error: Could not open job file: " << jobs_file_path << '\n';
+        return std::nullopt;
+    }
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    for (int line_number = 1; std::getline(jobs_file, line); ++line_number) {
+        std::istringstream line_stream{ line };
+        std::string scene_file_path, output_file_path;
+        if ((line_stream >> std::ws).eof() || line_stream.peek() == '#')
+            continue;
+
+        std::string rest;
+        if (!(line_stream >> std::quoted(scene_file_path) >> std::quoted(output_file_path)) || (line_stream >> rest)) {
+            std::cerr << "Error: Expected a scene file and an output file on line " << line_number << " of " << jobs_file_path << '\n';
+            return std::nullopt;
+        }
+        jobs.push_back(BatchJob { scene_file_path, output_file_path });
+    }
+    return jobs;
+}
+
+static BitmapCacheStats get_bitmap_cache_stats_difference(const BitmapCacheStats &after, const BitmapCacheStats &before) {
+    return BitmapCacheStats {
+        .file_hits = after.file_hits - before.file_hits,
+        .content_hits = after.content_hits - before.content_hits,
+        .misses = after.misses - before.misses,
+        .evictions = after.evictions - before.evictions,
+        // NOTE: Sizes can shrink through evictions, so the ones after are kept
+        .bitmap_count = after.bitmap_count,
+        .memory_size = after.memory_size,
+    };
+}
+
+using Clock = std::chrono::steady_clock;
+
+static double get_seconds_since(const Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Fills in the metrics as far as it gets. On failure, the error is set.
+ */
+static bool render_job(const BatchJob &job, BitmapCache &bitmap_cache, ThreadPool &thread_pool, JobMetrics &metrics) {
+    std::ifstream input_file{ job.scene_file_path, std::ios::in | std::ios::binary };
+    if (!input_file.is_open()) {
+        metrics.error = "could not open the scene file";
+        return false;
+    }
+
+    const Clock::time_point load_start = Clock::now();
+    std::optional<Scene> scene;
+    {
+        StatsScope stats_scope{ &metrics.stats };
+        ScopedStatTimer load_timer{ StatTimer::SceneLoad };
+        scene = json::read_scene_from_istream(input_file, job.scene_file_path.parent_path(), &bitmap_cache);
+    }
+    metrics.load_seconds = get_seconds_since(load_start);
+    if (!scene) {
+        metrics.error = "could not parse the scene file";
+        return false;
+    }
+
+    metrics.width = scene->camera.resolution_x();
+    metrics.height = scene->camera.resolution_y();
+    std::optional<RowEncoder> encoder = get_row_encoder(job.output_file_path, metrics.width, metrics.height);
+    if (!encoder) {
+        metrics.error = "unsupported output format (expected .ppm, .pfm or .exr)";
+        return false;
+    }
+
+    std::ofstream output_file{ job.output_file_path, std::ios::out | std::ios::binary };
+    if (!output_file.is_open()) {
+        metrics.error = "could not open the output file";
+        return false;
+    }
+
+    const RendererSettings settings;
+    const Clock::time_point render_start = Clock::now();
+    if (encoder->bottom_to_top) {
+        Image image{ metrics.width, metrics.height };
+        ImageTileSink sink{ image };
+        render_image(*scene, settings, sink, {}, &metrics.stats, nullptr, &thread_pool);
+        metrics.render_seconds = get_seconds_since(render_start);
+
+        const Clock::time_point write_start = Clock::now();
+        TraceScope trace_scope{ "write_image" };
+        write_image(image, *encoder, output_file);
+        metrics.write_seconds = get_seconds_since(write_start);
+    } else {
+        StreamingImageWriter writer{ output_file, metrics.width, metrics.height, std::move(*encoder) };
+        render_image(*scene, settings, writer, {}, &metrics.stats, nullptr, &thread_pool);
+        metrics.render_seconds = get_seconds_since(render_start);
+        if (writer.has_failed())
+            output_file.setstate(std::ios::failbit);
+    }
+
+    output_file.close();
+    if (!output_file) {
+        metrics.error = "could not write the output file";
+        // NOTE: Not left behind truncated
+        std::error_code error;
+        if (std::filesystem::is_regular_file(job.output_file_path, error))
+            std::filesystem::remove(job.output_file_path, error);
+        return false;
+    }
+    return true;
+}
+
+static JobMetrics run_job(const BatchJob &job, BitmapCache &bitmap_cache, ThreadPool &thread_pool) {
+    JobMetrics metrics;
+    const Clock::time_point start = Clock::now();
+    const BitmapCacheStats bitmap_cache_stats_before = bitmap_cache.stats();
+
+    metrics.succeeded = render_job(job, bitmap_cache, thread_pool, metrics);
+
+    // NOTE: With concurrent jobs, the loads of the other jobs in the meantime are counted as well
+    metrics.bitmap_cache_stats = get_bitmap_cache_stats_difference(bitmap_cache.stats(), bitmap_cache_stats_before);
+    metrics.total_seconds = get_seconds_since(start);
+    return metrics;
+}
+
+static void write_json_string(std::ostream &os, std::string_view text) {
+    os << '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[7];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            os << escaped;
+        } else {
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+/**
+ * A single line of JSON, so that the log of a batch can be followed (and parsed) while it's running
+ */
+static void write_job_metrics_json(std::ostream &os, size_t job_index, const BatchJob &job, const JobMetrics &metrics) {
+    os << "{\"job\": " << job_index << ", \"scene\": ";
+    write_json_string(os, job.scene_file_path.string());
+    os << ", \"output\": ";
+    write_json_string(os, job.output_file_path.string());
+    os << ", \"succeeded\": " << (metrics.succeeded ? "true" : "false");
+    if (!metrics.succeeded) {
+        os << ", \"error\": ";
+        write_json_string(os, metrics.error);
+    }
+    os << ", \"width\": " << metrics.width
+       << ", \"height\": " << metrics.height
+       << ", \"load_seconds\": " << metrics.load_seconds
+       << ", \"render_seconds\": " << metrics.render_seconds
+       << ", \"write_seconds\": " << metrics.write_seconds
+       << ", \"total_seconds\": " << metrics.total_seconds
+       << ", \"ray_count\": " << metrics.stats.ray_count()
+       << ", \"bitmap_file_hits\": " << metrics.bitmap_cache_stats.file_hits
+       << ", \"bitmap_content_hits\": " << metrics.bitmap_cache_stats.content_hits
+       << ", \"bitmap_misses\": " << metrics.bitmap_cache_stats.misses
+       << ", \"bitmap_evictions\": " << metrics.bitmap_cache_stats.evictions
+       << "}\n";
+}
+
+bool run_batch(const std::filesystem::path &jobs_file_path, const BatchSettings &settings, RenderStats *stats) {
+    std::optional<std::vector<BatchJob>> jobs = read_jobs(jobs_file_path);
+    if (!jobs)
+        return false;
+
+    std::ofstream metrics_log;
+    if (settings.metrics_log_path) {
+        metrics_log.open(*settings.metrics_log_path);
+        if (!metrics_log.is_open()) {
+            std::cerr << "Error: Could not open metrics log: " << *settings.metrics_log_path << '\n';
+            return false;
+        }
+    }
+
+    // NOTE: The scenes of a batch tend to use the same textures, so their bitmaps are shared
+    BitmapCache bitmap_cache{ settings.bitmap_cache_budget, settings.texture_page_directory };
+
+    const unsigned runner_count = std::clamp<unsigned>(settings.concurrent_job_count, 1, std::max<size_t>(jobs->size(), 1));
+    const unsigned threads_per_runner = std::max(1u, settings.thread_count / runner_count);
+
+    std::atomic<size_t> next_job_index{ 0 };
+    std::mutex mutex;
+    size_t finished_count = 0, failed_count = 0;
+
+    const Clock::time_point start = Clock::now();
+    const auto run_jobs = [&](const unsigned runner_index) {
+        if (trace::is_enabled())
+            trace::set_thread_name("batch runner " + std::to_string(runner_index));
+
+        // Started once and kept alive for all jobs of the runner
+        ThreadPool thread_pool{ threads_per_runner };
+
+        for (;;) {
+            const size_t job_index = next_job_index++;
+            if (job_index >= jobs->size())
+                break;
+
+            const BatchJob &job = (*jobs)[job_index];
+            JobMetrics metrics;
+            {
+                TraceScope trace_scope{ "batch_job", { "job", static_cast<int64_t>(job_index) } };
+                metrics = run_job(job, bitmap_cache, thread_pool);
+            }
+
+            std::scoped_lock lock{ mutex };
+            finished_count++;
+            std::cout << '[' << finished_count << '/' << jobs->size() << "] " << job.scene_file_path.string() << " -> " << job.output_file_path.string();
+            if (metrics.succeeded) {
+                std::cout << ": " << metrics.total_seconds << " seconds\n";
+            } else {
+                std::cout << ": " << metrics.error << '\n';
+                failed_count++;
+            }
+
+            if (metrics_log.is_open()) {
+                write_job_metrics_json(metrics_log, job_index, job, metrics);
+                metrics_log.flush();
+            }
+            if (stats)
+                stats->merge(metrics.stats);
+        }
+    };
+
+    {
+        std::vector<std::jthread> runners;
+        runners.reserve(runner_count);
+        for (unsigned i = 0; i < runner_count; ++i)
+            runners.emplace_back(run_jobs, i);
+    }
+    const double seconds = get_seconds_since(start);
+
+    const BitmapCacheStats bitmap_cache_stats = bitmap_cache.stats();
+    std::cout << "Rendered " << jobs->size() - failed_count << " of " << jobs->size() << " jobs in " << seconds << " seconds ("
+              << runner_count << " at a time, " << threads_per_runner << " threads each).\n"
+              << "Bitmaps: " << bitmap_cache_stats.misses << " decoded, " << bitmap_cache_stats.file_hits + bitmap_cache_stats.content_hits
+              << " reused (" << bitmap_cache_stats.content_hits << " of them identical files), " << bitmap_cache_stats.evictions
+              << " evicted, " << bitmap_cache_stats.memory_size / (1024 * 1024) << " MiB cached\n";
+
+    return failed_count == 0;
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <thread>
+
+#include "core/crt_bitmap_cache.h"
+#include "core/crt_stats.h"
+
+namespace crt::standalone {
+
+struct BatchSettings {
+    /**
+     * Jobs, which are loaded and rendered at the same time
+     */
+    unsigned concurrent_job_count{ 1 };
+    /**
+     * Render threads, split evenly between the concurrent jobs
+     */
+    unsigned thread_count{ std::max(1u, std::thread::hardware_concurrency()) };
+    /**
+     * Where a line of JSON with the metrics of every job is written, as soon as it's done
+     */
+    std::optional<std::filesystem::path> metrics_log_path;
+    /**
+     * Bitmaps, which no running job uses, are evicted from the cache beyond this size (in bytes)
+     */
+    size_t bitmap_cache_budget{ BitmapCache::UNLIMITED_MEMORY_BUDGET };
+    /**
+     * When not empty, textures are paged from files in this directory (see BitmapCache)
+     */
+    std::filesystem::path texture_page_directory;
+};
+
+/**
+ * Render the jobs of a job file in a single process.
+ *
+ * Every line of the file is a job: the scene file and the output file, separated by whitespace. Paths
+ * with whitespace must be in double quotes. Empty lines and lines starting with `#` are skipped.
+ *
+ * The render threads are kept alive between the jobs, and the bitmaps of the textures are shared between
+ * the scenes, which use the same image files (see BitmapCache). The stats of all jobs are added to `stats`.
+ *
+ * Returns whether all jobs succeeded. A failed job doesn't stop the others.
+ */
+bool run_batch(const std::filesystem::path &jobs_file_path, const BatchSettings &settings, RenderStats *stats = nullptr);
+
+}
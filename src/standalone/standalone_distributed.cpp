@@ -0,0 +1,563 @@
+#include "standalone_distributed.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "core/crt_image.h"
+#include "core/crt_trace.h"
+
+#include "standalone_socket.h"
+
+namespace crt::standalone {
+
+// The protocol: every message is a type byte, the size of its payload and the payload. Numbers are
+// sent little-endian, 4 bytes each.
+//
+//     worker      -> coordinator: Hello { magic, version, image width, image height, thread count }
+//     coordinator -> worker:      Bucket { x, y, width, height }, as many as the worker has room for
+//     worker      -> coordinator: Tile { x, y, width, height, width * height RGB floats }, for every bucket
+//     coordinator -> worker:      Done, once the whole image is there (tiles, which are still on their way, are dropped)
+
+enum class MessageType : uint8_t {
+    Hello = 1,
+    Bucket,
+    Tile,
+    Done,
+};
+
+inline constexpr uint32_t PROTOCOL_MAGIC = 0x44545243; // "CRTD"
+inline constexpr uint32_t PROTOCOL_VERSION = 1;
+
+inline constexpr size_t MESSAGE_HEADER_SIZE = 1 + 4;
+/**
+ * Larger messages are treated as garbage, rather than allocating memory for them
+ */
+inline constexpr size_t MAX_MESSAGE_PAYLOAD_SIZE = 256 * 1024 * 1024;
+
+/**
+ * Buckets queued up on a worker per render thread, so that it has the next one at hand while the
+ * tile of the previous one is on its way
+ */
+inline constexpr size_t BUCKETS_IN_FLIGHT_PER_THREAD = 2;
+
+inline constexpr std::chrono::milliseconds ACCEPT_TIMEOUT{ 100 };
+inline constexpr std::chrono::milliseconds DONE_POLL_INTERVAL{ 100 };
+inline constexpr std::chrono::milliseconds CONNECT_RETRY_INTERVAL{ 200 };
+/**
+ * Time a worker has for its hello after connecting, and for the rest of a message, once it has started
+ * sending it, so that a stalled worker is dropped (and its buckets handed out again), rather than holding up
+ * the end of the render
+ */
+inline constexpr std::chrono::seconds RECEIVE_TIMEOUT{ 30 };
+/**
+ * Workers can be started before the coordinator, so they keep trying to connect for a while
+ */
+inline constexpr int CONNECT_ATTEMPT_COUNT = 50;
+
+class MessageWriter {
+public:
+    explicit MessageWriter(const MessageType type) {
+        m_buffer.resize(MESSAGE_HEADER_SIZE);
+        m_buffer[0] = static_cast<std::byte>(type);
+    }
+
+    void append_u32(const uint32_t value) {
+        for (int i = 0; i < 4; ++i)
+            m_buffer.push_back(static_cast<std::byte>(value >> (8 * i)));
+    }
+
+    void append_int(const int value) {
+        append_u32(static_cast<uint32_t>(value));
+    }
+
+    void append_float(const float value) {
+        append_u32(std::bit_cast<uint32_t>(value));
+    }
+
+    void reserve(const size_t payload_size) {
+        m_buffer.reserve(MESSAGE_HEADER_SIZE + payload_size);
+    }
+
+    /**
+     * The whole message, with the size of the payload filled in
+     */
+    std::span<const std::byte> finish() {
+        const uint32_t payload_size = static_cast<uint32_t>(m_buffer.size() - MESSAGE_HEADER_SIZE);
+        for (int i = 0; i < 4; ++i)
+            m_buffer[1 + i] = static_cast<std::byte>(payload_size >> (8 * i));
+        return m_buffer;
+    }
+
+private:
+    std::vector<std::byte> m_buffer;
+};
+
+/**
+ * Reads the fields of a payload in order. Reading past its end gives zeros and makes it not ok().
+ */
+class MessageReader {
+public:
+    explicit MessageReader(std::span<const std::byte> payload)
+        : m_payload(payload)
+    {}
+
+    uint32_t read_u32() {
+        if (m_payload.size() < 4) {
+            m_ok = false;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i)
+            value |= static_cast<uint32_t>(m_payload[i]) << (8 * i);
+        m_payload = m_payload.subspan(4);
+        return value;
+    }
+
+    int read_int() {
+        return static_cast<int>(read_u32());
+    }
+
+    float read_float() {
+        return std::bit_cast<float>(read_u32());
+    }
+
+    size_t remaining_size() const noexcept {
+        return m_payload.size();
+    }
+
+    bool ok() const noexcept {
+        return m_ok;
+    }
+
+private:
+    std::span<const std::byte> m_payload;
+    bool m_ok{ true };
+};
+
+/**
+ * @param deadline If set, the whole message must be there by then
+ */
+static bool receive_message(Socket &socket, MessageType &type, std::vector<std::byte> &payload,
+                            const std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt) {
+    const auto receive_all = [&](std::span<std::byte> data) {
+        return deadline ? socket.receive_all(data, *deadline) : socket.receive_all(data);
+    };
+
+    std::byte header[MESSAGE_HEADER_SIZE];
+    if (!receive_all(header))
+        return false;
+
+    MessageReader header_reader{ std::span{ header }.subspan(1) };
+    const size_t payload_size = header_reader.read_u32();
+    if (payload_size > MAX_MESSAGE_PAYLOAD_SIZE)
+        return false;
+
+    type = static_cast<MessageType>(header[0]);
+    payload.resize(payload_size);
+    return receive_all(payload);
+}
+
+static bool send_bucket_message(Socket &socket, const MessageType type, const Bucket &bucket) {
+    MessageWriter writer{ type };
+    writer.append_int(bucket.x);
+    writer.append_int(bucket.y);
+    writer.append_int(bucket.width);
+    writer.append_int(bucket.height);
+    return socket.send_all(writer.finish());
+}
+
+static Bucket read_bucket(MessageReader &reader) {
+    Bucket bucket;
+    bucket.x = reader.read_int();
+    bucket.y = reader.read_int();
+    bucket.width = reader.read_int();
+    bucket.height = reader.read_int();
+    return bucket;
+}
+
+struct BucketProgress {
+    bool finished{ false };
+    /**
+     * Number of workers, which have the bucket in flight
+     */
+    int assigned_count{ 0 };
+    std::chrono::steady_clock::time_point assigned_at{};
+};
+
+struct CoordinatorState {
+    CoordinatorState(const int image_width, const int image_height, std::vector<Bucket> buckets)
+        : image_width(image_width)
+        , image_height(image_height)
+        , buckets(std::move(buckets))
+        , progress(this->buckets.size())
+    {
+        for (size_t i = 0; i < this->buckets.size(); ++i)
+            pending.push_back(i);
+    }
+
+    int image_width, image_height;
+    std::vector<Bucket> buckets;
+
+    std::mutex mutex;
+    /**
+     * Notified when a bucket is finished or handed back by a failed worker
+     */
+    std::condition_variable changed;
+    std::vector<BucketProgress> progress;
+    /**
+     * Indices of the buckets, which no worker has
+     */
+    std::deque<size_t> pending;
+    size_t finished_count{ 0 };
+
+    bool is_done() const noexcept {
+        return finished_count == buckets.size();
+    }
+};
+
+/**
+ * The next bucket for a worker. Once none are pending, a copy of the one, which has been in flight on a
+ * single worker the longest, is handed out with `allow_duplicate`, so that a slow worker doesn't hold up
+ * the end of the render.
+ *
+ * @warning The state must be locked.
+ */
+static std::optional<size_t> take_bucket(CoordinatorState &state, const bool allow_duplicate) {
+    std::optional<size_t> result;
+    if (!state.pending.empty()) {
+        result = state.pending.front();
+        state.pending.pop_front();
+    } else if (allow_duplicate) {
+        for (size_t i = 0; i < state.progress.size(); ++i) {
+            const BucketProgress &progress = state.progress[i];
+            if (!progress.finished && progress.assigned_count == 1 && (!result || progress.assigned_at < state.progress[*result].assigned_at))
+                result = i;
+        }
+        if (!result)
+            return std::nullopt;
+    } else {
+        return std::nullopt;
+    }
+
+    BucketProgress &progress = state.progress[*result];
+    if (progress.assigned_count++ == 0)
+        progress.assigned_at = std::chrono::steady_clock::now();
+    return result;
+}
+
+static void serve_worker(CoordinatorState &state, TileSink &sink, Socket socket, const std::string &name) {
+    if (trace::is_enabled())
+        trace::set_thread_name("worker " + name);
+
+    MessageType type;
+    std::vector<std::byte> payload;
+    if (!receive_message(socket, type, payload, std::chrono::steady_clock::now() + RECEIVE_TIMEOUT) || type != MessageType::Hello) {
+        std::cerr << "Worker " << name << ": no hello, disconnecting\n";
+        return;
+    }
+
+    MessageReader hello{ payload };
+    const uint32_t magic = hello.read_u32();
+    const uint32_t version = hello.read_u32();
+    const int image_width = hello.read_int();
+    const int image_height = hello.read_int();
+    const uint32_t thread_count = hello.read_u32();
+    if (!hello.ok() || magic != PROTOCOL_MAGIC || version != PROTOCOL_VERSION) {
+        std::cerr << "Worker " << name << ": unsupported protocol, disconnecting\n";
+        return;
+    }
+    if (image_width != state.image_width || image_height != state.image_height) {
+        std::cerr << "Worker " << name << ": renders a " << image_width << 'x' << image_height << " image instead of "
+                  << state.image_width << 'x' << state.image_height << ", disconnecting\n";
+        return;
+    }
+    const size_t capacity = BUCKETS_IN_FLIGHT_PER_THREAD * std::clamp(thread_count, 1u, 1024u);
+    std::cout << "Worker " << name << " connected (" << thread_count << " threads)\n";
+
+    // Indices of the buckets, which were sent to the worker and haven't come back yet
+    std::vector<size_t> in_flight;
+    size_t tile_count = 0;
+
+    const auto hand_back_buckets = [&](const char *reason) {
+        std::scoped_lock lock{ state.mutex };
+        size_t requeued_count = 0;
+        for (const size_t index : in_flight) {
+            BucketProgress &progress = state.progress[index];
+            if (--progress.assigned_count == 0 && !progress.finished) {
+                state.pending.push_front(index);
+                requeued_count++;
+            }
+        }
+        state.changed.notify_all();
+        std::cerr << "Worker " << name << ": " << reason << ", handed out its " << requeued_count << " unfinished buckets again\n";
+    };
+
+    std::vector<Color> pixels;
+    for (;;) {
+        std::vector<size_t> assigned;
+        {
+            std::unique_lock lock{ state.mutex };
+            for (;;) {
+                if (state.is_done())
+                    break;
+
+                while (in_flight.size() + assigned.size() < capacity) {
+                    const std::optional<size_t> index = take_bucket(state, in_flight.empty() && assigned.empty());
+                    if (!index)
+                        break;
+                    assigned.push_back(*index);
+                }
+                if (!in_flight.empty() || !assigned.empty())
+                    break;
+
+                state.changed.wait(lock);
+            }
+            if (state.is_done())
+                break;
+        }
+
+        in_flight.insert(in_flight.end(), assigned.begin(), assigned.end());
+        for (const size_t index : assigned) {
+            if (!send_bucket_message(socket, MessageType::Bucket, state.buckets[index])) {
+                hand_back_buckets("disconnected");
+                return;
+            }
+        }
+
+        // NOTE: Copies of the buckets in flight may be finished on other workers in the meantime. Then the tiles
+        // aren't needed, and the image may be done without them.
+        bool is_done = false;
+        while (!is_done && !socket.wait_readable(DONE_POLL_INTERVAL)) {
+            std::scoped_lock lock{ state.mutex };
+            is_done = state.is_done();
+        }
+        if (is_done)
+            break;
+
+        if (!receive_message(socket, type, payload, std::chrono::steady_clock::now() + RECEIVE_TIMEOUT) || type != MessageType::Tile) {
+            hand_back_buckets("disconnected or stalled");
+            return;
+        }
+
+        MessageReader reader{ payload };
+        const Bucket bucket = read_bucket(reader);
+        const auto in_flight_it = std::ranges::find_if(in_flight, [&](const size_t index) { return state.buckets[index] == bucket; });
+        if (!reader.ok() || in_flight_it == in_flight.end() || reader.remaining_size() != static_cast<size_t>(bucket.width) * bucket.height * 3 * 4) {
+            hand_back_buckets("sent an invalid tile");
+            return;
+        }
+        const size_t index = *in_flight_it;
+        in_flight.erase(in_flight_it);
+
+        pixels.resize(bucket.width * bucket.height);
+        for (Color &pixel : pixels) {
+            pixel.x = reader.read_float();
+            pixel.y = reader.read_float();
+            pixel.z = reader.read_float();
+        }
+
+        bool is_first = false;
+        {
+            std::scoped_lock lock{ state.mutex };
+            BucketProgress &progress = state.progress[index];
+            progress.assigned_count--;
+            if (!progress.finished) {
+                progress.finished = true;
+                state.finished_count++;
+                is_first = true;
+            }
+            state.changed.notify_all();
+        }
+        // NOTE: A copy of the bucket may have come back from another worker first
+        if (is_first) {
+            TraceScope trace_scope{ "write_tile", { "x", bucket.x }, { "y", bucket.y } };
+            sink.write_tile(Tile { bucket.x, bucket.y, bucket.width, bucket.height, pixels });
+            tile_count++;
+        }
+    }
+
+    MessageWriter done{ MessageType::Done };
+    socket.send_all(done.finish());
+    std::cout << "Worker " << name << " rendered " << tile_count << " buckets\n";
+}
+
+bool run_coordinator(const uint16_t port, const int image_width, const int image_height, const int bucket_size, TileSink &sink) {
+    std::optional<Socket> listener = Socket::listen(port);
+    if (!listener) {
+        std::cerr << "Error: Could not listen on port " << port << '\n';
+        return false;
+    }
+
+    CoordinatorState state{ image_width, image_height, get_buckets(image_width, image_height, bucket_size) };
+
+    std::cout << "Waiting for workers on port " << port << " (" << state.buckets.size() << " buckets)\n";
+
+    TraceScope trace_scope{ "coordinate_render" };
+    std::vector<std::jthread> worker_threads;
+    for (;;) {
+        {
+            std::scoped_lock lock{ state.mutex };
+            if (state.is_done())
+                break;
+        }
+
+        std::string name;
+        std::optional<Socket> socket = listener->accept(ACCEPT_TIMEOUT, &name);
+        if (socket)
+            worker_threads.emplace_back(serve_worker, std::ref(state), std::ref(sink), std::move(*socket), std::move(name));
+    }
+
+    // Join the threads, so that the last tiles are written before returning
+    worker_threads.clear();
+    return true;
+}
+
+/**
+ * The buckets, which the coordinator has sent, in order
+ */
+class RemoteBucketSource : public BucketSource {
+public:
+    std::optional<Bucket> next_bucket() override {
+        std::unique_lock lock{ m_mutex };
+        m_changed.wait(lock, [this]() { return !m_buckets.empty() || m_finished; });
+        if (m_buckets.empty())
+            return std::nullopt;
+
+        const Bucket bucket = m_buckets.front();
+        m_buckets.pop_front();
+        return bucket;
+    }
+
+    void push(const Bucket &bucket) {
+        std::scoped_lock lock{ m_mutex };
+        m_buckets.push_back(bucket);
+        m_changed.notify_one();
+    }
+
+    /**
+     * No more buckets are coming. The ones, which haven't been started, are dropped, as the coordinator
+     * doesn't need them anymore.
+     */
+    void finish() {
+        std::scoped_lock lock{ m_mutex };
+        m_buckets.clear();
+        m_finished = true;
+        m_changed.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<Bucket> m_buckets;
+    bool m_finished{ false };
+};
+
+/**
+ * Sends the tiles back to the coordinator
+ */
+class RemoteTileSink : public TileSink {
+public:
+    explicit RemoteTileSink(Socket &socket)
+        : m_socket(socket)
+    {}
+
+    void write_tile(const Tile &tile) override {
+        MessageWriter writer{ MessageType::Tile };
+        writer.reserve(4 * 4 + tile.pixels.size() * 3 * 4);
+        writer.append_int(tile.x);
+        writer.append_int(tile.y);
+        writer.append_int(tile.width);
+        writer.append_int(tile.height);
+        for (const Color &pixel : tile.pixels) {
+            writer.append_float(pixel.x);
+            writer.append_float(pixel.y);
+            writer.append_float(pixel.z);
+        }
+
+        std::scoped_lock lock{ m_mutex };
+        // NOTE: Fails once the coordinator is done and has disconnected, which is fine
+        if (m_socket.send_all(writer.finish()))
+            m_tile_count++;
+    }
+
+    size_t tile_count() const {
+        std::scoped_lock lock{ m_mutex };
+        return m_tile_count;
+    }
+
+private:
+    Socket &m_socket;
+    mutable std::mutex m_mutex;
+    size_t m_tile_count{ 0 };
+};
+
+bool run_worker(const Scene &scene, const RendererSettings &settings, const std::string &host, const uint16_t port, RenderStats *stats) {
+    std::optional<Socket> socket;
+    for (int attempt = 0; attempt < CONNECT_ATTEMPT_COUNT && !socket; ++attempt) {
+        if (attempt > 0)
+            std::this_thread::sleep_for(CONNECT_RETRY_INTERVAL);
+        socket = Socket::connect(host, port);
+    }
+    if (!socket) {
+        std::cerr << "Error: Could not connect to the coordinator at " << host << ':' << port << '\n';
+        return false;
+    }
+
+    MessageWriter hello{ MessageType::Hello };
+    hello.append_u32(PROTOCOL_MAGIC);
+    hello.append_u32(PROTOCOL_VERSION);
+    hello.append_int(scene.camera.resolution_x());
+    hello.append_int(scene.camera.resolution_y());
+    hello.append_u32(std::max(1u, std::thread::hardware_concurrency()));
+    if (!socket->send_all(hello.finish())) {
+        std::cerr << "Error: Could not connect to the coordinator at " << host << ':' << port << '\n';
+        return false;
+    }
+
+    RemoteBucketSource buckets;
+    RemoteTileSink sink{ *socket };
+    bool is_done = false;
+
+    std::jthread receiver{ [&]() {
+        MessageType type;
+        std::vector<std::byte> payload;
+        while (receive_message(*socket, type, payload)) {
+            if (type == MessageType::Done) {
+                is_done = true;
+                break;
+            }
+
+            MessageReader reader{ payload };
+            const Bucket bucket = read_bucket(reader);
+            if (type != MessageType::Bucket || !reader.ok() || bucket.width <= 0 || bucket.height <= 0
+                || bucket.x < 0 || bucket.y < 0 || bucket.x + bucket.width > scene.camera.resolution_x() || bucket.y + bucket.height > scene.camera.resolution_y())
+                break;
+            buckets.push(bucket);
+        }
+        buckets.finish();
+    } };
+
+    render_buckets(scene, settings, buckets, sink, {}, stats);
+    receiver.join();
+
+    if (!is_done) {
+        std::cerr << "Error: Lost the connection to the coordinator\n";
+        return false;
+    }
+    std::cout << "Rendered " << sink.tile_count() << " buckets\n";
+    return true;
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "core/crt_renderer.h"
+#include "core/crt_scene.h"
+#include "core/crt_stats.h"
+#include "core/crt_tile.h"
+
+namespace crt::standalone {
+
+/**
+ * Render an image on worker processes (see run_worker()), which connect on `port`.
+ *
+ * The image is split into buckets, which are handed out to the workers as they finish the previous
+ * ones, so faster workers get more of them. Every worker has a few buckets queued up, so that it doesn't
+ * wait for the network between them. When a worker disconnects, its unfinished buckets are handed out
+ * again. Once all buckets are handed out, idle workers get a copy of the bucket, which has been waiting
+ * the longest on another worker, and the first tile, which comes back, is used.
+ *
+ * The tiles are written to `sink` as they arrive. Returns once all of them have.
+ */
+bool run_coordinator(uint16_t port, int image_width, int image_height, int bucket_size, TileSink &sink);
+
+/**
+ * Render the buckets, which the coordinator at `host` and `port` hands out, and send them back, until
+ * it says that the image is done.
+ *
+ * The scene must be the one of the coordinator. Only its resolution is checked.
+ */
+bool run_worker(const Scene &scene, const RendererSettings &settings, const std::string &host, uint16_t port, RenderStats *stats = nullptr);
+
+}
@@ -0,0 +1,34 @@
+#include "standalone_image_file.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "core/crt_image_exr.h"
+#include "core/crt_image_pfm.h"
+#include "core/crt_image_ppm.h"
+
+namespace crt::standalone {
+
+std::optional<RowEncoder> get_row_encoder(const std::filesystem::path &output_file_path, int width, int height) {
+    const auto extension = output_file_path.extension();
+    if (extension == ".ppm")
+        return make_ppm_encoder(width, height);
+    if (extension == ".pfm")
+        return make_pfm_encoder(width, height);
+    if (extension == ".exr")
+        return make_exr_encoder(width, height);
+    return std::nullopt;
+}
+
+bool write_image_file(const Image &image, const std::filesystem::path &output_file_path) {
+    std::optional<RowEncoder> encoder = get_row_encoder(output_file_path, image.width, image.height);
+    std::ofstream output_file{ output_file_path, std::ios::out | std::ios::binary };
+    if (!encoder || !output_file.is_open()) {
+        std::cerr << "Error: Could not write output file: " << output_file_path << '\n';
+        return false;
+    }
+    write_image(image, *encoder, output_file);
+    return true;
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+
+#include "core/crt_image.h"
+#include "core/crt_image_encoder.h"
+
+namespace crt::standalone {
+
+/**
+ * The encoder for the format of the output file, picked by its extension (.ppm, .pfm or .exr)
+ */
+std::optional<RowEncoder> get_row_encoder(const std::filesystem::path &output_file_path, int width, int height);
+
+bool write_image_file(const Image &image, const std::filesystem::path &output_file_path);
+
+}
@@ -0,0 +1,193 @@
+#include "standalone_socket.h"
+
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace crt::standalone {
+
+#ifdef _WIN32
+static bool initialize_sockets() {
+    static const bool initialized = []() {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return initialized;
+}
+
+static void close_handle(const Socket::Handle handle) {
+    closesocket(handle);
+}
+
+static int poll_handle(pollfd *fd, const int timeout_ms) {
+    return WSAPoll(fd, 1, timeout_ms);
+}
+#else
+static bool initialize_sockets() {
+    return true;
+}
+
+static void close_handle(const Socket::Handle handle) {
+    ::close(handle);
+}
+
+static int poll_handle(pollfd *fd, const int timeout_ms) {
+    return ::poll(fd, 1, timeout_ms);
+}
+#endif
+
+#ifdef MSG_NOSIGNAL
+// NOTE: Otherwise writing to a connection, which the other side has closed, kills the process with SIGPIPE
+static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static constexpr int SEND_FLAGS = 0;
+#endif
+
+static void set_no_delay(const Socket::Handle handle) {
+    // The messages are small and answered one by one, so they shouldn't wait to be coalesced
+    const int enable = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&enable), sizeof(enable));
+}
+
+Socket::~Socket() {
+    close();
+}
+
+Socket::Socket(Socket &&other) noexcept
+    : m_handle(std::exchange(other.m_handle, INVALID_HANDLE))
+{}
+
+Socket &Socket::operator=(Socket &&other) noexcept {
+    if (this != &other) {
+        close();
+        m_handle = std::exchange(other.m_handle, INVALID_HANDLE);
+    }
+    return *this;
+}
+
+void Socket::close() {
+    if (m_handle != INVALID_HANDLE)
+        close_handle(std::exchange(m_handle, INVALID_HANDLE));
+}
+
+std::optional<Socket> Socket::connect(const std::string &host, const uint16_t port) {
+    if (!initialize_sockets())
+        return std::nullopt;
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+        return std::nullopt;
+
+    std::optional<Socket> result;
+    for (const addrinfo *address = addresses; address && !result; address = address->ai_next) {
+        Socket socket{ ::socket(address->ai_family, address->ai_socktype, address->ai_protocol) };
+        if (socket.is_open() && ::connect(socket.m_handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0) {
+            set_no_delay(socket.m_handle);
+            result = std::move(socket);
+        }
+    }
+    freeaddrinfo(addresses);
+    return result;
+}
+
+std::optional<Socket> Socket::listen(const uint16_t port) {
+    if (!initialize_sockets())
+        return std::nullopt;
+
+    Socket socket{ ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) };
+    if (!socket.is_open())
+        return std::nullopt;
+
+    // NOTE: So that a coordinator can be restarted right away on the same port
+    const int enable = 1;
+    setsockopt(socket.m_handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&enable), sizeof(enable));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (::bind(socket.m_handle, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        return std::nullopt;
+    if (::listen(socket.m_handle, SOMAXCONN) != 0)
+        return std::nullopt;
+
+    return socket;
+}
+
+bool Socket::wait_readable(const std::chrono::milliseconds timeout) {
+    pollfd fd{};
+    fd.fd = m_handle;
+    fd.events = POLLIN;
+    // NOTE: Errors count as readable, so that the following receive reports them
+    return poll_handle(&fd, static_cast<int>(timeout.count())) != 0;
+}
+
+std::optional<Socket> Socket::accept(const std::chrono::milliseconds timeout, std::string *peer_name) {
+    if (!wait_readable(timeout))
+        return std::nullopt;
+
+    sockaddr_storage address{};
+    socklen_t address_length = sizeof(address);
+    Socket socket{ ::accept(m_handle, reinterpret_cast<sockaddr *>(&address), &address_length) };
+    if (!socket.is_open())
+        return std::nullopt;
+    set_no_delay(socket.m_handle);
+
+    if (peer_name) {
+        char host[NI_MAXHOST], service[NI_MAXSERV];
+        if (getnameinfo(reinterpret_cast<const sockaddr *>(&address), address_length, host, sizeof(host), service, sizeof(service), NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+            *peer_name = std::string{ host } + ':' + service;
+    }
+    return socket;
+}
+
+bool Socket::send_all(std::span<const std::byte> data) {
+    while (!data.empty()) {
+        const auto sent = ::send(m_handle, reinterpret_cast<const char *>(data.data()), static_cast<int>(data.size()), SEND_FLAGS);
+        if (sent <= 0)
+            return false;
+        data = data.subspan(sent);
+    }
+    return true;
+}
+
+bool Socket::receive_all(std::span<std::byte> data) {
+    while (!data.empty()) {
+        const auto received = ::recv(m_handle, reinterpret_cast<char *>(data.data()), static_cast<int>(data.size()), 0);
+        if (received <= 0)
+            return false;
+        data = data.subspan(received);
+    }
+    return true;
+}
+
+bool Socket::receive_all(std::span<std::byte> data, const std::chrono::steady_clock::time_point deadline) {
+    while (!data.empty()) {
+        const auto timeout = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (timeout <= std::chrono::milliseconds::zero() || !wait_readable(timeout))
+            return false;
+
+        const auto received = ::recv(m_handle, reinterpret_cast<char *>(data.data()), static_cast<int>(data.size()), 0);
+        if (received <= 0)
+            return false;
+        data = data.subspan(received);
+    }
+    return true;
+}
+
+}
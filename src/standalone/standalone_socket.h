@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+namespace crt::standalone {
+
+/**
+ * A blocking TCP socket.
+ */
+class Socket {
+public:
+#ifdef _WIN32
+    using Handle = SOCKET;
+    static constexpr Handle INVALID_HANDLE = INVALID_SOCKET;
+#else
+    using Handle = int;
+    static constexpr Handle INVALID_HANDLE = -1;
+#endif
+
+    Socket() = default;
+    explicit Socket(Handle handle)
+        : m_handle(handle)
+    {}
+    ~Socket();
+
+    Socket(Socket &&other) noexcept;
+    Socket &operator=(Socket &&other) noexcept;
+
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+
+    /**
+     * Connect to `host` (a name or an address) on `port`.
+     */
+    static std::optional<Socket> connect(const std::string &host, uint16_t port);
+
+    /**
+     * Listen for connections on `port` of all interfaces.
+     */
+    static std::optional<Socket> listen(uint16_t port);
+
+    /**
+     * Wait for a connection on a listening socket for at most `timeout`.
+     */
+    std::optional<Socket> accept(std::chrono::milliseconds timeout, std::string *peer_name = nullptr);
+
+    /**
+     * Wait for at most `timeout` until there's something to receive (or the connection is closed).
+     */
+    bool wait_readable(std::chrono::milliseconds timeout);
+
+    /**
+     * Send all of `data`, or fail when the connection is broken.
+     */
+    bool send_all(std::span<const std::byte> data);
+
+    /**
+     * Fill all of `data`, or fail when the connection is closed or broken before that.
+     */
+    bool receive_all(std::span<std::byte> data);
+
+    /**
+     * Like receive_all(), but also fail when `data` isn't filled by `deadline`.
+     */
+    bool receive_all(std::span<std::byte> data, std::chrono::steady_clock::time_point deadline);
+
+    bool is_open() const noexcept {
+        return m_handle != INVALID_HANDLE;
+    }
+
+    void close();
+
+private:
+    Handle m_handle{ INVALID_HANDLE };
+};
+
+}